@@ -0,0 +1,318 @@
+// AsyncLogger.cpp
+// encoding: utf-8
+//
+// Buffered logging from time-critical threads to a file.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 20:53:56
+// Modified: 2026-10-17 10:14:37
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#include "AsyncLogger.h"
+
+#include <chrono>
+#include <string.h>
+
+
+// ===== Method Implementation for class LogBuffer =============================
+
+LogBuffer::LogBuffer(AsyncLogger* logger):
+    logger(logger), token(new char(0))
+{
+  // No put area: every character goes to overflow() or xsputn()
+}
+
+
+LogBuffer::~LogBuffer()
+{
+  // The lines of this thread go now; those of other threads when the thread
+  // next writes to a log, or exits
+  token.reset();
+  std::vector<Line>& lines = threadLines();
+  for(size_t k = lines.size(); k-- > 0;) {
+    if(lines[k].owner.expired()) {
+      lines.erase(lines.begin() + k);
+    }
+  }
+}
+
+
+std::vector<LogBuffer::Line>& LogBuffer::threadLines()
+{
+  thread_local std::vector<Line> lines;
+  return lines;
+}
+
+
+/*
+ * The calling thread's partial line for this buffer. Drops the lines of
+ * buffers that no longer exist on the way.
+ */
+LogBuffer::Line& LogBuffer::line()
+{
+  std::vector<Line>& lines = threadLines();
+  for(size_t k = lines.size(); k-- > 0;) {
+    const std::weak_ptr<char>& owner = lines[k].owner;
+    if(!owner.owner_before(token) && !token.owner_before(owner)) {
+      return lines[k];
+    }
+    if(owner.expired()) {
+      lines.erase(lines.begin() + k);
+    }
+  }
+  lines.push_back(Line());
+  Line& l = lines.back();
+  l.owner = token;
+  l.stream.reset(new std::ostream(this));
+  l.text.reserve(LOG_RECORD_TEXT);
+  l.level = LOG_INFO;
+  return l;
+}
+
+
+std::ostream& LogBuffer::stream()
+{
+  return *line().stream;
+}
+
+
+int LogBuffer::overflow(int c)
+{
+  if(c == traits_type::eof()) {
+    return 0;
+  }
+  Line& l = line();
+  l.text += (char) c;
+  if(c == '\n') {
+    logger->submit(l.level, l.text.data(), l.text.size());
+    l.text.clear();
+    l.level = LOG_INFO;
+  }
+  return c;
+}
+
+
+std::streamsize LogBuffer::xsputn(const char* s, std::streamsize n)
+{
+  Line& l = line();
+  const char* end = s + n;
+  const char* start = s;
+  for(const char* p = s; p < end; p++) {
+    if(*p == '\n') {
+      l.text.append(start, p + 1 - start);
+      logger->submit(l.level, l.text.data(), l.text.size());
+      l.text.clear();
+      l.level = LOG_INFO;
+      start = p + 1;
+    }
+  }
+  l.text.append(start, end - start);
+  return n;
+}
+
+
+int LogBuffer::sync()
+{
+  // A flush (std::endl) must not wait for the disk; unfinished lines stay
+  // with their thread until the newline arrives
+  return 0;
+}
+
+
+void LogBuffer::setLineLevel(LogLevel level)
+{
+  line().level = level;
+}
+
+
+std::ostream& operator<<(std::ostream& os, LogLevel level)
+{
+  LogBuffer* buf = dynamic_cast<LogBuffer*>(os.rdbuf());
+  if(buf != NULL) {
+    buf->setLineLevel(level);
+  }
+  return os;
+}
+
+
+// ===== Method Implementation for class AsyncLogger ===========================
+
+AsyncLogger::AsyncLogger(const char* fileName):
+    buffer(this), ring(LOG_CAPACITY), mask(LOG_CAPACITY - 1),
+    enqueuePos(0), dequeuePos(0), writtenPos(0), level(LOG_INFO), dropped(0),
+    droppedReported(0), file(fileName), running(true)
+{
+  for(size_t k = 0; k < ring.size(); k++) {
+    ring[k].sequence.store(k, std::memory_order_relaxed);
+  }
+  writer = std::thread(&AsyncLogger::writerLoop, this);
+}
+
+
+AsyncLogger::~AsyncLogger()
+{
+  running = false;
+  writer.join();
+}
+
+
+/*
+ * Claim consecutive records for all of `text` and copy it in, so a line is
+ * never split by another thread's. Returns false if the ring buffer has no
+ * room for the whole line.
+ */
+bool AsyncLogger::push(const char* text, size_t len)
+{
+  size_t count = (len + LOG_RECORD_TEXT - 1) / LOG_RECORD_TEXT;
+  if(count > LOG_CAPACITY) {
+    return false;
+  }
+  // Records are freed in order, so if the last one is free, all are
+  size_t pos = enqueuePos.load(std::memory_order_relaxed);
+  while(true) {
+    size_t last = pos + count - 1;
+    size_t seq = ring[last & mask].sequence.load(std::memory_order_acquire);
+    if(seq == last) {
+      if(enqueuePos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if(seq < last) {
+      return false;
+    } else {
+      pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+  for(size_t k = 0; k < count; k++) {
+    Record& r = ring[(pos + k) & mask];
+    size_t n = (len < LOG_RECORD_TEXT) ? len : LOG_RECORD_TEXT;
+    memcpy(r.text, text, n);
+    r.length = (unsigned short) n;
+    r.sequence.store(pos + k + 1, std::memory_order_release);
+    text += n;
+    len -= n;
+  }
+  // Wake the writer early when the ring buffer is filling up
+  if(((pos + count) & (LOG_CAPACITY/2 - 1)) < count) {
+    wake.notify_one();
+  }
+  return true;
+}
+
+
+void AsyncLogger::submit(LogLevel lineLevel, const char* text, size_t len)
+{
+  if(lineLevel < level.load(std::memory_order_relaxed)) {
+    return;
+  }
+  if(!push(text, len)) {
+    dropped++;
+  }
+}
+
+
+/*
+ * Write all ready records to the file in one call. Returns true if there
+ * were any.
+ */
+bool AsyncLogger::writePending()
+{
+  std::string batch;
+  size_t start = dequeuePos;
+  while(true) {
+    Record& r = ring[dequeuePos & mask];
+    if(r.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+      break;
+    }
+    batch.append(r.text, r.length);
+    r.sequence.store(dequeuePos + LOG_CAPACITY, std::memory_order_release);
+    dequeuePos++;
+  }
+  long d = dropped.load();
+  if(d != droppedReported) {
+    batch += "LOGGER: " + std::to_string(d - droppedReported)
+        + " lines dropped (log buffer full)\n";
+    droppedReported = d;
+  }
+  if(!batch.empty()) {
+    std::lock_guard<std::mutex> lock(fileMutex);
+    if(file.is_open()) {
+      file.write(batch.data(), batch.size());
+      file.flush();
+    }
+  }
+  writtenPos.store(dequeuePos, std::memory_order_release);
+  return dequeuePos != start;
+}
+
+
+void AsyncLogger::writerLoop()
+{
+  while(running) {
+    if(!writePending()) {
+      std::unique_lock<std::mutex> lock(wakeMutex);
+      wake.wait_for(lock, std::chrono::milliseconds(LOG_POLL_MS));
+    }
+  }
+  writePending();
+}
+
+
+void AsyncLogger::setLevel(LogLevel minLevel)
+{
+  level = minLevel;
+}
+
+
+void AsyncLogger::drain()
+{
+  size_t target = enqueuePos.load();
+  while(writtenPos.load(std::memory_order_acquire) < target) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+
+void AsyncLogger::open(const char* fileName, bool append)
+{
+  drain();
+  std::lock_guard<std::mutex> lock(fileMutex);
+  file.close();
+  file.clear();
+  file.open(fileName, append ? std::ios::app : std::ios::out);
+}
+
+
+void AsyncLogger::close()
+{
+  drain();
+  std::lock_guard<std::mutex> lock(fileMutex);
+  file.close();
+}
+
+
+long AsyncLogger::getDropped()
+{
+  return dropped;
+}
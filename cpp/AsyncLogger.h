@@ -0,0 +1,239 @@
+// AsyncLogger.h
+// encoding: utf-8
+//
+// Buffered logging from time-critical threads to a file.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 20:53:56
+// Modified: 2026-10-17 10:14:37
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#ifndef ASYNCLOGGER_H
+#define ASYNCLOGGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Number of records in the ring buffer, a power of two. With
+// LOG_RECORD_TEXT characters each, this bounds the memory of a logger.
+#define LOG_CAPACITY 1024
+#define LOG_RECORD_TEXT 244
+
+// Interval at which the writer thread looks for new records
+#define LOG_POLL_MS 20
+
+
+/*
+ * Importance of a log line. Insert it in a line to set the line's level, e.g.
+ *     logger << LOG_DEBUG << "polling" << std::endl;
+ * Lines without a level are LOG_INFO.
+ */
+enum LogLevel {
+  LOG_DEBUG,
+  LOG_INFO,
+  LOG_WARNING,
+  LOG_ERROR
+};
+
+
+class AsyncLogger;
+
+
+/*
+ * class LogBuffer
+ *
+ * Stream buffer of an AsyncLogger. Characters are collected in a separate
+ * line for each thread, and each completed line is handed to the logger, so
+ * lines written from several threads never interleave. Each thread also has
+ * its own std::ostream on the buffer, so that its formatting state is never
+ * shared.
+ *
+ * The lines of a thread are kept in a table of that thread. Each names its
+ * buffer by a weak reference to `token`, which expires with the buffer, so a
+ * buffer created later at the same address never takes over a line.
+ */
+class LogBuffer: public std::streambuf {
+  AsyncLogger* logger;
+  std::shared_ptr<char> token;
+
+  struct Line {
+    std::weak_ptr<char> owner;
+    std::unique_ptr<std::ostream> stream;
+    std::string text;
+    LogLevel level;
+  };
+
+  static std::vector<Line>& threadLines();
+  Line& line();
+
+protected:
+  int overflow(int c) override;
+  std::streamsize xsputn(const char* s, std::streamsize n) override;
+  int sync() override;
+
+public:
+  LogBuffer(AsyncLogger* logger);
+
+  ~LogBuffer();
+
+  /*
+   * The calling thread's stream to this buffer.
+   */
+  std::ostream& stream();
+
+  void setLineLevel(LogLevel level);
+};
+
+
+/*
+ * class AsyncLogger
+ *
+ * A log file whose writes never wait for the disk. Lines go into a bounded,
+ * lock-free ring buffer that any number of threads may fill, and a
+ * background thread writes them to the file in batches. std::endl therefore
+ * costs no system call.
+ *
+ * Write to it as to an output stream: `logger << x` writes to line(), the
+ * calling thread's own stream. Formatting set on that stream (precision,
+ * width, flags) lasts for the thread's later lines to this logger and never
+ * affects another thread's.
+ *
+ * Lines below the logger's level are discarded. If the ring buffer is full,
+ * new lines are dropped rather than blocking the caller; the number dropped
+ * is written to the file once there is room again.
+ */
+class AsyncLogger {
+  struct Record {
+    std::atomic<size_t> sequence;
+    unsigned short length;
+    char text[LOG_RECORD_TEXT];
+  };
+
+  LogBuffer buffer;
+
+  // Bounded multi-producer queue (D. Vyukov): a record is free for position p
+  // when its sequence is p, and ready to write when it is p + 1
+  std::vector<Record> ring;
+  size_t mask;
+  std::atomic<size_t> enqueuePos;
+  size_t dequeuePos;
+  std::atomic<size_t> writtenPos;
+
+  std::atomic<int> level;
+  std::atomic<long> dropped;
+  long droppedReported;
+
+  std::ofstream file;
+  std::mutex fileMutex;
+  std::thread writer;
+  std::atomic<bool> running;
+  std::mutex wakeMutex;
+  std::condition_variable wake;
+
+  bool push(const char* text, size_t len);
+  void writerLoop();
+  bool writePending();
+
+public:
+  /*
+   * Open a log file named `fileName`, truncating it.
+   */
+  AsyncLogger(const char* fileName);
+
+  ~AsyncLogger();
+
+
+  /*
+   * The calling thread's output stream to this logger.
+   */
+  std::ostream& line() {
+    return buffer.stream();
+  }
+
+  template<typename T>
+  std::ostream& operator<<(const T& value) {
+    return line() << value;
+  }
+
+  std::ostream& operator<<(std::ostream& (*manip)(std::ostream&)) {
+    return line() << manip;
+  }
+
+
+  /*
+   * Add one complete line (including its newline) at the given level. Lines
+   * longer than a record take several consecutive records.
+   */
+  void submit(LogLevel lineLevel, const char* text, size_t len);
+
+
+  /*
+   * Discard lines below `minLevel` from now on.
+   */
+  void setLevel(LogLevel minLevel);
+
+
+  /*
+   * Wait until every line submitted so far is in the file.
+   */
+  void drain();
+
+
+  /*
+   * Write the remaining lines, then continue in the file `fileName`,
+   * replacing it or, if `append` is true, adding to its end.
+   */
+  void open(const char* fileName, bool append = false);
+
+
+  /*
+   * Write the remaining lines and close the file. Later lines are discarded
+   * until open() is called.
+   */
+  void close();
+
+
+  /*
+   * Returns the number of lines dropped because the ring buffer was full.
+   */
+  long getDropped();
+
+};
+
+
+/*
+ * Set the level of the current line of an AsyncLogger's stream. Has no
+ * effect on other streams.
+ */
+std::ostream& operator<<(std::ostream& os, LogLevel level);
+
+#endif
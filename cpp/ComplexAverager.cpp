@@ -0,0 +1,90 @@
+// ComplexAverager.cpp
+// encoding: utf-8
+//
+// Running average of complex lock-in samples.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 22:02:41
+// Modified: 2026-10-16 22:02:41
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#include "ComplexAverager.h"
+
+#include <cmath>
+#include <limits>
+
+
+// ===== Method Implementation for class ComplexAverager =======================
+
+ComplexAverager::ComplexAverager()
+{
+  start(false);
+}
+
+
+void ComplexAverager::start(bool rejectOutliers)
+{
+  this->rejectOutliers = rejectOutliers;
+  n = 0;
+  rejected = 0;
+  meanRe = 0;
+  meanIm = 0;
+  m2 = 0;
+}
+
+
+bool ComplexAverager::add(double re, double im)
+{
+  double dRe = re - meanRe;
+  double dIm = im - meanIm;
+  if(rejectOutliers && n >= AVG_OUTLIER_MIN_PTS && m2 > 0) {
+    double variance = m2 / (n - 1);
+    if(dRe*dRe + dIm*dIm > AVG_OUTLIER_SIGMAS * AVG_OUTLIER_SIGMAS * variance) {
+      rejected++;
+      return false;
+    }
+  }
+  n++;
+  meanRe += dRe / n;
+  meanIm += dIm / n;
+  m2 += dRe * (re - meanRe) + dIm * (im - meanIm);
+  return true;
+}
+
+
+double ComplexAverager::stdDev() const
+{
+  return (n > 0) ? sqrt(m2 / n) : 0;
+}
+
+
+double ComplexAverager::stdError() const
+{
+  if(n < 2) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return sqrt(m2 / (n - 1) / n);
+}
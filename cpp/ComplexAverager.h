@@ -0,0 +1,110 @@
+// ComplexAverager.h
+// encoding: utf-8
+//
+// Running average of complex lock-in samples.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 22:02:41
+// Modified: 2026-10-16 22:02:41
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#ifndef COMPLEXAVERAGER_H
+#define COMPLEXAVERAGER_H
+
+// With outlier rejection, samples further than this many standard
+// deviations from the running mean are dropped ...
+#define AVG_OUTLIER_SIGMAS 4
+
+// ... once this many samples have been kept
+#define AVG_OUTLIER_MIN_PTS 5
+
+
+/*
+ * class ComplexAverager
+ *
+ * Mean and spread of the complex samples (X, Y) of one point, updated with
+ * every sample (Welford's method), so that no sample is stored and the
+ * caller can stop as soon as the mean is known well enough.
+ *
+ * The spread is that of the complex value: the variance is the mean of
+ * |z - mean|^2.
+ */
+class ComplexAverager {
+  long n;
+  long rejected;
+  bool rejectOutliers;
+  double meanRe;
+  double meanIm;
+  double m2;
+
+public:
+  ComplexAverager();
+
+
+  /*
+   * Start a new point; with `rejectOutliers`, drop samples that are far
+   * from the others (see AVG_OUTLIER_SIGMAS).
+   */
+  void start(bool rejectOutliers);
+
+
+  /*
+   * Add the sample (re, im). Returns false if it was rejected as an
+   * outlier.
+   */
+  bool add(double re, double im);
+
+
+  /*
+   * Standard deviation of the samples kept (as the variance over n, not
+   * n - 1).
+   */
+  double stdDev() const;
+
+
+  /*
+   * Estimated standard error of the mean; infinite with fewer than two
+   * samples.
+   */
+  double stdError() const;
+
+
+  long count() const {
+    return n;
+  }
+  long numRejected() const {
+    return rejected;
+  }
+  double re() const {
+    return meanRe;
+  }
+  double im() const {
+    return meanIm;
+  }
+
+};
+
+#endif
@@ -0,0 +1,779 @@
+// EmulatedSR830.cpp
+// encoding: utf-8
+//
+// Software model of an SR830 lock-in amplifier, for use without hardware.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 09:12:40
+// Modified: 2026-10-17 04:20:55
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#include "EmulatedSR830.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+// Equivalent noise bandwidth of the output filter, in units of 1/tau, for
+// slopes of 6, 12, 18 and 24 dB/oct
+static const double ENBW_FACTOR[] = {1.0/4, 1.0/8, 3.0/32, 5.0/64};
+
+
+/*
+ * Full-scale value (V) of the sensitivity given by index i. Same mapping as
+ * getSensValue() in FreqVoltageXYSweep.cpp.
+ */
+static double sensValue(int i)
+{
+  int m = i % 3;
+  return (m*m + 2*m + 2) * pow(10.0, i/3 - 9.0);
+}
+
+
+/*
+ * Time constant (s) given by index i. Same mapping as getTimeConstValue() in
+ * FreqVoltageXYSweep.cpp.
+ */
+static double timeConstValue(int i)
+{
+  return (2*(i%2) + 1) * pow(10.0, i/2 - 5.0);
+}
+
+
+/*
+ * Data storage sample rate (Hz) given by index i < 14; index 14 means
+ * "trigger".
+ */
+static double sampleRateValue(int i)
+{
+  return 0.0625 * (1 << i);
+}
+
+
+EmulatedSR830::EmulatedSR830(int pad): pad(pad), rng(pad)
+{
+  reset();
+}
+
+
+int EmulatedSR830::getAddress()
+{
+  return pad;
+}
+
+
+/*
+ * Restore the power-on defaults listed in the SR830 manual and settle the
+ * output filter onto the resulting signal.
+ */
+void EmulatedSR830::reset()
+{
+  phase = 0;
+  frequency = 1000;
+  amplitude = 1.0;
+  refSource = 1;
+  refTrigger = 0;
+  harmonic = 1;
+  inputConfig = 0;
+  shieldGround = 0;
+  coupling = 0;
+  lineFilter = 0;
+  sensitivity = 26;
+  reserve = 1;
+  timeConstant = 8;
+  filterSlope = 1;
+  syncFilter = 0;
+  for(int ch = 0; ch < 2; ch++) {
+    display[ch][0] = display[ch][1] = 0;
+    frontPanel[ch] = 1;
+  }
+  for(int i = 0; i < 3; i++) {
+    offset[i] = 0;
+    expand[i] = 0;
+  }
+  for(int i = 0; i < 4; i++) {
+    auxOut[i] = 0;
+  }
+  sampleRate = 4;
+  bufferMode = 1;
+  triggerStart = 0;
+  fastMode = 0;
+
+  esr = 0;
+  liaStatus = 0;
+  errStatus = 0;
+
+  stored[0].clear();
+  stored[1].clear();
+  storing = false;
+  fastQueue.clear();
+  fastOverflows = 0;
+
+  std::complex<double> u = target();
+  for(int k = 0; k < SR830_MAX_POLES; k++) {
+    stages[k] = u;
+  }
+  lastUpdate = Clock::now();
+  outputQueue.clear();
+  outputQueue.reserve(SR830_OUTPUT_QUEUE);
+}
+
+
+/*
+ * The signal at the detection harmonic that the output filter is settling
+ * towards, for the current instrument settings.
+ */
+std::complex<double> EmulatedSR830::target()
+{
+  double r = frequency / sample.resonance;
+  std::complex<double> h = sample.gain
+      / std::complex<double>(1 - r*r, r / sample.quality);
+  h *= pow(sample.harmonicGain, harmonic - 1);
+
+  double w = sample.spotWidth;
+  h *= exp(-(auxOut[0]*auxOut[0] + auxOut[1]*auxOut[1]) / (2*w*w));
+
+  return amplitude * h * std::polar(1.0, -phase * M_PI / 180);
+}
+
+
+/*
+ * Advance the cascade of identical single-pole filters from lastUpdate to t.
+ *
+ * The input is constant between commands, so the deviation e_k = s_k - u of
+ * each pole evolves exactly as
+ *   e_k(t) = exp(-t/tau) * sum_{j<=k} e_j(0) (t/tau)^(k-j) / (k-j)!
+ */
+void EmulatedSR830::advanceFilter(Clock::time_point t)
+{
+  if(t <= lastUpdate) {
+    return;
+  }
+  double x = std::chrono::duration<double>(t - lastUpdate).count()
+      / timeConstValue(timeConstant);
+  lastUpdate = t;
+
+  std::complex<double> u = target();
+  if(x > 60) {
+    for(int k = 0; k < SR830_MAX_POLES; k++) {
+      stages[k] = u;
+    }
+    return;
+  }
+
+  std::complex<double> e0[SR830_MAX_POLES];
+  for(int k = 0; k < SR830_MAX_POLES; k++) {
+    e0[k] = stages[k] - u;
+  }
+  double decay = exp(-x);
+  for(int k = 0; k < SR830_MAX_POLES; k++) {
+    std::complex<double> e = 0;
+    double term = 1;
+    for(int j = k; j >= 0; j--) {
+      e += e0[j] * term;
+      term *= x / (k - j + 1);
+    }
+    stages[k] = u + decay * e;
+  }
+}
+
+
+/*
+ * RMS noise on each of X and Y for the current time constant and slope.
+ */
+double EmulatedSR830::noiseLevel()
+{
+  return sample.noiseDensity
+      * sqrt(ENBW_FACTOR[filterSlope] / timeConstValue(timeConstant));
+}
+
+
+/*
+ * The (X, Y) output at time t, including noise and clipping at full scale.
+ */
+std::complex<double> EmulatedSR830::output(Clock::time_point t)
+{
+  advanceFilter(t);
+  std::normal_distribution<double> noise(0.0, noiseLevel());
+  double x = stages[filterSlope].real() + noise(rng);
+  double y = stages[filterSlope].imag() + noise(rng);
+
+  double fullScale = sensValue(sensitivity);
+  if(fabs(x) > fullScale || fabs(y) > fullScale || hypot(x, y) > fullScale) {
+    liaStatus |= 4;
+    double limit = 1.09 * fullScale;
+    x = fmax(-limit, fmin(limit, x));
+    y = fmax(-limit, fmin(limit, y));
+  }
+  return std::complex<double>(x, y);
+}
+
+
+/*
+ * Append the CH1 and CH2 display values at time t to the data buffer. A full
+ * buffer stops storing in one-shot mode and drops its oldest point in loop
+ * mode.
+ */
+void EmulatedSR830::storeSample(Clock::time_point t)
+{
+  if(stored[0].size() >= SR830_BUFFER_POINTS) {
+    if(bufferMode == 0) {
+      storing = false;
+      return;
+    }
+    stored[0].erase(stored[0].begin());
+    stored[1].erase(stored[1].begin());
+  }
+  std::complex<double> xy = output(t);
+  stored[0].push_back((float) displayValue(0, xy));
+  stored[1].push_back((float) displayValue(1, xy));
+
+  if(fastMode != 0) {
+    // Both channels as 16-bit integers, +/-30000 = +/- full scale
+    if(fastQueue.size() >= 4 * SR830_FAST_FIFO) {
+      fastOverflows++;
+      return;
+    }
+    double fullScale = sensValue(sensitivity);
+    for(int ch = 0; ch < 2; ch++) {
+      long v = lround(30000 * stored[ch].back() / fullScale);
+      short word = (short) ((v > 32767) ? 32767 : ((v < -32768) ? -32768 : v));
+      fastQueue.append((const char*) &word, 2);
+    }
+  }
+}
+
+
+/*
+ * Take every sample that fell due between nextSample and now. Must run before
+ * anything else advances the filter past nextSample.
+ */
+void EmulatedSR830::storeSamples(Clock::time_point now)
+{
+  if(!storing || sampleRate == 14) {
+    return;
+  }
+  Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+    std::chrono::duration<double>(1 / sampleRateValue(sampleRate))
+  );
+  if(now - nextSample > period * SR830_BUFFER_POINTS) {
+    // Only the last buffer-full can survive; skip the rest
+    nextSample = now - period * SR830_BUFFER_POINTS;
+  }
+  while(storing && nextSample <= now) {
+    storeSample(nextSample);
+    nextSample += period;
+  }
+}
+
+
+/*
+ * Answer TRCA?, TRCB? or TRCL? for `count` points of `channel` (1 or 2)
+ * starting at bin `start`. The binary formats are sent without a terminator,
+ * and none of the replies is limited by the output queue.
+ */
+void EmulatedSR830::transferBuffer(
+  const std::string& mnemonic, int channel, int start, int count
+)
+{
+  const float* data = stored[channel - 1].data() + start;
+  char buf[32];
+  for(int k = 0; k < count; k++) {
+    if(mnemonic == "TRCA") {
+      snprintf(buf, 32, "%.6e,", data[k]);
+      outputQueue += buf;
+    } else if(mnemonic == "TRCB") {
+      outputQueue.append((const char*) &data[k], 4);
+    } else {
+      // Non-normalized float: value = mantissa * 2^(exponent - 124), with
+      // 16-bit little-endian mantissa and exponent
+      int e;
+      double f = frexp(data[k], &e);
+      long m = lround(ldexp(f, 15));
+      if(m == 32768 || m == -32768) {
+        m /= 2;
+        e++;
+      }
+      short word[2] = {(short) m, (short) ((m == 0) ? 0 : e - 15 + 124)};
+      outputQueue.append((const char*) word, 4);
+    }
+  }
+  if(mnemonic == "TRCA") {
+    outputQueue += '\n';
+  }
+}
+
+
+double EmulatedSR830::displayValue(int channel, std::complex<double> xy)
+{
+  switch(display[channel][0]) {
+    case 0: return (channel == 0) ? xy.real() : xy.imag();
+    case 1: return (channel == 0) ? std::abs(xy) : 180 * std::arg(xy) / M_PI;
+    case 2: return noiseLevel();
+    default: return 0;
+  }
+}
+
+
+/*
+ * Value of parameter `index` of the SNAP? command (see SR830 manual).
+ */
+double EmulatedSR830::snapValue(int index, std::complex<double> xy)
+{
+  switch(index) {
+    case 1: return xy.real();
+    case 2: return xy.imag();
+    case 3: return std::abs(xy);
+    case 4: return 180 * std::arg(xy) / M_PI;
+    case 9: return frequency;
+    case 10: return displayValue(0, xy);
+    case 11: return displayValue(1, xy);
+    default: return 0;  // Aux inputs 1-4 are left unconnected
+  }
+}
+
+
+void EmulatedSR830::respond(const char* response)
+{
+  // The queue keeps its capacity (see reset()), so replies do not allocate
+  size_t len = strlen(response);
+  if(outputQueue.size() + len + 1 > SR830_OUTPUT_QUEUE) {
+    esr |= 4;  // QRY: output queue overflow
+    return;
+  }
+  outputQueue.append(response, len);
+  outputQueue += '\n';
+}
+
+
+void EmulatedSR830::respond(double value)
+{
+  char buf[32];
+  snprintf(buf, 32, "%.10g", value);
+  respond(buf);
+}
+
+
+void EmulatedSR830::respond(int value)
+{
+  char buf[32];
+  snprintf(buf, 32, "%d", value);
+  respond(buf);
+}
+
+
+/*
+ * Parse up to maxVals comma-separated numbers. Returns false if any field is
+ * not a number.
+ */
+bool EmulatedSR830::parseArgs(
+  const std::string& args, double* vals, int maxVals, int& nVals
+)
+{
+  nVals = 0;
+  const char* s = args.c_str();
+  while(*s == ' ') s++;
+  if(*s == '\0') {
+    return true;
+  }
+  while(nVals < maxVals) {
+    char* end;
+    vals[nVals] = strtod(s, &end);
+    if(end == s) {
+      return false;
+    }
+    nVals++;
+    s = end;
+    while(*s == ' ') s++;
+    if(*s != ',') {
+      return *s == '\0';
+    }
+    s++;
+  }
+  return false;
+}
+
+
+/*
+ * Execute a single command (without the ';' separator). Invalid commands set
+ * the CMD bit of the standard event status register; out-of-range parameters
+ * set the EXE bit and leave the setting unchanged.
+ */
+void EmulatedSR830::execute(const std::string& command, int& queries)
+{
+  size_t pos = 0;
+  while(pos < command.size() && command[pos] == ' ') pos++;
+  std::string mnemonic;
+  while(pos < command.size()
+      && (isalpha((unsigned char) command[pos]) || command[pos] == '*')) {
+    mnemonic += (char) toupper((unsigned char) command[pos]);
+    pos++;
+  }
+  if(mnemonic.empty()) {
+    if(pos < command.size()) {
+      esr |= 32;
+    }
+    return;
+  }
+  bool query = (pos < command.size() && command[pos] == '?');
+  if(query) {
+    pos++;
+    queries++;
+  }
+
+  double args[8];
+  int nArgs;
+  if(!parseArgs(command.substr(pos), args, 8, nArgs)) {
+    esr |= 32;
+    return;
+  }
+
+  // Changes to the signal path take effect from now on
+  Clock::time_point now = Clock::now();
+  storeSamples(now);
+  advanceFilter(now);
+
+  // Settings holding a single integer
+  int* intField = NULL;
+  int lo = 0, hi = 0;
+  if(mnemonic == "FMOD") { intField = &refSource; hi = 1; }
+  else if(mnemonic == "RSLP") { intField = &refTrigger; hi = 2; }
+  else if(mnemonic == "HARM") { intField = &harmonic; lo = 1; hi = 19999; }
+  else if(mnemonic == "ISRC") { intField = &inputConfig; hi = 3; }
+  else if(mnemonic == "IGND") { intField = &shieldGround; hi = 1; }
+  else if(mnemonic == "ICPL") { intField = &coupling; hi = 1; }
+  else if(mnemonic == "ILIN") { intField = &lineFilter; hi = 3; }
+  else if(mnemonic == "SENS") { intField = &sensitivity; hi = 26; }
+  else if(mnemonic == "RMOD") { intField = &reserve; hi = 2; }
+  else if(mnemonic == "OFLT") { intField = &timeConstant; hi = 19; }
+  else if(mnemonic == "OFSL") { intField = &filterSlope; hi = 3; }
+  else if(mnemonic == "SYNC") { intField = &syncFilter; hi = 1; }
+  else if(mnemonic == "SRAT") { intField = &sampleRate; hi = 14; }
+  else if(mnemonic == "SEND") { intField = &bufferMode; hi = 1; }
+  else if(mnemonic == "TSTR") { intField = &triggerStart; hi = 1; }
+  else if(mnemonic == "FAST") { intField = &fastMode; hi = 2; }
+  if(intField != NULL) {
+    if(query) {
+      respond(*intField);
+    } else if(nArgs != 1 || args[0] < lo || args[0] > hi) {
+      esr |= 16;
+    } else {
+      if(intField == &timeConstant && (int) args[0] != timeConstant) {
+        liaStatus |= 32;
+      }
+      *intField = (int) args[0];
+    }
+    return;
+  }
+
+  // Settings holding a single real number
+  double* dblField = NULL;
+  double dlo = 0, dhi = 0;
+  if(mnemonic == "PHAS") { dblField = &phase; dlo = -360; dhi = 729.99; }
+  else if(mnemonic == "FREQ") { dblField = &frequency; dlo = 0.001; dhi = 102000; }
+  else if(mnemonic == "SLVL") { dblField = &amplitude; dlo = 0.004; dhi = 5.0; }
+  if(dblField != NULL) {
+    if(query) {
+      respond(*dblField);
+    } else if(nArgs != 1 || args[0] < dlo || args[0] > dhi) {
+      esr |= 16;
+    } else {
+      *dblField = args[0];
+      if(dblField == &phase) {
+        phase = fmod(phase + 180, 360);
+        phase = (phase < 0) ? phase + 180 : phase - 180;
+      }
+    }
+    return;
+  }
+
+  // Indexed settings and outputs
+  int i = (nArgs > 0) ? (int) args[0] : 0;
+  char buf[64];
+  if(mnemonic == "DDEF") {
+    if(i < 1 || i > 2) {
+      esr |= 16;
+    } else if(query) {
+      snprintf(buf, 64, "%d,%d", display[i-1][0], display[i-1][1]);
+      respond(buf);
+    } else if(nArgs != 3 || args[1] < 0 || args[1] > 4 || args[2] < 0 || args[2] > 2) {
+      esr |= 16;
+    } else {
+      display[i-1][0] = (int) args[1];
+      display[i-1][1] = (int) args[2];
+    }
+  }
+  else if(mnemonic == "FPOP") {
+    if(i < 1 || i > 2) {
+      esr |= 16;
+    } else if(query) {
+      respond(frontPanel[i-1]);
+    } else if(nArgs != 2 || args[1] < 0 || args[1] > 1) {
+      esr |= 16;
+    } else {
+      frontPanel[i-1] = (int) args[1];
+    }
+  }
+  else if(mnemonic == "OEXP") {
+    if(i < 1 || i > 3) {
+      esr |= 16;
+    } else if(query) {
+      snprintf(buf, 64, "%.2f,%d", offset[i-1], expand[i-1]);
+      respond(buf);
+    } else if(nArgs != 3 || fabs(args[1]) > 105 || args[2] < 0 || args[2] > 2) {
+      esr |= 16;
+    } else {
+      offset[i-1] = args[1];
+      expand[i-1] = (int) args[2];
+    }
+  }
+  else if(mnemonic == "AUXV") {
+    if(i < 1 || i > 4) {
+      esr |= 16;
+    } else if(query) {
+      respond(auxOut[i-1]);
+    } else if(nArgs != 2 || fabs(args[1]) > 10.5) {
+      esr |= 16;
+    } else {
+      auxOut[i-1] = args[1];
+    }
+  }
+  else if(mnemonic == "OAUX" && query) {
+    respond(0.0);
+  }
+  else if(mnemonic == "OUTP" && query) {
+    if(i < 1 || i > 4) {
+      esr |= 16;
+    } else {
+      snprintf(buf, 64, "%g", snapValue(i, output(now)));
+      respond(buf);
+    }
+  }
+  else if(mnemonic == "OUTR" && query) {
+    if(i < 1 || i > 2) {
+      esr |= 16;
+    } else {
+      snprintf(buf, 64, "%g", displayValue(i-1, output(now)));
+      respond(buf);
+    }
+  }
+  else if(mnemonic == "SNAP" && query) {
+    if(nArgs < 2 || nArgs > 6) {
+      esr |= 16;
+      return;
+    }
+    // All values of a snapshot are taken at the same instant
+    std::complex<double> xy = output(now);
+    char response[6 * 16];
+    int len = 0;
+    for(int k = 0; k < nArgs; k++) {
+      len += snprintf(response + len, sizeof(response) - len, (k == 0) ? "%g" : ",%g",
+          snapValue((int) args[k], xy));
+    }
+    respond(response);
+  }
+  else if(mnemonic == "STRT") {
+    if(!storing) {
+      storing = true;
+      nextSample = now;
+      storeSamples(now);
+    }
+  }
+  else if(mnemonic == "STRD") {
+    // Fast mode start: storage begins after a 0.5 s delay
+    if(!storing) {
+      storing = true;
+      nextSample = now + std::chrono::milliseconds(500);
+    }
+  }
+  else if(mnemonic == "PAUS") {
+    storing = false;
+  }
+  else if(mnemonic == "REST") {
+    stored[0].clear();
+    stored[1].clear();
+    storing = false;
+  }
+  else if(mnemonic == "TRIG") {
+    if(storing && sampleRate == 14) {
+      storeSample(now);
+    }
+  }
+  else if(mnemonic == "SPTS" && query) {
+    respond((int) stored[0].size());
+  }
+  else if(
+    query && (mnemonic == "TRCA" || mnemonic == "TRCB" || mnemonic == "TRCL")
+  ) {
+    int n = (int) stored[0].size();
+    int start = (nArgs > 1) ? (int) args[1] : 0;
+    int count = (nArgs > 2) ? (int) args[2] : 0;
+    if(nArgs != 3 || i < 1 || i > 2 || start < 0 || count < 1 || start + count > n) {
+      esr |= 16;
+    } else {
+      transferBuffer(mnemonic, i, start, count);
+    }
+  }
+  else if(mnemonic == "*IDN" && query) {
+    snprintf(buf, 64, "Stanford_Research_Systems,SR830,s/n%05d,ver1.07", 80000 + pad);
+    respond(buf);
+  }
+  else if(mnemonic == "*RST") {
+    reset();
+  }
+  else if(mnemonic == "*CLS") {
+    esr = liaStatus = errStatus = 0;
+  }
+  else if(mnemonic == "*STB" && query) {
+    int stb = statusByte();
+    respond((nArgs > 0) ? ((stb >> i) & 1) : stb);
+  }
+  else if(
+    query && (mnemonic == "*ESR" || mnemonic == "LIAS" || mnemonic == "ERRS")
+  ) {
+    // Reading a status register clears the bits that were read
+    int* reg = (mnemonic == "*ESR") ? &esr
+        : ((mnemonic == "LIAS") ? &liaStatus : &errStatus);
+    if(nArgs > 0) {
+      respond((*reg >> i) & 1);
+      *reg &= ~(1 << i);
+    } else {
+      respond(*reg);
+      *reg = 0;
+    }
+  }
+  else if(mnemonic == "*ESE" || mnemonic == "*SRE" || mnemonic == "LOCL"
+      || mnemonic == "OUTX" || mnemonic == "OVRM") {
+    // Accepted; interface configuration has no effect on the emulation
+    if(query) {
+      respond(0);
+    }
+  }
+  else {
+    esr |= 32;  // CMD: illegal command
+  }
+}
+
+
+long EmulatedSR830::write(const char* data, size_t len)
+{
+  if(len > SR830_INPUT_QUEUE) {
+    esr |= 1;  // INP: input queue overflow; the excess is lost
+    len = SR830_INPUT_QUEUE;
+  }
+  std::string message(data, len);
+
+  int commands = 0;
+  int queries = 0;
+  size_t start = 0;
+  while(start <= message.size()) {
+    size_t stop = message.find_first_of(";\r\n", start);
+    if(stop == std::string::npos) {
+      stop = message.size();
+    }
+    if(stop > start) {
+      execute(message.substr(start, stop - start), queries);
+      commands++;
+    }
+    start = stop + 1;
+  }
+  return commands * timing.perCommand + queries * timing.perQuery;
+}
+
+
+size_t EmulatedSR830::read(char* buf, size_t cnt, int stopChar, bool& end)
+{
+  if(outputQueue.empty() && !fastQueue.empty()) {
+    // The stream has no terminator and never asserts EOI
+    size_t n = (cnt < fastQueue.size()) ? cnt : fastQueue.size();
+    fastQueue.copy(buf, n);
+    fastQueue.erase(0, n);
+    end = false;
+    return n;
+  }
+  size_t n = (cnt < outputQueue.size()) ? cnt : outputQueue.size();
+  if(stopChar >= 0) {
+    size_t stop = outputQueue.find((char) stopChar);
+    if(stop != std::string::npos && stop + 1 < n) {
+      n = stop + 1;
+    }
+  }
+  outputQueue.copy(buf, n);
+  outputQueue.erase(0, n);
+  end = outputQueue.empty();
+  return n;
+}
+
+
+size_t EmulatedSR830::pending()
+{
+  if(streaming()) {
+    storeSamples(Clock::now());
+  }
+  return outputQueue.size() + fastQueue.size();
+}
+
+
+void EmulatedSR830::clear()
+{
+  outputQueue.clear();
+  fastQueue.clear();
+}
+
+
+bool EmulatedSR830::streaming()
+{
+  return storing && fastMode != 0;
+}
+
+
+std::chrono::steady_clock::time_point EmulatedSR830::nextSampleTime()
+{
+  return nextSample;
+}
+
+
+long EmulatedSR830::getFastOverflows()
+{
+  return fastOverflows;
+}
+
+
+int EmulatedSR830::statusByte()
+{
+  int stb = 0;
+  if(errStatus) stb |= 4;
+  if(liaStatus) stb |= 8;
+  if(!outputQueue.empty()) stb |= 16;
+  if(esr) stb |= 32;
+  return stb;
+}
@@ -0,0 +1,235 @@
+// EmulatedSR830.h
+// encoding: utf-8
+//
+// Software model of an SR830 lock-in amplifier, for use without hardware.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 09:12:40
+// Modified: 2026-10-17 04:20:55
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#ifndef EMULATEDSR830_H
+#define EMULATEDSR830_H
+
+#include <chrono>
+#include <complex>
+#include <random>
+#include <string>
+#include <vector>
+
+#define SR830_INPUT_QUEUE 256
+#define SR830_OUTPUT_QUEUE 256
+#define SR830_MAX_POLES 4
+#define SR830_BUFFER_POINTS 16383
+#define SR830_FAST_FIFO 512
+
+
+/*
+ * struct EmulatedTiming
+ *
+ * Per-operation latency of the emulated instrument, in microseconds. The
+ * defaults approximate an SR830 behind an NI GPIB-USB-HS controller.
+ *
+ * Fields:
+ *   messageOverhead - fixed cost of every Send or Receive (addressing,
+ *       handshake and driver overhead)
+ *   perByte - transfer time per data byte
+ *   perCommand - parse and execute time for each command in a message
+ *   perQuery - additional time for the instrument to format a query response
+ *   timeScale - multiplier applied to all of the above; 0 disables the delays
+ */
+struct EmulatedTiming {
+  long messageOverhead;
+  long perByte;
+  long perCommand;
+  long perQuery;
+  double timeScale;
+
+  EmulatedTiming() {
+    messageOverhead = 1200;
+    perByte = 8;
+    perCommand = 400;
+    perQuery = 1500;
+    timeScale = 1.0;
+  }
+};
+
+
+/*
+ * struct EmulatedSample
+ *
+ * The device under test, as seen by the emulated lock-in: a damped resonator
+ * driven by the sine output, whose response is modulated by the two galvo
+ * voltages on Aux Out 1 and Aux Out 2.
+ *
+ * Fields:
+ *   resonance - resonance frequency, in Hz
+ *   quality - quality factor of the resonance
+ *   gain - response (V) per volt of sine output amplitude, at DC
+ *   harmonicGain - relative strength of each successive detection harmonic
+ *   spotWidth - width (V) of the Gaussian dependence on Aux Out 1 and 2
+ *   noiseDensity - input-referred noise density, in V/sqrt(Hz)
+ */
+struct EmulatedSample {
+  double resonance;
+  double quality;
+  double gain;
+  double harmonicGain;
+  double spotWidth;
+  double noiseDensity;
+
+  EmulatedSample() {
+    resonance = 10000;
+    quality = 50;
+    gain = 1e-3;
+    harmonicGain = 0.01;
+    spotWidth = 4;
+    noiseDensity = 20e-9;
+  }
+};
+
+
+class EmulatedSR830 {
+  typedef std::chrono::steady_clock Clock;
+
+  int pad;
+
+  // Instrument settings (see LockinSettings.cpp for the meaning of each)
+  double phase, frequency, amplitude;
+  int refSource, refTrigger, harmonic;
+  int inputConfig, shieldGround, coupling, lineFilter;
+  int sensitivity, reserve, timeConstant, filterSlope, syncFilter;
+  int display[2][2], frontPanel[2];
+  double offset[3];
+  int expand[3];
+  double auxOut[4];
+  int sampleRate, bufferMode, triggerStart, fastMode;
+
+  // Status registers
+  int esr, liaStatus, errStatus;
+
+  // Low-pass filter state: one complex value per pole, advanced to lastUpdate
+  std::complex<double> stages[SR830_MAX_POLES];
+  Clock::time_point lastUpdate;
+
+  // Data storage buffer: CH1 and CH2 display values, taken at sampleRate
+  // while `storing`, starting at nextSample
+  std::vector<float> stored[2];
+  bool storing;
+  Clock::time_point nextSample;
+
+  // Fast mode: binary (X, Y) pairs waiting to be read, and samples lost
+  // because the controller did not read them in time
+  std::string fastQueue;
+  long fastOverflows;
+
+  std::string outputQueue;
+  std::mt19937 rng;
+
+  void reset();
+  void advanceFilter(Clock::time_point t);
+  std::complex<double> target();
+  std::complex<double> output(Clock::time_point t);
+  void storeSample(Clock::time_point t);
+  void storeSamples(Clock::time_point now);
+  void transferBuffer(const std::string& mnemonic, int channel, int start, int count);
+  double noiseLevel();
+  double displayValue(int channel, std::complex<double> xy);
+  double snapValue(int index, std::complex<double> xy);
+  void execute(const std::string& command, int& queries);
+  void respond(const char* response);
+  void respond(double value);
+  void respond(int value);
+  bool parseArgs(const std::string& args, double* vals, int maxVals, int& nVals);
+
+public:
+  EmulatedTiming timing;
+  EmulatedSample sample;
+
+  EmulatedSR830(int pad);
+
+
+  /*
+   * Returns the primary GPIB address of the instrument.
+   */
+  int getAddress();
+
+
+  /*
+   * Process one message written by the controller. The message may contain
+   * several commands separated by ';'. Returns the number of microseconds the
+   * instrument spends parsing and executing the message.
+   */
+  long write(const char* data, size_t len);
+
+
+  /*
+   * Copy up to cnt bytes of pending output into buf, stopping early after the
+   * byte `stopChar` if it is not negative. Returns the number of bytes copied;
+   * `end` is set when the last byte of the output queue was sent (EOI
+   * asserted).
+   */
+  size_t read(char* buf, size_t cnt, int stopChar, bool& end);
+
+
+  /*
+   * Returns the number of bytes waiting in the output queue.
+   */
+  size_t pending();
+
+
+  /*
+   * Clear the input and output queues (device clear / interface clear).
+   */
+  void clear();
+
+
+  /*
+   * Returns true while fast mode is streaming samples to the controller.
+   */
+  bool streaming();
+
+
+  /*
+   * Returns the time at which the next data storage sample will be taken.
+   */
+  std::chrono::steady_clock::time_point nextSampleTime();
+
+
+  /*
+   * Returns the number of fast-mode samples dropped because the controller
+   * fell behind.
+   */
+  long getFastOverflows();
+
+
+  /*
+   * Returns the serial poll status byte.
+   */
+  int statusByte();
+
+};
+
+#endif
@@ -5,7 +5,7 @@
 //
 // Author:   Connor D. Pierce
 // Created:  2018-02-02
-// Modified: 2023-04-05 21:30:24
+// Modified: 2026-10-17 10:14:37
 //
 // Copyright (C) 2018-2023 Connor D. Pierce
 //
@@ -103,6 +103,30 @@ LRESULT CALLBACK WndProc(HWND hwndLcl, UINT msg, WPARAM wParam, LPARAM lParam)
           }
           break;
         }
+        case MI_ADAPTIVE_SETTLE: {
+          HMENU menu = GetMenu(hwnd);
+          if(settleMode != SETTLE_FIXED) {
+            settleMode = SETTLE_FIXED;
+            CheckMenuItem(menu, MI_ADAPTIVE_SETTLE, MF_UNCHECKED);
+          } else {
+            int ret = DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(SETTLE_DIALOG), hwnd, SettleDlgProc);
+            if(ret == IDOK) {
+              logger << "WndProc: user enabled adaptive settling; mode: "
+                  << settleMode << ", tolerance: " << settleTolerance << "%" << std::endl;
+              CheckMenuItem(menu, MI_ADAPTIVE_SETTLE, MF_CHECKED);
+            }
+          }
+          break;
+        }
+        case MI_REFINEMENT: {
+          int ret = DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(REFINE_DIALOG), hwnd, RefineDlgProc);
+          if(ret == IDOK) {
+            logger << "WndProc: user set adaptive refinement; tolerance: "
+                << refineTolerance << "%, phase step: " << refinePhaseStep
+                << ", points: " << refineMaxPoints << std::endl;
+          }
+          break;
+        }
         case MI_EXIT:
           PostMessage(hwndLcl, WM_CLOSE, 0, 0);
           break;
@@ -118,6 +142,7 @@ LRESULT CALLBACK WndProc(HWND hwndLcl, UINT msg, WPARAM wParam, LPARAM lParam)
           CheckMenuItem(menu, MI_RAMP_NONE, MF_CHECKED);
           CheckMenuItem(menu, MI_RAMP_ALL, MF_UNCHECKED);
           CheckMenuItem(menu, MI_RAMP_LOG, MF_UNCHECKED);
+          CheckMenuItem(menu, MI_RAMP_SLEW, MF_UNCHECKED);
           break;
         }
         case MI_RAMP_ALL: {
@@ -126,6 +151,7 @@ LRESULT CALLBACK WndProc(HWND hwndLcl, UINT msg, WPARAM wParam, LPARAM lParam)
           CheckMenuItem(menu, MI_RAMP_NONE, MF_UNCHECKED);
           CheckMenuItem(menu, MI_RAMP_ALL, MF_CHECKED);
           CheckMenuItem(menu, MI_RAMP_LOG, MF_UNCHECKED);
+          CheckMenuItem(menu, MI_RAMP_SLEW, MF_UNCHECKED);
           break;
         }
         case MI_RAMP_LOG: {
@@ -134,11 +160,98 @@ LRESULT CALLBACK WndProc(HWND hwndLcl, UINT msg, WPARAM wParam, LPARAM lParam)
           CheckMenuItem(menu, MI_RAMP_NONE, MF_UNCHECKED);
           CheckMenuItem(menu, MI_RAMP_ALL, MF_UNCHECKED);
           CheckMenuItem(menu, MI_RAMP_LOG, MF_CHECKED);
+          CheckMenuItem(menu, MI_RAMP_SLEW, MF_UNCHECKED);
+          break;
+        }
+        case MI_RAMP_SLEW: {
+          int ret = DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(SLEW_DIALOG), hwnd, SlewDlgProc);
+          if(ret == IDOK) {
+            rampType = RAMP_SLEW;
+            HMENU menu = GetMenu(hwnd);
+            CheckMenuItem(menu, MI_RAMP_NONE, MF_UNCHECKED);
+            CheckMenuItem(menu, MI_RAMP_ALL, MF_UNCHECKED);
+            CheckMenuItem(menu, MI_RAMP_LOG, MF_UNCHECKED);
+            CheckMenuItem(menu, MI_RAMP_SLEW, MF_CHECKED);
+            validateSweepParams(false);
+          }
+          break;
+        }
+        case MI_BINARY_OUTPUT: {
+          binaryOutput = !binaryOutput;
+          HMENU menu = GetMenu(hwnd);
+          CheckMenuItem(menu, MI_BINARY_OUTPUT,
+              binaryOutput ? MF_CHECKED : MF_UNCHECKED);
+          break;
+        }
+        case MI_RESUME_SWEEP:
+          if(connReady && cancelSweep && GetOpenFileName(&ofnJournal)) {
+            engine.config = sweepConfig();
+            std::string error = engine.loadJournal(szJournalName);
+            if(error.empty() && !applySweepConfig(engine.config)) {
+              error = "Output file name of the journal is too long";
+            }
+            if(error.empty()) {
+              HMENU menu = GetMenu(hwnd);
+              CheckMenuItem(menu, MI_BINARY_OUTPUT,
+                  binaryOutput ? MF_CHECKED : MF_UNCHECKED);
+              CheckMenuItem(menu, MI_ADAPTIVE_SETTLE,
+                  (settleMode != SETTLE_FIXED) ? MF_CHECKED : MF_UNCHECKED);
+              CheckMenuItem(menu, MI_ORDER_TIME_CONST,
+                  orderTimeConsts ? MF_CHECKED : MF_UNCHECKED);
+              cancelSweep = false;
+              engine.clearCancel();
+              bgThreadHandle = CreateThread(NULL, 0, SweepThreadFunction,
+                  NULL, 0, NULL);
+            } else {
+              MessageBox(hwnd, error.c_str(), "Resume Sweep",
+                  MB_OK | MB_ICONERROR);
+            }
+          }
+          logger << "Resume Sweep!" << std::endl;
+          break;
+        case MI_QUEUE_ADD:
+          queueSweep(JOB_PRIORITY_NORMAL);
+          break;
+        case MI_QUEUE_URGENT:
+          queueSweep(JOB_PRIORITY_URGENT);
+          break;
+        case MI_QUEUE_RUN:
+          startQueue();
+          break;
+        case MI_QUEUE_PAUSE: {
+          if(sweepQueue.isPaused()) {
+            sweepQueue.resume();
+            startQueue();
+          } else {
+            sweepQueue.pause();
+          }
+          HMENU menu = GetMenu(hwnd);
+          CheckMenuItem(menu, MI_QUEUE_PAUSE,
+              sweepQueue.isPaused() ? MF_CHECKED : MF_UNCHECKED);
+          break;
+        }
+        case MI_QUEUE_STOP:
+          sweepQueue.stop();
+          engine.cancel();
+          break;
+        case MI_HOLD_ON_CANCEL: {
+          holdOnCancel = !holdOnCancel;
+          HMENU menu = GetMenu(hwnd);
+          CheckMenuItem(menu, MI_HOLD_ON_CANCEL,
+              holdOnCancel ? MF_CHECKED : MF_UNCHECKED);
+          break;
+        }
+        case MI_ORDER_TIME_CONST: {
+          orderTimeConsts = !orderTimeConsts;
+          HMENU menu = GetMenu(hwnd);
+          CheckMenuItem(menu, MI_ORDER_TIME_CONST,
+              orderTimeConsts ? MF_CHECKED : MF_UNCHECKED);
+          validateSweepParams(false);
           break;
         }
         case BTN_CANCEL_SWEEP:
           cancelSweep = true;
-          SetEvent(cancelSweepEvent);
+          engine.cancel();
 //          logger << count << std::endl;
           break;
         case BTN_C_ADD:
@@ -171,8 +284,10 @@ LRESULT CALLBACK WndProc(HWND hwndLcl, UINT msg, WPARAM wParam, LPARAM lParam)
           double X, Y;
           bool flag = getCustomXYValues(X, Y);
           if(flag && connReady) {
+            lockin->begin_batch();
             sendCommandToLockin(SWEEP_X, X);
             sendCommandToLockin(SWEEP_Y, Y);
+            lockin->end_batch();
           }
           break;
         }
@@ -213,6 +328,19 @@ LRESULT CALLBACK WndProc(HWND hwndLcl, UINT msg, WPARAM wParam, LPARAM lParam)
           validateSweepParams(false);
           break;
         }
+        case LTEXT_F_ADAPT:
+        case LTEXT_A_ADAPT: {
+          int param = (LOWORD(wParam) == LTEXT_F_ADAPT) ? SWEEP_F : SWEEP_A;
+          sweepSetup.adaptive[param] = !sweepSetup.adaptive[param];
+          HWND chkBx = GetDlgItem(hwnd, LOWORD(wParam));
+          if(sweepSetup.adaptive[param]) {
+            SendMessage(chkBx, BM_SETCHECK, BST_CHECKED, 0);
+          } else {
+            SendMessage(chkBx, BM_SETCHECK, BST_UNCHECKED, 0);
+          }
+          validateSweepParams(false);
+          break;
+        }
         case LTEXT_X_BIDIR:
         case LTEXT_Y_BIDIR:
         case LTEXT_A_BIDIR:
@@ -237,11 +365,11 @@ LRESULT CALLBACK WndProc(HWND hwndLcl, UINT msg, WPARAM wParam, LPARAM lParam)
       }
       break;
     case WM_CLOSE:
-      SetEvent(cancelSweepEvent);
+      sweepQueue.stop();
+      engine.cancel();
       SetEvent(quitGpibCheckerEvent);
       WaitForSingleObject(bgThreadHandle, 5000ul);
       WaitForSingleObject(gpibCheckerHandle, 1000);
-      logger.flush();
       logger.close();
       DestroyWindow(hwndLcl);
     break;
@@ -448,13 +576,45 @@ LRESULT CALLBACK AveragingDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM
         case WM_INITDIALOG:
           snprintf(content, 80, "%d", numAvgPts);
           SetWindowText(ctrl, content);
+          CheckDlgButton(
+            hwnd, CHK_AVG_BUFFER, bufferedAveraging ? BST_CHECKED : BST_UNCHECKED
+          );
+          snprintf(content, 80, "%g", getSampleRateValue(avgSampleRate));
+          SetWindowText(GetDlgItem(hwnd, LTEXT_AVG_RATE), content);
+          snprintf(content, 80, "%g", avgTargetError);
+          SetWindowText(GetDlgItem(hwnd, LTEXT_AVG_TARGET), content);
+          snprintf(content, 80, "%d", avgMinPts);
+          SetWindowText(GetDlgItem(hwnd, LTEXT_AVG_MIN), content);
+          CheckDlgButton(
+            hwnd, CHK_AVG_OUTLIERS, avgRejectOutliers ? BST_CHECKED : BST_UNCHECKED
+          );
           return TRUE;
         case WM_COMMAND:
             switch(LOWORD(wParam)){
                 case IDOK: {
+          int pts, minPts;
+          double rate, target;
           GetWindowText(ctrl, content, 80);
-          STRCONV_ERROR res = str2int(numAvgPts, content);
-          if(res == CONV_SUCCESS){
+          STRCONV_ERROR res = str2int(pts, content);
+          GetWindowText(GetDlgItem(hwnd, LTEXT_AVG_RATE), content, 80);
+          if(res == CONV_SUCCESS) {
+            res = str2dbl(rate, content);
+          }
+          GetWindowText(GetDlgItem(hwnd, LTEXT_AVG_TARGET), content, 80);
+          if(res == CONV_SUCCESS) {
+            res = str2dbl(target, content);
+          }
+          GetWindowText(GetDlgItem(hwnd, LTEXT_AVG_MIN), content, 80);
+          if(res == CONV_SUCCESS) {
+            res = str2int(minPts, content);
+          }
+          if(res == CONV_SUCCESS && pts > 0 && target >= 0 && minPts > 0) {
+            numAvgPts = pts;
+            bufferedAveraging = IsDlgButtonChecked(hwnd, CHK_AVG_BUFFER);
+            avgSampleRate = getSampleRate(rate);
+            avgTargetError = target;
+            avgMinPts = minPts;
+            avgRejectOutliers = IsDlgButtonChecked(hwnd, CHK_AVG_OUTLIERS);
             EndDialog(hwnd, IDOK);
           }
                   break;
@@ -471,6 +631,92 @@ LRESULT CALLBACK AveragingDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM
 }
 
 
+LRESULT CALLBACK RefineDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM lParam)
+{
+  char content[80];
+  switch(Message) {
+    case WM_INITDIALOG:
+      snprintf(content, 80, "%g", refineTolerance);
+      SetWindowText(GetDlgItem(hwnd, LTEXT_REFINE_TOL), content);
+      snprintf(content, 80, "%g", refinePhaseStep);
+      SetWindowText(GetDlgItem(hwnd, LTEXT_REFINE_PHASE), content);
+      snprintf(content, 80, "%d", refineMaxPoints);
+      SetWindowText(GetDlgItem(hwnd, LTEXT_REFINE_POINTS), content);
+      return TRUE;
+    case WM_COMMAND:
+      switch(LOWORD(wParam)) {
+        case IDOK: {
+          double tol, phase;
+          int points;
+          GetWindowText(GetDlgItem(hwnd, LTEXT_REFINE_TOL), content, 80);
+          STRCONV_ERROR res = str2dbl(tol, content);
+          GetWindowText(GetDlgItem(hwnd, LTEXT_REFINE_PHASE), content, 80);
+          if(res == CONV_SUCCESS) {
+            res = str2dbl(phase, content);
+          }
+          GetWindowText(GetDlgItem(hwnd, LTEXT_REFINE_POINTS), content, 80);
+          if(res == CONV_SUCCESS) {
+            res = str2int(points, content);
+          }
+          if(res == CONV_SUCCESS && tol > 0 && phase >= 0 && points > 0) {
+            refineTolerance = tol;
+            refinePhaseStep = phase;
+            refineMaxPoints = points;
+            EndDialog(hwnd, IDOK);
+          }
+          break;
+        }
+        case IDCANCEL:
+          EndDialog(hwnd, IDCANCEL);
+          break;
+      }
+      break;
+    default:
+      return FALSE;
+  }
+  return TRUE;
+}
+
+
+LRESULT CALLBACK SlewDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM lParam)
+{
+  const int ids[] = {LTEXT_SLEW_X, LTEXT_SLEW_Y, LTEXT_SLEW_F, LTEXT_SLEW_A};
+  char content[80];
+  switch(Message) {
+    case WM_INITDIALOG:
+      for(int k = 0; k < 4; k++) {
+        snprintf(content, 80, "%g", sweepSetup.slewRates[k]);
+        SetWindowText(GetDlgItem(hwnd, ids[k]), content);
+      }
+      return TRUE;
+    case WM_COMMAND:
+      switch(LOWORD(wParam)) {
+        case IDOK: {
+          double rates[4];
+          for(int k = 0; k < 4; k++) {
+            GetWindowText(GetDlgItem(hwnd, ids[k]), content, 80);
+            if(str2dbl(rates[k], content) != CONV_SUCCESS || rates[k] < 0) {
+              return TRUE;
+            }
+          }
+          for(int k = 0; k < 4; k++) {
+            sweepSetup.slewRates[k] = rates[k];
+          }
+          EndDialog(hwnd, IDOK);
+          break;
+        }
+        case IDCANCEL:
+          EndDialog(hwnd, IDCANCEL);
+          break;
+      }
+      break;
+    default:
+      return FALSE;
+  }
+  return TRUE;
+}
+
+
 int WINAPI WinMain(
   HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow
 )
@@ -481,6 +727,12 @@ int WINAPI WinMain(
   HICON hMyIcon   = (HICON) LoadImage(hInstance, MAKEINTRESOURCE(SWEEP_ICON), IMAGE_ICON, 32, 32, 0);
   HICON hMyIconSm = (HICON) LoadImage(hInstance, MAKEINTRESOURCE(SWEEP_ICON), IMAGE_ICON, 16, 16, 0);
   logger << "Loaded icons!" << std::endl;
+  engine.estimator.load(SWEEP_TIMING_FILE);
+  engine.onProgress = sweepShowProgress;
+  sweepQueue.setLogger(&logger);
+  if(!sweepQueue.load(SWEEP_QUEUE_FILE)) {
+    logger << "Could not read the sweep queue " << SWEEP_QUEUE_FILE << std::endl;
+  }
   
   //Step 1: Registering the Window Class
   wc.cbSize     = sizeof(WNDCLASSEX);
@@ -530,6 +782,14 @@ int WINAPI WinMain(
   ofn.Flags = OFN_EXPLORER | OFN_FILEMUSTEXIST | OFN_HIDEREADONLY |
       OFN_OVERWRITEPROMPT;
       
+  ZeroMemory(&ofnJournal, sizeof(ofnJournal));
+  ofnJournal.lStructSize = sizeof(ofnJournal);
+  ofnJournal.hwndOwner = hwnd;
+  ofnJournal.lpstrFilter = "Sweep Journals (*.journal)\0*.journal\0";
+  ofnJournal.lpstrFile = szJournalName;
+  ofnJournal.nMaxFile = MAX_PATH;
+  ofnJournal.Flags = OFN_EXPLORER | OFN_FILEMUSTEXIST | OFN_HIDEREADONLY;
+
   logger << "Created filechooser struct" << std::endl;
 
   INITCOMMONCONTROLSEX initCtrls;
@@ -544,6 +804,8 @@ int WINAPI WinMain(
   sweepSetup.signalToDC = -40;
   for(int i = 0; i<NUM_AVAIL_PARAMS; i++) {
     sweepSetup.logSpacing[i] = false;
+    sweepSetup.adaptive[i] = false;
+    sweepSetup.slewRates[i] = 1;
   }
   createControls(hInstance);
   acceptTextInput = TRUE;
@@ -583,10 +845,11 @@ DWORD WINAPI connectToAmp(LPVOID lpParam)
           logger << "connectToAmp: trying to create interface" << std::endl;
           gpibInterface = new GPIBInterface(0);
           logger << "  connectToAmp: created interface" << std::endl;
-          lockin = new SR830(gpibInterface,8);
-          lockin->settings.queryAllOptions(lockin->address);
-          filterType = lockin->settings.get("Low Pass Filter Slope").intVal1;
+          // The first SRS lockin on the bus, else the one at its usual address
+          Addr4882_t found = gpibInterface->findListener("SR8");
+          lockin = new SR830(gpibInterface, (found != NOADDR) ? GetPAD(found) : 8);
           logger << "    connectToAmp: created SR830" << std::endl;
+          engine.setLockin(lockin);
           connReady = true;
         } catch(DisconnectedException &ex) {
           logger << "  connectToAmp: disconnected exception:" << ex.what() << std::endl;
@@ -601,9 +864,9 @@ DWORD WINAPI connectToAmp(LPVOID lpParam)
         }
       } else {
         //We were connected at last check; see if we're still connected
-        logger << "connectToAmp: checking to see if still connected" << std::endl;
+        logger << LOG_DEBUG << "connectToAmp: checking to see if still connected" << std::endl;
         FindLstn(0, nstrmnts, rslt, 31);
-        if(ibsta & ERR) {
+        if(ThreadIbsta() & ERR) {
           logger << "  connectToAmp: error occured in FindLstn" << std::endl;
               //Connection to GPIB board had some kind of error; we're
               //probably not connected anymore. Free up the memory used
@@ -616,7 +879,7 @@ DWORD WINAPI connectToAmp(LPVOID lpParam)
             }
       }
     }
-    logger << "  connectToAmp: validating sweep params" << std::endl;
+    logger << LOG_DEBUG << "  connectToAmp: validating sweep params" << std::endl;
     validateSweepParams(false);
     if(WaitForSingleObject(quitGpibCheckerEvent, 5000) == WAIT_OBJECT_0) {
       break;
@@ -734,11 +997,19 @@ void createParamControls(HINSTANCE hInstance, int yPos, int param, BOOL active)
         WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 400, yPos, 100, 15,
         hwnd, (HMENU) LTEXT_F_LOG, hInstance, NULL);
     EnableWindow(tmp, active);
+    tmp = CreateWindow("BUTTON", "Adaptive",
+        WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 600, yPos, 80, 15,
+        hwnd, (HMENU) LTEXT_F_ADAPT, hInstance, NULL);
+    EnableWindow(tmp, active);
   } else if(param == SWEEP_A) {
     tmp = CreateWindow("BUTTON", "Log Spacing",
         WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 400, yPos, 100, 15,
         hwnd, (HMENU) LTEXT_A_LOG, hInstance, NULL);
     EnableWindow(tmp, active);
+    tmp = CreateWindow("BUTTON", "Adaptive",
+        WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 600, yPos, 80, 15,
+        hwnd, (HMENU) LTEXT_A_ADAPT, hInstance, NULL);
+    EnableWindow(tmp, active);
   }
 }
 
@@ -929,10 +1200,14 @@ void updateActiveParams(int changedParam)
     EnableWindow(ctrl, activeParams[idx]);
     ctrl = GetDlgItem(hwnd, LTEXT_F_LOG);
     EnableWindow(ctrl, activeParams[idx]);
+    ctrl = GetDlgItem(hwnd, LTEXT_F_ADAPT);
+    EnableWindow(ctrl, activeParams[idx]);
   }
   else if(idx == SWEEP_A) {
     HWND ctrl = GetDlgItem(hwnd, LTEXT_A_LOG);
     EnableWindow(ctrl, activeParams[idx]);
+    ctrl = GetDlgItem(hwnd, LTEXT_A_ADAPT);
+    EnableWindow(ctrl, activeParams[idx]);
   }
 
   EnableWindow(GetDlgItem(hwnd, BTN_RUN_SWEEP),numActiveParams > 0);
@@ -979,7 +1254,7 @@ bool validateSweepParams(bool runSweep)
       ctrl = GetDlgItem(hwnd, LTEXT_C_WAIT);
       GetWindowText(ctrl, content, 80);
       res = str2long(sweepSetup.waits[i], content);
-      if(sweepSetup.waits[i] < 1) {
+      if(res != CONV_SUCCESS) {
         return false;
       }
       sweepSetup.repeats[i] = 1;
@@ -1022,21 +1297,11 @@ bool validateSweepParams(bool runSweep)
           case 3: {
             // Check the "steps" field
             res = str2int(sweepSetup.steps[i], content);
-            if(sweepSetup.steps[i] < 1) {
-              //Must have at least one step in the sweep;
-              //this is an invalid value
-              return false;
-            }
             break;
           }
           case 4: {
             // Check the "repeats" field
             res = str2int(sweepSetup.repeats[i], content);
-            if(sweepSetup.repeats[i] < 1) {
-              //Must perform the sweep at least once; this
-              //is an invalid value
-              return false;
-            }
             break;
           }
           case 5: {
@@ -1045,11 +1310,6 @@ bool validateSweepParams(bool runSweep)
             }
             else {
               res = str2long(sweepSetup.waits[i], content);
-              if(sweepSetup.waits[i] < 1) {
-                //Wait time cannot be less than 0; this is
-                //invalid value
-                return false;
-              }
             }
             break;
           }
@@ -1057,41 +1317,46 @@ bool validateSweepParams(bool runSweep)
         if(res != CONV_SUCCESS) { // Found an invalid value
           return false;
         }
-        else {
-          if(i == SWEEP_X || i == SWEEP_Y) {
-            if(sweepSetup.starts[i] > VOLTAGE_MAX) {
-              sweepSetup.starts[i] = VOLTAGE_MAX;
-            } else if(sweepSetup.starts[i] < VOLTAGE_MIN) {
-              sweepSetup.starts[i] = VOLTAGE_MIN;
-            }
-            if(sweepSetup.ends[i] > VOLTAGE_MAX) {
-              sweepSetup.ends[i] = VOLTAGE_MAX;
-            } else if(sweepSetup.ends[i] < VOLTAGE_MIN) {
-              sweepSetup.ends[i] = VOLTAGE_MIN;
-            }
-          }
-        }
       }
     }
   }
 
+  // The ranges are checked, and the voltages clamped, by the same routine
+  // as sweep definitions read from a file
+  SweepConfig config = sweepConfig();
+  std::string error = SweepEngine::validateConfig(config);
+  if(!error.empty()) {
+    logger << "validating; " << error << std::endl;
+    return false;
+  }
+  sweepSetup = config.setup;
+
   EnableWindow(GetDlgItem(hwnd,BTN_RUN_SWEEP), TRUE);
 
   populateTree(tree);
 
-  long dur = calculateSweepDuration();
+  long rampMillis = 0;
+  long dur = engine.duration(sweepConfig(), &rampMillis);
   int hours =  dur / (3600000);
   int minutes = (dur % 3600000) / 60000;
   double seconds = (dur % 60000) / (1000.0);
   std::ostringstream desc;
   desc << ((connReady)?"GPIB Ready\r\n":"GPIB Disconnected!\r\n");
-  desc << "Estimated Duration:\r\n";
-  desc << hours << "hr " << minutes << "min " << seconds << "s";
+  if(dur < 0) {
+    desc << "Sweep has too many points";
+  } else {
+    desc << "Estimated Duration:\r\n";
+    desc << hours << "hr " << minutes << "min " << seconds << "s";
+    if(rampType == RAMP_SLEW) {
+      desc << "\r\nRamping: " << rampMillis / 1000.0 << "s";
+    }
+  }
 
-  if(runSweep && connReady && !settingCustomSweep) {
+  if(runSweep && connReady && cancelSweep && !settingCustomSweep) {
     LPDWORD threadId = NULL;
     cancelSweep = false;
-    ResetEvent(cancelSweepEvent);
+    engine.config = sweepConfig();
+    engine.clearCancel();
     bgThreadHandle = CreateThread(NULL, 0, SweepThreadFunction,
         NULL, 0, threadId);
     logger << bgThreadHandle << std::endl;
@@ -1167,608 +1432,127 @@ bool enableCustomSweep(bool useXY)
 DWORD WINAPI SweepThreadFunction( LPVOID lpParam )
 {
   logger <<"Sweep called; lockin="<<lockin->address<< std::endl;
-  int retVal = sweep();
+  int retVal = engine.run();
+  cancelSweep = true;
   validateSweepParams(false);
   return retVal;
 }
 
 
-double getSensValue(int i)
-{
-  int m = i % 3;
-  return (m*m + 2*m + 2) * pow(10.0, i/3 - 9.0);
-}
-
-
-double getTimeConstValue(int i)
-{
-  return (2*(i%2) + 1) * pow(10.0, i/2 - 5.0);
-}
-
-
-int getTimeConst(double reqTau)
-{
-  double logTau = log10(reqTau);
-  double iPart = floor(logTau);
-  //logger << "   getTimeConst: reqTau is " << reqTau <<std::endl;
-  //logger << "   getTimeConst: logTau is " << logTau <<std::endl;
-  //logger << "   getTimeConst: iPart is " << iPart <<std::endl;
-  //logger << "   getTimeConst: rT / pow() is " << (reqTau / pow(10.0, iPart)) <<std::endl;
-  
-  return (2*iPart) + (((reqTau / pow(10.0, iPart)) > 3)?12:11);
-}
-
-
-double getFiltSlopeValue(int i)
-{
-  return -6.0 *(i+1);
-}
-
-
-double getWaitFactor(int filtSlope)
-{
-  switch(filtSlope) {
-    case 0: return 5.0;
-    case 1: return 7.0;
-    case 2: return 9.0;
-    case 3: return 10.0;
-  }
-}
-
-
-bool outOfRange(double ampl, int sens)
-{
-  double fullScale = getSensValue(sens);
-  double relAmpl   = ampl / fullScale;
-  return (relAmpl < 0.0016) || (relAmpl > 1);
-}
-
-
-int getBestSens(double ampl, int currSens)
-{
-  // Calculate the minimum sensitivity we should jump to, which should not be smaller
-  // than the resolution at the current sensitivity
-  double currSensVal = getSensValue(currSens);
-  double resolution = currSensVal / pow(2, 12);
-  int minSens = currSens;
-  for(int sens = currSens - 1; sens >= 0; sens--) {
-    if(getSensValue(sens) < resolution) {
-      break;
-    }
-    else {
-      minSens = sens;
-    }
-  }
-  double minVal = getSensValue(minSens);
-
-  // Select the appropriate sensitivity
-  if(ampl < 0.9 * minVal) {
-    return minSens;
-  }
-  else if(ampl >= 0.9) {
-    return 26;
-  }
-  else {
-    double logAmp = log10(ampl);
-    double base   = floor(logAmp);
-    double frac   = logAmp - base;
-    
-    int decade = 3 * ( (int) base + 9);
-    int offset;
-    if(frac <= 0.25527) {
-      offset = 0;
-    } else if(frac <= 0.63521) {
-      offset = 1;
-    } else if(frac <= 0.95424) {
-      offset = 2;
-    } else {
-      offset = 3;
-    }
-    logger << "getBestSens: for voltage " << ampl << ", best sensitivity is " << getSensValue(decade+offset) << std::endl;
-    return decade + offset;
-  }
-}
-
-
-void sweepInitOutput(std::ofstream& outps)
-{
-  // Parse output filename
-  std::string ofilename(szFileName);
-  int idx = ofilename.rfind(".txt");
-  
-  // Open the output file where results will be stored
-  std::string outputFileName = ofilename.substr(0, idx);
-  outputFileName.append(".txt");
-  outps.open(outputFileName.c_str());
-  
-  // Modify the file name appropriately for the settings files, and
-  // open the settings file. 
-  std::string settingsFileName = ofilename.substr(0, idx);
-  settingsFileName.append("_settings.txt");
-  LockinSettings::settingsLogger = new std::ofstream(settingsFileName.c_str());
-  
-  // Write the lockin device description and current settings to the settings file
-  (*LockinSettings::settingsLogger) << "SOFTWARE VERSION: " << FVXY_version << std::endl;
-  (*LockinSettings::settingsLogger) << "LOCK-IN VERSION : " << lockin->get_device_description() << std::endl;
-  lockin->settings.queryAllOptions(lockin->address);
-  filterType = lockin->settings.get("Low Pass Filter Slope").intVal1;
-  lockin->settings.writeAllOptions(&outps);
-  
-  // Write header to output file
-  outps << std::endl;
-  for(int i = 0; i < NUM_AVAIL_PARAMS; i++) {
-    if(sweepSetup.parameters[i] == SWEEP_CUSTOM) {
-      outps << "X\tY\t";
-    } else if(sweepSetup.parameters[i] == SWEEP_F) {
-      outps << "Frequency\t";
-    } else if(sweepSetup.parameters[i] == SWEEP_A) {
-      outps << "Amplitude\t";
-    } else if(sweepSetup.parameters[i] == SWEEP_X) {
-      outps << "X\t";
-    } else if(sweepSetup.parameters[i] == SWEEP_Y) {
-      outps << "Y\t";
-    }
-  }
-  if(averaging) {
-    outps << "R\tTheta\tStdDev\t" << std::endl;
-  } else {
-    outps << "R\tTheta\t" << std::endl;
-  }
-  
-  // Log the start time of the sweep
-  time_t now = time(0);
-  struct tm* tmNow = localtime(&now);
-  (*LockinSettings::settingsLogger) << std::endl << "=== SWEEP STARTED at " 
-      << (1900 + tmNow->tm_year) << "-" << (1 + tmNow->tm_mon) << "-"
-      << tmNow->tm_mday << " " << tmNow->tm_hour << ":" << tmNow->tm_min
-      << ":" << tmNow->tm_sec << " ===" << std::endl;
-}
-
-
-void sweepFinalizeOutput(std::ofstream& outps)
+void queueSweep(int priority)
 {
-  // Log the finish time of the sweep
-  time_t now = time(0);
-  struct tm* tmNow = localtime(&now);
-  (*LockinSettings::settingsLogger) << std::endl << "=== SWEEP ENDED at " 
-      << (1900 + tmNow->tm_year) << "-" << (1 + tmNow->tm_mon) << "-"
-      << tmNow->tm_mday << " " << tmNow->tm_hour << ":" << tmNow->tm_min
-      << ":" << tmNow->tm_sec << " ===" << std::endl;
-  
-  // Flush and close output file
-  outps.flush();
-  outps.close();
-  
-  // Flush and close logger
-//  LockinSettings::settingsLogger->flush();
-//  LockinSettings::settingsLogger->close();
-//  delete LockinSettings::settingsLogger;
-}
-
-
-int sweepRepeatLoop(int recursionLevel, std::string prefix, std::ofstream& outps)
-{
-  if(cancelSweep) {
-    logCanceledSweep();
-    return 0;
+  if(!validateSweepParams(false)) {
+    return;
   }
-  
-  // Identify the parameter being swept at the current level
-  int currParam = sweepSetup.parameters[recursionLevel];
-  
-  // Calculate the number of steps, repeats, and wait times for the current parameter
-  int currSteps;
-  if(currParam == SWEEP_CUSTOM){
-    currSteps = numCustom - 1;
-  } else {
-    currSteps = sweepSetup.steps[currParam];
-  }
-  int currRepeats = sweepSetup.repeats[currParam];
-  long currWait = sweepSetup.waits[currParam];
-  
-  // Calculate all the parameter values
-  double *currValues = new double[currSteps + 1];
-  getCurrentValues(currParam, currValues);
-  
-  int exitVal = 1;
-  int initialSens = 0;
-  
-  // Loop over _repeats_
-  for(int r = 0; r < currRepeats; r++) {
-    // Preliminaries: log the sweep level, check if the sweep has been canceled
-    (*LockinSettings::settingsLogger) << "At level " << recursionLevel
-        << " of sweep; starting loop #" << r << std::endl;
-    if(cancelSweep) {
-      logCanceledSweep();
-      return 0;
-    }
-    
-    // Set a pre-determined sensitivty if:
-    //   1. auto-sensitivity is enabled
-    //   2. this is the innermost parameter (where the measurements are made)
-    //   3. this is a repeat of the sweep over the innermost parameter
-    if(
-      sweepSetup.autoSens
-      && recursionLevel == sweepSetup.maxRecursionLevel
-      && r > 0
-    ) {
-      (*LockinSettings::settingsLogger) << "Setting initial sensitivity; r = " << r << std::endl;
-      lockin->set_sensitivity(initialSens);
-    }
-    
-    // Do forward parameter sweep (currStart -> currEnd)
-    int i = 0;
-    exitVal = sweepParameterLoop(
-      recursionLevel,
-      currValues,
-      currSteps + 1,
-      currWait,
-      false,
-      r,
-      i,
-      initialSens,
-      prefix,
-      outps
-    );
-    (*LockinSettings::settingsLogger) << "Forward sweep finished; exitVal = " << exitVal << "; i = " << i << std::endl;
-    if(exitVal == 0) {
-      // Ramp back down to 0 if the sweep is canceled
-      rampDown(recursionLevel, currParam, currValues, i);
-      return 0;
-    }
-    
-    // Do reverse parameter sweep, if enabled
-    if(sweepSetup.bidirectional[currParam]) {
-      exitVal = sweepParameterLoop(
-        recursionLevel,
-        currValues,
-        currSteps + 1,
-        currWait,
-        true,
-        r,
-        i,
-        initialSens,
-        prefix,
-        outps
-      );
-      if(exitVal == 0) {
-        // Ramp back down to 0 if the sweep is canceled
-        rampDown(recursionLevel, currParam, currValues, i);
-        return 0;
-      }
-    }
-    else {
-      // If not a directional sweep, perform the appropriate ramp down
-      i--;
-      rampDown(recursionLevel, currParam, currValues, i);
-    }
-  }
-  
-  delete[] currValues;
-  return 1;
+  std::string dir(szFileName);
+  size_t slash = dir.find_last_of("\\/");
+  sweepQueue.outputDir = (slash == std::string::npos) ? "" : dir.substr(0, slash);
+  long id = sweepQueue.add(sweepConfig(), priority);
+  logger << "Queued sweep as job " << id << " (priority " << priority << ")"
+      << std::endl;
+  startQueue();
 }
 
 
-void getCurrentValues(int currParam, double * currValues)
+void startQueue()
 {
-  double currStart, currEnd;
-  if(sweepSetup.logSpacing[currParam]) {
-    currStart = log10(sweepSetup.starts[currParam]);
-    currEnd   = log10(sweepSetup.ends[currParam]);  
-  } else {
-    currStart = sweepSetup.starts[currParam];
-    currEnd   = sweepSetup.ends[currParam];
-  }
-  
-  int currSteps;
-  if(currParam == SWEEP_CUSTOM){
-    currSteps = numCustom - 1;
-  } else {
-    currSteps = sweepSetup.steps[currParam];
-  }
-  double stepSize = (currEnd - currStart) / currSteps;
-  
-  for(int i = 0; i < currSteps + 1; i++) {
-    double val = currStart + i * stepSize;
-    if(sweepSetup.logSpacing[currParam])
-      currValues[i] = pow(10, val);
-    else
-      currValues[i] = val;
+  if(connReady && cancelSweep && !sweepQueue.isPaused()
+      && sweepQueue.pending() > 0) {
+    cancelSweep = false;
+    bgThreadHandle = CreateThread(NULL, 0, QueueThreadFunction,
+        NULL, 0, NULL);
   }
 }
 
 
-void rampDown(int recursionLevel, int currParam, double * allSteps, int& i)
+DWORD WINAPI QueueThreadFunction( LPVOID lpParam )
 {
-    (*LockinSettings::settingsLogger) << "At level " << recursionLevel
-            << " of sweep; ramping down to initial value." << std::endl;
-    if(currParam == SWEEP_CUSTOM) {
-        if(rampType == 0) {
-            sendCommandToLockin(SWEEP_X, customX[0]);
-            sendCommandToLockin(SWEEP_Y, customY[0]);
-        } else {
-            for(--i; i >= 0; i--) {
-                sendCommandToLockin(SWEEP_X, customX[i]);
-                sendCommandToLockin(SWEEP_Y, customY[i]);
-            }
-        }
-    }
-    else {
-        if(rampType == 0) {
-            sendCommandToLockin(currParam, allSteps[0]);
-        }
-        else if(rampType == 1) {
-            for( --i; i >= 0; i--) {
-                sendCommandToLockin(currParam, allSteps[i]);
-            }
-        }
-        else if(rampType == 2) {
-            double endDecade = log10(allSteps[i]);
-            double startDecade = log10(sweepSetup.starts[currParam]);
-            double decades = abs(endDecade - startDecade);
-            int steps = (int) ceil(STEPS_PER_RAMP_DECADE * decades);
-            double rampStep = (endDecade - startDecade) / steps;
-            for(int m = steps - 1; m >= 0; m--) {
-                double currVal = pow(10, startDecade + rampStep*m);
-                sendCommandToLockin(currParam, currVal);
-            }
-        }
-    }
-    i = 0;
+  int ran = sweepQueue.run(engine, logger);
+  logger << "Sweep queue ran " << ran << " jobs; " << sweepQueue.pending()
+      << " left" << std::endl;
+  cancelSweep = true;
+  validateSweepParams(false);
+  return ran;
 }
 
 
-int sweepParameterLoop(
-  int recursionLevel,
-  double * currValues,
-  int nValues,
-  int currWait,
-  bool reversed,
-  int repeatNum,
-  int &i,
-  int &initialSens,
-  std::string prefix,
-  std::ofstream& outps
-)
+SweepConfig sweepConfig()
 {
-  int currParam = sweepSetup.parameters[recursionLevel];
-  int waitTime = currWait;
-  int exitVal = 1;
-  
-  // Loop over parameter values
-  for(i = 0; i < nValues; i++) {
-    if(cancelSweep) {
-      logCanceledSweep();
-      return 0;
-    }
-    
-    // Command the lockin to set the current parameter to the current value
-    int currIndex;
-    if(reversed)
-      currIndex = nValues - i - 1;
-    else
-      currIndex = i;
-    
-    double currVal = 1;
-    if(currParam == SWEEP_CUSTOM) {
-      sendCommandToLockin(SWEEP_X, customX[currIndex]);
-      sendCommandToLockin(SWEEP_Y, customY[currIndex]);
-    } else {
-      currVal = currValues[currIndex];
-      sendCommandToLockin(currParam, currVal);
-    }
-
-    // AUTOMATICALLY SET THE TIME CONSTANT IF APPLICABLE
-    if(currParam == SWEEP_F && sweepSetup.autoTimeConst) {
-      if(sweepSetAutoTimeConst(currVal, &waitTime) == 0)
-        return 0;
-    }
-    
-    // Wait before proceeding to the measurement step
-    // Note: must wait an additional amount of time on the first step of a sweep
-    if(
-      WaitForSingleObject(
-        cancelSweepEvent, waitTime + ((i == 0) ? FIRST_STEP_WAIT : 0)
-      ) == WAIT_OBJECT_0
-    ) {
-      logCanceledSweep();
-      return 0;
-    }
-
-    // TAKE MEASUREMENT OR PROCEED TO NEXT SWEEP LEVEL
-    if(recursionLevel < sweepSetup.maxRecursionLevel) {
-      std::ostringstream prefixTmp;
-      if(currParam == SWEEP_CUSTOM) {
-        prefixTmp << prefix << customX[i] << "\t" << customY[i] << "\t";
-      } else {
-        prefixTmp << prefix << currVal << "\t";
-      }
-      exitVal = sweepRepeatLoop(recursionLevel + 1, prefixTmp.str(), outps);
-      if(exitVal == 0)
-        return 0;
-    }
-    else {
-      double ampl = 0;
-      double phs = 0;
-      double stdDev = 0;
-      
-      if(
-        sweepDoMeasurement(
-          &ampl, &phs, waitTime, repeatNum, i, initialSens, prefix, currVal
-        ) == 0
-      )
-        return 0;
-      if(averaging) {
-        sweepDoAveraging(ampl, phs, &ampl, &phs, &stdDev);
-      }
-      
-      if(currParam == SWEEP_CUSTOM) {
-        outps << prefix << customX[i] << '\t' << customY[i];
-      } else {
-        outps << prefix << currVal;
-      }
-      sweepWriteMeasurement(outps, prefix, ampl, phs, stdDev);
-      if(i % 10 == 0) {
-        outps.flush();
-      }
-    }
+  SweepConfig config;
+  config.setup = sweepSetup;
+  if(numCustom > 0) {
+    config.customX.assign(customX, customX + numCustom);
+    config.customY.assign(customY, customY + numCustom);
   }
-    return 1;
+  config.fileName = szFileName;
+  config.binaryOutput = binaryOutput;
+  config.averaging = averaging;
+  config.numAvgPts = numAvgPts;
+  config.bufferedAveraging = bufferedAveraging;
+  config.avgSampleRate = avgSampleRate;
+  config.avgTargetError = avgTargetError;
+  config.avgMinPts = avgMinPts;
+  config.avgRejectOutliers = avgRejectOutliers;
+  config.rampType = rampType;
+  config.holdOnCancel = holdOnCancel;
+  config.orderTimeConsts = orderTimeConsts;
+  config.refineTolerance = refineTolerance;
+  config.refinePhaseStep = refinePhaseStep;
+  config.refineMaxPoints = refineMaxPoints;
+  config.settleMode = settleMode;
+  config.settleTolerance = settleTolerance;
+  return config;
 }
 
 
-int sweepDoMeasurement(
-    double *ampl,
-    double *phs,
-    int waitTime,
-    int r,
-    int i,
-    int& initialSens,
-    std::string prefix,
-    double currVal
-)
+bool applySweepConfig(const SweepConfig& config)
 {
-    lockin->get_AmplPhase(*ampl, *phs);
-    int ct = 0;
-    int currSens = lockin->get_sensitivity();
-    while(
-        sweepSetup.autoSens
-        && outOfRange(*ampl, currSens)
-        && ct < 10
-    ) {
-        int sens = getBestSens(*ampl, currSens);
-        lockin->set_sensitivity(sens);
-        if(WaitForSingleObject(cancelSweepEvent, waitTime) == WAIT_OBJECT_0) {
-            logCanceledSweep();
-            return 0;
-        }
-        lockin->get_AmplPhase(*ampl, *phs);
-        currSens = lockin->get_sensitivity();
-        ct++;
-    }
-    
-    if(ct == 10 && outOfRange(*ampl, lockin->get_sensitivity())) {
-        // Sensitivity is invalid
-        
-        (*LockinSettings::settingsLogger) << "Unable to determine appropriate sensitivity for "
-                << prefix << currVal << std::endl;
-    } else {
-        // Sensitivity is valid
-        
-        if(r == 0 && i == 0) {
-            // Store this sensitivity so we can set it as a start value on
-            // subsequent repeats of this parameter
-            initialSens = lockin->get_sensitivity();
-        }
-    }
-    return 1;
-}
-
-
-double getTauReq(double freq, int filtSlope)
-{
-  double tau_2f = pow(2, ATTEN_2F / getFiltSlopeValue(filtSlope)) / (4 * M_PI * freq);
-  double tau_1f = pow(
-    2,
-    (sweepSetup.signalToDC + ATTEN_2F) / getFiltSlopeValue(filtSlope)
-  ) / (2 * M_PI * freq);
-  double tau_req;
-  if(sweepSetup.ac_couple) {
-    // ac-coupled input
-    return tau_2f;
-  }
-  else {
-    return fmax(tau_1f, tau_2f);
+  if(config.fileName.size() >= MAX_PATH) {
+    return false;
   }
-}
-
-
-int sweepSetAutoTimeConst(double currFreq, int *waitTime)
-{
-  int filtSlope = lockin->settings.get("Low Pass Filter Slope").intVal1;
-  double tau_req = getTauReq(currFreq, filtSlope);
-  int currTimeConst = lockin->settings.get("Time Constant").intVal1;
-  int newTimeConst = getTimeConst(tau_req);
-  
-  if(newTimeConst != currTimeConst) {
-    // The current setting for the time constant is not correct. Update
-    // the lockin settings accordingly.
-    lockin->settings.set(lockin->address, "Time Constant", newTimeConst);
-    if(WaitForSingleObject(cancelSweepEvent, FIRST_STEP_WAIT) == WAIT_OBJECT_0) {
-        logCanceledSweep();
-        return 0;
-    }
+  strcpy(szFileName, config.fileName.c_str());
+  sweepSetup = config.setup;
+  if(!config.customX.empty()) {
+    numCustom = config.customX.size();
+    customX = new double[numCustom];
+    customY = new double[numCustom];
+    std::copy(config.customX.begin(), config.customX.end(), customX);
+    std::copy(config.customY.begin(), config.customY.end(), customY);
   }
-  *waitTime = getWaitFactor(filtSlope)*getTimeConstValue(newTimeConst)*1000;
-  return 1;
-}
-
-void sweepWriteMeasurement(
-    std::ofstream& outps, std::string prefix, double ampl, double phs, double stdDev
-)
-{
-    // WRITE MEASURED VALUE TO OUTPUT STREAM
-    outps << '\t' << ampl;
-
-    if(lockin->isPhaseAccessible()) {
-        outps << '\t' << phs;
-    }
-
-    if(averaging) {
-        outps << '\t' << stdDev;
-    }
-    
-    outps<<std::endl;
+  binaryOutput = config.binaryOutput;
+  averaging = config.averaging;
+  numAvgPts = config.numAvgPts;
+  bufferedAveraging = config.bufferedAveraging;
+  avgSampleRate = config.avgSampleRate;
+  avgTargetError = config.avgTargetError;
+  avgMinPts = config.avgMinPts;
+  avgRejectOutliers = config.avgRejectOutliers;
+  rampType = config.rampType;
+  holdOnCancel = config.holdOnCancel;
+  orderTimeConsts = config.orderTimeConsts;
+  refineTolerance = config.refineTolerance;
+  refinePhaseStep = config.refinePhaseStep;
+  refineMaxPoints = config.refineMaxPoints;
+  settleMode = config.settleMode;
+  settleTolerance = config.settleTolerance;
+  return true;
 }
 
 
-void sweepDoAveraging(
-  double ampl0, double phs0, double *ampl, double *phs, double *stdDev
-)
+void sweepShowProgress(double fraction, double remainingMs)
 {
-  double* re = new double[numAvgPts];
-  double* im = new double[numAvgPts];
-  
-  // Store the existing measurement
-  re[0] = ampl0*cos(M_PI*phs0/180);
-  im[0] = ampl0*sin(M_PI*phs0/180);
-
-  // Take repeated measurements, convert to complex numbers and store,
-  // and update the sum.
-  double reTot = re[0];
-  double imTot = im[0];
-  double ampl_tmp, phs_tmp;
-  for(int m = 1; m < numAvgPts; m++) {
-    lockin->get_AmplPhase(ampl_tmp, phs_tmp);
-    re[m] = ampl_tmp * cos(M_PI * phs_tmp / 180);
-    im[m] = ampl_tmp * sin(M_PI * phs_tmp / 180);
-    reTot += re[m];
-    imTot += im[m];
-  }
-  
-  // Compute the average: (sum)/(count)
-  reTot /= numAvgPts;
-  imTot /= numAvgPts;
-  
-  // Compute the variance: E[ (x-u)(x-u)* ]
-  double varianceTot = 0;
-  for(int m = 0; m < numAvgPts; m++) {
-    double R = re[m] - reTot;
-    double I = im[m] - imTot;
-    varianceTot += R*R + I*I;
+  long left = (long) (remainingMs / 1000);
+  std::ostringstream desc;
+  desc << ((connReady)?"GPIB Ready\r\n":"GPIB Disconnected!\r\n");
+  desc << "Sweeping... " << (int) (100 * fraction) << "% done";
+  size_t queued = sweepQueue.pending();
+  if(queued > 0) {
+    desc << " (" << queued << " queued)";
   }
-  varianceTot /= numAvgPts;
-  
-  // Compute the standard deviation: the square root of the variance
-  *stdDev = sqrt(varianceTot);
-  
-  // Convert the average value back to (amplitude-phase) form
-  *ampl = sqrt(reTot*reTot + imTot*imTot);
-  *phs  = 180 * atan2(imTot, reTot) / M_PI;
-  
-  // Clean up the dynamically allocated array.
-  delete[] re;
-  delete[] im;
+  desc << "\r\n";
+  desc << "About " << left / 3600 << "hr " << (left % 3600) / 60 << "min "
+      << left % 60 << "s left";
+  SetWindowText(GetDlgItem(hwnd, LTEXT_SUMMARY), desc.str().c_str());
 }
 
 
@@ -1836,127 +1620,52 @@ LRESULT CALLBACK SignalDCDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM
 }
 
 
-int sweep()
-{
-  // Initialize output
-  std::ofstream outps;
-  sweepInitOutput(outps);
-  std::string prefix;
-
-  // Store initial settings so they can be reset
-  int initialSens0 = lockin->get_sensitivity();
-  int initialTC0 = lockin->get_time_constant();
-  int initialCoupling = lockin->settings.get("Input Coupling").intVal1;
-
-  // Setup lockin
-  lockin->set_harmonic(sweepSetup.detHarm);
-  if(sweepSetup.ac_couple) {
-    lockin->AC_couple();
-  }
-  else {
-    lockin->DC_couple();
-  }
-
-  // Do the parametric sweep
-  int exitVal = sweepRepeatLoop(0, prefix, outps);
-
-  // Cleanup
-  sweepFinalizeOutput(outps);
-  if(initialCoupling == 0) {
-    lockin->AC_couple();
-  }
-  else {
-    lockin->DC_couple();
-  }
-  if(sweepSetup.autoSens)
-    lockin->set_sensitivity(initialSens0);
-  if(sweepSetup.autoTimeConst)
-    lockin->set_time_constant(initialTC0);
-
-  // Finish
-  cancelSweep = true;
-  return exitVal;
-}
-
-
-/*
- * Log that a sweep was canceled and the time of cancellation
- */
-void logCanceledSweep()
+LRESULT CALLBACK SettleDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM lParam)
 {
-  time_t now = time(0);
-  struct tm* tmNow = localtime(&now);
-  (*LockinSettings::settingsLogger) << std::endl << "=== SWEEP CANCELED at " 
-      << (1900 + tmNow->tm_year) << "-" << (1 + tmNow->tm_mon) << "-"
-      << tmNow->tm_mday << " " << tmNow->tm_hour << ":" << tmNow->tm_min
-      << ":" << tmNow->tm_sec << " ===" << std::endl;
-}
-
-
-void sendCommandToLockin(int currParam, double currVal)
-{
-  switch(currParam) {
-    case SWEEP_F:
-      lockin->set_frequency(currVal);
-    break;
-    case SWEEP_X:
-      lockin->set_auxout1(currVal);
-    break;
-    case SWEEP_Y:
-      lockin->set_auxout2(currVal);
-    break;
-    case SWEEP_A:
-      lockin->set_reference_amplitude(currVal);
-    break;
-  }
-}
-
-long calculateSweepDuration()
-{
-  long millis = 0;
-  for(int i = numActiveParams-1; i >= 0; i--) {
-    if(sweepSetup.parameters[i] == SWEEP_CUSTOM) {
-      millis += sweepSetup.waits[sweepSetup.parameters[i]];
-      millis *= numCustom;
+  HWND ctrl = GetDlgItem(hwnd, LTEXT_SETTLE_TOL);
+  char content[80];
+  switch(Message) {
+    case WM_INITDIALOG: {
+      bool converge = settleMode == SETTLE_CONVERGE;
+      CheckDlgButton(hwnd, BTN_SETTLE_MODEL, converge ? BST_UNCHECKED : BST_CHECKED);
+      CheckDlgButton(hwnd, BTN_SETTLE_CONVERGE, converge ? BST_CHECKED : BST_UNCHECKED);
+      snprintf(content, 80, "%g", settleTolerance);
+      SetWindowText(ctrl, content);
+      return TRUE;
     }
-    else {
-      if(sweepSetup.parameters[i] == SWEEP_F && sweepSetup.autoTimeConst) {
-        // Multiply the time for each sub-sweep by the number of steps at the
-        // current sweep level
-        millis *= sweepSetup.steps[sweepSetup.parameters[i]] + 1;
-        
-        // Calculate wait times for variable time constant
-        double * currValues = new double[sweepSetup.steps[SWEEP_F] + 1];
-        getCurrentValues(SWEEP_F, currValues);
-        
-        // Add up all the wait times for the steps at the current level
-        int lastTimeConst = -1;
-        for(int j = 0; j <= sweepSetup.steps[SWEEP_F]; j++) {
-          double tau_req = getTauReq(currValues[j], filterType);
-          int newTimeConst = getTimeConst(tau_req);
-          if(lastTimeConst != -1 && newTimeConst != lastTimeConst)
-            millis += FIRST_STEP_WAIT;
-          millis += getWaitFactor(filterType)*getTimeConstValue(newTimeConst)*1000;
-          lastTimeConst = newTimeConst;
+    case WM_COMMAND: {
+      switch(LOWORD(wParam)) {
+        case BTN_SETTLE_MODEL:
+        case BTN_SETTLE_CONVERGE: {
+          bool converge = LOWORD(wParam) == BTN_SETTLE_CONVERGE;
+          CheckDlgButton(hwnd, BTN_SETTLE_MODEL, converge ? BST_UNCHECKED : BST_CHECKED);
+          CheckDlgButton(hwnd, BTN_SETTLE_CONVERGE, converge ? BST_CHECKED : BST_UNCHECKED);
+          return TRUE;
         }
-        delete[] currValues;
-      }
-      else {
-        millis += sweepSetup.waits[sweepSetup.parameters[i]];
-        millis *= sweepSetup.steps[sweepSetup.parameters[i]] + 1;
+        case IDOK: {
+          double tol;
+          GetWindowText(ctrl, content, 80);
+          if(str2dbl(tol, content) != CONV_SUCCESS || tol <= 0) {
+            return FALSE;
+          }
+          settleTolerance = tol;
+          settleMode = IsDlgButtonChecked(hwnd, BTN_SETTLE_CONVERGE)
+              ? SETTLE_CONVERGE : SETTLE_MODEL;
+          EndDialog(hwnd, IDOK);
+          return TRUE;
+        }
+        case IDCANCEL: {
+          EndDialog(hwnd, IDCANCEL);
+          return TRUE;
+        }
+        default: return FALSE;
       }
     }
-    millis += FIRST_STEP_WAIT;
-    millis *= sweepSetup.repeats[sweepSetup.parameters[i]];
-  
-    if(sweepSetup.bidirectional[sweepSetup.parameters[i]]) {
-      millis *= 2.0;
-    }
+    default: return FALSE;
   }
-  
-  return millis;
 }
 
+
 void populateTree(HWND tree)
 {
   HTREEITEM parent;
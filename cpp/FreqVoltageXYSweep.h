@@ -5,7 +5,7 @@
 //
 // Author:   Connor D. Pierce
 // Created:  2018-02-02
-// Modified: 2023-04-05 21:30:11
+// Modified: 2026-10-17 01:12:47
 //
 // Copyright (C) 2018-2023 Connor D. Pierce
 //
@@ -44,18 +44,23 @@
 #include <cmath>
 #include <ctime>
 #include <fstream>
+#include <map>
+#include <vector>
+#include <algorithm>
 
 #include "resource.h"
+#include "AsyncLogger.h"
 #include "SR830.h"
+#include "SweepEngine.h"
+#include "SweepQueue.h"
 
 
 ///////////////////////////////////// DEFINES //////////////////////////////////////////
 
-#define ATTEN_2F -80
-#define SIGNAL_TO_DC -40
-#define FIRST_STEP_WAIT 2000
 #define LOG10_3 0.477121
-#define STEPS_PER_RAMP_DECADE 25
+
+// Sweeps queued to run back to back, kept across restarts
+#define SWEEP_QUEUE_FILE "sweep_queue.txt"
 
 
 ///////////////////////////////////// CONSTANTS ////////////////////////////////////////
@@ -69,69 +74,6 @@ const char FVXY_version[] = SOFTWARE_NAME_VERSION;
 
 //////////////////////////////////// STRUCTS ///////////////////////////////////////////
 
-/*
- * struct SweepParameters
- *
- * This data structure defines the data that is needed to perform a sweep
- * across N variables. This structure describes the dimensionality, nesting
- * order, repetition, wait times, and ranges for a multi-parameter sweep.
- *
- * Fields:
- *   parameters - int array of size N. This parameter describes the nesting of
- *       the sweeps. parameters[0] contains an identifier for the parameter to
- *       be controlled in the top-level sweep. parameters[1] contains an
- *       identifier for the parameter to be controlled in the second-level
- *       sweep; that is, a full sweep of parameters[1] will be made for each
- *       value of parameters[0] in the top level of the sweep
- *   maxRecursionLevel - integer describing the size of parameters, identifying
- *       the number of parameters to be swept, and therefore the number of
- *       levels of recursion of the sweep
- *   starts - array with size equal to size(parameters). starts[i] gives the
- *       starting value for the i^th level of the sweep
- *   ends - array with size equal to size(parameters). ends[i] gives the final
- *       value for the i^th level of the sweep
- *   steps - array with size equal to size(parameters). steps[i] gives the
- *       number of steps between starts[i] and ends[i]. Note that a sweep with
- *       N steps will include N+1 points, in order to include the endpoints
- *   repeats - array with size equal to size(parameters). repeats[i] gives the
- *       number of times to repeat the i^th level of the sweep
- *   waits - array with size equal to size(parameters). waits[i] gives the
- *       number of milliseconds to wait after setting the value for the i^th
- *       parameter in the sweep. If i denotes the innermost level of the sweep,
- *       the program will wait for a period of waits[i] before measuring the
- *       response of the vibrometer. If i denotes a level which is not the
- *       innermost level of the sweep, the program will wait for a period of
- *       waits[i] before entering the (i+1)^th level of the sweep
- *   autoTimeConst - if true, allow the program to automatically adjust the time
- *       constant to be appropriate for the frequency being studied. This value
- *       will have no effect unless parameters[i] = SWEEP_F for some i.
- *   autoSens - allow the program to automatically adjust the lockin sensitivity
- *       to adjust to signal magnitudes which have a functional dependence on
- *       the sweep parameters.
- *   detHarm - detection harmonic, for example, if detHarm=2, the lockin will
- *       excite a frequency f and measure the signal component at 2f
- *   logSpacing - true to specify logarithmicly-spaced sweep values, false to
- *       specify linearly-spaced sweep values. ADDED IN V1.0.9. As of V1.0.9,
- *       only amplitude and frequency can be log-spaced.
- */
-struct SweepParameters {
-  bool ac_couple;
-  bool autoSens;
-  bool autoTimeConst;
-  bool bidirectional[NUM_AVAIL_PARAMS];
-  int detHarm;
-  double ends[NUM_AVAIL_PARAMS];
-  bool logSpacing[NUM_AVAIL_PARAMS];
-  int maxRecursionLevel;
-  int parameters[NUM_AVAIL_PARAMS];
-  int repeats[NUM_AVAIL_PARAMS];
-  double signalToDC;
-  double starts[NUM_AVAIL_PARAMS];
-  int steps[NUM_AVAIL_PARAMS];
-  long waits[NUM_AVAIL_PARAMS];
-};
-
-
 enum STRCONV_ERROR {
   CONV_SUCCESS,
   CONV_OVERFLOW,
@@ -148,11 +90,24 @@ bool activeParams[] = {false, false, true, true, false};
 
 bool averaging = false;
 
+// Averaging stops once the standard error of the mean is below avgTargetError
+// percent of its amplitude, after at least avgMinPts samples; with 0 it
+// always takes numAvgPts, which is otherwise the most samples it takes
+double avgTargetError = 0;
+
+int avgMinPts = 5;
+
+bool avgRejectOutliers = false;
+
+int avgSampleRate = 9;
+
 HANDLE bgThreadHandle = NULL, gpibCheckerHandle = NULL;
 
-volatile bool cancelSweep = true;
+bool binaryOutput = false;
 
-const HANDLE cancelSweepEvent = CreateEvent(NULL, TRUE, FALSE, "CancelSweepEvent");
+bool bufferedAveraging = false;
+
+volatile bool cancelSweep = true;
 
 volatile bool connReady = false;
 
@@ -164,7 +119,13 @@ double* customX;
 
 double* customY;
 
-int filterType = 3;
+// Leave the swept parameters where they are when a sweep is canceled, so
+// that it can be resumed without ramping back up
+bool holdOnCancel = false;
+
+// Order frequency points by the time constant they need, and keep a longer
+// time constant when lowering it would not pay off (see TimeConstOrder)
+bool orderTimeConsts = false;
 
 GPIBInterface *gpibInterface = NULL;
 
@@ -172,7 +133,14 @@ HWND hwnd;
 
 SR830 *lockin = NULL; 
 
-std::ofstream logger("log.txt");
+AsyncLogger logger("log.txt");
+
+// Runs the sweeps; the globals here are only the sweep being edited, copied
+// into engine.config when a sweep starts (see sweepConfig)
+SweepEngine engine(logger);
+
+// Sweeps waiting to run on engine, each with its own copy of the sweep
+SweepQueue sweepQueue;
 
 Addr4882_t nstrmnts[31], rslt[31];
 
@@ -182,19 +150,35 @@ int numAvgPts = 10;
 
 int numCustom;
 
-OPENFILENAME ofn;
+OPENFILENAME ofn, ofnJournal;
 
 const HANDLE quitGpibCheckerEvent = CreateEvent(NULL, TRUE, FALSE,
     "QuitGpibCheckerEvent");
 
-int rampType = 1;
+int rampType = RAMP_ALL;
+
+// Adaptive refinement: tolerance in percent of the largest amplitude of a
+// pass, largest phase step in degrees, and most points in a refined pass
+double refineTolerance = 1;
+
+double refinePhaseStep = 10;
+
+int refineMaxPoints = 400;
 
 bool settingCustomSweep = FALSE;
 
+// How to wait after setting a point (see SettleMode), and the settling
+// tolerance in percent
+int settleMode = SETTLE_FIXED;
+
+double settleTolerance = 1;
+
 SweepParameters sweepSetup;
 
 char szFileName[MAX_PATH] = "";
 
+char szJournalName[MAX_PATH] = "";
+
 
 /////////////////////////////////// FUNCTIONS //////////////////////////////////////////
 
@@ -259,7 +243,30 @@ STRCONV_ERROR str2dbl (double &d, char const *s) {
 LRESULT CALLBACK AveragingDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM lParam);
 
 
-long calculateSweepDuration();
+LRESULT CALLBACK RefineDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM lParam);
+
+
+LRESULT CALLBACK SlewDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM lParam);
+
+
+/*
+ * Snapshot of the sweep being edited, to hand to the engine.
+ */
+SweepConfig sweepConfig();
+
+
+/*
+ * Make `config` (as loaded from a journal) the sweep being edited. Returns
+ * false if its output file name does not fit szFileName.
+ */
+bool applySweepConfig(const SweepConfig& config);
+
+
+/*
+ * Show the progress of the running sweep in the summary: the fraction done
+ * and the time left (ms).
+ */
+void sweepShowProgress(double fraction, double remainingMs);
 
 
 DWORD WINAPI connectToAmp(LPVOID lpParam);
@@ -286,12 +293,6 @@ LRESULT CALLBACK DetHarmDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM l
 bool enableCustomSweep(bool useXY);
 
 
-/*
- * Get the most appropriate lockin sensitivity for the given voltage.
- */
-int getBestSens(double ampl, int currSens);
-
-
 /*
  * Gets the Win32 identifiers for the controls corresponding to the parameter
  * identified by param. The values are stored in the array IDs, which should be
@@ -310,173 +311,39 @@ int getBestSens(double ampl, int currSens);
 void getControlIDs(uintptr_t* IDs, int param);
 
 
-void getCurrentValues(int currParam, double * currValues);
-
-
 bool getCustomXYValues(double &x, double &y);
 
 
-/*
- * Get the value (in volts) of the sensitivity given by the index i.
- *
- * See LockinSettings.cpp for valid indices and the values of the sensitivity to which
- * they correspond.
- */
-double getSensValue(int i);
-
-
-/*
- * Get the minimum required time constant.
- *
- * The time constant is computed for the given frequency and filter slope, assuming the
- * lockin input coupling is set by sweepSetup.ac_couple.
- */
-double getTauReq(double freq, int filtSlope);
-
-/*
- * Get the smallest available time constant setting that is larger than reqTau.
- */
-int getTimeConst(double reqTau);
-
-
-/*
- * Returns the double-precision value representing the value of the time 
- * constant given by the index i. See LockinSettings.cpp for valid indices and
- * the values of the time constant to which they correspond. Returned value is
- * in seconds.
- */
-double getTimeConstValue(int i);
-
-
-/*
- * Returns the double-precision value representing the slope of the low-pass
- * filter given by the index i. See LockinSettings.cpp for valid indices and the
- * values of the filter slope to which they correspond. Returned value is in
- * dB/octet and is signed, i.e. a filter with roll-off of 18 dB/octet will be
- * represented by -18.0.
- */
-double getFiltSlopeValue(int i);
-
-
-/*
- * Returns the multiplier which relates the wait time to the time constant
- * that is appropriate for the indicated slope of the low-pass filter.
- */
-double getWaitFactor(int filtSlope);
-
-
-void logCanceledSweep();
-
-
 void populateTree(HWND tree);
 
 
-/*
- * Determines whether the given voltage `ampl` is out of range for the lockin
- * sensitivity `sens`.
- */
-bool outOfRange(double ampl, int sens);
-
-
-/*
- * Ramp the current parameter down from its current value to its initial value.
- *
- * @param recursionLevel - the level of the parametric sweep
- * @param currParam - the parameter at the current sweep level
- * @param allSteps - the array of values for the current sweep level
- * @param i - the currently-active value in the sweep
- */
-void rampDown(int recursionLevel, int currParam, double * allSteps, int& i);
-
-
-void sendCommandToLockin(int currParam, double currVal);
-
-
 /*
  * Callback function for the signal-to-dc dialog box.
  */
 LRESULT CALLBACK SignalDCDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM lParam);
 
 
-/*
- * Run a parametric sweep
- */
-int sweep();
-
-
-/*
- * Get the average value and standard deviation over multiple repeated measurements.
- */
-void sweepDoAveraging(
-  double ampl0, double phs0, double *ampl, double *phs, double *stdDev
-);
-
-
-/*
- * Record measured value to file.
- */
-void sweepWriteMeasurement(
-  std::ofstream& outps, std::string prefix, double ampl, double phs, double stdDev
-);
+LRESULT CALLBACK SettleDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM lParam);
 
 
-/*
- * Take a measurement with the lock-in amplifier and verify the sensitivity setting.
- */
-int sweepDoMeasurement(
-  double *ampl,
-  double *phs,
-  int waitTime,
-  int r,
-  int i,
-  int &initialSens,
-  std::string prefix,
-  double currVal
-);
-
-
-/*
- * Initialize output file and logging at the beginning of a sweep.
- */
-void sweepInitOutput(std::ofstream& outps);
-
-
-/*
- * Log the end time of the sweep and flush the output and settings files.
- */
-void sweepFinalizeOutput(std::ofstream& outps);
-
-
-/*
- * Parameter values loop for a single level of the multi-level sweep.
- */
-int sweepParameterLoop(
-  int recursionLevel,
-  double * currValues,
-  int nValues,
-  int currWait,
-  bool reversed,
-  int repeatNum,
-  int &i,
-  int &initialSens,
-  std::string prefix,
-  std::ofstream& outps
-);
+DWORD WINAPI SweepThreadFunction( LPVOID lpParam );
 
 
 /*
- * "Repeats" loop for a single level of the multi-level sweep
+ * Queue the sweep being edited at `priority`, with its output next to
+ * szFileName, and start the queue.
  */
-int sweepRepeatLoop(int recursionLevel, std::string prefix, std::ofstream& outps);
+void queueSweep(int priority);
 
 
 /*
- * Calculate and set the minimum time constant for the given frequency.
+ * Run the queued sweeps on a background thread, unless a sweep is running or
+ * the queue is paused.
  */
-int sweepSetAutoTimeConst(double currFreq, int *waitTime);
+void startQueue();
 
 
-DWORD WINAPI SweepThreadFunction( LPVOID lpParam );
+DWORD WINAPI QueueThreadFunction( LPVOID lpParam );
 
 
 bool storeCustomXYPoint();
@@ -5,7 +5,7 @@
 //
 // Author:   Connor D. Pierce
 // Created:  2018-02-02
-// Modified: 2023-04-05 21:31:36
+// Modified: 2026-10-17 05:44:51
 //
 // Copyright (C) 2018-2023 Connor D. Pierce
 //
@@ -32,17 +32,58 @@
 
 #include "GPIB.h"
 
+#include <cctype>
+
+
+// ===== Method Implementation for class BusArbiter ============================
+
+void BusArbiter::lock()
+{
+  std::unique_lock<std::mutex> guard(mutex);
+  unsigned long ticket = nextTicket++;
+  turnChanged.wait(guard, [this, ticket] { return serving == ticket; });
+}
+
+
+void BusArbiter::unlock()
+{
+  std::lock_guard<std::mutex> guard(mutex);
+  serving++;
+  turnChanged.notify_all();
+}
+
+
+// ===== Method Implementation for class GPIBInterface =========================
+
+GPIBInterface::SyncTurn::SyncTurn(GPIBInterface* gpib)
+{
+  this->gpib = gpib;
+  {
+    std::unique_lock<std::mutex> lock(gpib->queueMutex);
+    gpib->waitForQueue(lock);
+  }
+  gpib->bus.lock();
+}
+
+
+GPIBInterface::SyncTurn::~SyncTurn()
+{
+  gpib->bus.unlock();
+}
+
 
 GPIBInterface::GPIBInterface(int idd)
 {
   id = idd;
+  stopping = false;
+  asyncErrors = 0;
   char buffer[BUF_SIZE];
   int i; //the number of listeners on the bus
   unsigned short address; //the address of a listener
 
   SendIFC(id);
   //check for an error
-  if(ibsta & ERR) {
+  if(ThreadIbsta() & ERR) {
     gpib_error(1, "GPIB-Interface: Could not send IFC");
     throw DisconnectedException("GPIB disconnected; error in SendIFC");
   }
@@ -55,12 +96,12 @@ GPIBInterface::GPIBInterface(int idd)
   FindLstn(id, instruments, result, NUM_DEVICES);
 
   //check for error
-  if(ibsta & ERR) {
+  if(ThreadIbsta() & ERR) {
     gpib_error(2, "GPIB-Interface: Could not find listeners");
     throw DisconnectedException("GPIB disconnected; error in FindLstn");
   }
 
-  num_listeners = ibcnt;
+  num_listeners = ThreadIbcnt();
   result[num_listeners] = NOADDR;
 
   std::cout << "GPIB-Interface: Found " << num_listeners << " GPIB devices." << std::endl;
@@ -76,7 +117,7 @@ GPIBInterface::GPIBInterface(int idd)
 
   SendList(id, result, sIDN, 5L, NLend);
 
-  if (ibsta & ERR) {
+  if (ThreadIbsta() & ERR) {
     gpib_error(3, "GPIB-Interface: Could not send *IDN? to devices");
   }
 
@@ -85,20 +126,99 @@ GPIBInterface::GPIBInterface(int idd)
   for(int i = 0; i < num_listeners; i++) {
     Receive(id, result[i], buffer, BUF_SIZE, STOPend);
 
-    if(ibsta & ERR) {
+    if(ThreadIbsta() & ERR) {
       gpib_error(4, "GPIB-Interface: Could not receive from device");
     }
 
     address = GetPAD(result[i]);
 
-    buffer[ibcnt] = '\0';
+    buffer[ThreadIbcnt()] = '\0';
     
     strcpy(deviceDesc, buffer);
+    deviceDescs[i] = buffer;
+    while(!deviceDescs[i].empty() && isspace((unsigned char) *deviceDescs[i].rbegin())) {
+      deviceDescs[i].erase(deviceDescs[i].size() - 1);
+    }
 
     //Now output the results
-    std::cout << ibcnt << std::endl;
     std::cout << "#" << i+1 << " ADDRESS: " <<  address << " ID: " << buffer;
   }
+
+  // Start the worker only once the bus is known to be good, so that a
+  // failed connection never leaves a running thread behind
+  worker = std::thread(&GPIBInterface::workerLoop, this);
+}
+
+
+GPIBInterface::~GPIBInterface()
+{
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stopping = true;
+  }
+  queueChanged.notify_all();
+  if(worker.joinable()) {
+    worker.join();
+  }
+}
+
+
+void GPIBInterface::workerLoop()
+{
+  char buffer[BUF_SIZE];
+  std::unique_lock<std::mutex> lock(queueMutex);
+  while(true) {
+    queueChanged.wait(lock, [this] { return stopping || !queue.empty(); });
+    if(queue.empty()) {
+      // Stopping, and everything already queued has been sent
+      break;
+    }
+    QueuedCommand item = std::move(queue.front());
+    queue.pop_front();
+    lock.unlock();
+
+    bool failed;
+    {
+      std::lock_guard<BusArbiter> turn(bus);
+      Send(id, item.address, item.command.c_str(), item.command.size(), NLend);
+      failed = (ThreadIbsta() & ERR) != 0;
+      if(item.query) {
+        if(!failed) {
+          Receive(id, item.address, buffer, BUF_SIZE - 1, STOPend);
+          failed = (ThreadIbsta() & ERR) != 0;
+        }
+        buffer[failed ? 0 : ThreadIbcnt()] = '\0';
+      }
+    }
+    if(item.query) {
+      item.response.set_value(std::string(buffer));
+    }
+    if(failed) {
+      std::cout << "GPIB-Interface: queued command failed: " << item.command << std::endl;
+    }
+
+    lock.lock();
+    if(--pending[item.owner] == 0) {
+      pending.erase(item.owner);
+    }
+    if(failed) {
+      asyncErrors++;
+      asyncErrorsAt[item.address]++;
+    }
+    queueChanged.notify_all();
+  }
+}
+
+
+/*
+ * Queue the calling thread's batch, and wait until every command the thread
+ * queued has been sent. Must be called with queueMutex held, in `lock`.
+ */
+void GPIBInterface::waitForQueue(std::unique_lock<std::mutex>& lock)
+{
+  queueBatch();
+  std::thread::id self = std::this_thread::get_id();
+  queueChanged.wait(lock, [this, self] { return pending.count(self) == 0; });
 }
 
 
@@ -109,6 +229,41 @@ void GPIBInterface::getDeviceDesc(char* buffer, int len)
 }
 
 
+void GPIBInterface::getDeviceDesc(Addr4882_t address, char* buffer, int len)
+{
+  buffer[0] = '\0';
+  for(int i = 0; i < num_listeners; i++) {
+    if(result[i] == address) {
+      strncpy(buffer, deviceDescs[i].c_str(), len);
+      buffer[len-1] = '\0';
+    }
+  }
+}
+
+
+int GPIBInterface::listenerCount()
+{
+  return num_listeners;
+}
+
+
+Addr4882_t GPIBInterface::listenerAddress(int k)
+{
+  return (k >= 0 && k < num_listeners) ? result[k] : NOADDR;
+}
+
+
+Addr4882_t GPIBInterface::findListener(const char* model)
+{
+  for(int i = 0; i < num_listeners; i++) {
+    if(deviceDescs[i].find(model) != std::string::npos) {
+      return result[i];
+    }
+  }
+  return NOADDR;
+}
+
+
 Addr4882_t GPIBInterface::DeviceAddress(unsigned short GPIBaddress)
 {
   for(int i=0;i<num_listeners;i++) {
@@ -123,48 +278,289 @@ Addr4882_t GPIBInterface::DeviceAddress(unsigned short GPIBaddress)
 
 void GPIBInterface::disconnect_gpib()
 {
-  ibonl(0,0);
+  ibonl(id,0);
 }
 
 
 void GPIBInterface::send_command(Addr4882_t address, char *command)
 {
+  SyncTurn turn(this);
   Send(id, address, command, strlen(command), NLend);
 }
 
 
-double GPIBInterface::numerical_response_command(Addr4882_t address, char *command)
+int parseNumberList(const char* begin, const char* end, double* values, int maxValues)
+{
+  int n = 0;
+  const char* p = begin;
+  while(n < maxValues) {
+    while(p < end && (*p == ' ' || *p == '+')) p++;
+    std::from_chars_result r = std::from_chars(p, end, values[n]);
+    if(r.ec != std::errc()) {
+      break;
+    }
+    n++;
+    p = r.ptr;
+    if(p == end || *p != ',') {
+      break;
+    }
+    p++;
+  }
+  return n;
+}
+
+
+/*
+ * Send a query and read the response into rxBuffer, null-terminated. Returns
+ * the length of the response. Must be called during a SyncTurn.
+ */
+int GPIBInterface::query(Addr4882_t address, const char* command)
 {
-  char *result = new char[1024];
   Send(id, address, command, strlen(command), NLend);
-  Receive(id, address, result, 1024, STOPend);
-  result[ibcnt]='\0';
-  double numval = atof(result);
-  delete[] result;
+  Receive(id, address, rxBuffer, BUF_SIZE - 1, STOPend);
+  int len = (ThreadIbsta() & ERR) ? 0 : ThreadIbcnt();
+  rxBuffer[len] = '\0';
+  return len;
+}
+
+
+double GPIBInterface::numerical_response_command(Addr4882_t address, char *command)
+{
+  SyncTurn turn(this);
+  int len = query(address, command);
+  double numval = 0;
+  parseNumberList(rxBuffer, rxBuffer + len, &numval, 1);
   return numval;
 }
 
 
 int GPIBInterface::integer_response_command(Addr4882_t address, char *command)
 {
-  char *result = new char[1024];
-  Send(id, address, command, strlen(command), NLend);
-  Receive(id, address, result, 1024, STOPend);
-  result[ibcnt]='\0';
-  int numval = atoi(result);
-  delete[] result;
+  SyncTurn turn(this);
+  int len = query(address, command);
+  const char* start = rxBuffer;
+  while(start < rxBuffer + len && (*start == ' ' || *start == '+')) start++;
+  int numval = 0;
+  std::from_chars(start, rxBuffer + len, numval);
   return numval;
 }
 
 
+int GPIBInterface::numerical_list_response_command(
+  Addr4882_t address, const char* command, double* values, int maxValues
+)
+{
+  SyncTurn turn(this);
+  int len = query(address, command);
+  return parseNumberList(rxBuffer, rxBuffer + len, values, maxValues);
+}
+
+
+void GPIBInterface::numerical_multi_response_command(
+  Addr4882_t address, const char* const* commands, int count,
+  double* values, int* numValues, int maxValues
+)
+{
+  SyncTurn turn(this);
+  char message[BATCH_SIZE + 1];
+  int first = 0;
+  while(first < count) {
+    // Pack queries while the message and the expected replies fit
+    int msgLen = 0;
+    int replyLen = 0;
+    int last = first;
+    while(last < count) {
+      int cmdLen = strlen(commands[last]);
+      int sepLen = (last > first) ? 1 : 0;
+      int reply = numValues[last] * REPLY_BYTES_PER_VALUE;
+      if(last > first && (msgLen + sepLen + cmdLen > BATCH_SIZE ||
+          replyLen + reply > OUTPUT_QUEUE_SIZE)) {
+        break;
+      }
+      if(sepLen) {
+        message[msgLen++] = ';';
+      }
+      memcpy(message + msgLen, commands[last], cmdLen);
+      msgLen += cmdLen;
+      replyLen += reply;
+      last++;
+    }
+    message[msgLen] = '\0';
+
+    // The replies come back in order, each ended by a newline (or ';')
+    int len = query(address, message);
+    const char* lineStart = rxBuffer;
+    const char* end = rxBuffer + len;
+    int k = first;
+    for(const char* p = rxBuffer; p < end && k < last; p++) {
+      if(*p == '\n' || *p == ';') {
+        numValues[k] = parseNumberList(lineStart, p, values + k*maxValues, maxValues);
+        k++;
+        lineStart = p + 1;
+      }
+    }
+    if(k < last && lineStart < end) {
+      numValues[k] = parseNumberList(lineStart, end, values + k*maxValues, maxValues);
+      k++;
+    }
+    if(k != last) {
+      for(k = first; k < last; k++) {
+        len = query(address, commands[k]);
+        numValues[k] = parseNumberList(rxBuffer, rxBuffer + len, values + k*maxValues, maxValues);
+      }
+    }
+    first = last;
+  }
+}
+
+
+int GPIBInterface::binary_response_command(
+  Addr4882_t address, const char* command, char* result, int resultLen
+)
+{
+  SyncTurn turn(this);
+  Send(id, address, command, strlen(command), NLend);
+  Receive(id, address, result, resultLen, STOPend);
+  return (ThreadIbsta() & ERR) ? 0 : ThreadIbcnt();
+}
+
+
+int GPIBInterface::receive_raw(Addr4882_t address, char* result, int resultLen)
+{
+  SyncTurn turn(this);
+  Receive(id, address, result, resultLen, STOPend);
+  return (ThreadIbsta() & ERR) ? 0 : ThreadIbcnt();
+}
+
+
+void GPIBInterface::clear_device(Addr4882_t address)
+{
+  SyncTurn turn(this);
+  DevClear(id, address);
+}
+
+
 void GPIBInterface::string_response_command(Addr4882_t address, char* command, char* result, int resultLen)
 {
+  SyncTurn turn(this);
   Send(id, address, command, strlen(command), NLend);
 //      std::cout << "string_response_command(): command = " << command << std::endl;
 //      std::cout << "  string_response_command(): strlen(result) = " << strlen(result) << std::endl;
   Receive(id, address, result, resultLen, STOPend);
-  result[ibcnt] = '\0';
+  result[ThreadIbcnt()] = '\0';
 //      std::cout << "  string_response_command(): result = " << result << std::endl;
 }
 
 
+/*
+ * Append a command to the queue and wake the worker. Must be called with
+ * queueMutex held.
+ */
+QueuedCommand& GPIBInterface::enqueue(Addr4882_t address, const std::string& command, bool query)
+{
+  queue.emplace_back();
+  queue.back().address = address;
+  queue.back().command = command;
+  queue.back().query = query;
+  queue.back().owner = std::this_thread::get_id();
+  pending[queue.back().owner]++;
+  queueChanged.notify_all();
+  return queue.back();
+}
+
+
+/*
+ * Move the commands the calling thread collected since begin_batch() to the
+ * queue as one message. Must be called with queueMutex held.
+ */
+void GPIBInterface::queueBatch()
+{
+  std::map<std::thread::id, PendingBatch>::iterator it =
+      batches.find(std::this_thread::get_id());
+  if(it == batches.end()) {
+    return;
+  }
+  PendingBatch& batch = it->second;
+  if(!batch.commands.empty()) {
+    enqueue(batch.address, batch.commands, false);
+    batch.commands.clear();
+  }
+  if(batch.depth == 0) {
+    batches.erase(it);
+  }
+}
+
+
+void GPIBInterface::send_command_async(Addr4882_t address, const char *command)
+{
+  std::lock_guard<std::mutex> lock(queueMutex);
+  std::map<std::thread::id, PendingBatch>::iterator it =
+      batches.find(std::this_thread::get_id());
+  if(it != batches.end() && it->second.depth > 0 && address == it->second.address) {
+    std::string& commands = it->second.commands;
+    size_t len = strlen(command);
+    if(!commands.empty() && commands.size() + 1 + len > BATCH_SIZE) {
+      queueBatch();
+    }
+    if(!commands.empty()) {
+      commands += ';';
+    }
+    commands += command;
+    return;
+  }
+  queueBatch();
+  enqueue(address, command, false);
+}
+
+
+std::future<std::string> GPIBInterface::query_async(Addr4882_t address, const char *command)
+{
+  std::lock_guard<std::mutex> lock(queueMutex);
+  queueBatch();
+  return enqueue(address, command, true).response.get_future();
+}
+
+
+void GPIBInterface::begin_batch(Addr4882_t address)
+{
+  std::lock_guard<std::mutex> lock(queueMutex);
+  PendingBatch& batch = batches[std::this_thread::get_id()];
+  if(batch.depth > 0 && address != batch.address) {
+    queueBatch();
+  }
+  batch.address = address;
+  batch.depth++;
+}
+
+
+void GPIBInterface::end_batch()
+{
+  std::lock_guard<std::mutex> lock(queueMutex);
+  std::map<std::thread::id, PendingBatch>::iterator it =
+      batches.find(std::this_thread::get_id());
+  if(it != batches.end() && it->second.depth > 0 && --it->second.depth == 0) {
+    queueBatch();
+  }
+}
+
+
+void GPIBInterface::flush()
+{
+  std::unique_lock<std::mutex> lock(queueMutex);
+  waitForQueue(lock);
+}
+
+
+long GPIBInterface::get_async_errors()
+{
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return asyncErrors;
+}
+
+
+long GPIBInterface::get_async_errors(Addr4882_t address)
+{
+  std::lock_guard<std::mutex> lock(queueMutex);
+  std::map<Addr4882_t, long>::const_iterator it = asyncErrorsAt.find(address);
+  return (it != asyncErrorsAt.end()) ? it->second : 0;
+}
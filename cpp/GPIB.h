@@ -5,7 +5,7 @@
 //
 // Author:   Connor D. Pierce
 // Created:  2018-02-02
-// Modified: 2023-04-05 21:32:09
+// Modified: 2026-10-17 03:12:40
 //
 // Copyright (C) 2018-2023 Connor D. Pierce
 //
@@ -36,13 +36,31 @@
 #include <iostream>
 #include <string.h>
 #include <stdlib.h>
+#include <charconv>
+#include <condition_variable>
+#include <deque>
 #include <exception>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include <ni4882.h>
 
 #define NUM_DEVICES 31
 #define BUF_SIZE 1024
 
+// Longest message built by begin_batch()/end_batch(). The SR830 input queue
+// holds 256 characters, including the terminating newline.
+#define BATCH_SIZE 250
+
+// Space reserved in the instrument's output queue (256 characters on the
+// SR830) for each value of a query reply, when several queries share one
+// message. Replies that do not fit are lost, so the estimate is generous.
+#define OUTPUT_QUEUE_SIZE 256
+#define REPLY_BYTES_PER_VALUE 16
+
 class DisconnectedException: public std::exception {
 	char message[80];
 	
@@ -57,28 +75,169 @@ public:
 };
 
 
+/*
+ * A command waiting in the asynchronous queue of a GPIBInterface. Queries
+ * carry a promise that is fulfilled with the instrument's response. `owner`
+ * is the thread that queued it.
+ */
+struct QueuedCommand {
+    Addr4882_t address;
+    std::string command;
+    bool query;
+    std::promise<std::string> response;
+    std::thread::id owner;
+};
+
+
+/*
+ * Commands collected by one thread between begin_batch() and end_batch(),
+ * not yet added to the queue.
+ */
+struct PendingBatch {
+    std::string commands;
+    Addr4882_t address;
+    int depth;
+
+    PendingBatch(): address(NOADDR), depth(0) {}
+};
+
+
+/*
+ * class BusArbiter
+ *
+ * Hands a GPIB bus to one transaction at a time, in the order they asked for
+ * it (a ticket lock), so that an instrument whose thread keeps the bus busy
+ * cannot starve the others sharing it. Meets BasicLockable, for use with
+ * std::lock_guard.
+ */
+class BusArbiter {
+    std::mutex mutex;
+    std::condition_variable turnChanged;
+    unsigned long nextTicket;
+    unsigned long serving;
+
+public:
+    BusArbiter(): nextTicket(0), serving(0) {}
+
+    void lock();
+    void unlock();
+};
+
+
+/*
+ * Parse up to maxValues comma-separated numbers from the characters in
+ * [begin, end) into `values`, without allocating. Leading blanks and '+' signs
+ * are skipped, and parsing stops at the first field that is not a number (for
+ * example the terminating newline). Returns the number of values parsed.
+ */
+int parseNumberList(const char* begin, const char* end, double* values, int maxValues);
+
+
+/*
+ * class GPIBInterface
+ *
+ * One GPIB interface board and the instruments listening on it. The status
+ * and count of each NI-488.2 call are read with ThreadIbsta() and
+ * ThreadIbcnt(), which hold those of the calling thread rather than of the
+ * last call in the process, so that several boards can be driven at once,
+ * each from threads of its own.
+ */
 class GPIBInterface {
     int id;
     char *command;
     char deviceDesc[BUF_SIZE];
+    // Identification of each listener, without the line end, in the order of
+    // `result`
+    std::string deviceDescs[NUM_DEVICES];
+    // Receive buffer shared by the synchronous queries, which all hold the
+    // bus while using it
+    char rxBuffer[BUF_SIZE];
     int num_listeners;
     Addr4882_t instruments[NUM_DEVICES], result[NUM_DEVICES];
 
+    // Asynchronous command queue, drained in order by the worker thread. The
+    // synchronous methods of a thread wait until the commands it queued have
+    // been sent before using the bus, so each thread's commands reach the
+    // instrument in the order they were issued. Threads driving different
+    // instruments do not wait for each other's commands, only for the bus.
+    std::deque<QueuedCommand> queue;
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    bool stopping;
+    long asyncErrors;
+    std::map<Addr4882_t, long> asyncErrorsAt;
+    std::thread worker;
+    BusArbiter bus;
+
+    // Commands queued or being sent, and open batch, of each thread
+    std::map<std::thread::id, int> pending;
+    std::map<std::thread::id, PendingBatch> batches;
+
+    /*
+     * Turn on the bus of a synchronous call, for as long as it lives: waits
+     * for the commands the calling thread queued, then for the bus.
+     */
+    class SyncTurn {
+        GPIBInterface* gpib;
+
+    public:
+        SyncTurn(GPIBInterface* gpib);
+        ~SyncTurn();
+    };
+
+    void workerLoop();
+    void waitForQueue(std::unique_lock<std::mutex>& lock);
+    int query(Addr4882_t address, const char* command);
+    QueuedCommand& enqueue(Addr4882_t address, const std::string& command, bool query);
+    void queueBatch();
+
     void gpib_error(int errnum, std::string errmsg) {
         std::cout << "Error #" << errnum << ": " << errmsg << std::endl;
-        ibonl(0,0); //take the board offline
+        ibonl(id,0); //take the board offline
 //        exit(1); //terminate program  //REMOVED BY CONNOR 2/5/2018
     }
 
 public:
     GPIBInterface(int idd);
 
+    ~GPIBInterface();
+
+    /*
+     * Index of the interface board.
+     */
+    int getBoardId() {
+        return id;
+    }
+
 	/*
      * Copy the name of the active device into the character array "buffer".
 	 */
     void getDeviceDesc(char* buffer, int len);
 
 
+    /*
+     * Copy the identification of the device at full address `address` into
+     * "buffer"; empty if there is no device there.
+     */
+    void getDeviceDesc(Addr4882_t address, char* buffer, int len);
+
+
+    /*
+     * Number of listeners found on the bus, and the full address of listener
+     * k (0 <= k < listenerCount()).
+     */
+    int listenerCount();
+
+    Addr4882_t listenerAddress(int k);
+
+
+    /*
+     * Full address of the first listener whose identification contains
+     * `model` (e.g. "SR830"), or NOADDR if there is none.
+     */
+    Addr4882_t findListener(const char* model);
+
+
     /*
      * Get the full address for the device with the given primary address.
      */
@@ -108,6 +267,53 @@ public:
     int integer_response_command(Addr4882_t address, char *command);
     
     
+    /*
+     * Send command to lockin and parse its comma-separated numerical response
+     * into `values`. Returns the number of values parsed.
+     */
+    int numerical_list_response_command(
+        Addr4882_t address, const char* command, double* values, int maxValues
+    );
+
+
+    /*
+     * Send `count` queries to lockin, packed into as few messages as the
+     * instrument's input and output queues allow, and parse the reply to
+     * query k into values[k*maxValues ...]. On entry numValues[k] is the
+     * number of values expected from query k; on return it is the number
+     * parsed. If the replies to a message cannot be matched to its queries,
+     * those queries are repeated one at a time.
+     */
+    void numerical_multi_response_command(
+        Addr4882_t address, const char* const* commands, int count,
+        double* values, int* numValues, int maxValues
+    );
+
+
+    /*
+     * Send command to lockin and read up to resultLen bytes of binary response
+     * into `result`, until EOI. Returns the number of bytes read.
+     */
+    int binary_response_command(
+        Addr4882_t address, const char* command, char* result, int resultLen
+    );
+
+
+    /*
+     * Read up to resultLen bytes that the instrument is already talking (for
+     * example a fast-mode data stream) into `result`, without sending a
+     * command. Returns the number of bytes read.
+     */
+    int receive_raw(Addr4882_t address, char* result, int resultLen);
+
+
+    /*
+     * Send the selected device clear message, which empties the instrument's
+     * input and output queues.
+     */
+    void clear_device(Addr4882_t address);
+
+
     /*
      * Send command to lockin and get the raw string response.
      */
@@ -115,6 +321,54 @@ public:
         Addr4882_t address, char* command, char* result, int resultLen
     );
 
+
+    /*
+     * Queue a command that has no response and return immediately. Queued
+     * commands are sent in order by a background thread.
+     */
+    void send_command_async(Addr4882_t address, const char *command);
+
+
+    /*
+     * Queue a query and return immediately. The returned future resolves to
+     * the raw response once the query has been sent and answered.
+     */
+    std::future<std::string> query_async(Addr4882_t address, const char *command);
+
+
+    /*
+     * Start collecting the commands passed to send_command_async() for
+     * `address` instead of queueing them one by one. Until the matching
+     * end_batch(), they are joined with ';' and sent as a single message (or
+     * as few messages as BATCH_SIZE allows). Batches may be nested; only the
+     * outermost end_batch() sends. Any other command, query or flush() sends
+     * the collected commands first, so the order on the bus never changes.
+     * Each thread has a batch of its own.
+     */
+    void begin_batch(Addr4882_t address);
+
+
+    /*
+     * Queue the commands the calling thread collected since begin_batch().
+     */
+    void end_batch();
+
+
+    /*
+     * Block until every command queued by the calling thread has been sent
+     * to the instrument.
+     */
+    void flush();
+
+
+    /*
+     * Returns the number of queued commands that failed on the bus, in all
+     * or to the instrument at `address`.
+     */
+    long get_async_errors();
+
+    long get_async_errors(Addr4882_t address);
+
 };
 
 
@@ -5,7 +5,7 @@
 //
 // Author:   Connor D. Pierce
 // Created:  2018-02-02
-// Modified: 2023-04-05 21:33:16
+// Modified: 2026-10-16 20:51:37
 //
 // Copyright (C) 2018-2023 Connor D. Pierce
 //
@@ -33,102 +33,78 @@
 #ifndef LOCKINPARAMETERS_H_
 #define LOCKINPARAMETERS_H_
 
-#include <map>
-#include <string>
-#include <cstdio>
-
-struct OptionData {
-	double dblVal1, dblVal2;
-	int intVal1, intVal2;
-	
-	bool dblVal1Set;
-	bool dblVal2Set;
-	bool intVal1Set;
-	bool intVal2Set;
-	
-	OptionData() {
-		dblVal1 = dblVal2 = 0;
-		intVal1 = intVal2 = 0;
-		dblVal1Set = dblVal2Set = intVal1Set = intVal2Set = false;
-	}
-	
-};
-
-class Parameter {
-
-protected:
-	std::string desc;
-	std::string units;
-	std::string type;
-	
-public:
-	std::string getDescription();
-	std::string getType();
-	std::string getUnits();
-	void setUnits();
-	
-	virtual void setValue(std::string val) = 0;
-	virtual OptionData getValue() = 0;
-	virtual std::string getDisplayString() = 0;
-	virtual bool isValid(std::string value) = 0;
-	
+/*
+ * Identifiers of the lock-in settings. They index the option table in
+ * LockinSettings.cpp and are listed in alphabetical order of the option
+ * names, which is the order in which writeAllOptions() has always printed
+ * them.
+ */
+enum LockinOption {
+	OPT_AUX_OUT_1,            // "Aux Out 1"
+	OPT_AUX_OUT_2,            // "Aux Out 2"
+	OPT_AUX_OUT_3,            // "Aux Out 3"
+	OPT_AUX_OUT_4,            // "Aux Out 4"
+	OPT_CH1_OUTPUT,           // "CH1 Output Quantity"
+	OPT_CH1_DISPLAY,          // "CH1 display settings"
+	OPT_CH2_OUTPUT,           // "CH2 Output Quantity"
+	OPT_CH2_DISPLAY,          // "CH2 display settings"
+	OPT_SAMPLE_RATE,          // "Data Storage Sample Rate"
+	OPT_TRIGGER_START,        // "Data Storage Trigger Start Mode"
+	OPT_HARMONIC,             // "Detection Harmonic"
+	OPT_RESERVE,              // "Dynamic Reserve Mode"
+	OPT_BUFFER_MODE,          // "End of Buffer Mode"
+	OPT_FAST_MODE,            // "Fast Data Transfer Mode"
+	OPT_INPUT_CONFIG,         // "Input Configuration"
+	OPT_INPUT_COUPLING,       // "Input Coupling"
+	OPT_LINE_FILTER,          // "Input Line Notch Filter Status"
+	OPT_SHIELD_GROUND,        // "Input Shield Grounding"
+	OPT_FILTER_SLOPE,         // "Low Pass Filter Slope"
+	OPT_R_OUTPUT,             // "R output settings"
+	OPT_REF_FREQUENCY,        // "Reference Frequency"
+	OPT_REF_PHASE,            // "Reference Phase Shift"
+	OPT_REF_SOURCE,           // "Reference Source"
+	OPT_REF_TRIGGER,          // "Reference Trigger"
+	OPT_SENSITIVITY,          // "Sensitivity"
+	OPT_SINE_AMPLITUDE,       // "Sine Output Amplitude"
+	OPT_SYNC_FILTER,          // "Synchronous Filter Status"
+	OPT_TIME_CONSTANT,        // "Time Constant"
+	OPT_X_OUTPUT,             // "X output settings"
+	OPT_Y_OUTPUT,             // "Y output settings"
+	NUM_OPTIONS
 };
 
-class IntParameter: public Parameter {
+#define MAX_OPTION_PARAMS 2
 
-protected:
-	const int minValue, maxValue;
-	int value;
-	
-public:
-	IntParameter(std::string description, std::string units, int minValue, int maxValue);
-	
-	void setValue(int val);
-	int getMinValue();
-	void setMinValue(int val);
-	int getMaxValue();
-	void setMaxValue(int val);
-	std::string getUnits();
-	void setUnits(std::string units);
-	
-	virtual void setValue(std::string val);
-	virtual OptionData getValue();
-	virtual std::string getDisplayString();
-	virtual bool isValid(std::string value);
-	
+enum ParameterType {
+	PARAM_INT,     // integer
+	PARAM_LIST,    // integer index into a list of named values
+	PARAM_DOUBLE   // real number
 };
 
-class ListParameter: public IntParameter {
-	std::map<int, std::string> displayVals;
-	
-public:
-	ListParameter(std::string description, std::string units, int minValue, int maxValue);
-	
-	void setDisplayValue(int key, std::string displayVal);
-	std::map<int, std::string> getDisplayValues();
-	
-	virtual std::string getDisplayString();
-	
+/*
+ * Description of one value of an option: its name, units, type and valid
+ * range. For PARAM_LIST, displayVals names each value from minValue to
+ * maxValue.
+ */
+struct ParameterDesc {
+	const char* desc;
+	const char* units;
+	ParameterType type;
+	double minValue, maxValue;
+	const char* const* displayVals;
 };
 
-class DoubleParameter: public Parameter {
-	const double minValue, maxValue;
-	double value;
-	
-public:
-	DoubleParameter(std::string description, std::string units, double minValue, double maxValue);
-	void setValue(double val);
-	double getMinValue();
-	void setMinValue(double val);
-	double getMaxValue();
-	void setMaxValue(double val);
-	std::string getUnits();
-	
-	virtual void setValue(std::string val);
-	virtual OptionData getValue();
-	virtual std::string getDisplayString();
-	virtual bool isValid(std::string value);
-	
+/*
+ * Description of one lock-in option: its name, the prefix printed before
+ * each parameter, the printf-style assignment command and the query command.
+ */
+struct OptionDesc {
+	const char* name;
+	const char* prefix;
+	const char* assignCmd;
+	const char* queryCmd;
+	int numParams;
+	ParameterDesc params[MAX_OPTION_PARAMS];
 };
 
 #endif
@@ -5,7 +5,7 @@
 //
 // Author:   Connor D. Pierce
 // Created:  2018-02-02
-// Modified: 2023-04-05 21:34:05
+// Modified: 2026-10-17 10:14:37
 //
 // Copyright (C) 2018-2023 Connor D. Pierce
 //
@@ -34,716 +34,389 @@
 #define LOCKINSETTINGS_CPP_
 
 #include "LockinSettings.h"
-
-// ======= Method Implementation for class Option ==============================
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+// ======= Option table ========================================================
+
+static constexpr const char* REF_SOURCE_VALS[] = {"external", "internal"};
+static constexpr const char* REF_TRIGGER_VALS[] = {
+  "sine zero crossing", "TTL rising edge", "TTL falling edge"
+};
+static constexpr const char* INPUT_CONFIG_VALS[] = {
+  "A", "A-B", "I (1 megaohm)", "I (100 megaohm)"
+};
+static constexpr const char* SHIELD_GROUND_VALS[] = {"Float", "Ground"};
+static constexpr const char* INPUT_COUPLING_VALS[] = {"AC", "DC"};
+static constexpr const char* LINE_FILTER_VALS[] = {
+  "No Filters", "Line Notch In", "2xLine Notch In", "Both Notch Filters In"
+};
+static constexpr const char* SENSITIVITY_VALS[] = {
+  "2 nV (fA)", "5 nV (fA)", "10 nV (fA)", "20 nV (fA)", "50 nV (fA)",
+  "100 nV (fA)", "200 nV (fA)", "500 nV (fA)", "1 uV (pA)", "2 uV (pA)",
+  "5 uV (pA)", "10 uV (pA)", "20 uV (pA)", "50 uV (pA)", "100 uV (pA)",
+  "200 uV (pA)", "500 uV (pA)", "1 mV (nA)", "2 mV (nA)", "5 mV (nA)",
+  "10 mV (nA)", "20 mV (nA)", "50 mV (nA)", "100 mV (nA)", "200 mV (nA)",
+  "500 mV (nA)", "1 V (uA)"
+};
+static constexpr const char* RESERVE_VALS[] = {
+  "High Reserve", "Normal", "Low Noise"
+};
+static constexpr const char* TIME_CONSTANT_VALS[] = {
+  "10 us", "30 us", "100 us", "300 us", "1 ms", "3 ms", "10 ms", "30 ms",
+  "100 ms", "300 ms", "1 s", "3 s", "10 s", "30 s", "100 s", "300 s", "1 ks",
+  "3 ks", "10 ks", "30 ks"
+};
+static constexpr const char* FILTER_SLOPE_VALS[] = {
+  "6 dB/oct", "12 dB/oct", "18 dB/oct", "24 dB/oct"
+};
+static constexpr const char* SYNC_FILTER_VALS[] = {
+  "No synchronous filtering", "Synchronous filtering below 200Hz"
+};
+static constexpr const char* CH1_DISPLAY_VALS[] = {
+  "X", "R", "X Noise", "Aux In 1", "Aux In 2"
+};
+static constexpr const char* CH1_RATIO_VALS[] = {"none", "Aux In 1", "Aux In 2"};
+static constexpr const char* CH2_DISPLAY_VALS[] = {
+  "Y", "Theta", "Y Noise", "Aux In 3", "Aux In 4"
+};
+static constexpr const char* CH2_RATIO_VALS[] = {"none", "Aux In 3", "Aux In 4"};
+static constexpr const char* CH1_OUTPUT_VALS[] = {"CH 1 Display", "X"};
+static constexpr const char* CH2_OUTPUT_VALS[] = {"CH 2 Display", "Y"};
+static constexpr const char* EXPAND_VALS[] = {
+  "No Expand", "Expand by 10", "Expand by 100"
+};
+static constexpr const char* SAMPLE_RATE_VALS[] = {
+  "62.5 mHz", "125 mHz", "250 mHz", "500 mHz", "1 Hz", "2 Hz", "4 Hz", "8 Hz",
+  "16 Hz", "32 Hz", "64 Hz", "128 Hz", "256 Hz", "512 Hz", "Trigger"
+};
+static constexpr const char* BUFFER_MODE_VALS[] = {"1 Shot", "Loop"};
+static constexpr const char* TRIGGER_START_VALS[] = {
+  "Trigger Start Feature Off", "Trigger Starts the Scan"
+};
+static constexpr const char* FAST_MODE_VALS[] = {
+  "Off", "On (DOS programs)", "On (Windows programs)"
+};
 
 /*
- * CONSTRUCTOR FOR Option
- * 
- * Option::Option()
- * 
- * Empty constructor. The std::string fields `desc`, `assignCmd`, 
- * and `queryCmd`are all initialized to the empty string. No other
- * initialization is required.
+ * One entry per LockinOption, in the same order. The names are those of the
+ * former string-keyed settings map and are still used in the logs.
  */
-Option::Option(): desc(""), assignCmd(""), queryCmd("") {
-  // No other initialization needed
+static constexpr OptionDesc OPTIONS[] = {
+  {"Aux Out 1", "", "AUXV 1,%f", "AUXV? 1", 1, {
+    {"Aux Output 1 ", "V", PARAM_DOUBLE, -10.5, 10.5, NULL}}},
+  {"Aux Out 2", "", "AUXV 2,%f", "AUXV? 2", 1, {
+    {"Aux Output 2 ", "V", PARAM_DOUBLE, -10.5, 10.5, NULL}}},
+  {"Aux Out 3", "", "AUXV 3,%f", "AUXV? 3", 1, {
+    {"Aux Output 3 ", "V", PARAM_DOUBLE, -10.5, 10.5, NULL}}},
+  {"Aux Out 4", "", "AUXV 4,%f", "AUXV? 4", 1, {
+    {"Aux Output 4 ", "V", PARAM_DOUBLE, -10.5, 10.5, NULL}}},
+  {"CH1 Output Quantity", "CH1 ", "FPOP 1,%d", "FPOP? 1", 1, {
+    {"Output Quantity", "-", PARAM_LIST, 0, 1, CH1_OUTPUT_VALS}}},
+  {"CH1 display settings", "CH1 ", "DDEF 1,%d,%d", "DDEF? 1", 2, {
+    {"Displayed Value", "-", PARAM_LIST, 0, 4, CH1_DISPLAY_VALS},
+    {"Ratio", "-", PARAM_LIST, 0, 2, CH1_RATIO_VALS}}},
+  {"CH2 Output Quantity", "CH2 ", "FPOP 2,%d", "FPOP? 2", 1, {
+    {"Output Quantity", "-", PARAM_LIST, 0, 1, CH2_OUTPUT_VALS}}},
+  {"CH2 display settings", "CH2 ", "DDEF 2,%d,%d", "DDEF? 2", 2, {
+    {"Displayed Value", "-", PARAM_LIST, 0, 4, CH2_DISPLAY_VALS},
+    {"Ratio", "-", PARAM_LIST, 0, 2, CH2_RATIO_VALS}}},
+  {"Data Storage Sample Rate", "", "SRAT %d", "SRAT?", 1, {
+    {"Data Storage Sample Rate", "-", PARAM_LIST, 0, 14, SAMPLE_RATE_VALS}}},
+  {"Data Storage Trigger Start Mode", "", "TSTR %d", "TSTR?", 1, {
+    {"Data Storage Trigger Start Mode", "-", PARAM_LIST, 0, 1,
+        TRIGGER_START_VALS}}},
+  {"Detection Harmonic", "", "HARM %d", "HARM?", 1, {
+    {"Detection Harmonic", "-", PARAM_INT, 1, 19999, NULL}}},
+  {"Dynamic Reserve Mode", "", "RMOD %d", "RMOD?", 1, {
+    {"Dynamic Reserve Mode", "-", PARAM_LIST, 0, 2, RESERVE_VALS}}},
+  {"End of Buffer Mode", "", "SEND %d", "SEND?", 1, {
+    {"End of Buffer Mode", "-", PARAM_LIST, 0, 1, BUFFER_MODE_VALS}}},
+  {"Fast Data Transfer Mode", "", "FAST %d", "FAST?", 1, {
+    {"Fast Data Transfer Mode", "-", PARAM_LIST, 0, 2, FAST_MODE_VALS}}},
+  {"Input Configuration", "", "ISRC %d", "ISRC?", 1, {
+    {"Input Configuration", "-", PARAM_LIST, 0, 3, INPUT_CONFIG_VALS}}},
+  {"Input Coupling", "", "ICPL %d", "ICPL?", 1, {
+    {"Input Coupling", "-", PARAM_LIST, 0, 1, INPUT_COUPLING_VALS}}},
+  {"Input Line Notch Filter Status", "", "ILIN %d", "ILIN?", 1, {
+    {"Input Line Notch Filter Status", "-", PARAM_LIST, 0, 1,
+        LINE_FILTER_VALS}}},
+  {"Input Shield Grounding", "", "IGND %d", "IGND?", 1, {
+    {"Input Shield Grounding", "-", PARAM_LIST, 0, 1, SHIELD_GROUND_VALS}}},
+  {"Low Pass Filter Slope", "", "OFSL %d", "OFSL?", 1, {
+    {"Low Pass Filter Slope", "-", PARAM_LIST, 0, 3, FILTER_SLOPE_VALS}}},
+  {"R output settings", "R Output ", "OEXP 2,%f,%d", "OEXP? 2", 2, {
+    {"Offset", "%", PARAM_DOUBLE, -105, 105, NULL},
+    {"Expand", "-", PARAM_LIST, 0, 2, EXPAND_VALS}}},
+  {"Reference Frequency", "", "FREQ %f", "FREQ?", 1, {
+    {"Reference Frequency", "Hz", PARAM_DOUBLE, 0.001, 102000, NULL}}},
+  {"Reference Phase Shift", "", "PHAS %f", "PHAS?", 1, {
+    {"Reference Phase Shift", "deg", PARAM_DOUBLE, -180, 180, NULL}}},
+  {"Reference Source", "", "FMOD %d", "FMOD?", 1, {
+    {"Reference Source", "-", PARAM_LIST, 0, 1, REF_SOURCE_VALS}}},
+  {"Reference Trigger", "", "RSLP %d", "RSLP?", 1, {
+    {"Reference Trigger", "-", PARAM_LIST, 0, 2, REF_TRIGGER_VALS}}},
+  {"Sensitivity", "", "SENS %d", "SENS?", 1, {
+    {"Sensitivity", "-", PARAM_LIST, 0, 26, SENSITIVITY_VALS}}},
+  {"Sine Output Amplitude", "", "SLVL %f", "SLVL?", 1, {
+    // FIXED in V1.0.8: max is 5V, not 0.5V
+    {"Sine Output Amplitude", "V", PARAM_DOUBLE, 0.004, 5.0, NULL}}},
+  {"Synchronous Filter Status", "", "SYNC %d", "SYNC?", 1, {
+    {"Synchronous Filter Status", "-", PARAM_LIST, 0, 1, SYNC_FILTER_VALS}}},
+  {"Time Constant", "", "OFLT %d", "OFLT?", 1, {
+    {"Time Constant", "-", PARAM_LIST, 0, 19, TIME_CONSTANT_VALS}}},
+  {"X output settings", "X Output ", "OEXP 1,%f,%d", "OEXP? 1", 2, {
+    {"Offset", "%", PARAM_DOUBLE, -105, 105, NULL},
+    {"Expand", "-", PARAM_LIST, 0, 2, EXPAND_VALS}}},
+  {"Y output settings", "Y Output ", "OEXP 2,%f,%d", "OEXP? 2", 2, {
+    {"Offset", "%", PARAM_DOUBLE, -105, 105, NULL},
+    {"Expand", "-", PARAM_LIST, 0, 2, EXPAND_VALS}}}
+};
+
+static_assert(sizeof(OPTIONS) / sizeof(OPTIONS[0]) == NUM_OPTIONS,
+    "OPTIONS must have one entry per LockinOption");
+
+static bool isInteger(const ParameterDesc& p) {
+  return p.type != PARAM_DOUBLE;
 }
 
-/* 
- * CONSTRUCTOR FOR Option
- * 
- * Option::Option(std::string, std::string, std::string)
- * 
- * The std::string fields `desc`, `assignCmd`, and `queryCmd` are initialized
- * to the provided values. No other initialization is needed.
+/*
+ * Display string of one parameter: description, value and units (or, for a
+ * list, the name of the value), separated by tabs.
  */
-Option::Option(std::string desc, std::string assignCmd, std::string queryCmd) :
-    desc(desc), 
-    assignCmd(assignCmd), 
-    queryCmd(queryCmd) {
-  // No other initialization needed
+static std::string parameterDisplayString(const ParameterDesc& p, double value) {
+  std::ostringstream s;
+  s << p.desc << "\t";
+  if(isInteger(p)) {
+    int v = (int) value;
+    s << v << "\t";
+    if(p.type == PARAM_LIST) {
+      if(v >= p.minValue && v <= p.maxValue) {
+        s << p.displayVals[v];
+      }
+    } else {
+      s << p.units;
+    }
+  } else {
+    s << value << "\t" << p.units;
+  }
+  return s.str();
 }
 
-std::string Option::getDesc() {
-  return desc;
-}
+// ===== Method Implementation for class LockinSettings ========================
+
+AsyncLogger* LockinSettings::settingsLogger = new AsyncLogger("settings_log.txt");
 
-std::string Option::getAssignCommand() {
-  return assignCmd;
+LockinSettings::LockinSettings(GPIBInterface* g) {
+  this->g = g;
+  for(int i = 0; i < NUM_OPTIONS; i++) {
+    for(int p = 0; p < MAX_OPTION_PARAMS; p++) {
+      values[i][p] = 0;
+    }
+  }
+  elidedWrites = 0;
+  asyncErrorsSeen = 0;
+  log = settingsLogger;
+  invalidateAll();
 }
 
-std::string Option::getQueryCommand() {
-  return queryCmd;
+const OptionDesc& LockinSettings::describe(LockinOption option) {
+  return OPTIONS[option];
 }
 
-std::string Option::getDisplayString() {
+std::string LockinSettings::getDisplayString(LockinOption option) {
+  const OptionDesc& d = OPTIONS[option];
   std::ostringstream oss;
-  int lastParam = params.size()-1;
-  int currParam = 0;
-  for(std::list<Parameter*>::iterator i = params.begin(); i != params.end(); i++) {
-    oss << desc;
-    oss << (*i)->getDisplayString();
-    if(currParam != lastParam) {
+  for(int p = 0; p < d.numParams; p++) {
+    oss << d.prefix << parameterDisplayString(d.params[p], values[option][p]);
+    if(p != d.numParams-1) {
       oss << std::endl;
     }
-    currParam++;
   }
   return oss.str();
 }
 
-void Option::addParameter(int index, Parameter* param) {
-  std::list<Parameter*>::iterator it = params.begin();
-  for(int i = 0; i < index; i++) {
-    it++;
-  }
-  params.insert(it, param);
-}
-
-void Option::removeParameter(Parameter* param) {
-  params.remove(param);
-}
-
-std::list<Parameter*> Option::getParameters() {
-  return params;
-}
-
-void Option::setValues(std::string val) {
-  int count = 0;
-  int last = 0;
-  while(val.find(",", last) != -1) {
-    last = val.find(",", last)+1;
-    count++;
+/*
+ * Read every option from the instrument. The queries are sent in a few
+ * combined messages rather than one round trip each.
+ */
+void LockinSettings::queryAllOptions(Addr4882_t addr) {
+  (*log) << "=== CURRENT SETTINGS CONFIGURATION ===" << std::endl;
+  const char* commands[NUM_OPTIONS];
+  int numValues[NUM_OPTIONS];
+  double vals[NUM_OPTIONS][MAX_OPTION_PARAMS];
+  for(int i = 0; i < NUM_OPTIONS; i++) {
+    commands[i] = OPTIONS[i].queryCmd;
+    numValues[i] = OPTIONS[i].numParams;
   }
-  if(params.size() != count+1) {
-    std::cout << "INVALID NUMBER OF PARAMETERS SUPPLIED FOR OPTION " << desc << std::endl;
-  } else {
-    int firstInd = 0;
-    int secondInd = 0;
-    bool validValues = true;
-    for(std::list<Parameter*>::iterator it = params.begin(); it != params.end(); it++) {
-      secondInd = val.find(",", firstInd);
-      bool isParamValid = (*it)->isValid(val.substr(firstInd, secondInd-firstInd));
-      validValues = validValues && isParamValid;
-      firstInd = secondInd+1;
+  g->numerical_multi_response_command(addr, commands, NUM_OPTIONS, &vals[0][0],
+      numValues, MAX_OPTION_PARAMS);
+  for(int i = 0; i < NUM_OPTIONS; i++) {
+    LockinOption option = (LockinOption) i;
+    const OptionDesc& d = OPTIONS[option];
+    if(numValues[i] != d.numParams) {
+      std::cout << "INVALID NUMBER OF PARAMETERS SUPPLIED FOR OPTION " << d.name << std::endl;
+      continue;
     }
-    
-    firstInd = secondInd = 0;
-    for(std::list<Parameter*>::iterator it = params.begin(); it != params.end(); it++) {
-      secondInd = val.find(",", firstInd);
-      if(validValues) {
-        (*it)->setValue(val.substr(firstInd, secondInd-firstInd));
-      } else {
-        (*LockinSettings::settingsLogger) << "COULD NOT ";
-      }
-      (*LockinSettings::settingsLogger) << "SET OPTION: " << desc << (*it)->getDisplayString() << std::endl;
-      firstInd = secondInd+1;
+    if(store(option, vals[i])) {
+      dirty[option] = false;
     }
   }
 }
 
-OptionData Option::getValues() {
-  OptionData values;
-//  values.dblVal1 = 0;
-//  values.dblVal2 = 0;
-//  values.intVal1 = 0;
-//  values.intVal2 = 0;
-  for(std::list<Parameter*>::iterator i = params.begin(); i != params.end(); i++) {
-    if((*i)->getType() == "int") {
-      if(values.intVal1Set) {
-        values.intVal2 = (*i)->getValue().intVal1;
-        values.intVal2Set = true;
-      } else {
-        values.intVal1 = (*i)->getValue().intVal1;
-        values.intVal1Set = true;
-      }
-    } else {
-      if(values.dblVal1Set) {
-        values.dblVal2 = (*i)->getValue().dblVal1;
-        values.dblVal2Set = true;
-      } else {
-        values.dblVal1 = (*i)->getValue().dblVal1;
-        values.dblVal1Set = true;
-      }
+bool LockinSettings::isValid(LockinOption option, const double* vals, int count) {
+  const OptionDesc& d = OPTIONS[option];
+  for(int p = 0; p < count; p++) {
+    double v = isInteger(d.params[p]) ? (int) vals[p] : vals[p];
+    if(v < d.params[p].minValue || v > d.params[p].maxValue) {
+      return false;
     }
   }
-  return values;
-}
-
-// ===== Method Implementation for class Parameter =============================
-std::string Parameter::getDescription() {
-  return desc;
-}
-
-std::string Parameter::getType() {
-  return type;
-}
-
-std::string Parameter::getUnits() {
-  return this->units;
-}
-
-std::string Parameter::getDisplayString() {
-  std::cout << "Warning: getting display string using virtual method of Parameter";
-  return std::string("");
-}
-
-void Parameter::setValue(std::string val) {
-  std::cout << "Warning: setting value using virtual method of Parameter";
-}
-
-// ===== Method Implementation for class IntParameter ==========================
-IntParameter::IntParameter(const std::string description, const std::string units,
-    int minValue, int maxValue):
-    minValue(minValue),
-    maxValue(maxValue) {
-  desc = description;
-  this->units = units;
-  this->type = "int";
-}
-  
-OptionData IntParameter::getValue() {
-  OptionData data;
-  data.intVal1 = this->value;
-  data.intVal1Set = true;
-  return data;
+  return true;
 }
 
-void IntParameter::setValue(int val) {
-  if(val < minValue || val > maxValue) {
-    (*LockinSettings::settingsLogger) << "Could not set value of " << desc << " to " << val << std::endl;
-  } else {
-    this->value = val;
+/*
+ * Format the assignment command of `option` for the parameter values `vals`.
+ */
+void LockinSettings::formatCommand(LockinOption option, const double* vals, char* cmdStr, int len) {
+  const OptionDesc& d = OPTIONS[option];
+  bool int1 = isInteger(d.params[0]);
+  if(d.numParams == 1) {
+    if(int1) {
+      snprintf(cmdStr, len, d.assignCmd, (int) vals[0]);
+    } else {
+      snprintf(cmdStr, len, d.assignCmd, vals[0]);
+    }
+    return;
   }
-}
-
-int IntParameter::getMinValue() {
-  return this->minValue;
-}
-
-int IntParameter::getMaxValue() {
-  return this->maxValue;
-}
-
-std::string IntParameter::getDisplayString() {
-  std::ostringstream s;
-  s << desc << "\t" << value << "\t" << units;
-  return s.str();
-}
-
-void IntParameter::setValue(std::string val) {
-    setValue(atoi(val.c_str()));
-}
-
-bool IntParameter::isValid(std::string value) {
-    int val = atoi(value.c_str());
-    return (val >= minValue && val <= maxValue);
-}
-
-// ===== Method Implementation for class ListParameter =========================
-ListParameter::ListParameter(std::string description, std::string units,
-    int minValue, int maxValue): IntParameter(description, units, minValue, maxValue) {
-  // No further initialization needed
-}
-
-std::string ListParameter::getDisplayString() {
-  std::ostringstream s;
-  s << desc << "\t" << value << "\t" << displayVals.find(value)->second;
-  return s.str();
-}
-
-void ListParameter::setDisplayValue(int key, std::string displayVal) {
-  displayVals[key] = displayVal;
-}
-
-std::map<int, std::string> ListParameter::getDisplayValues() {
-  return displayVals;
-}
-
-// ===== Method Implementation for class DoubleParameter =======================  
-DoubleParameter::DoubleParameter(std::string description, std::string units, 
-    double minValue, double maxValue):
-    minValue(minValue),
-    maxValue(maxValue) {
-  desc = description;
-  this->units = units;
-  this->type = "double";
-}
-  
-OptionData DoubleParameter::getValue() {
-  OptionData data;
-  data.dblVal1 = this->value;
-  data.dblVal1Set = true;
-  return data;
-}
-
-void DoubleParameter::setValue(double val) {
-  if(val < minValue || val > maxValue) {
-    (*LockinSettings::settingsLogger) << "Could not set value of " << desc << " to " << val << std::endl;
+  bool int2 = isInteger(d.params[1]);
+  if(int1 && int2) {
+    snprintf(cmdStr, len, d.assignCmd, (int) vals[0], (int) vals[1]);
+  } else if(int1) {
+    snprintf(cmdStr, len, d.assignCmd, (int) vals[0], vals[1]);
+  } else if(int2) {
+    snprintf(cmdStr, len, d.assignCmd, vals[0], (int) vals[1]);
   } else {
-    this->value = val;
+    snprintf(cmdStr, len, d.assignCmd, vals[0], vals[1]);
   }
 }
 
-double DoubleParameter::getMinValue() {
-  return this->minValue;
-}
-
-double DoubleParameter::getMaxValue() {
-  return this->maxValue;
-}
-
-std::string DoubleParameter::getDisplayString() {
-  std::ostringstream s;
-  s << desc << "\t" << value << "\t" << units;
-  return s.str();
-}
-
-void DoubleParameter::setValue(std::string val) {
-  double v = atof(val.c_str());
-    this->setValue(v);
-}
-
-bool DoubleParameter::isValid(std::string value) {
-    double val = atof(value.c_str());
-    return (val >= minValue && val <= maxValue);
+/*
+ * Store new values of `option` in the cache if all of them are in range, and
+ * log the outcome for each parameter. Returns true if the values were stored.
+ */
+bool LockinSettings::store(LockinOption option, const double* vals) {
+  const OptionDesc& d = OPTIONS[option];
+  bool validValues = isValid(option, vals, d.numParams);
+  for(int p = 0; p < d.numParams; p++) {
+    if(validValues) {
+      values[option][p] = vals[p];
+    } else {
+      (*log) << "COULD NOT ";
+    }
+    (*log) << "SET OPTION: " << d.prefix
+        << parameterDisplayString(d.params[p], values[option][p]) << std::endl;
+  }
+  return validValues;
 }
 
-// ===== Method Implementation for class LockinSettings ========================
-
-std::ofstream* LockinSettings::settingsLogger = new std::ofstream("settings_log.txt");
-
 /*
- * Available settings:
- *
- * Reference Phase Shift
- * Reference Source
- * Reference Frequency
- * Reference Trigger
- * Detection Harmonic
- * Sine Output Amplitude
- * Input Configuration
- * Input Shield Grounding
- * Input Coupling
- * Input Line Notch Filter Status
- * Sensitivity
- * Dynamic Reserve Mode
- * Time Constant
- * Low Pass Filter Slope
- * Synchronous Filter Status
- * CH1 display settings
- * CH2 display settings
- * CH1 Output Quantity
- * CH2 Output Quantity
- * X output settings
- * Y output settings
- * R output settings
- * Aux Out 1
- * Aux Out 2
- * Aux Out 3
- * Aux Out 4
- * Data Storage Sample Rate
- * End of Buffer Mode
- * Data Storage Trigger Start Mode
+ * Send new values of `option` to the instrument, unless the option is not
+ * dirty and its cached values give an identical command. A queued command
+ * that failed on the bus leaves the instrument state unknown, so any new
+ * asynchronous error to this instrument invalidates the whole cache.
  */
-LockinSettings::LockinSettings(GPIBInterface* g) {
-  this->g = g;
-  Option* o = new Option("", "PHAS %f\0", "PHAS?\0");
-  DoubleParameter* d = new DoubleParameter("Reference Phase Shift", "deg", -180, 180);
-  o->addParameter(0, d);
-  settings["Reference Phase Shift"] = *o; 
-  
-  o = new Option("", "FMOD %d\0", "FMOD?\0");
-  ListParameter* l = new ListParameter("Reference Source", "-", 0, 1);
-  l->setDisplayValue(0, "external");
-  l->setDisplayValue(1, "internal");
-  o->addParameter(0, l);
-  settings["Reference Source"] = *o;
-  
-  o = new Option("", "FREQ %f\0", "FREQ?\0");
-  d = new DoubleParameter("Reference Frequency", "Hz", 0.001, 102000);
-  o->addParameter(0, d);
-  settings["Reference Frequency"] = *o;
-  
-  o = new Option("", "RSLP %d\0", "RSLP?\0");
-  l = new ListParameter("Reference Trigger", "-", 0, 2);
-  l->setDisplayValue(0, "sine zero crossing");
-  l->setDisplayValue(1, "TTL rising edge");
-  l->setDisplayValue(2, "TTL falling edge");
-  o->addParameter(0, l);
-  settings["Reference Trigger"] = *o;
-  
-  o = new Option("", "HARM %d\0", "HARM?\0");
-  IntParameter* i = new IntParameter("Detection Harmonic", "-", 1, 19999);
-  o->addParameter(0, i);
-  settings["Detection Harmonic"] = *o;
-  
-  o = new Option("", "SLVL %f\0", "SLVL?\0");
-  d = new DoubleParameter("Sine Output Amplitude", "V", 0.004, 5.0); // FIXED in V1.0.8: max is 5V, not 0.5V
-  o->addParameter(0, d);
-  settings["Sine Output Amplitude"] = *o;
-  
-  o = new Option("", "ISRC %d", "ISRC?");
-  l = new ListParameter("Input Configuration", "-", 0, 3);
-  l->setDisplayValue(0, "A");
-  l->setDisplayValue(1, "A-B");
-  l->setDisplayValue(2, "I (1 megaohm)");
-  l->setDisplayValue(3, "I (100 megaohm)");
-  o->addParameter(0, l);
-  settings["Input Configuration"] = *o;
-  
-  o = new Option("", "IGND %d", "IGND?");
-  l = new ListParameter("Input Shield Grounding", "-", 0, 1);
-  l->setDisplayValue(0, "Float");
-  l->setDisplayValue(1, "Ground");
-  o->addParameter(0, l);
-  settings["Input Shield Grounding"] = *o;
-  
-  o = new Option("", "ICPL %d", "ICPL?");
-  l = new ListParameter("Input Coupling", "-", 0, 1);
-  l->setDisplayValue(0, "AC");
-  l->setDisplayValue(1, "DC");
-  o->addParameter(0, l);
-  settings["Input Coupling"] = *o;
-  
-  o = new Option("", "ILIN %d", "ILIN?");
-  l = new ListParameter("Input Line Notch Filter Status", "-", 0, 1);
-  l->setDisplayValue(0, "No Filters");
-  l->setDisplayValue(1, "Line Notch In");
-  l->setDisplayValue(2, "2xLine Notch In");
-  l->setDisplayValue(3, "Both Notch Filters In");
-  o->addParameter(0, l);
-  settings["Input Line Notch Filter Status"] = *o;
-  
-  o = new Option("", "SENS %d", "SENS?");
-  l = new ListParameter("Sensitivity", "-", 0, 26);
-  l->setDisplayValue(0, "2 nV (fA)");
-  l->setDisplayValue(1, "5 nV (fA)");
-  l->setDisplayValue(2, "10 nV (fA)");
-  l->setDisplayValue(3, "20 nV (fA)");
-  l->setDisplayValue(4, "50 nV (fA)");
-  l->setDisplayValue(5, "100 nV (fA)");
-  l->setDisplayValue(6, "200 nV (fA)");
-  l->setDisplayValue(7, "500 nV (fA)");
-  l->setDisplayValue(8, "1 uV (pA)");
-  l->setDisplayValue(9, "2 uV (pA)");
-  l->setDisplayValue(10, "5 uV (pA)");
-  l->setDisplayValue(11, "10 uV (pA)");
-  l->setDisplayValue(12, "20 uV (pA)");
-  l->setDisplayValue(13, "50 uV (pA)");
-  l->setDisplayValue(14, "100 uV (pA)");
-  l->setDisplayValue(15, "200 uV (pA)");
-  l->setDisplayValue(16, "500 uV (pA)");
-  l->setDisplayValue(17, "1 mV (nA)");
-  l->setDisplayValue(18, "2 mV (nA)");
-  l->setDisplayValue(19, "5 mV (nA)");
-  l->setDisplayValue(20, "10 mV (nA)");
-  l->setDisplayValue(21, "20 mV (nA)");
-  l->setDisplayValue(22, "50 mV (nA)");
-  l->setDisplayValue(23, "100 mV (nA)");
-  l->setDisplayValue(24, "200 mV (nA)");
-  l->setDisplayValue(25, "500 mV (nA)");
-  l->setDisplayValue(26, "1 V (uA)");
-  o->addParameter(0, l);
-  settings["Sensitivity"] = *o;
-  
-  o = new Option("", "RMOD %d", "RMOD?");
-  l = new ListParameter("Dynamic Reserve Mode", "-", 0, 2);
-  l->setDisplayValue(0, "High Reserve");
-  l->setDisplayValue(1, "Normal");
-  l->setDisplayValue(2, "Low Noise");
-  o->addParameter(0, l);
-  settings["Dynamic Reserve Mode"] = *o;
-  
-  o = new Option("", "OFLT %d", "OFLT?");
-  l = new ListParameter("Time Constant", "-", 0, 19);
-  l->setDisplayValue(0, "10 us");
-  l->setDisplayValue(1, "30 us");
-  l->setDisplayValue(2, "100 us");
-  l->setDisplayValue(3, "300 us");
-  l->setDisplayValue(4, "1 ms");
-  l->setDisplayValue(5, "3 ms");
-  l->setDisplayValue(6, "10 ms");
-  l->setDisplayValue(7, "30 ms");
-  l->setDisplayValue(8, "100 ms");
-  l->setDisplayValue(9, "300 ms");
-  l->setDisplayValue(10, "1 s");
-  l->setDisplayValue(11, "3 s");
-  l->setDisplayValue(12, "10 s");
-  l->setDisplayValue(13, "30 s");
-  l->setDisplayValue(14, "100 s");
-  l->setDisplayValue(15, "300 s");
-  l->setDisplayValue(16, "1 ks");
-  l->setDisplayValue(17, "3 ks");
-  l->setDisplayValue(18, "10 ks");
-  l->setDisplayValue(19, "30 ks");
-  o->addParameter(0, l);
-  settings["Time Constant"] = *o;
-  
-  o = new Option("", "OFSL %d", "OFSL?");
-  l = new ListParameter("Low Pass Filter Slope", "-", 0, 3);
-  l->setDisplayValue(0, "6 dB/oct");
-  l->setDisplayValue(1, "12 dB/oct");
-  l->setDisplayValue(2, "18 dB/oct");
-  l->setDisplayValue(3, "24 dB/oct");
-  o->addParameter(0, l);
-  settings["Low Pass Filter Slope"] = *o;
-  
-  o = new Option("", "SYNC %d", "SYNC?");
-  l = new ListParameter("Synchronous Filter Status", "-", 0, 1);
-  l->setDisplayValue(0, "No synchronous filtering");
-  l->setDisplayValue(1, "Synchronous filtering below 200Hz");
-  o->addParameter(0, l);
-  settings["Synchronous Filter Status"] = *o;
-  
-  o = new Option("CH1 ", "DDEF 1,%d,%d", "DDEF? 1");
-  l = new ListParameter("Displayed Value", "-", 0, 4);
-  l->setDisplayValue(0, "X");
-  l->setDisplayValue(1, "R");
-  l->setDisplayValue(2, "X Noise");
-  l->setDisplayValue(3, "Aux In 1");
-  l->setDisplayValue(4, "Aux In 2");
-  ListParameter* l2 = new ListParameter("Ratio", "-", 0, 2);
-  l2->setDisplayValue(0, "none");
-  l2->setDisplayValue(1, "Aux In 1");
-  l2->setDisplayValue(2, "Aux In 2");
-  o->addParameter(0, l);
-  o->addParameter(1, l2);
-  settings["CH1 display settings"] = *o;
-  
-  o = new Option("CH2 ", "DDEF 2,%d,%d", "DDEF? 2");
-  l = new ListParameter("Displayed Value", "-", 0, 4);
-  l->setDisplayValue(0, "Y");
-  l->setDisplayValue(1, "Theta");
-  l->setDisplayValue(2, "Y Noise");
-  l->setDisplayValue(3, "Aux In 3");
-  l->setDisplayValue(4, "Aux In 4");
-  l2 = new ListParameter("Ratio", "-", 0, 2);
-  l2->setDisplayValue(0, "none");
-  l2->setDisplayValue(1, "Aux In 3");
-  l2->setDisplayValue(2, "Aux In 4");
-  o->addParameter(0, l);
-  o->addParameter(1, l2);
-  settings["CH2 display settings"] = *o;
-  
-  o = new Option("CH1 ", "FPOP 1,%d", "FPOP? 1");
-  l = new ListParameter("Output Quantity", "-", 0, 1);
-  l->setDisplayValue(0, "CH 1 Display");
-  l->setDisplayValue(1, "X");
-  o->addParameter(0, l);
-  settings["CH1 Output Quantity"] = *o;
-  
-  o = new Option("CH2 ", "FPOP 2,%d", "FPOP? 2");
-  l = new ListParameter("Output Quantity", "-", 0, 1);
-  l->setDisplayValue(0, "CH 2 Display");
-  l->setDisplayValue(1, "Y");
-  o->addParameter(0, l);
-  settings["CH2 Output Quantity"] = *o;
-  
-  o = new Option("X Output ", "OEXP 1,%f,%d", "OEXP? 1");
-  d = new DoubleParameter("Offset", "%", -105, 105);
-  l = new ListParameter("Expand", "-", 0, 2);
-  l->setDisplayValue(0, "No Expand");
-  l->setDisplayValue(1, "Expand by 10");
-  l->setDisplayValue(2, "Expand by 100");
-  o->addParameter(0, d);
-  o->addParameter(1, l);
-  settings["X output settings"] = *o;
-  
-  
-  o = new Option("Y Output ", "OEXP 2,%f,%d", "OEXP? 2");
-  d = new DoubleParameter("Offset", "%", -105, 105);
-  l = new ListParameter("Expand", "-", 0, 2);
-  l->setDisplayValue(0, "No Expand");
-  l->setDisplayValue(1, "Expand by 10");
-  l->setDisplayValue(2, "Expand by 100");
-  o->addParameter(0, d);
-  o->addParameter(1, l);
-  settings["Y output settings"] = *o;
-  
-  
-  o = new Option("R Output ", "OEXP 2,%f,%d", "OEXP? 2");
-  d = new DoubleParameter("Offset", "%", -105, 105);
-  l = new ListParameter("Expand", "-", 0, 2);
-  l->setDisplayValue(0, "No Expand");
-  l->setDisplayValue(1, "Expand by 10");
-  l->setDisplayValue(2, "Expand by 100");
-  o->addParameter(0, d);
-  o->addParameter(1, l);
-  settings["R output settings"] = *o;
-  
-  o = new Option("", "AUXV 1,%f", "AUXV? 1");
-  d = new DoubleParameter("Aux Output 1 ", "V", -10.5, 10.5);
-  o->addParameter(0, d);
-  settings["Aux Out 1"] = *o;
-  
-  o = new Option("", "AUXV 2,%f", "AUXV? 2");
-  d = new DoubleParameter("Aux Output 2 ", "V", -10.5, 10.5);
-  o->addParameter(0, d);
-  settings["Aux Out 2"] = *o;
-  
-  o = new Option("", "AUXV 3,%f", "AUXV? 3");
-  d = new DoubleParameter("Aux Output 3 ", "V", -10.5, 10.5);
-  o->addParameter(0, d);
-  settings["Aux Out 3"] = *o;
-  
-  o = new Option("", "AUXV 4,%f", "AUXV? 4");
-  d = new DoubleParameter("Aux Output 4 ", "V", -10.5, 10.5);
-  o->addParameter(0, d);
-  settings["Aux Out 4"] = *o;
-  
-  o = new Option("", "SRAT %d", "SRAT?");
-  l = new ListParameter("Data Storage Sample Rate", "-", 0, 14);
-  l->setDisplayValue(0, "62.5 mHz");
-  l->setDisplayValue(1, "125 mHz");
-  l->setDisplayValue(2, "250 mHz");
-  l->setDisplayValue(3, "500 mHz");
-  l->setDisplayValue(4, "1 Hz");
-  l->setDisplayValue(5, "2 Hz");
-  l->setDisplayValue(6, "4 Hz");
-  l->setDisplayValue(7, "8 Hz");
-  l->setDisplayValue(8, "16 Hz");
-  l->setDisplayValue(9, "32 Hz");
-  l->setDisplayValue(10, "64 Hz");
-  l->setDisplayValue(11, "128 Hz");
-  l->setDisplayValue(12, "256 Hz");
-  l->setDisplayValue(13, "512 Hz");
-  l->setDisplayValue(14, "Trigger");
-  o->addParameter(0, l);
-  settings["Data Storage Sample Rate"] = *o;
-  
-  o = new Option("", "SEND %d", "SEND?");
-  l = new ListParameter("End of Buffer Mode", "-", 0, 1);
-  l->setDisplayValue(0, "1 Shot");
-  l->setDisplayValue(1, "Loop");
-  o->addParameter(0, l);
-  settings["End of Buffer Mode"] = *o;
-  
-  o = new Option("", "TSTR %d", "TSTR?");
-  l = new ListParameter("Data Storage Trigger Start Mode", "-", 0, 1);
-  l->setDisplayValue(0, "Trigger Start Feature Off");
-  l->setDisplayValue(1, "Trigger Starts the Scan");
-  o->addParameter(0, l);
-  settings["Data Storage Trigger Start Mode"] = *o;
-}  
-
-void LockinSettings::queryAllOptions(Addr4882_t addr) {
-  (*LockinSettings::settingsLogger) << "=== CURRENT SETTINGS CONFIGURATION ===" << std::endl;
-  LockinSettings::settingsLogger->flush();
-  for(std::map<std::string, Option>::iterator it = settings.begin();
-      it != settings.end(); it++) {
-    char res[40];
-    char cmd[40];
-    strcpy(cmd, it->second.getQueryCommand().c_str());
-    g->string_response_command(addr, cmd, res, 40);
-//    std::cout << "queryAll: setting option "<< it->first << " to '" << std::string(res) << std::endl;
-        it->second.setValues(std::string(res));
-        OptionData vals = it->second.getValues();
-//        std::cout << "queryAll: option " << it->first << " values (i1, i2, d1, d2) are: " << vals.intVal1 << ", " << vals.intVal2 << ", " << vals.dblVal1 << ", " << vals.dblVal2 << std::endl;
+void LockinSettings::write(Addr4882_t addr, LockinOption option, const double* vals) {
+  long asyncErrors = g->get_async_errors(addr);
+  if(asyncErrors != asyncErrorsSeen) {
+    asyncErrorsSeen = asyncErrors;
+    invalidateAll();
+  }
+  char cmdStr[40];
+  char cachedStr[40];
+  formatCommand(option, vals, cmdStr, 40);
+  formatCommand(option, values[option], cachedStr, 40);
+  if(!dirty[option] && strcmp(cmdStr, cachedStr) == 0) {
+    elidedWrites++;
+    return;
   }
+  store(option, vals);
+  formatCommand(option, values[option], cmdStr, 40);
+  g->send_command_async(addr, cmdStr);
+  dirty[option] = false;
 }
 
-bool LockinSettings::isIOption(std::string option) {
-  for(int i = 0; i < NUM_IOPTIONS; i++) {
-    if(option == iOptions[i]) {
-      return true;
-    }
+void LockinSettings::set(Addr4882_t addr, LockinOption option, int value) {
+  const OptionDesc& d = OPTIONS[option];
+  if(d.numParams == 1 && isInteger(d.params[0])) {
+    double vals[MAX_OPTION_PARAMS] = {(double) value, 0};
+    write(addr, option, vals);
+  } else {
+    std::cout << "Option " << d.name << "is not an integer Option";
   }
-  return false;
 }
 
-void LockinSettings::set(Addr4882_t addr, std::string option, int value) {
-  if(isIOption(option)) {
-    char passVal[40];
-    snprintf(passVal, 40, "%d", value);
-    settings[option].setValues(std::string(passVal));
-    char cmdStr[40];
-    snprintf(cmdStr, 40, settings[option].getAssignCommand().c_str(),
-        settings[option].getValues().intVal1);
-    g->send_command(addr, cmdStr);
+void LockinSettings::set(Addr4882_t addr, LockinOption option, double value) {
+  const OptionDesc& d = OPTIONS[option];
+  if(d.numParams == 1 && !isInteger(d.params[0])) {
+    double vals[MAX_OPTION_PARAMS] = {value, 0};
+    write(addr, option, vals);
   } else {
-    std::cout << "Option " << option << "is not an integer Option";
+    std::cout << "Option " << d.name << "is not a double Option";
   }
 }
 
-bool LockinSettings::isDOption(std::string option) {
-  for(int i = 0; i < NUM_DOPTIONS; i++) {
-    if(option == dOptions[i]) {
-      return true;
-    }
+void LockinSettings::set(Addr4882_t addr, LockinOption option, double val1, int val2) {
+  const OptionDesc& d = OPTIONS[option];
+  if(d.numParams == 2 && !isInteger(d.params[0]) && isInteger(d.params[1])) {
+    double vals[MAX_OPTION_PARAMS] = {val1, (double) val2};
+    write(addr, option, vals);
+  } else {
+    std::cout << "Option " << d.name << "is not a double,integer Option";
   }
-  return false;
 }
 
-void LockinSettings::set(Addr4882_t addr, std::string option, double value) {
-  if(isDOption(option)) {
-    char passVal[40];
-    snprintf(passVal, 40, "%f", value);
-    settings[option].setValues(std::string(passVal));
-    char cmdStr[40];
-    snprintf(cmdStr, 40, settings[option].getAssignCommand().c_str(),
-        settings[option].getValues().dblVal1);
-    g->send_command(addr, cmdStr);
+void LockinSettings::set(Addr4882_t addr, LockinOption option, int val1, int val2) {
+  const OptionDesc& d = OPTIONS[option];
+  if(d.numParams == 2 && isInteger(d.params[0]) && isInteger(d.params[1])) {
+    double vals[MAX_OPTION_PARAMS] = {(double) val1, (double) val2};
+    write(addr, option, vals);
   } else {
-    std::cout << "Option " << option << "is not a double Option";
+    std::cout << "Option " << d.name << "is not an integer,integer Option";
   }
 }
 
-bool LockinSettings::isDIOption(std::string option) {
-  for(int i = 0; i < NUM_DIOPTIONS; i++) {
-    if(option == diOptions[i]) {
-      return true;
-    }
-  }
-  return false;
+void LockinSettings::invalidate(LockinOption option) {
+  dirty[option] = true;
 }
 
-void LockinSettings::set(Addr4882_t addr, std::string option, double val1, int val2) {
-  if(isDIOption(option)) {
-    char passVal[40];
-    snprintf(passVal, 40, "%f,%d", val1, val2);
-    settings[option].setValues(std::string(passVal));
-    char cmdStr[40];
-    snprintf(cmdStr, 40, settings[option].getAssignCommand().c_str(),
-        settings[option].getValues().dblVal1, settings[option].getValues().intVal1);
-    g->send_command(addr, cmdStr);
-  } else {
-    std::cout << "Option " << option << "is not a double,integer Option";
+void LockinSettings::invalidateAll() {
+  for(int i = 0; i < NUM_OPTIONS; i++) {
+    dirty[i] = true;
   }
 }
 
-bool LockinSettings::isIIOption(std::string option) {
-  for(int i = 0; i < NUM_IIOPTIONS; i++) {
-    if(option == iiOptions[i]) {
-      return true;
-    }
-  }
-  return false;
+long LockinSettings::getElidedWrites() {
+  return elidedWrites;
 }
 
-void LockinSettings::set(Addr4882_t addr, std::string option, int val1, int val2) {
-  if(isIIOption(option)) {
-    char passVal[40];
-    snprintf(passVal, 40, "%d,%d", val1, val2);
-    settings[option].setValues(std::string(passVal));
-    char cmdStr[40];
-    snprintf(cmdStr, 40, settings[option].getAssignCommand().c_str(),
-        settings[option].getValues().intVal1, settings[option].getValues().intVal2);
-    g->send_command(addr, cmdStr);
-  } else {
-    std::cout << "Option " << option << "is not an integer,integer Option";
-  }
+void LockinSettings::resetElidedWrites() {
+  elidedWrites = 0;
 }
 
-void LockinSettings::writeAllOptions(std::ofstream* opfs) {
-  for(std::map<std::string, Option>::iterator i = settings.begin(); 
-      i != settings.end(); i++) {
-    (*opfs) << i->second.getDisplayString() << std::endl;
-  }
+void LockinSettings::beginBatch(Addr4882_t addr) {
+  g->begin_batch(addr);
 }
 
-OptionData LockinSettings::get(std::string option) {
-  return settings[option].getValues();
+void LockinSettings::endBatch() {
+  g->end_batch();
+}
+
+void LockinSettings::writeAllOptions(std::ostream* opfs) {
+  for(int i = 0; i < NUM_OPTIONS; i++) {
+    (*opfs) << getDisplayString((LockinOption) i) << std::endl;
+  }
 }
 
 #endif
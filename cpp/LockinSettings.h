@@ -5,7 +5,7 @@
 //
 // Author:   Connor D. Pierce
 // Created:  2018-02-02
-// Modified: 2023-04-05 21:34:58
+// Modified: 2026-10-16 23:58:31
 //
 // Copyright (C) 2018-2023 Connor D. Pierce
 //
@@ -34,81 +34,84 @@
 #define LOCKINSETTINGS_H_
 
 #include <fstream>
-#include <list>
-#include <sstream>
+#include <string>
 
+#include "AsyncLogger.h"
 #include "GPIB.h"
 #include "LockinParameters.h"
 
-class Option {
-	std::string desc;
-	std::string assignCmd;
-	std::string queryCmd;
-	std::list<Parameter*> params;
-	
-public:
-	Option();
-	Option(std::string desc, std::string assignCmd, std::string queryCmd);
+class LockinSettings {
+	//TODO: build a system where failures to set the requested setting are passed back to the calling function
+	GPIBInterface* g;
 	
-	std::string getDesc();
-	std::string getDisplayString();
-	std::string getAssignCommand();
-	std::string getQueryCommand();
+	// Cached value of every parameter of every option, indexed by LockinOption
+	double values[NUM_OPTIONS][MAX_OPTION_PARAMS];
 	
-	void addParameter(int index, Parameter* param);
-	void removeParameter(Parameter* param);
-	std::list<Parameter*> getParameters();
+	// The cache is authoritative: set() skips the bus when the cached value
+	// already matches, unless the option is dirty (the instrument may hold
+	// something else)
+	bool dirty[NUM_OPTIONS];
+	long elidedWrites;
+	long asyncErrorsSeen;
 	
-	void setValues(std::string val);
-	OptionData getValues();
+	// Where settings changes are logged; settingsLogger unless set
+	AsyncLogger* log;
 	
-};
-
-#define NUM_IOPTIONS 17
-#define NUM_DOPTIONS 7
-#define NUM_IIOPTIONS 2
-#define NUM_DIOPTIONS 3
-class LockinSettings {
-	//TODO: build a system where failures to set the requested setting are passed back to the calling function
-	std::map<std::string, Option> settings;
-	GPIBInterface* g;
+	bool isValid(LockinOption option, const double* vals, int count);
+	void formatCommand(LockinOption option, const double* vals, char* cmdStr, int len);
+	bool store(LockinOption option, const double* vals);
+	void write(Addr4882_t addr, LockinOption option, const double* vals);
 	
 public:
-	static std::ofstream* settingsLogger;
+	static AsyncLogger* settingsLogger;
 	
 	LockinSettings(GPIBInterface* g);
 	
+	// Log settings changes of this instrument to `logger` instead of
+	// settingsLogger, so that each instrument can have its own log
+	void setLogger(AsyncLogger* logger) {
+		log = logger;
+	}
+	AsyncLogger* getLogger() {
+		return log;
+	}
+	
 	void queryAllOptions(Addr4882_t addr);
-	void writeAllOptions(std::ofstream* opfs);
+	void writeAllOptions(std::ostream* opfs);
+	
+	// Description of an option, including its name for logging
+	static const OptionDesc& describe(LockinOption option);
 	
-	bool isIOption(std::string option);
-	bool isDOption(std::string option);
-	bool isDIOption(std::string option);
-	bool isIIOption(std::string option);
+	// Display string of an option: one line per parameter, as written by
+	// writeAllOptions()
+	std::string getDisplayString(LockinOption option);
 	
-	void set(Addr4882_t addr, std::string option, int value);
-	void set(Addr4882_t addr, std::string option, double value);
-	void set(Addr4882_t addr, std::string option, double val1, int val2);
-	void set(Addr4882_t addr, std::string option, int val1, int val2);
+	void set(Addr4882_t addr, LockinOption option, int value);
+	void set(Addr4882_t addr, LockinOption option, double value);
+	void set(Addr4882_t addr, LockinOption option, double val1, int val2);
+	void set(Addr4882_t addr, LockinOption option, int val1, int val2);
 	
-	OptionData get(std::string option);
+	// Combine the commands of consecutive set() calls into one GPIB message
+	void beginBatch(Addr4882_t addr);
+	void endBatch();
+	
+	// Cached value of parameter `param` of an option
+	int getInt(LockinOption option, int param = 0) {
+		return (int) values[option][param];
+	}
+	double getDouble(LockinOption option, int param = 0) {
+		return values[option][param];
+	}
+	
+	// Mark cached values as possibly out of date, so that the next set()
+	// always reaches the instrument
+	void invalidate(LockinOption option);
+	void invalidateAll();
+	
+	// Number of set() calls skipped because the value was already current
+	long getElidedWrites();
+	void resetElidedWrites();
 	
 };
 
-const std::string iOptions[] = {"Reference Source", 
-		"Reference Trigger", "Detection Harmonic",
-		"Input Configuration", "Input Shield Grounding", "Input Coupling",
-		"Input Line Notch Filter Status", "Sensitivity",
-		"Dynamic Reserve Mode", "Time Constant", "Low Pass Filter Slope",
-		"Synchronous Filter Status", "CH1 Output Quantity",
-		"CH2 Output Quantity", "Data Storage Sample Rate",
-		"End of Buffer Mode", "Data Storage Trigger Start Mode"};
-const std::string dOptions[] = {"Reference Phase Shift", 
-		"Reference Frequency", "Sine Output Amplitude",
-		"Aux Out 1", "Aux Out 2", "Aux Out 3", "Aux Out 4"};
-const std::string iiOptions[] = {"CH1 display settings",
-		"CH2 display settings"};
-static const std::string diOptions[] = {"X output settings",
-		"Y output settings", "R output settings"};
-
 #endif
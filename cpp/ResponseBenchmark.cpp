@@ -0,0 +1,145 @@
+// ResponseBenchmark.cpp
+// encoding: utf-8
+//
+// Heap allocations and time per measurement of the response parsing path.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-17 04:20:55
+// Modified: 2026-10-17 04:20:55
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+//
+// Usage:
+//
+//   ResponseBenchmark [-n measurements]
+//
+// Takes `measurements` measurements (default 20000) from a simulated SR830,
+// each one SR830::get_AmplPhase() and one SR830::get_amplitude(), as the
+// sweep does at every point, and prints the heap allocations and the time
+// per measurement. Allocations are counted on the measuring thread only; the
+// simulated bus runs on that thread too, so the instrument's side is
+// included. Simulated latencies are disabled, so that the time is that of
+// the software.
+//
+// Link against the simulated backend:
+//
+//   g++ -std=c++17 -O2 -I. -o ResponseBenchmark ResponseBenchmark.cpp
+//       AsyncLogger.cpp EmulatedSR830.cpp GPIB.cpp LockinSettings.cpp
+//       ni4882sim.cpp -lpthread
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "GPIB.h"
+#include "ni4882sim.h"
+#include "SR830.h"
+
+
+// Measurements taken before counting, so that buffers have grown to size
+#define WARMUP_MEASUREMENTS 100
+
+static thread_local bool counting = false;
+static std::atomic<long> allocations(0);
+
+
+void* operator new(std::size_t size)
+{
+  if(counting) {
+    allocations++;
+  }
+  void* p = malloc(size ? size : 1);
+  if(p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+  free(p);
+}
+
+
+int main(int argc, char** argv)
+{
+  long measurements = 20000;
+  if(argc == 3 && std::string(argv[1]) == "-n") {
+    measurements = atol(argv[2]);
+  } else if(argc != 1) {
+    fprintf(stderr, "Usage: ResponseBenchmark [-n measurements]\n");
+    return 2;
+  }
+
+  setenv("NI4882SIM_TIMESCALE", "0", 1);
+  simAttachSR830(0, 8);
+  GPIBInterface gpib(0);
+  SR830 lockin(&gpib, 8);
+
+  double ampl, phase, r = 0;
+  for(int k = 0; k < WARMUP_MEASUREMENTS; k++) {
+    lockin.get_AmplPhase(ampl, phase);
+    r += lockin.get_amplitude();
+  }
+
+  counting = true;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(long k = 0; k < measurements; k++) {
+    lockin.get_AmplPhase(ampl, phase);
+    r += lockin.get_amplitude();
+  }
+  double micros = std::chrono::duration<double, std::micro>(
+    std::chrono::steady_clock::now() - start
+  ).count();
+  counting = false;
+
+  printf("%ld measurements: %.2f allocations/measurement, %.2f us/measurement"
+      " (mean amplitude %g V)\n", measurements,
+      (double) allocations / measurements, micros / measurements,
+      r / (measurements + WARMUP_MEASUREMENTS));
+  return (allocations == 0) ? 0 : 1;
+}
@@ -5,7 +5,7 @@
 //
 // Author:   Connor D. Pierce
 // Created:  2018-02-01
-// Modified: 2023-04-05 21:45:37
+// Modified: 2026-10-17 06:55:32
 //
 // Copyright (C) 2018-2023 Connor D. Pierce
 //
@@ -35,10 +35,36 @@
 
 #include "GPIB.h"
 #include "LockinSettings.h"
+#include <stdint.h>
 #include <string>
+#include <vector>
+
+#define SR830_BUFFER_SIZE 16383
+
+
+/*
+ * Decode `count` points of a TRCL? transfer into `values`. Each point is a
+ * 16-bit mantissa m and a 16-bit exponent e, both little-endian, with value
+ * m * 2^(e - 124). The power of two is built directly in the exponent bits of
+ * a double, so the loop has no branches or library calls and vectorizes.
+ */
+inline void decodeTRCL(const unsigned char* data, int count, double* values)
+{
+  for(int k = 0; k < count; k++) {
+    const unsigned char* p = data + 4*k;
+    int16_t mantissa = (int16_t) (p[0] | (p[1] << 8));
+    int16_t exponent = (int16_t) (p[2] | (p[3] << 8));
+    uint64_t bits = (uint64_t) (exponent - 124 + 1023) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    values[k] = mantissa * scale;
+  }
+}
 
 
 class SR830 {
+  // Raw bytes of the last TRCL? transfer
+  std::vector<char> traceBuffer;
 
 public:
   GPIBInterface *gInterface;
@@ -46,15 +72,23 @@ public:
   LockinSettings settings;
   bool phaseAccessible;
 
-  SR830(GPIBInterface *interface1, int address1):
+  /*
+   * Settings changes of the instrument, starting with the settings read
+   * here, are logged to `settingsLog`, or to LockinSettings::settingsLogger
+   * if it is NULL.
+   */
+  SR830(GPIBInterface *interface1, int address1, AsyncLogger* settingsLog = NULL):
       settings(interface1)
   {
+    if(settingsLog != NULL) {
+      settings.setLogger(settingsLog);
+    }
     address = interface1->DeviceAddress(address1);
     gInterface = interface1;
     settings.queryAllOptions(address);
     int bufLen = 60;
     char buf[bufLen];
-    gInterface->getDeviceDesc(buf, bufLen);
+    gInterface->getDeviceDesc(address, buf, bufLen);
     if(strstr(buf, "SR830")) {
       phaseAccessible = true;
     }
@@ -63,36 +97,59 @@ public:
     }
   }
 
+  /*
+   * Wait until all queued setting changes have reached the instrument. Call
+   * before any wait that relies on a new setting having taken effect.
+   */
+  void sync()
+  {
+    gInterface->flush();
+  }
+
+  /*
+   * Send the setting changes made until the matching end_batch() as a single
+   * GPIB message. sync() sends whatever has been collected so far.
+   */
+  void begin_batch()
+  {
+    settings.beginBatch(address);
+  }
+
+  void end_batch()
+  {
+    settings.endBatch();
+  }
+
   std::string get_device_description()
   {
     char desc[BUF_SIZE];
-    gInterface->getDeviceDesc(desc, BUF_SIZE);
+    gInterface->getDeviceDesc(address, desc, BUF_SIZE);
     return std::string(desc);
   }
 
   double get_reference_amplitude()
   {
-    return settings.get("Sine Output Amplitude").dblVal1;
+    return settings.getDouble(OPT_SINE_AMPLITUDE);
   }
 
   void set_reference_amplitude(double ampl)
   {
-    settings.set(address, "Sine Output Amplitude", ampl);
+    settings.set(address, OPT_SINE_AMPLITUDE, ampl);
   }
 
   int get_harmonic()
   {
-    return settings.get("Detection Harmonic").intVal1;
+    return settings.getInt(OPT_HARMONIC);
   }
 
   void set_harmonic(int harmonic)
   {
-    settings.set(address, "Detection Harmonic", harmonic);
+    settings.set(address, OPT_HARMONIC, harmonic);
   }
 
   double get_reference_phase()
   {
-    return settings.get("Reference Phase Shift").dblVal1;
+    return settings.getDouble(OPT_REF_PHASE);
   }
 
   void set_reference_phase(double phas)
@@ -101,53 +158,53 @@ public:
       std::cout << "Note: phase " << phas << " will be wrapped to the range"
           << "-180 to +180";
     }
-    settings.set(address, "Reference Phase Shift", phas);
+    settings.set(address, OPT_REF_PHASE, phas);
   }
 
   double get_frequency()
   {
-    return settings.get("Reference Frequency").dblVal1;
+    return settings.getDouble(OPT_REF_FREQUENCY);
   }
 
   void set_frequency(double freq)
   {
-    settings.set(address, "Reference Frequency", freq);
+    settings.set(address, OPT_REF_FREQUENCY, freq);
   }
 
   void ground_shield()
   {
-    settings.set(address, "Input Shield Grounding", 1);
+    settings.set(address, OPT_SHIELD_GROUND, 1);
   }
 
   void float_shield()
   {
-    settings.set(address, "Input Shield Grounding", 0);
+    settings.set(address, OPT_SHIELD_GROUND, 0);
   }
 
   void internal_reference()
   {
-    settings.set(address, "Reference Source", 1);
+    settings.set(address, OPT_REF_SOURCE, 1);
   }
 
   void AC_couple()
   {
-    settings.set(address, "Input Coupling", 0);
+    settings.set(address, OPT_INPUT_COUPLING, 0);
   }
 
   void DC_couple()
   {
-    settings.set(address, "Input Coupling", 1);
+    settings.set(address, OPT_INPUT_COUPLING, 1);
   }
 
   int get_time_constant()
   {
-    return settings.get("Time Constant").intVal1;
+    return settings.getInt(OPT_TIME_CONSTANT);
   }
 
   void set_time_constant(int tc)
   {
     if(tc >= 0 && tc <= 19) {
-      settings.set(address, "Time Constant", tc);
+      settings.set(address, OPT_TIME_CONSTANT, tc);
     }
     else {
       std::cout << "SR830: Invalid lowpass filter time constant.\n";
@@ -156,13 +213,13 @@ public:
 
   int get_sensitivity()
   {
-    return settings.get("Sensitivity").intVal1;
+    return settings.getInt(OPT_SENSITIVITY);
   }
 
   void set_sensitivity(int sens)
   {
     if(sens >= 0 && sens <= 26) {
-        settings.set(address, "Sensitivity", sens);
+        settings.set(address, OPT_SENSITIVITY, sens);
     }
     else {
         std::cout << "SR830: Invalid lowpass filter sensitivity.\n";
@@ -171,13 +228,13 @@ public:
 
   int get_order()
   {
-    return settings.get("Low Pass Filter Slope").intVal1;
+    return settings.getInt(OPT_FILTER_SLOPE);
   }
 
   int set_order(int order)
   {
     if(order >= 1 && order <= 4) {
-      settings.set(address, "Low Pass Filter Slope", order-1);
+      settings.set(address, OPT_FILTER_SLOPE, order-1);
       return 1;
     }
     else {
@@ -196,14 +253,10 @@ public:
   void get_AmplPhase(double &ampl, double &phs)
   {
     if(phaseAccessible) {
-      char command[9];
-      strcpy(command, "SNAP?3,4\0");
-      char result[80];
-      gInterface->string_response_command(address, command, result, 80);
-      std::string response(result);
-      int commaLoc = response.find(',');
-      ampl = atof(response.substr(0,commaLoc).c_str());
-      phs  = atof(response.substr(commaLoc+1).c_str());
+      double values[2] = {0, 0};
+      gInterface->numerical_list_response_command(address, "SNAP?3,4", values, 2);
+      ampl = values[0];
+      phs  = values[1];
     }
     else {
       ampl = get_amplitude();
@@ -239,6 +292,17 @@ public:
     }
   }
 
+  /*
+   * Read X and Y at the same instant.
+   */
+  void get_XY(double &x, double &y)
+  {
+    double values[2] = {0, 0};
+    gInterface->numerical_list_response_command(address, "SNAP?1,2", values, 2);
+    x = values[0];
+    y = values[1];
+  }
+
   double get_X()
   {
     char command[8];
@@ -255,12 +319,12 @@ public:
 
   void set_auxout1(double xvol)
   {
-    settings.set(address, "Aux Out 1", xvol);
+    settings.set(address, OPT_AUX_OUT_1, xvol);
   }
 
   void set_auxout2(double yvol)
   {
-      settings.set(address, "Aux Out 2", yvol);
+      settings.set(address, OPT_AUX_OUT_2, yvol);
   }
 
   double get_auxin1()
@@ -277,6 +341,57 @@ public:
     return gInterface->numerical_response_command(address, command);
   }
 
+  /*
+   * Clear the data buffer and start storing CH1 and CH2 at the sample rate
+   * with index `rate` (0 = 62.5 mHz ... 13 = 512 Hz). Storage stops when the
+   * buffer is full.
+   */
+  void buffer_start(int rate)
+  {
+    begin_batch();
+    gInterface->send_command_async(address, "REST");
+    settings.set(address, OPT_SAMPLE_RATE, rate);
+    settings.set(address, OPT_BUFFER_MODE, 0);
+    settings.set(address, OPT_TRIGGER_START, 0);
+    gInterface->send_command_async(address, "STRT");
+    end_batch();
+  }
+
+  void buffer_pause()
+  {
+    gInterface->send_command_async(address, "PAUS");
+  }
+
+  /*
+   * Returns the number of points stored in the data buffer.
+   */
+  int buffer_points()
+  {
+    char command[6];
+    strcpy(command, "SPTS?");
+    return gInterface->integer_response_command(address, command);
+  }
+
+  /*
+   * Read `count` points of channel 1 or 2 from the data buffer, starting at
+   * bin `start`, in a single binary transfer. Returns the number of values
+   * stored in `values`.
+   */
+  int buffer_read(int channel, int start, int count, double* values)
+  {
+    char command[40];
+    snprintf(command, 40, "TRCL?%d,%d,%d", channel, start, count);
+    if((int) traceBuffer.size() < 4*count) {
+      traceBuffer.resize(4*count);
+    }
+    int len = gInterface->binary_response_command(
+      address, command, traceBuffer.data(), 4*count
+    );
+    int n = len / 4;
+    decodeTRCL((const unsigned char*) traceBuffer.data(), n, values);
+    return n;
+  }
+
 };
 
 #endif
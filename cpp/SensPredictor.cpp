@@ -0,0 +1,109 @@
+// SensPredictor.cpp
+// encoding: utf-8
+//
+// Prediction of the lock-in sensitivity needed at the next point of a sweep.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 21:48:05
+// Modified: 2026-10-16 21:48:05
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#include "SensPredictor.h"
+
+#include <cmath>
+
+
+// ===== Method Implementation for class SensPredictor =========================
+
+SensPredictor::SensPredictor()
+{
+  start(std::vector<double>());
+}
+
+
+void SensPredictor::start(const std::vector<double>& positions)
+{
+  this->positions = positions;
+  prior.assign(positions.size(), 0);
+  passPoints.clear();
+  passAmpls.clear();
+  preset = 0;
+  hunted = 0;
+  huntedWait = 0;
+}
+
+
+void SensPredictor::startPass()
+{
+  for(size_t k = 0; k < passPoints.size(); k++) {
+    prior[passPoints[k]] = passAmpls[k];
+  }
+  passPoints.clear();
+  passAmpls.clear();
+}
+
+
+void SensPredictor::add(int point, double ampl)
+{
+  if(point < 0 || point >= (int) prior.size() || !(ampl > 0)) {
+    return;
+  }
+  passPoints.push_back(point);
+  passAmpls.push_back(ampl);
+}
+
+
+bool SensPredictor::predict(int point, double& ampl) const
+{
+  if(point < 0 || point >= (int) prior.size()) {
+    return false;
+  }
+  size_t n = passPoints.size();
+  if(prior[point] > 0) {
+    // Same point earlier, following the drift since then
+    double drift = 1;
+    if(n > 0 && prior[passPoints[n-1]] > 0) {
+      drift = passAmpls[n-1] / prior[passPoints[n-1]];
+    }
+    ampl = prior[point] * drift;
+    return true;
+  }
+  if(n == 0) {
+    return false;
+  }
+  ampl = passAmpls[n-1];
+  if(n > 1) {
+    double u1 = positions[passPoints[n-2]];
+    double u2 = positions[passPoints[n-1]];
+    if(u1 != u2) {
+      double slope = log(passAmpls[n-1] / passAmpls[n-2]) / (u2 - u1);
+      double step = slope * (positions[point] - u2);
+      double limit = log((double) SENS_PREDICT_MAX_STEP);
+      ampl *= exp(fmax(-limit, fmin(limit, step)));
+    }
+  }
+  return true;
+}
@@ -0,0 +1,112 @@
+// SensPredictor.h
+// encoding: utf-8
+//
+// Prediction of the lock-in sensitivity needed at the next point of a sweep.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 21:48:05
+// Modified: 2026-10-16 21:48:05
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#ifndef SENSPREDICTOR_H
+#define SENSPREDICTOR_H
+
+#include <stddef.h>
+#include <vector>
+
+// Largest factor by which the trend of a pass may change the amplitude from
+// one point to the next
+#define SENS_PREDICT_MAX_STEP 10
+
+
+/*
+ * class SensPredictor
+ *
+ * Predicts the signal amplitude at the next point of the innermost level of
+ * a sweep, so that the sensitivity can be set together with the point,
+ * before the settling wait, instead of being found by trial afterwards.
+ *
+ * Every point of the level has a position along it (the value, its log10
+ * for a log-spaced level, or its index). The prediction at a point is, by
+ * preference:
+ *   - the amplitude measured there in an earlier pass (another repeat or
+ *     direction, or under the previous point of an outer level), scaled by
+ *     how the last point of this pass compares with its own earlier value;
+ *   - the trend of the last two points of this pass, extrapolated in log
+ *     amplitude and limited to a factor of SENS_PREDICT_MAX_STEP;
+ *   - the amplitude at the last point of this pass.
+ *
+ * It also counts sensitivity changes over a sweep: those made ahead of the
+ * wait, and those found by trial after it, each of which costs a wait.
+ */
+class SensPredictor {
+  std::vector<double> positions;
+
+  // Amplitude at each point in the passes before this one; 0 if unknown
+  std::vector<double> prior;
+
+  // Points measured in this pass, and their amplitudes
+  std::vector<int> passPoints;
+  std::vector<double> passAmpls;
+
+public:
+  // Sensitivity changes made ahead of the wait
+  long preset;
+
+  // Sensitivity changes found by trial, and the time (ms) waited for them
+  long hunted;
+  long long huntedWait;
+
+  SensPredictor();
+
+
+  /*
+   * Start a sweep whose innermost level has points at `positions`.
+   */
+  void start(const std::vector<double>& positions);
+
+
+  /*
+   * Start a new pass over the level.
+   */
+  void startPass();
+
+
+  /*
+   * Record amplitude `ampl` measured at point `point`.
+   */
+  void add(int point, double ampl);
+
+
+  /*
+   * Predict the amplitude at point `point` into `ampl`. Returns false if
+   * nothing is known yet.
+   */
+  bool predict(int point, double& ampl) const;
+
+};
+
+#endif
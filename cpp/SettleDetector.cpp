@@ -0,0 +1,158 @@
+// SettleDetector.cpp
+// encoding: utf-8
+//
+// Detection of the lock-in output settling after a setting change.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 21:12:57
+// Modified: 2026-10-16 21:12:57
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#include "SettleDetector.h"
+
+#include <cmath>
+
+
+SettleDetector::SettleDetector()
+{
+  start(SETTLE_FIXED, 0, 1, 0, 0);
+}
+
+
+void SettleDetector::start(
+  int mode, int filtSlope, double tau, double tolerance, double fullScale
+)
+{
+  this->mode = mode;
+  this->order = filtSlope + 1;
+  this->tau = tau;
+  this->tolerance = tolerance;
+  floor = 0.01 * fullScale;
+  count = 0;
+  fitted = false;
+}
+
+
+bool SettleDetector::add(double t, double x, double y)
+{
+  int newest = count % SETTLE_WINDOW;
+  this->t[newest] = t;
+  this->x[newest] = x;
+  this->y[newest] = y;
+  count++;
+  switch(mode) {
+    case SETTLE_MODEL: return addModel(newest);
+    case SETTLE_CONVERGE: return addConverge();
+    default: return false;
+  }
+}
+
+
+/*
+ * Fit the final value to the newest and the oldest kept reading: the longer
+ * the baseline, the less the fit amplifies noise.
+ */
+bool SettleDetector::addModel(int newest)
+{
+  if(count < 2) {
+    return false;
+  }
+  int oldest = (count < SETTLE_WINDOW) ? 0 : count % SETTLE_WINDOW;
+  double e1 = remaining(t[oldest]);
+  double e2 = remaining(t[newest]);
+  double stepX = 0;
+  double stepY = 0;
+  if(e1 - e2 > 1e-12) {
+    stepX = (x[newest] - x[oldest]) / (e1 - e2);
+    stepY = (y[newest] - y[oldest]) / (e1 - e2);
+  }
+  double fx = x[newest] + stepX * e2;
+  double fy = y[newest] + stepY * e2;
+
+  double limit = tolerance * fmax(hypot(fx, fy), floor);
+  bool settled = fitted
+      && hypot(fx - finalX, fy - finalY) <= limit
+      && hypot(stepX, stepY) * e2 <= limit;
+  fitted = true;
+  finalX = fx;
+  finalY = fy;
+  return settled;
+}
+
+
+bool SettleDetector::addConverge()
+{
+  if(count < SETTLE_WINDOW) {
+    return false;
+  }
+  int oldest = count % SETTLE_WINDOW;
+  int newest = (count - 1) % SETTLE_WINDOW;
+  // Readings taken within the delay of the cascade all look alike
+  if(t[newest] - t[oldest] < tau || t[newest] < order * tau) {
+    return false;
+  }
+  double mx = 0;
+  double my = 0;
+  for(int k = 0; k < SETTLE_WINDOW; k++) {
+    mx += x[k];
+    my += y[k];
+  }
+  mx /= SETTLE_WINDOW;
+  my /= SETTLE_WINDOW;
+  double limit = tolerance * fmax(hypot(mx, my), floor);
+  for(int k = 0; k < SETTLE_WINDOW; k++) {
+    if(hypot(x[k] - mx, y[k] - my) > limit) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+int SettleDetector::pollInterval() const
+{
+  int ms = (int) (500 * tau);
+  if(ms < SETTLE_MIN_POLL_MS) {
+    return SETTLE_MIN_POLL_MS;
+  }
+  return (ms > SETTLE_MAX_POLL_MS) ? SETTLE_MAX_POLL_MS : ms;
+}
+
+
+double SettleDetector::remaining(double t) const
+{
+  if(t <= 0) {
+    return 1;
+  }
+  double u = t / tau;
+  double sum = 0;
+  double term = 1;
+  for(int k = 0; k < order; k++) {
+    sum += term;
+    term *= u / (k + 1);
+  }
+  return exp(-u) * sum;
+}
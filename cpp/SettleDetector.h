@@ -0,0 +1,133 @@
+// SettleDetector.h
+// encoding: utf-8
+//
+// Detection of the lock-in output settling after a setting change.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 21:12:57
+// Modified: 2026-10-16 21:12:57
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#ifndef SETTLEDETECTOR_H
+#define SETTLEDETECTOR_H
+
+// Readings kept by the detector; the convergence test needs all of them
+#define SETTLE_WINDOW 4
+
+// Polling interval while settling, between these bounds (ms)
+#define SETTLE_MIN_POLL_MS 20
+#define SETTLE_MAX_POLL_MS 500
+
+
+/*
+ * How the sweep waits after changing a setting.
+ *
+ *   SETTLE_FIXED - wait the full time
+ *   SETTLE_MODEL - fit the step response of the low-pass filter to the
+ *       readings and stop when the fitted final value is stable and the
+ *       predicted remaining error is within tolerance
+ *   SETTLE_CONVERGE - stop when SETTLE_WINDOW readings spanning at least one
+ *       time constant, and past the delay of the filter, agree within
+ *       tolerance; assumes nothing else about the response
+ */
+enum SettleMode {
+  SETTLE_FIXED,
+  SETTLE_MODEL,
+  SETTLE_CONVERGE
+};
+
+
+/*
+ * class SettleDetector
+ *
+ * Decides from a series of (X, Y) readings taken after a setting change
+ * whether the lock-in output has settled. The caller polls the outputs at
+ * pollInterval() and stops waiting when add() returns true, keeping its
+ * fixed wait as the upper bound.
+ *
+ * The filter of slope index n (6, 12, 18 or 24 dB/oct) is n+1 identical
+ * poles of time constant tau. After a step at t = 0, the fraction of the
+ * step still to come is
+ *   e(t) = exp(-t/tau) * sum_{k<=n} (t/tau)^k / k!
+ * so two readings y1, y2 at t1, t2 give the final value
+ *   y = y2 + (y2 - y1) e(t2) / (e(t1) - e(t2))
+ */
+class SettleDetector {
+  int mode;
+  int order;
+  double tau;
+  double tolerance;
+  double floor;
+
+  // Last SETTLE_WINDOW readings, oldest at (count % SETTLE_WINDOW) once full
+  int count;
+  double t[SETTLE_WINDOW];
+  double x[SETTLE_WINDOW];
+  double y[SETTLE_WINDOW];
+
+  // Final value fitted to the previous reading
+  bool fitted;
+  double finalX;
+  double finalY;
+
+  bool addModel(int newest);
+  bool addConverge();
+
+public:
+  SettleDetector();
+
+
+  /*
+   * Start watching a new settling period. `filtSlope` and `tau` (s) describe
+   * the low-pass filter; `tolerance` is relative to the signal amplitude, but
+   * never finer than that fraction of 1% of `fullScale` (V), so that small
+   * signals are not held to their own noise.
+   */
+  void start(int mode, int filtSlope, double tau, double tolerance, double fullScale);
+
+
+  /*
+   * Add the reading (x, y), taken `t` seconds after the setting change.
+   * Returns true once the output has settled.
+   */
+  bool add(double t, double x, double y);
+
+
+  /*
+   * Interval (ms) at which to take readings.
+   */
+  int pollInterval() const;
+
+
+  /*
+   * Fraction of a step still to come `t` seconds after it, for the current
+   * filter.
+   */
+  double remaining(double t) const;
+
+};
+
+#endif
@@ -0,0 +1,211 @@
+// StreamCapture.cpp
+// encoding: utf-8
+//
+// Continuous capture of X and Y using the SR830 fast data transfer mode.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 20:44:16
+// Modified: 2026-10-16 20:51:37
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#include "StreamCapture.h"
+
+#include <cmath>
+#include <string.h>
+
+
+// Delay between STRD and the first stored sample
+#define STRD_DELAY_MS 500
+
+// Samples that may still be in transfer when a read completes
+#define MISSED_TOLERANCE 2
+
+
+/*
+ * Full-scale value (V) of the sensitivity given by index i. Same mapping as
+ * getSensValue() in FreqVoltageXYSweep.cpp.
+ */
+static double sensValue(int i)
+{
+  int m = i % 3;
+  return (m*m + 2*m + 2) * pow(10.0, i/3 - 9.0);
+}
+
+
+StreamCapture::StreamCapture(SR830* lockin, size_t capacity):
+    lockin(lockin), head(0), tail(0), running(false), lastReceive(0),
+    received(0), ringOverruns(0), missedSamples(0)
+{
+  size_t size = 1;
+  while(size < capacity) {
+    size <<= 1;
+  }
+  ring.resize(size);
+  mask = size - 1;
+  scale = 0;
+  rate = 0;
+}
+
+
+StreamCapture::~StreamCapture()
+{
+  stop();
+}
+
+
+bool StreamCapture::start(int rate)
+{
+  if(running || rate < 0 || rate > 13) {
+    return false;
+  }
+  this->rate = 0.0625 * (1 << rate);
+  scale = sensValue(lockin->get_sensitivity()) / 30000;
+  for(int p = 0; p < 2; p++) {
+    savedDisplay[0][p] = lockin->settings.getInt(OPT_CH1_DISPLAY, p);
+    savedDisplay[1][p] = lockin->settings.getInt(OPT_CH2_DISPLAY, p);
+  }
+
+  lockin->begin_batch();
+  lockin->settings.set(lockin->address, OPT_CH1_DISPLAY, 0, 0);
+  lockin->settings.set(lockin->address, OPT_CH2_DISPLAY, 0, 0);
+  lockin->settings.set(lockin->address, OPT_SAMPLE_RATE, rate);
+  lockin->settings.set(lockin->address, OPT_BUFFER_MODE, 1);
+  lockin->settings.set(lockin->address, OPT_TRIGGER_START, 0);
+  lockin->settings.set(lockin->address, OPT_FAST_MODE, 2);
+  lockin->gInterface->send_command_async(lockin->address, "REST");
+  lockin->gInterface->send_command_async(lockin->address, "STRD");
+  lockin->end_batch();
+  lockin->sync();
+
+  streamStart = Clock::now() + std::chrono::milliseconds(STRD_DELAY_MS);
+  lastReceive = 0;
+  received = 0;
+  ringOverruns = 0;
+  missedSamples = 0;
+  running = true;
+  reader = std::thread(&StreamCapture::readerLoop, this);
+  return true;
+}
+
+
+void StreamCapture::stop()
+{
+  if(!running) {
+    return;
+  }
+  running = false;
+  reader.join();
+
+  lockin->begin_batch();
+  lockin->gInterface->send_command_async(lockin->address, "PAUS");
+  lockin->settings.set(lockin->address, OPT_FAST_MODE, 0);
+  lockin->settings.set(lockin->address, OPT_CH1_DISPLAY,
+      savedDisplay[0][0], savedDisplay[0][1]);
+  lockin->settings.set(lockin->address, OPT_CH2_DISPLAY,
+      savedDisplay[1][0], savedDisplay[1][1]);
+  lockin->end_batch();
+  // Discard whatever was streamed after the last read
+  lockin->gInterface->clear_device(lockin->address);
+}
+
+
+/*
+ * Body of the reader thread: read the stream in chunks of about 50 ms, decode
+ * each 4-byte (X, Y) pair and append it to the ring buffer.
+ */
+void StreamCapture::readerLoop()
+{
+  int chunkPoints = (int) (rate / 20);
+  if(chunkPoints < 1) {
+    chunkPoints = 1;
+  }
+  std::vector<char> chunk(4 * (chunkPoints + 1));
+  int carry = 0;
+  std::chrono::duration<double> period(1 / rate);
+
+  while(running) {
+    int n = lockin->gInterface->receive_raw(
+      lockin->address, chunk.data() + carry, 4 * chunkPoints
+    );
+    if(n <= 0) {
+      // Timed out, or storage has not started yet
+      std::this_thread::sleep_for(period);
+      continue;
+    }
+    Clock::time_point now = Clock::now();
+    n += carry;
+    int points = n / 4;
+    const unsigned char* p = (const unsigned char*) chunk.data();
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    for(int k = 0; k < points; k++, p += 4) {
+      if(h - t > mask) {
+        ringOverruns++;
+        continue;
+      }
+      StreamSample& s = ring[h & mask];
+      s.x = (float) (scale * (int16_t) (p[0] | (p[1] << 8)));
+      s.y = (float) (scale * (int16_t) (p[2] | (p[3] << 8)));
+      h++;
+    }
+    head.store(h, std::memory_order_release);
+    carry = n - 4 * points;
+    memmove(chunk.data(), chunk.data() + 4 * points, carry);
+
+    // The read ends as the last sample of the chunk arrives, so every sample
+    // due by then, less those still in transfer, should have been received
+    long total = (received += points);
+    long expected = (long) floor((now - streamStart) / period) + 1;
+    if(expected - total - MISSED_TOLERANCE > missedSamples) {
+      missedSamples = expected - total - MISSED_TOLERANCE;
+    }
+    lastReceive = std::chrono::duration<double>(now - streamStart).count();
+  }
+}
+
+
+size_t StreamCapture::read(StreamSample* out, size_t maxCount)
+{
+  size_t t = tail.load(std::memory_order_relaxed);
+  size_t h = head.load(std::memory_order_acquire);
+  size_t n = (h - t < maxCount) ? h - t : maxCount;
+  for(size_t k = 0; k < n; k++) {
+    out[k] = ring[(t + k) & mask];
+  }
+  tail.store(t + n, std::memory_order_release);
+  return n;
+}
+
+
+StreamStats StreamCapture::get_stats()
+{
+  StreamStats stats;
+  stats.samples = received;
+  stats.ringOverruns = ringOverruns;
+  stats.missedSamples = missedSamples;
+  double elapsed = lastReceive;
+  stats.samplesPerSec = (elapsed > 0) ? stats.samples / elapsed : 0;
+  return stats;
+}
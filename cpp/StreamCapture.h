@@ -0,0 +1,154 @@
+// StreamCapture.h
+// encoding: utf-8
+//
+// Continuous capture of X and Y using the SR830 fast data transfer mode.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 20:44:16
+// Modified: 2026-10-16 20:51:37
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#ifndef STREAMCAPTURE_H
+#define STREAMCAPTURE_H
+
+#include "SR830.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+/*
+ * struct StreamSample
+ *
+ * One fast-mode sample: the CH1 and CH2 outputs, in volts. StreamCapture
+ * sets the displays to X and Y.
+ */
+struct StreamSample {
+  float x;
+  float y;
+};
+
+
+/*
+ * struct StreamStats
+ *
+ * Counters of a StreamCapture.
+ *
+ * Fields:
+ *   samples - samples received from the instrument
+ *   ringOverruns - samples dropped because the ring buffer was full
+ *   missedSamples - largest shortfall of received samples behind those the
+ *       instrument has taken (lost, or still queued when the reader falls
+ *       behind), estimated from the elapsed time and the sample rate
+ *   samplesPerSec - sustained receive rate since the first sample
+ */
+struct StreamStats {
+  long samples;
+  long ringOverruns;
+  long missedSamples;
+  double samplesPerSec;
+};
+
+
+/*
+ * class StreamCapture
+ *
+ * Streams X and Y from an SR830 in fast data transfer mode (FAST 2, STRD).
+ * A dedicated reader thread drains the binary stream through the lockin's
+ * GPIBInterface and decodes it into a single-producer, single-consumer ring
+ * buffer, from which the application takes samples with read().
+ *
+ * While a capture runs the instrument talks continuously, so nothing else may
+ * send commands to it, and its sensitivity must not change.
+ */
+class StreamCapture {
+  typedef std::chrono::steady_clock Clock;
+
+  SR830* lockin;
+
+  // Ring buffer; head is written only by the reader thread and tail only by
+  // the consumer. The capacity is a power of two.
+  std::vector<StreamSample> ring;
+  size_t mask;
+  std::atomic<size_t> head;
+  std::atomic<size_t> tail;
+
+  std::thread reader;
+  std::atomic<bool> running;
+
+  // Volts per count of the 16-bit stream (+/-30000 = +/- full scale)
+  double scale;
+  double rate;
+  Clock::time_point streamStart;
+  std::atomic<double> lastReceive;  // seconds after streamStart
+  int savedDisplay[2][2];  // CH1 and CH2 display settings before start()
+
+  std::atomic<long> received;
+  std::atomic<long> ringOverruns;
+  std::atomic<long> missedSamples;
+
+  void readerLoop();
+
+public:
+  /*
+   * Prepare a capture from `lockin` with room for at least `capacity`
+   * unread samples.
+   */
+  StreamCapture(SR830* lockin, size_t capacity);
+
+  ~StreamCapture();
+
+
+  /*
+   * Start streaming at the data storage sample rate with index `rate`
+   * (0 = 62.5 mHz ... 13 = 512 Hz). Returns false if already running or the
+   * rate is invalid.
+   */
+  bool start(int rate);
+
+
+  /*
+   * Stop streaming, take the instrument out of fast mode and restore its
+   * displays. Samples already in the ring buffer can still be read.
+   */
+  void stop();
+
+
+  /*
+   * Move up to maxCount of the oldest unread samples into `out`. Returns the
+   * number of samples moved. Must be called from one thread only.
+   */
+  size_t read(StreamSample* out, size_t maxCount);
+
+
+  /*
+   * Returns the current counters.
+   */
+  StreamStats get_stats();
+
+};
+
+#endif
@@ -0,0 +1,215 @@
+// SweepBenchmark.cpp
+// encoding: utf-8
+//
+// Throughput of sweeps run at once on several simulated GPIB boards.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-17 03:12:40
+// Modified: 2026-10-17 10:35:08
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+//
+// Usage:
+//
+//   SweepBenchmark [-b boards] [-l lockins] [-p points] [-a samples]
+//
+// Runs the same frequency sweep of `points` points (default 20), averaging
+// `samples` readings per point (default 50), on N x `lockins` lockins at once
+// for N = 1, 2, ... `boards` (default 4; `lockins` default 1), one engine and
+// thread per lockin (see SweepScheduler.h): first with all of them on one
+// simulated board, then with `lockins` on each of N boards. Each reading is a
+// query of its own, so the sweep spends most of its time on the bus. Lockins
+// sharing one bus then take turns, while lockins on separate boards do not,
+// so the sweeps completed per minute of the second run should grow in
+// proportion to N where those of the first stay flat. The bus columns are the
+// fraction of the time the busiest bus was transferring data (a query also
+// holds the bus while the lockin prepares its reply, so a shared bus is
+// saturated well below 100%), and the gain is the throughput on N boards over
+// that on one. With `samples` 1 the sweep is dominated by its waits instead.
+// Outputs go to benchmark_<board>_<address>.txt.
+//
+// Link against the simulated backend; the latencies follow
+// NI4882SIM_TIMESCALE (see ni4882sim.h):
+//
+//   g++ -std=c++17 -O2 -I. -o SweepBenchmark SweepBenchmark.cpp SweepEngine.cpp
+//       AsyncLogger.cpp ComplexAverager.cpp EmulatedSR830.cpp GPIB.cpp
+//       LockinSettings.cpp SensPredictor.cpp SettleDetector.cpp
+//       SweepDataFile.cpp SweepEstimator.cpp SweepJournal.cpp SweepLevel.cpp
+//       SweepPlan.cpp SweepRefiner.cpp SweepScheduler.cpp SweepTextWriter.cpp
+//       ni4882sim.cpp -lpthread
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "AsyncLogger.h"
+#include "GPIB.h"
+#include "ni4882sim.h"
+#include "SweepEngine.h"
+#include "SweepScheduler.h"
+
+
+// First primary address of the lockins of each board
+#define BENCH_FIRST_ADDRESS 8
+
+
+/*
+ * The benchmark sweep: `points` frequencies from 100 Hz to 1 kHz, with
+ * automatic sensitivity at the lockin's time constant, averaging `samples`
+ * readings per point.
+ */
+static SweepConfig benchmarkSweep(int points, int samples)
+{
+  std::map<std::string, std::string> def;
+  def["levels"] = "0 2 0 1 3 4";
+  def["param2"] = "100 1000 " + std::to_string(points) + " 1 10 1 0";
+  def["options"] = "0 1 0 1 -40";
+  def["averaging"] = std::string((samples > 1) ? "1 " : "0 ")
+      + std::to_string(samples) + " 0 9";
+  def["ramp"] = "1";
+  SweepConfig config;
+  std::string error = SweepEngine::parseDefinition(def, config);
+  if(!error.empty()) {
+    std::cerr << "Benchmark sweep: " << error << std::endl;
+  }
+  return config;
+}
+
+
+/*
+ * Run the sweep on `lockins` lockins of each of boards 0 to boards-1 at
+ * once. Returns the sweeps completed per minute, and the largest fraction of
+ * the time a bus was in use in `busLoad`.
+ */
+static double runBoards(
+  int boards, int lockins, const SweepConfig& sweep, AsyncLogger& logger,
+  double* busLoad
+)
+{
+  std::vector<GPIBInterface*> interfaces;
+  for(int b = 0; b < boards; b++) {
+    interfaces.push_back(new GPIBInterface(b));
+  }
+
+  int completed;
+  double seconds;
+  {
+    SweepScheduler scheduler(logger);
+    for(int b = 0; b < boards; b++) {
+      for(int l = 0; l < lockins; l++) {
+        int pad = BENCH_FIRST_ADDRESS + l;
+        SweepEngine* engine = scheduler.add(interfaces[b], pad);
+        engine->config = sweep;
+        engine->config.fileName = "benchmark_" + std::to_string(b) + "_"
+            + std::to_string(pad) + ".txt";
+      }
+    }
+    for(int b = 0; b < boards; b++) {
+      simResetBusStats(b);
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    completed = scheduler.run();
+    seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start
+    ).count();
+  }
+
+  *busLoad = 0;
+  for(int b = 0; b < boards; b++) {
+    *busLoad = std::max(*busLoad, simGetBusStats(b).busyMicros / 1e6 / seconds);
+    delete interfaces[b];
+  }
+  return 60 * completed / seconds;
+}
+
+
+int main(int argc, char** argv)
+{
+  int maxBoards = 4;
+  int lockins = 1;
+  int points = 20;
+  int samples = 50;
+  for(int k = 1; k + 1 < argc; k += 2) {
+    std::string arg = argv[k];
+    if(arg == "-b") {
+      maxBoards = atoi(argv[k + 1]);
+    } else if(arg == "-l") {
+      lockins = atoi(argv[k + 1]);
+    } else if(arg == "-p") {
+      points = atoi(argv[k + 1]);
+    } else if(arg == "-a") {
+      samples = atoi(argv[k + 1]);
+    } else {
+      std::cerr << "Usage: SweepBenchmark [-b boards] [-l lockins] [-p points]"
+          << " [-a samples]" << std::endl;
+      return 2;
+    }
+  }
+  if(maxBoards < 1 || lockins < 1 || points < 1 || samples < 1) {
+    std::cerr << "Boards, lockins, points and samples must be at least 1"
+        << std::endl;
+    return 2;
+  }
+  if(BENCH_FIRST_ADDRESS + maxBoards * lockins > 31) {
+    std::cerr << "At most " << 31 - BENCH_FIRST_ADDRESS
+        << " lockins fit on one board" << std::endl;
+    return 2;
+  }
+
+  // Board 0 holds every lockin for the runs on one bus
+  for(int l = 0; l < maxBoards * lockins; l++) {
+    simAttachSR830(0, BENCH_FIRST_ADDRESS + l);
+  }
+  for(int b = 1; b < maxBoards; b++) {
+    for(int l = 0; l < lockins; l++) {
+      simAttachSR830(b, BENCH_FIRST_ADDRESS + l);
+    }
+  }
+  AsyncLogger logger("sweep_benchmark_log.txt");
+  SweepConfig sweep = benchmarkSweep(points, samples);
+
+  printf("                  one board          N boards\n");
+  printf("     N  lockins  sweeps/min  bus  sweeps/min  bus  gain\n");
+  for(int boards = 1; boards <= maxBoards; boards++) {
+    double sharedLoad;
+    double shared = runBoards(1, boards * lockins, sweep, logger, &sharedLoad);
+    double spreadLoad = sharedLoad;
+    double spread = shared;
+    if(boards > 1) {
+      spread = runBoards(boards, lockins, sweep, logger, &spreadLoad);
+    }
+    printf("%6d  %7d  %10.2f  %3.0f%%  %10.2f  %3.0f%%  %4.2f\n", boards,
+        boards * lockins, shared, 100 * sharedLoad, spread, 100 * spreadLoad,
+        (shared > 0) ? spread / shared : 0);
+    fflush(stdout);
+  }
+  logger.close();
+  return 0;
+}
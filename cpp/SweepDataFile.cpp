@@ -0,0 +1,486 @@
+// SweepDataFile.cpp
+// encoding: utf-8
+//
+// Chunked, columnar binary file of sweep measurements.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 20:56:26
+// Modified: 2026-10-16 21:05:57
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#include "SweepDataFile.h"
+#include "SweepJournal.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+/*
+ * Size in bytes of a chunk of `rows` rows with `numCoords` coordinates.
+ */
+static size_t chunkBytes(uint32_t numCoords, uint32_t rows)
+{
+  return (size_t) rows * (8 * (numCoords + SWEEP_DOUBLE_COLUMNS) + 4 * SWEEP_INT_COLUMNS);
+}
+
+
+// ===== Method Implementation for class SweepDataWriter =======================
+
+SweepDataWriter::SweepDataWriter(): file(NULL), position(0), chunkFill(0), totalRows(0)
+{
+  memset(&header, 0, sizeof(header));
+}
+
+
+SweepDataWriter::~SweepDataWriter()
+{
+  if(file != NULL) {
+    close();
+  }
+}
+
+
+bool SweepDataWriter::open(
+  const char* fileName, const std::vector<std::string>& coordNames,
+  const std::string& metadata
+)
+{
+  file = fopen(fileName, "wb");
+  if(file == NULL) {
+    return false;
+  }
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SWEEP_FILE_MAGIC, 8);
+  header.version = SWEEP_FILE_VERSION;
+  header.numCoords = (coordNames.size() < SWEEP_MAX_COORDS) ? coordNames.size() : SWEEP_MAX_COORDS;
+  header.chunkRows = SWEEP_CHUNK_ROWS;
+  for(uint32_t k = 0; k < header.numCoords; k++) {
+    strncpy(header.coordNames[k], coordNames[k].c_str(), SWEEP_COORD_NAME - 1);
+  }
+  fwrite(&header, sizeof(header), 1, file);
+  position = sizeof(header);
+
+  chunk.assign(chunkBytes(header.numCoords, header.chunkRows), 0);
+  chunkFill = 0;
+  totalRows = 0;
+  chunks.clear();
+  runs.clear();
+  this->metadata = metadata;
+  return true;
+}
+
+
+bool SweepDataWriter::reopen(
+  const char* fileName, uint64_t rows, const std::string& metadata
+)
+{
+  file = fopen(fileName, "r+b");
+  if(file == NULL) {
+    return false;
+  }
+  bool valid = fread(&header, sizeof(header), 1, file) == 1
+      && memcmp(header.magic, SWEEP_FILE_MAGIC, 8) == 0
+      && header.version == SWEEP_FILE_VERSION
+      && header.numCoords > 0 && header.numCoords <= SWEEP_MAX_COORDS
+      && header.chunkRows > 0;
+  size_t size = valid ? chunkBytes(header.numCoords, header.chunkRows) : 0;
+  uint64_t fullChunks = valid ? rows / header.chunkRows : 0;
+  chunkFill = valid ? rows % header.chunkRows : 0;
+  uint64_t keep = sizeof(header) + (fullChunks + (chunkFill > 0)) * size;
+  fseek(file, 0, SEEK_END);
+  if(!valid || fileTell(file) < (long long) keep) {
+    fclose(file);
+    file = NULL;
+    return false;
+  }
+
+  // Rebuild the chunk index and the runs of the outermost coordinate, which
+  // is the first column of every chunk
+  chunk.assign(size, 0);
+  chunks.clear();
+  runs.clear();
+  totalRows = 0;
+  position = sizeof(header);
+  for(uint64_t c = 0; c <= fullChunks; c++) {
+    uint32_t n = (c < fullChunks) ? header.chunkRows : chunkFill;
+    if(n == 0) {
+      break;
+    }
+    fileSeek(file, position);
+    fread(chunk.data(), 1, size, file);
+    const double* outer = (const double*) chunk.data();
+    for(uint32_t k = 0; k < n; k++) {
+      extendRun(outer[k]);
+      totalRows++;
+    }
+    if(c < fullChunks) {
+      SweepChunkEntry entry = {position, n, 0};
+      chunks.push_back(entry);
+      position += size;
+    }
+  }
+  // The partly filled chunk stays in `chunk`, to be rewritten in place
+  if(chunkFill == 0) {
+    memset(chunk.data(), 0, size);
+  }
+  fclose(file);
+  file = NULL;
+  if(!fileTruncate(fileName, keep)) {
+    return false;
+  }
+  file = fopen(fileName, "r+b");
+  this->metadata = metadata;
+  return file != NULL;
+}
+
+
+bool SweepDataWriter::isOpen()
+{
+  return file != NULL;
+}
+
+
+void SweepDataWriter::append(
+  const double* coords, double r, double theta, double stdDev,
+  int sensitivity, int timeConstant
+)
+{
+  const uint32_t n = header.chunkRows;
+  double* doubles = (double*) chunk.data();
+  for(uint32_t k = 0; k < header.numCoords; k++) {
+    doubles[k*n + chunkFill] = coords[k];
+  }
+  double* measured = doubles + header.numCoords*n;
+  measured[COL_R*n + chunkFill] = r;
+  measured[COL_THETA*n + chunkFill] = theta;
+  measured[COL_STDDEV*n + chunkFill] = stdDev;
+  int32_t* ints = (int32_t*) (doubles + (header.numCoords + SWEEP_DOUBLE_COLUMNS)*n);
+  ints[chunkFill] = sensitivity;
+  ints[n + chunkFill] = timeConstant;
+
+  extendRun((header.numCoords > 0) ? coords[0] : 0);
+
+  chunkFill++;
+  totalRows++;
+  if(chunkFill == n) {
+    writeChunk();
+  }
+}
+
+
+/*
+ * Extend the current run of the outermost coordinate with a row at
+ * totalRows, or start a new one.
+ */
+void SweepDataWriter::extendRun(double outer)
+{
+  if(runs.empty() || runs.back().value != outer) {
+    SweepOuterRun run = {outer, totalRows, 0};
+    runs.push_back(run);
+  }
+  runs.back().rows++;
+}
+
+
+void SweepDataWriter::writeChunk()
+{
+  SweepChunkEntry entry = {position, chunkFill, 0};
+  // sync() may have left the file position past this chunk
+  fileSeek(file, position);
+  fwrite(chunk.data(), 1, chunk.size(), file);
+  position += chunk.size();
+  chunks.push_back(entry);
+  memset(chunk.data(), 0, chunk.size());
+  chunkFill = 0;
+}
+
+
+void SweepDataWriter::sync()
+{
+  if(file == NULL) {
+    return;
+  }
+  if(chunkFill > 0) {
+    fileSeek(file, position);
+    fwrite(chunk.data(), 1, chunk.size(), file);
+  }
+  fileSync(file);
+}
+
+
+uint64_t SweepDataWriter::rows()
+{
+  return totalRows;
+}
+
+
+void SweepDataWriter::close()
+{
+  if(file == NULL) {
+    return;
+  }
+  if(chunkFill > 0) {
+    writeChunk();
+  }
+  fileSeek(file, position);
+  SweepFileTrailer trailer;
+  memset(&trailer, 0, sizeof(trailer));
+  trailer.metadataOffset = position;
+  trailer.metadataLength = metadata.size();
+  fwrite(metadata.data(), 1, metadata.size(), file);
+  // Keep the index 8-byte aligned in the mapping
+  static const char pad[8] = {0};
+  size_t padLen = (8 - metadata.size() % 8) % 8;
+  fwrite(pad, 1, padLen, file);
+  trailer.indexOffset = position + metadata.size() + padLen;
+  trailer.numChunks = chunks.size();
+  fwrite(chunks.data(), sizeof(SweepChunkEntry), chunks.size(), file);
+  trailer.runsOffset = trailer.indexOffset + chunks.size()*sizeof(SweepChunkEntry);
+  trailer.numRuns = runs.size();
+  fwrite(runs.data(), sizeof(SweepOuterRun), runs.size(), file);
+  trailer.totalRows = totalRows;
+  memcpy(trailer.magic, SWEEP_FILE_MAGIC, 8);
+  fwrite(&trailer, sizeof(trailer), 1, file);
+  fclose(file);
+  file = NULL;
+}
+
+
+// ===== Method Implementation for class SweepDataReader =======================
+
+SweepDataReader::SweepDataReader():
+    data(NULL), length(0), header(NULL), trailer(NULL), chunks(NULL), runs(NULL)
+#ifdef _WIN32
+    , fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL)
+#else
+    , fd(-1)
+#endif
+{
+}
+
+
+SweepDataReader::~SweepDataReader()
+{
+  close();
+}
+
+
+bool SweepDataReader::open(const char* fileName)
+{
+  close();
+#ifdef _WIN32
+  fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(fileHandle == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size;
+  GetFileSizeEx(fileHandle, &size);
+  length = size.QuadPart;
+  mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+  if(mappingHandle != NULL) {
+    data = (const char*) MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+  }
+#else
+  fd = ::open(fileName, O_RDONLY);
+  if(fd < 0) {
+    return false;
+  }
+  struct stat st;
+  fstat(fd, &st);
+  length = st.st_size;
+  if(length > 0) {
+    void* p = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    data = (p == MAP_FAILED) ? NULL : (const char*) p;
+  }
+#endif
+  if(data == NULL || length < sizeof(SweepFileHeader) + sizeof(SweepFileTrailer)) {
+    close();
+    return false;
+  }
+
+  header = (const SweepFileHeader*) data;
+  trailer = (const SweepFileTrailer*) (data + length - sizeof(SweepFileTrailer));
+  bool valid =
+      memcmp(header->magic, SWEEP_FILE_MAGIC, 8) == 0
+      && memcmp(trailer->magic, SWEEP_FILE_MAGIC, 8) == 0
+      && header->version == SWEEP_FILE_VERSION
+      && header->numCoords <= SWEEP_MAX_COORDS
+      && trailer->metadataOffset + trailer->metadataLength <= length
+      && trailer->indexOffset + trailer->numChunks*sizeof(SweepChunkEntry) <= length
+      && trailer->runsOffset + trailer->numRuns*sizeof(SweepOuterRun) <= length;
+  if(valid) {
+    chunks = (const SweepChunkEntry*) (data + trailer->indexOffset);
+    runs = (const SweepOuterRun*) (data + trailer->runsOffset);
+    size_t size = chunkBytes(header->numCoords, header->chunkRows);
+    for(size_t c = 0; c < trailer->numChunks && valid; c++) {
+      valid = chunks[c].offset + size <= length && chunks[c].rows <= header->chunkRows;
+    }
+  }
+  if(!valid) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+
+void SweepDataReader::close()
+{
+#ifdef _WIN32
+  if(data != NULL) {
+    UnmapViewOfFile(data);
+  }
+  if(mappingHandle != NULL) {
+    CloseHandle(mappingHandle);
+  }
+  if(fileHandle != INVALID_HANDLE_VALUE) {
+    CloseHandle(fileHandle);
+  }
+  mappingHandle = NULL;
+  fileHandle = INVALID_HANDLE_VALUE;
+#else
+  if(data != NULL) {
+    munmap((void*) data, length);
+  }
+  if(fd >= 0) {
+    ::close(fd);
+  }
+  fd = -1;
+#endif
+  data = NULL;
+  length = 0;
+  header = NULL;
+  trailer = NULL;
+  chunks = NULL;
+  runs = NULL;
+}
+
+
+int SweepDataReader::numCoords()
+{
+  return header->numCoords;
+}
+
+
+const char* SweepDataReader::coordName(int coord)
+{
+  return header->coordNames[coord];
+}
+
+
+uint64_t SweepDataReader::numRows()
+{
+  return trailer->totalRows;
+}
+
+
+size_t SweepDataReader::numChunks()
+{
+  return trailer->numChunks;
+}
+
+
+uint32_t SweepDataReader::chunkRows(size_t chunk)
+{
+  return chunks[chunk].rows;
+}
+
+
+const char* SweepDataReader::metadata(size_t& len)
+{
+  len = trailer->metadataLength;
+  return data + trailer->metadataOffset;
+}
+
+
+/*
+ * Offset from the chunk start of double column `doubleColumn` (coordinates
+ * first, then R, theta, stdDev).
+ */
+size_t SweepDataReader::columnOffset(int doubleColumn)
+{
+  return (size_t) doubleColumn * header->chunkRows * 8;
+}
+
+
+const double* SweepDataReader::coordColumn(size_t chunk, int coord)
+{
+  return (const double*) (data + chunks[chunk].offset + columnOffset(coord));
+}
+
+
+const double* SweepDataReader::column(size_t chunk, SweepColumn col)
+{
+  return (const double*) (
+    data + chunks[chunk].offset + columnOffset(header->numCoords + col)
+  );
+}
+
+
+const int32_t* SweepDataReader::intColumn(size_t chunk, SweepColumn col)
+{
+  const char* ints = data + chunks[chunk].offset
+      + columnOffset(header->numCoords + SWEEP_DOUBLE_COLUMNS);
+  return (const int32_t*) ints + (size_t) (col - COL_SENSITIVITY) * header->chunkRows;
+}
+
+
+double SweepDataReader::valueAt(uint64_t row, SweepColumn col)
+{
+  size_t chunk = row / header->chunkRows;
+  size_t k = row % header->chunkRows;
+  if(col >= COL_SENSITIVITY) {
+    return intColumn(chunk, col)[k];
+  }
+  return column(chunk, col)[k];
+}
+
+
+double SweepDataReader::coordAt(uint64_t row, int coord)
+{
+  return coordColumn(row / header->chunkRows, coord)[row % header->chunkRows];
+}
+
+
+long SweepDataReader::findOuter(double outerValue, uint64_t& firstRow, uint64_t& rows, size_t run)
+{
+  for(; run < trailer->numRuns; run++) {
+    if(runs[run].value == outerValue) {
+      firstRow = runs[run].firstRow;
+      rows = runs[run].rows;
+      return run;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,274 @@
+// SweepDataFile.h
+// encoding: utf-8
+//
+// Chunked, columnar binary file of sweep measurements.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 20:56:26
+// Modified: 2026-10-16 21:05:57
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#ifndef SWEEPDATAFILE_H
+#define SWEEPDATAFILE_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * File layout (all integers and doubles little-endian):
+ *
+ *   SweepFileHeader
+ *   chunk 0, chunk 1, ... chunk N-1
+ *   settings snapshot (text, metadataLength bytes)
+ *   SweepChunkEntry[N]
+ *   SweepOuterRun[numRuns]
+ *   SweepFileTrailer
+ *
+ * Every chunk has room for chunkRows rows, whether full or not, and stores
+ * its rows column by column: the coordinates of the sweep levels, outermost
+ * first (double), then R, theta and stdDev (double), then the sensitivity and
+ * time constant indices (int32). A column of a chunk is therefore a plain
+ * array at a fixed offset from the chunk start.
+ *
+ * The outer runs list the consecutive rows that share a value of the
+ * outermost coordinate, so a reader can go straight to them.
+ */
+
+#define SWEEP_FILE_MAGIC "LCSWEEP1"
+#define SWEEP_FILE_VERSION 1
+#define SWEEP_MAX_COORDS 8
+#define SWEEP_COORD_NAME 16
+#define SWEEP_CHUNK_ROWS 4096
+
+enum SweepColumn {
+  COL_R,
+  COL_THETA,
+  COL_STDDEV,
+  COL_SENSITIVITY,   // int32
+  COL_TIME_CONSTANT  // int32
+};
+
+#define SWEEP_DOUBLE_COLUMNS 3
+#define SWEEP_INT_COLUMNS 2
+
+struct SweepFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t numCoords;
+  uint32_t chunkRows;
+  uint32_t reserved;
+  char coordNames[SWEEP_MAX_COORDS][SWEEP_COORD_NAME];
+};
+
+struct SweepChunkEntry {
+  uint64_t offset;
+  uint32_t rows;
+  uint32_t reserved;
+};
+
+struct SweepOuterRun {
+  double value;
+  uint64_t firstRow;
+  uint64_t rows;
+};
+
+struct SweepFileTrailer {
+  uint64_t metadataOffset;
+  uint64_t metadataLength;
+  uint64_t indexOffset;
+  uint64_t numChunks;
+  uint64_t runsOffset;
+  uint64_t numRuns;
+  uint64_t totalRows;
+  char magic[8];
+};
+
+
+/*
+ * class SweepDataWriter
+ *
+ * Writes measurements to a sweep data file, one chunk at a time.
+ */
+class SweepDataWriter {
+  FILE* file;
+  uint64_t position;  // bytes written so far
+  SweepFileHeader header;
+  std::vector<char> chunk;
+  uint32_t chunkFill;
+  uint64_t totalRows;
+  std::vector<SweepChunkEntry> chunks;
+  std::vector<SweepOuterRun> runs;
+  std::string metadata;
+
+  void writeChunk();
+  void extendRun(double outer);
+
+public:
+  SweepDataWriter();
+  ~SweepDataWriter();
+
+
+  /*
+   * Create `fileName` for rows with the given coordinates (at most
+   * SWEEP_MAX_COORDS, names truncated to SWEEP_COORD_NAME - 1 characters).
+   * `metadata`, normally the settings snapshot, is stored with the index.
+   * Returns false if the file cannot be created.
+   */
+  bool open(
+    const char* fileName, const std::vector<std::string>& coordNames,
+    const std::string& metadata
+  );
+
+
+  /*
+   * Open the unfinished file `fileName` to continue after its first `rows`
+   * rows, dropping any later rows and the index (for a resumed sweep). The
+   * index is rebuilt from the rows kept; `metadata` replaces the stored
+   * metadata. Returns false if the file is not a sweep data file holding
+   * that many rows.
+   */
+  bool reopen(const char* fileName, uint64_t rows, const std::string& metadata);
+
+
+  bool isOpen();
+
+
+  /*
+   * Add one row. `coords` holds one value per coordinate.
+   */
+  void append(
+    const double* coords, double r, double theta, double stdDev,
+    int sensitivity, int timeConstant
+  );
+
+
+  /*
+   * Write the partly filled chunk in place and have the file written to
+   * disk, so that reopen() can continue after every row appended so far.
+   */
+  void sync();
+
+
+  /*
+   * Number of rows appended.
+   */
+  uint64_t rows();
+
+
+  /*
+   * Write the last chunk, the metadata and the index, and close the file.
+   * Without it, the file cannot be read.
+   */
+  void close();
+
+};
+
+
+/*
+ * class SweepDataReader
+ *
+ * Read access to a sweep data file through a memory mapping. Columns are
+ * returned as pointers into the mapping and are valid until close().
+ */
+class SweepDataReader {
+  const char* data;
+  size_t length;
+  const SweepFileHeader* header;
+  const SweepFileTrailer* trailer;
+  const SweepChunkEntry* chunks;
+  const SweepOuterRun* runs;
+#ifdef _WIN32
+  void* fileHandle;
+  void* mappingHandle;
+#else
+  int fd;
+#endif
+
+  size_t columnOffset(int doubleColumn);
+
+public:
+  SweepDataReader();
+  ~SweepDataReader();
+
+
+  /*
+   * Map `fileName` and check its header and index. Returns false if the
+   * file cannot be mapped or is not a complete sweep data file.
+   */
+  bool open(const char* fileName);
+
+  void close();
+
+
+  int numCoords();
+  const char* coordName(int coord);
+  uint64_t numRows();
+  size_t numChunks();
+  uint32_t chunkRows(size_t chunk);
+
+  /*
+   * Settings snapshot stored with the data (not NUL-terminated).
+   */
+  const char* metadata(size_t& len);
+
+
+  /*
+   * Coordinate `coord` (0 = outermost level) of the rows of `chunk`.
+   */
+  const double* coordColumn(size_t chunk, int coord);
+
+
+  /*
+   * COL_R, COL_THETA or COL_STDDEV of the rows of `chunk`.
+   */
+  const double* column(size_t chunk, SweepColumn col);
+
+
+  /*
+   * COL_SENSITIVITY or COL_TIME_CONSTANT of the rows of `chunk`.
+   */
+  const int32_t* intColumn(size_t chunk, SweepColumn col);
+
+
+  /*
+   * Value of column `col`, or of coordinate `coord`, at row `row` of the file.
+   */
+  double valueAt(uint64_t row, SweepColumn col);
+  double coordAt(uint64_t row, int coord);
+
+
+  /*
+   * Find the next run of rows, starting with run index `run`, whose outermost
+   * coordinate equals `outerValue`. On success, sets firstRow and rows and
+   * returns the run index (pass it + 1 to continue the search); otherwise
+   * returns -1.
+   */
+  long findOuter(double outerValue, uint64_t& firstRow, uint64_t& rows, size_t run = 0);
+
+};
+
+#endif
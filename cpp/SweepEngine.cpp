@@ -0,0 +1,1991 @@
+// SweepEngine.cpp
+// encoding: utf-8
+//
+// Parametric sweep of one lock-in amplifier, independent of the user interface.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 23:05:40
+// Modified: 2026-10-17 10:14:37
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#include "SweepEngine.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "version.h"
+
+
+double getSensValue(int i)
+{
+  int m = i % 3;
+  return (m*m + 2*m + 2) * pow(10.0, i/3 - 9.0);
+}
+
+
+double getTimeConstValue(int i)
+{
+  return (2*(i%2) + 1) * pow(10.0, i/2 - 5.0);
+}
+
+
+double getSampleRateValue(int i)
+{
+  return 0.0625 * (1 << i);
+}
+
+
+int getSampleRate(double rate)
+{
+  int i = (int) floor(log2(rate / 0.0625));
+  return (i < 0) ? 0 : ((i > 13) ? 13 : i);
+}
+
+
+int getTimeConst(double reqTau)
+{
+  double logTau = log10(reqTau);
+  double iPart = floor(logTau);
+  //logger << "   getTimeConst: reqTau is " << reqTau <<std::endl;
+  //logger << "   getTimeConst: logTau is " << logTau <<std::endl;
+  //logger << "   getTimeConst: iPart is " << iPart <<std::endl;
+  //logger << "   getTimeConst: rT / pow() is " << (reqTau / pow(10.0, iPart)) <<std::endl;
+  
+  return (2*iPart) + (((reqTau / pow(10.0, iPart)) > 3)?12:11);
+}
+
+
+double getFiltSlopeValue(int i)
+{
+  return -6.0 *(i+1);
+}
+
+
+double getWaitFactor(int filtSlope)
+{
+  switch(filtSlope) {
+    case 0: return 5.0;
+    case 1: return 7.0;
+    case 2: return 9.0;
+    case 3: return 10.0;
+  }
+}
+
+
+bool outOfRange(double ampl, int sens)
+{
+  double fullScale = getSensValue(sens);
+  double relAmpl   = ampl / fullScale;
+  return (relAmpl < 0.0016) || (relAmpl > 1);
+}
+
+
+int getBestSens(double ampl, int currSens)
+{
+  // Calculate the minimum sensitivity we should jump to, which should not be smaller
+  // than the resolution at the current sensitivity
+  double currSensVal = getSensValue(currSens);
+  double resolution = currSensVal / pow(2, 12);
+  int minSens = currSens;
+  for(int sens = currSens - 1; sens >= 0; sens--) {
+    if(getSensValue(sens) < resolution) {
+      break;
+    }
+    else {
+      minSens = sens;
+    }
+  }
+  double minVal = getSensValue(minSens);
+
+  // Select the appropriate sensitivity
+  if(ampl < 0.9 * minVal) {
+    return minSens;
+  }
+  else if(ampl >= 0.9) {
+    return 26;
+  }
+  else {
+    double logAmp = log10(ampl);
+    double base   = floor(logAmp);
+    double frac   = logAmp - base;
+    
+    int decade = 3 * ( (int) base + 9);
+    int offset;
+    if(frac <= 0.25527) {
+      offset = 0;
+    } else if(frac <= 0.63521) {
+      offset = 1;
+    } else if(frac <= 0.95424) {
+      offset = 2;
+    } else {
+      offset = 3;
+    }
+    return decade + offset;
+  }
+}
+
+
+double getTauReq(double freq, int filtSlope, bool acCouple, double signalToDC)
+{
+  double tau_2f = pow(2, ATTEN_2F / getFiltSlopeValue(filtSlope)) / (4 * M_PI * freq);
+  double tau_1f = pow(
+    2,
+    (signalToDC + ATTEN_2F) / getFiltSlopeValue(filtSlope)
+  ) / (2 * M_PI * freq);
+  if(acCouple) {
+    // ac-coupled input
+    return tau_2f;
+  }
+  else {
+    return fmax(tau_1f, tau_2f);
+  }
+}
+
+
+double millisSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start
+  ).count();
+}
+
+
+struct tm localTime(time_t when)
+{
+  struct tm local;
+#ifdef _WIN32
+  localtime_s(&local, &when);
+#else
+  localtime_r(&when, &local);
+#endif
+  return local;
+}
+
+
+// ===== Method Implementation for struct SweepConfig ==========================
+
+SweepConfig::SweepConfig()
+{
+  setup = SweepParameters();
+  binaryOutput = false;
+  averaging = false;
+  numAvgPts = 10;
+  bufferedAveraging = false;
+  avgSampleRate = 9;
+  avgTargetError = 0;
+  avgMinPts = 5;
+  avgRejectOutliers = false;
+  rampType = RAMP_ALL;
+  holdOnCancel = false;
+  orderTimeConsts = false;
+  refineTolerance = 1;
+  refinePhaseStep = 10;
+  refineMaxPoints = 400;
+  settleMode = SETTLE_FIXED;
+  settleTolerance = 1;
+}
+
+
+// ===== Method Implementation for class SweepEngine ===========================
+
+SweepEngine::SweepEngine(AsyncLogger& log): log(log)
+{
+  lockin = NULL;
+  canceling = false;
+  filterType = 3;
+  resumingSweep = false;
+  // Zeroed, so that the first checkpoint of a sweep is well defined
+  resumePoint = SweepCheckpoint();
+  lastPoint = SweepCheckpoint();
+  avgSamples = 0;
+  avgRejected = 0;
+  rampTime = 0;
+  timingFile = SWEEP_TIMING_FILE;
+  historyFile = SWEEP_TIMING_HISTORY;
+  keepState = false;
+  holdingState = false;
+  restoreSens = restoreTimeConst = restoreDisplays = false;
+}
+
+
+void SweepEngine::setLockin(SR830* lockin)
+{
+  this->lockin = lockin;
+  // State held on another lockin is not this one's to restore
+  holdingState = false;
+  restoreSens = restoreTimeConst = restoreDisplays = false;
+  if(lockin != NULL) {
+    filterType = lockin->settings.getInt(OPT_FILTER_SLOPE);
+    estimator.select(lockin->get_device_description());
+  }
+}
+
+
+void SweepEngine::cancel()
+{
+  std::lock_guard<std::mutex> lock(cancelMutex);
+  canceling = true;
+  cancelWake.notify_all();
+}
+
+
+void SweepEngine::clearCancel()
+{
+  std::lock_guard<std::mutex> lock(cancelMutex);
+  canceling = false;
+}
+
+
+bool SweepEngine::waitCanceled(long millis)
+{
+  std::unique_lock<std::mutex> lock(cancelMutex);
+  return cancelWake.wait_for(lock, std::chrono::milliseconds(millis), [this] {
+    return (bool) canceling;
+  });
+}
+
+
+bool SweepEngine::waitCanceled(Clock::time_point deadline)
+{
+  std::unique_lock<std::mutex> lock(cancelMutex);
+  return cancelWake.wait_until(lock, deadline, [this] {
+    return (bool) canceling;
+  });
+}
+
+
+std::string SweepEngine::outputBase()
+{
+  return outputBase(config.fileName);
+}
+
+
+std::string SweepEngine::outputBase(const std::string& fileName)
+{
+  int idx = fileName.rfind(".txt");
+  return fileName.substr(0, idx);
+}
+
+
+bool SweepEngine::initOutput(SweepTextWriter& outps)
+{
+  // Open the output file where results will be stored: tab-separated text,
+  // or typed columns in a binary file (see SweepDataFile.h)
+  std::string outputFileName = outputBase();
+  bool created = true;
+  if(config.binaryOutput) {
+    outputFileName.append(".sweep");
+  } else {
+    outputFileName.append(".txt");
+    if(!resumingSweep) {
+      created = outps.open(outputFileName.c_str());
+    }
+  }
+  
+  // Modify the file name appropriately for the settings files, and
+  // open the settings file. A resumed sweep adds to it.
+  std::string settingsFileName = outputBase();
+  settingsFileName.append("_settings.txt");
+  settingsLog().open(settingsFileName.c_str(), resumingSweep);
+  if(!created) {
+    log << "Could not create output file " << outputFileName << std::endl;
+    return false;
+  }
+  
+  // Write the lockin device description and current settings to the settings file
+  settingsLog() << "SOFTWARE VERSION: " << SOFTWARE_NAME_VERSION << std::endl;
+  settingsLog() << "LOCK-IN VERSION : " << lockin->get_device_description() << std::endl;
+  if(holdingState) {
+    // Only this engine has changed the settings since the last sweep, so the
+    // cached ones are current
+    settingsLog() << "=== CURRENT SETTINGS CONFIGURATION (cached) ===" << std::endl;
+    lockin->settings.writeAllOptions(&settingsLog().line());
+  } else {
+    lockin->settings.queryAllOptions(lockin->address);
+  }
+  filterType = lockin->settings.getInt(OPT_FILTER_SLOPE);
+  if(resumingSweep) {
+    // Continue the output after the last checkpoint; anything written later
+    // belongs to points that are measured again
+    bool reopened;
+    if(config.binaryOutput) {
+      std::ostringstream snapshot;
+      lockin->settings.writeAllOptions(&snapshot);
+      reopened = dataWriter.reopen(
+        outputFileName.c_str(), resumePoint.outputLength, snapshot.str()
+      );
+    } else {
+      reopened = outps.reopen(outputFileName.c_str(), resumePoint.outputLength);
+    }
+    if(!reopened) {
+      settingsLog() << "Could not reopen output file "
+          << outputFileName << std::endl;
+      return false;
+    }
+    time_t now = time(0);
+    struct tm tmNow = localTime(now);
+    settingsLog() << std::endl << "=== SWEEP RESUMED at "
+        << (1900 + tmNow.tm_year) << "-" << (1 + tmNow.tm_mon) << "-"
+        << tmNow.tm_mday << " " << tmNow.tm_hour << ":" << tmNow.tm_min
+        << ":" << tmNow.tm_sec << " (checkpoint " << resumePoint.sequence
+        << ") ===" << std::endl;
+    return true;
+  }
+  if(config.binaryOutput) {
+    // The settings snapshot goes into the file with the index
+    std::ostringstream snapshot;
+    lockin->settings.writeAllOptions(&snapshot);
+    std::vector<std::string> coordNames;
+    for(int level = 0; level <= config.setup.maxRecursionLevel; level++) {
+      if(config.setup.parameters[level] == SWEEP_CUSTOM) {
+        coordNames.push_back("X");
+        coordNames.push_back("Y");
+      } else {
+        coordNames.push_back(PARAM_DESCRIPTIONS[config.setup.parameters[level]]);
+      }
+    }
+    if(!dataWriter.open(outputFileName.c_str(), coordNames, snapshot.str())) {
+      log << "Could not create output file " << outputFileName << std::endl;
+      return false;
+    }
+  } else {
+    std::ostringstream settingsText;
+    lockin->settings.writeAllOptions(&settingsText);
+    outps << settingsText.str();
+  }
+  
+  // Write header to output file
+  if(!config.binaryOutput) {
+    outps << '\n';
+    for(int i = 0; i < NUM_AVAIL_PARAMS; i++) {
+      if(config.setup.parameters[i] == SWEEP_CUSTOM) {
+        outps << "X\tY\t";
+      } else if(config.setup.parameters[i] == SWEEP_F) {
+        outps << "Frequency\t";
+      } else if(config.setup.parameters[i] == SWEEP_A) {
+        outps << "Amplitude\t";
+      } else if(config.setup.parameters[i] == SWEEP_X) {
+        outps << "X\t";
+      } else if(config.setup.parameters[i] == SWEEP_Y) {
+        outps << "Y\t";
+      }
+    }
+    if(config.averaging) {
+      outps << "R\tTheta\tStdDev\t" << '\n';
+    } else {
+      outps << "R\tTheta\t" << '\n';
+    }
+  }
+  
+  // Log the start time of the sweep
+  time_t now = time(0);
+  struct tm tmNow = localTime(now);
+  settingsLog() << std::endl << "=== SWEEP STARTED at " 
+      << (1900 + tmNow.tm_year) << "-" << (1 + tmNow.tm_mon) << "-"
+      << tmNow.tm_mday << " " << tmNow.tm_hour << ":" << tmNow.tm_min
+      << ":" << tmNow.tm_sec << " ===" << std::endl;
+  return true;
+}
+
+
+void SweepEngine::finalizeOutput(SweepTextWriter& outps)
+{
+  // Log the finish time of the sweep
+  time_t now = time(0);
+  struct tm tmNow = localTime(now);
+  settingsLog() << std::endl << "=== SWEEP ENDED at " 
+      << (1900 + tmNow.tm_year) << "-" << (1 + tmNow.tm_mon) << "-"
+      << tmNow.tm_mday << " " << tmNow.tm_hour << ":" << tmNow.tm_min
+      << ":" << tmNow.tm_sec << " ===" << std::endl;
+  
+  // Flush and close output file
+  if(dataWriter.isOpen()) {
+    dataWriter.close();
+  }
+  outps.flush();
+  outps.close();
+  
+  // Make sure the settings file is complete; the logger keeps writing to it
+  // until the next sweep opens a new one
+  settingsLog().drain();
+}
+
+
+int SweepEngine::runPlan(SweepTextWriter& outps, long firstStep, const int* points)
+{
+  int numLevels = sweepPlan.numLevels();
+  int innermost = numLevels - 1;
+  size_t numSteps = sweepPlan.size();
+  int atPoint[NUM_AVAIL_PARAMS];
+  int waitTime[NUM_AVAIL_PARAMS];
+  for(int level = 0; level < numLevels; level++) {
+    atPoint[level] = 0;
+    waitTime[level] = sweepPlan.level(level).wait;
+  }
+  int initialSens = 0;
+  bool alreadySet = false;
+  bool firstWait = false;
+  bool canceled = false;
+  size_t measured = 0;
+  long long settledTime = 0;
+  long long fixedTime = 0;
+  // Time taken commanding points, waiting, averaging, ramping and refining,
+  // against the planned waits, to learn the timing of the lockin (see
+  // SweepTiming)
+  Clock::time_point started = Clock::now();
+  Clock::time_point shown = started;
+  SweepClock clock = {-1, 0};
+  double doneBefore = 0;
+  double waitingTime = 0;
+  double plannedWait = 0;
+  double commandTime = 0;
+  long commands = 0;
+  double rampSlew = 0;
+  double avgTime = 0;
+  double refineTime = 0;
+  long long refineSamples = 0;
+  long refineHunted = 0;
+  long long refineHuntedWait = 0;
+  SweepRefiner refiner;
+  std::vector<RefinePoint> passRows;
+  std::vector<double> positions;
+  const SweepPlanLevel& inner = sweepPlan.level(innermost);
+  for(size_t p = 0; p < inner.x.size(); p++) {
+    if(inner.param == SWEEP_CUSTOM) {
+      positions.push_back(p);
+    } else {
+      positions.push_back(inner.logSpacing ? log10(inner.x[p]) : inner.x[p]);
+    }
+  }
+  sensPredictor.start(positions);
+  avgSamples = 0;
+  avgRejected = 0;
+  rampTime = 0;
+  for(long k = 0; k < firstStep; k++) {
+    measured += (sweepPlan.step(k).type == STEP_MEASURE);
+    doneBefore += stepTime(config, sweepPlan, sweepPlan.step(k), clock);
+  }
+  size_t measuredBefore = measured;
+  double estimate = planDuration(config, sweepPlan, NULL);
+  estimator.start(estimate, doneBefore);
+  
+  if(firstStep > 0) {
+    // Resuming: put every level back at its point, then continue after the
+    // checkpointed measurement with a first-step wait
+    initialSens = resumePoint.levels[innermost].initialSens;
+    lockin->begin_batch();
+    for(int level = 0; level < numLevels && !canceled; level++) {
+      const SweepPlanLevel& L = sweepPlan.level(level);
+      atPoint[level] = points[level];
+      sweepPos[level] = resumePoint.levels[level];
+      sweepCoords[L.coord] = L.x[points[level]];
+      if(L.param == SWEEP_CUSTOM) {
+        sweepCoords[L.coord + 1] = L.y[points[level]];
+      }
+      setPlanPoint(level, points[level]);
+      if(L.param == SWEEP_F && config.setup.autoTimeConst) {
+        canceled = setAutoTimeConst(L.x[points[level]], &waitTime[level]) == 0;
+      }
+    }
+    lockin->end_batch();
+    firstWait = true;
+  }
+  
+  for(size_t k = firstStep; k < numSteps && !canceled; k++) {
+    const SweepStep& st = sweepPlan.step(k);
+    const SweepPlanLevel& L = sweepPlan.level(st.level);
+    Clock::time_point stepStart = Clock::now();
+    size_t stepFirst = k;
+    switch(st.type) {
+      case STEP_REPEAT:
+        settingsLog() << "At level " << (int) st.level
+            << " of sweep; starting loop #" << st.repeat << std::endl;
+        if(canceling) {
+          logCanceled();
+          canceled = true;
+          break;
+        }
+        // Start a repeat of the innermost level at the sensitivity found at
+        // its first point, if auto-sensitivity is enabled
+        if(config.setup.autoSens && st.level == innermost && st.repeat > 0) {
+          settingsLog() << "Setting initial sensitivity; r = " << st.repeat << std::endl;
+          lockin->set_sensitivity(initialSens);
+        }
+        break;
+      
+      case STEP_SET: {
+        if(canceling) {
+          logCanceled();
+          canceled = true;
+          break;
+        }
+        SweepPosition& pos = sweepPos[st.level];
+        pos.repeat = st.repeat;
+        pos.reversed = st.reversed;
+        pos.index = st.index;
+        atPoint[st.level] = st.point;
+        sweepCoords[L.coord] = st.value;
+        if(L.param == SWEEP_CUSTOM) {
+          sweepCoords[L.coord + 1] = L.y[st.point];
+        }
+        // Command the lockin to set the parameter to the point, unless it was
+        // already queued at the end of the previous measurement. A new
+        // frequency and its time constant go out in the same message.
+        lockin->begin_batch();
+        if(!alreadySet) {
+          setPlanPoint(st.level, st.point);
+        }
+        alreadySet = false;
+        if(L.param == SWEEP_F && config.setup.autoTimeConst) {
+          int* wait = &waitTime[st.level];
+          canceled = ((st.timeConst >= 0) ? setTimeConst(st.timeConst, wait)
+              : setAutoTimeConst(st.value, wait)) == 0;
+        }
+        // Range the signal expected at the point before waiting for it
+        if(st.level == innermost) {
+          if(st.index == 0) {
+            sensPredictor.startPass();
+          }
+          if(config.setup.autoSens) {
+            presetSens(st.point);
+          }
+        }
+        lockin->end_batch();
+        if(L.adaptive && st.index == 0) {
+          refiner.start(L.logSpacing, config.refineTolerance / 100, config.refinePhaseStep,
+              config.refineMaxPoints);
+        }
+        break;
+      }
+      
+      case STEP_WAIT: {
+        // Must wait an additional amount of time on the first step of a sweep
+        int wait = waitTime[st.level];
+        if(st.index == 0 || firstWait) {
+          wait += FIRST_STEP_WAIT;
+        }
+        firstWait = false;
+        // The wait starts once the lockin has taken the commands of the point
+        lockin->sync();
+        commandTime += millisSince(stepStart);
+        stepStart = Clock::now();
+        long waited = settle(wait);
+        if(waited < 0) {
+          canceled = true;
+          break;
+        }
+        if(config.settleMode != SETTLE_FIXED) {
+          settledTime += waited;
+          fixedTime += wait;
+          settingsLog() << "Settled in " << waited
+              << " of " << wait << " ms" << std::endl;
+        }
+        break;
+      }
+      
+      case STEP_MEASURE: {
+        double ampl = 0;
+        double phs = 0;
+        double stdDev = 0;
+        if(
+          doMeasurement(
+            &ampl, &phs, waitTime[st.level], st.repeat, st.index, initialSens
+          ) == 0
+        ) {
+          canceled = true;
+          break;
+        }
+        sensPredictor.add(st.point, ampl);
+        if(config.averaging) {
+          Clock::time_point avgStart = Clock::now();
+          doAveraging(ampl, phs, &ampl, &phs, &stdDev);
+          avgTime += millisSince(avgStart);
+        }
+        
+        // Queue the next point before writing this one, so that the file
+        // output overlaps with the bus transfer. The last point of an
+        // adaptive pass is followed by its refinement instead.
+        bool passDone = st.index + 1 == (int) L.x.size();
+        bool flipped = L.ordered && sweepPlan.isFlipped(st);
+        if(k + 1 < numSteps && !(L.adaptive && passDone)) {
+          const SweepStep& next = sweepPlan.step(k + 1);
+          if(next.type == STEP_SET && next.level == st.level) {
+            setPlanPoint(next.level, next.point);
+            alreadySet = true;
+          }
+        }
+        measured++;
+        
+        if(L.adaptive || flipped) {
+          // The pass is written, and journaled, once it has been refined, or
+          // in the order of its points if it went backwards
+          RefinePoint p = {
+            st.value, ampl, phs, stdDev,
+            lockin->get_sensitivity(), lockin->get_time_constant()
+          };
+          if(L.adaptive) {
+            refiner.add(p);
+          } else {
+            passRows.push_back(p);
+          }
+          if(!passDone) {
+            break;
+          }
+          if(L.adaptive) {
+            // The points added are not in the plan; leave their time out
+            Clock::time_point refineStart = Clock::now();
+            long long samples = avgSamples;
+            long hunted = sensPredictor.hunted;
+            long long huntedWait = sensPredictor.huntedWait;
+            int refined = refinePass(outps, refiner, st.level, st.reversed, initialSens);
+            refineTime += millisSince(refineStart);
+            refineSamples += avgSamples - samples;
+            refineHunted += sensPredictor.hunted - hunted;
+            refineHuntedWait += sensPredictor.huntedWait - huntedWait;
+            if(refined == 0) {
+              canceled = true;
+              break;
+            }
+          } else {
+            writePass(outps, st.level, passRows, true);
+            passRows.clear();
+            sweepCoords[L.coord] = st.value;
+          }
+        } else if(dataWriter.isOpen()) {
+          dataWriter.append(
+            sweepCoords, ampl, phs, stdDev,
+            lockin->get_sensitivity(), lockin->get_time_constant()
+          );
+        } else {
+          writeMeasurement(outps, ampl, phs, stdDev);
+        }
+        
+        // Journal the point; checkpoints go to disk in batches
+        sweepPos[st.level].initialSens = initialSens;
+        lastPoint.numLevels = numLevels;
+        lastPoint.sensitivity = lockin->get_sensitivity();
+        lastPoint.timeConstant = lockin->get_time_constant();
+        std::copy(sweepPos, sweepPos + numLevels, lastPoint.levels);
+        if(journal.pointDone()) {
+          checkpoint(outps);
+          settingsLog() << "Checkpoint: " << measured
+              << " of " << sweepPlan.numMeasurements() << " points" << std::endl;
+        }
+        break;
+      }
+      
+      case STEP_RAMP: {
+        // Send the whole ramp of the level at once; its steps in the plan
+        // are those of the level's ramp
+        const std::vector<SweepStep>& steps = L.ramp;
+        size_t end = k + steps.size();
+        long long slew = ramp(steps.data(), steps.size(), true);
+        if(slew < 0) {
+          logCanceled();
+          canceled = true;
+          break;
+        }
+        double took = millisSince(stepStart);
+        rampSlew += slew;
+        commandTime += fmax(0, took - slew);
+        commands += end - k;
+        atPoint[st.level] = 0;
+        k = end - 1;
+        break;
+      }
+    }
+    
+    // Move the estimate on by the steps done, and show the progress
+    if(st.type == STEP_SET) {
+      commandTime += millisSince(stepStart);
+      commands++;
+    } else if(st.type == STEP_WAIT) {
+      waitingTime += millisSince(stepStart);
+    }
+    for(; stepFirst <= k; stepFirst++) {
+      const SweepStep& done = sweepPlan.step(stepFirst);
+      double t = stepTime(config, sweepPlan, done, clock);
+      estimator.advance(t);
+      if(done.type == STEP_WAIT) {
+        plannedWait += t / estimator.timing.waitScale;
+      }
+    }
+    if(onProgress && millisSince(shown) >= PROGRESS_INTERVAL_MS) {
+      shown = Clock::now();
+      onProgress(
+        estimator.fraction(),
+        estimator.remaining(millisSince(started), doneBefore)
+      );
+    }
+  }
+  
+  if(fixedTime > 0) {
+    log << "Adaptive settling: waited " << settledTime / 1000.0 << " s of "
+        << fixedTime / 1000.0 << " s" << std::endl;
+  }
+  if(config.rampType == RAMP_SLEW) {
+    log << "Ramping: " << rampTime / 1000.0 << " s" << std::endl;
+  }
+  if(config.averaging && measured > 0) {
+    log << "Averaging: " << avgSamples << " samples, "
+        << (double) avgSamples / measured << " per point";
+    if(config.avgRejectOutliers) {
+      log << ", " << avgRejected << " rejected as outliers";
+    }
+    log << std::endl;
+  }
+  if(config.setup.autoSens) {
+    log << "Auto-sensitivity: " << sensPredictor.preset
+        << " range changes ahead of the wait, " << sensPredictor.hunted
+        << " after it (" << sensPredictor.huntedWait / 1000.0
+        << " s of extra waits)" << std::endl;
+  }
+  
+  // Learn the timing of the lockin from the points of the plan measured:
+  // what they took beyond commanding, waiting, averaging and ramping
+  double elapsed = millisSince(started);
+  size_t planPoints = measured - measuredBefore;
+  if(planPoints > 0) {
+    SweepTiming taken = {-1, -1, -1, -1, -1, -1, -1, 0};
+    if(plannedWait > 0) {
+      taken.waitScale = waitingTime / plannedWait;
+    }
+    if(commands > 0) {
+      taken.commandMs = commandTime / commands;
+    }
+    double huntedWait = sensPredictor.huntedWait - refineHuntedWait;
+    taken.measureMs = fmax(0,
+      elapsed - waitingTime - commandTime - avgTime - rampSlew - refineTime
+      - huntedWait
+    ) / planPoints;
+    if(config.averaging) {
+      double samples = (double) (avgSamples - refineSamples) / planPoints;
+      if(config.avgTargetError > 0) {
+        taken.avgFraction = samples / config.numAvgPts;
+      }
+      if(config.bufferedAveraging) {
+        taken.bufferMs = fmax(0, avgTime / planPoints
+            - 1000 * (samples - 1) / getSampleRateValue(config.avgSampleRate));
+      } else if(samples > 1) {
+        taken.sampleMs = avgTime / planPoints / (samples - 1);
+      }
+    }
+    if(config.setup.autoSens) {
+      taken.huntsPerPoint = (double) (sensPredictor.hunted - refineHunted) / planPoints;
+    }
+    estimator.learn(taken);
+    if(!estimator.save(timingFile.c_str())) {
+      log << "Could not save sweep timing to " << timingFile << std::endl;
+    }
+    if(!canceled && firstStep == 0) {
+      recordDuration(measured, estimate, elapsed);
+    }
+  }
+  
+  if(canceled) {
+    // Ramp every level back down to its start, innermost first, unless
+    // asked to hold position; slew-limited levels ramp at the same time
+    if(!config.holdOnCancel) {
+      std::vector<SweepStep> steps;
+      for(int level = innermost; level >= 0; level--) {
+        sweepPlan.appendRamp(steps, level, atPoint[level]);
+      }
+      if(!steps.empty()) {
+        ramp(steps.data(), steps.size(), false);
+      }
+    }
+    return 0;
+  }
+  return 1;
+}
+
+
+int SweepEngine::refinePass(
+  SweepTextWriter& outps, SweepRefiner& refiner, int level, bool reversed,
+  int &initialSens
+)
+{
+  const SweepPlanLevel& L = sweepPlan.level(level);
+  size_t coarse = refiner.result().size();
+  int waitTime = L.wait;
+  for(;;) {
+    const std::vector<double>& round = refiner.nextRound();
+    if(round.empty()) {
+      break;
+    }
+    // Each round goes over the pass again, in its direction
+    for(size_t k = 0; k < round.size(); k++) {
+      double value = round[reversed ? round.size() - 1 - k : k];
+      if(canceling) {
+        logCanceled();
+        return 0;
+      }
+      lockin->begin_batch();
+      sendCommand(L.param, value);
+      int exitVal = 1;
+      if(L.param == SWEEP_F && config.setup.autoTimeConst) {
+        exitVal = setAutoTimeConst(value, &waitTime);
+      }
+      lockin->end_batch();
+      if(exitVal == 0) {
+        return 0;
+      }
+      lockin->sync();
+      if(settle(waitTime + ((k == 0) ? FIRST_STEP_WAIT : 0)) < 0) {
+        return 0;
+      }
+      
+      sweepCoords[L.coord] = value;
+      double ampl = 0;
+      double phs = 0;
+      double stdDev = 0;
+      if(doMeasurement(&ampl, &phs, waitTime, -1, -1, initialSens) == 0) {
+        return 0;
+      }
+      if(config.averaging) {
+        doAveraging(ampl, phs, &ampl, &phs, &stdDev);
+      }
+      RefinePoint p = {
+        value, ampl, phs, stdDev,
+        lockin->get_sensitivity(), lockin->get_time_constant()
+      };
+      refiner.add(p);
+    }
+  }
+  
+  const std::vector<RefinePoint>& points = refiner.result();
+  writePass(outps, level, points, reversed);
+  settingsLog() << "At level " << level
+      << " of sweep; refined pass to " << points.size() << " points ("
+      << points.size() - coarse << " added)" << std::endl;
+  
+  // The rest of the plan continues from the last point of the pass
+  double last = L.x[reversed ? 0 : L.x.size() - 1];
+  sweepCoords[L.coord] = last;
+  lockin->begin_batch();
+  sendCommand(L.param, last);
+  int exitVal = 1;
+  if(L.param == SWEEP_F && config.setup.autoTimeConst) {
+    exitVal = setAutoTimeConst(last, &waitTime);
+  }
+  lockin->end_batch();
+  return exitVal;
+}
+
+
+void SweepEngine::writePass(
+  SweepTextWriter& outps, int level, const std::vector<RefinePoint>& points,
+  bool backwards
+)
+{
+  const SweepPlanLevel& L = sweepPlan.level(level);
+  for(size_t k = 0; k < points.size(); k++) {
+    const RefinePoint& p = points[backwards ? points.size() - 1 - k : k];
+    sweepCoords[L.coord] = p.value;
+    if(dataWriter.isOpen()) {
+      dataWriter.append(
+        sweepCoords, p.ampl, p.phs, p.stdDev, p.sensitivity, p.timeConstant
+      );
+    } else {
+      writeMeasurement(outps, p.ampl, p.phs, p.stdDev);
+    }
+  }
+}
+
+
+long long SweepEngine::ramp(
+  const SweepStep* steps, size_t count, bool cancelable
+)
+{
+  settingsLog() << "At level " << (int) steps[0].level
+      << " of sweep; ramping down to initial value." << std::endl;
+  
+  // Time of each step from the start of the ramp: the steps of a level
+  // follow each other as fast as its slew rate allows, and the levels ramp
+  // side by side
+  std::vector<long long> at(count);
+  std::vector<size_t> order(count);
+  long long levelTime[NUM_AVAIL_PARAMS] = {0};
+  long long end = 0;
+  for(size_t k = 0; k < count; k++) {
+    at[k] = levelTime[steps[k].level];
+    levelTime[steps[k].level] += steps[k].duration;
+    end = std::max(end, levelTime[steps[k].level]);
+    order[k] = k;
+  }
+  std::stable_sort(order.begin(), order.end(), [&at](size_t p, size_t q) {
+    return at[p] < at[q];
+  });
+  
+  // Send the steps due together as one message, waiting for each batch
+  // until its time from the start of the ramp
+  bool holdable = cancelable && config.holdOnCancel;
+  Clock::time_point start = Clock::now();
+  long long now = 0;
+  bool stopped = false;
+  lockin->begin_batch();
+  for(size_t n = 0; n <= count; n++) {
+    long long due = (n < count) ? at[order[n]] : end;
+    if(due > now) {
+      lockin->end_batch();
+      lockin->sync();
+      Clock::time_point deadline = start + std::chrono::milliseconds(due);
+      if(holdable) {
+        stopped = waitCanceled(deadline);
+      } else {
+        std::this_thread::sleep_until(deadline);
+      }
+      now = due;
+      lockin->begin_batch();
+    }
+    if(n == count || stopped) {
+      break;
+    }
+    const SweepStep& st = steps[order[n]];
+    const SweepPlanLevel& L = sweepPlan.level(st.level);
+    if(L.param == SWEEP_CUSTOM) {
+      sendCommand(SWEEP_X, L.x[st.point]);
+      sendCommand(SWEEP_Y, L.y[st.point]);
+    } else {
+      sendCommand(L.param, st.value);
+    }
+  }
+  lockin->end_batch();
+  lockin->sync();
+  rampTime += (long long) millisSince(start);
+  return stopped ? -1 : end;
+}
+
+
+int SweepEngine::doMeasurement(
+    double *ampl,
+    double *phs,
+    int waitTime,
+    int r,
+    int i,
+    int& initialSens
+)
+{
+    lockin->get_AmplPhase(*ampl, *phs);
+    int ct = 0;
+    int currSens = lockin->get_sensitivity();
+    while(
+        config.setup.autoSens
+        && outOfRange(*ampl, currSens)
+        && ct < 10
+    ) {
+        int sens = getBestSens(*ampl, currSens);
+        log << "getBestSens: for voltage " << *ampl << ", best sensitivity is "
+            << getSensValue(sens) << std::endl;
+        lockin->set_sensitivity(sens);
+        lockin->sync();
+        sensPredictor.hunted++;
+        sensPredictor.huntedWait += waitTime;
+        if(waitCanceled(waitTime)) {
+            logCanceled();
+            return 0;
+        }
+        lockin->get_AmplPhase(*ampl, *phs);
+        currSens = lockin->get_sensitivity();
+        ct++;
+    }
+    
+    if(ct == 10 && outOfRange(*ampl, lockin->get_sensitivity())) {
+        // Sensitivity is invalid
+        
+        settingsLog() << "Unable to determine appropriate sensitivity for";
+        for(int c = 0; c < sweepPlan.numCoords(); c++) {
+            settingsLog() << ' ' << sweepCoords[c];
+        }
+        settingsLog() << std::endl;
+    } else {
+        // Sensitivity is valid
+        
+        if(r == 0 && i == 0) {
+            // Store this sensitivity so we can set it as a start value on
+            // subsequent repeats of this parameter
+            initialSens = lockin->get_sensitivity();
+        }
+    }
+    return 1;
+}
+
+
+void SweepEngine::presetSens(int point)
+{
+  double ampl;
+  if(!sensPredictor.predict(point, ampl)) {
+    return;
+  }
+  int sens = lockin->get_sensitivity();
+  if(
+    outOfRange(ampl * SENS_PREDICT_HEADROOM, sens)
+    || outOfRange(ampl / SENS_PREDICT_HEADROOM, sens)
+  ) {
+    int best = getBestSens(ampl * SENS_PREDICT_HEADROOM, sens);
+    if(best != sens) {
+      lockin->set_sensitivity(best);
+      sensPredictor.preset++;
+    }
+  }
+}
+
+
+long SweepEngine::settle(int maxWait)
+{
+  typedef std::chrono::steady_clock Clock;
+  if(config.settleMode == SETTLE_FIXED) {
+    if(waitCanceled(maxWait)) {
+      logCanceled();
+      return -1;
+    }
+    return maxWait;
+  }
+  
+  SettleDetector detector;
+  detector.start(
+    config.settleMode,
+    lockin->settings.getInt(OPT_FILTER_SLOPE),
+    getTimeConstValue(lockin->get_time_constant()),
+    config.settleTolerance / 100,
+    getSensValue(lockin->get_sensitivity())
+  );
+  int poll = detector.pollInterval();
+  Clock::time_point start = Clock::now();
+  for(;;) {
+    long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      Clock::now() - start
+    ).count();
+    if(elapsed >= maxWait) {
+      return elapsed;
+    }
+    double x, y;
+    lockin->get_XY(x, y);
+    if(detector.add(elapsed / 1000.0, x, y)) {
+      return elapsed;
+    }
+    long next = maxWait - elapsed;
+    if(waitCanceled((poll < next) ? poll : next)) {
+      logCanceled();
+      return -1;
+    }
+  }
+}
+
+
+int SweepEngine::setAutoTimeConst(double currFreq, int *waitTime)
+{
+  int filtSlope = lockin->settings.getInt(OPT_FILTER_SLOPE);
+  double tau_req = getTauReq(
+    currFreq, filtSlope, config.setup.ac_couple, config.setup.signalToDC
+  );
+  return setTimeConst(getTimeConst(tau_req), waitTime);
+}
+
+
+int SweepEngine::setTimeConst(int newTimeConst, int *waitTime)
+{
+  int filtSlope = lockin->settings.getInt(OPT_FILTER_SLOPE);
+  int currTimeConst = lockin->settings.getInt(OPT_TIME_CONSTANT);
+  
+  if(newTimeConst != currTimeConst) {
+    // The current setting for the time constant is not correct. Update
+    // the lockin settings accordingly.
+    lockin->settings.set(lockin->address, OPT_TIME_CONSTANT, newTimeConst);
+    lockin->sync();
+    if(waitCanceled(FIRST_STEP_WAIT)) {
+        logCanceled();
+        return 0;
+    }
+  }
+  *waitTime = getWaitFactor(filtSlope)*getTimeConstValue(newTimeConst)*1000;
+  return 1;
+}
+
+void SweepEngine::writeMeasurement(
+    SweepTextWriter& outps, double ampl, double phs, double stdDev
+)
+{
+    // WRITE COORDINATES AND MEASURED VALUE TO OUTPUT STREAM
+    outps << sweepCoords[0];
+    for(int c = 1; c < sweepPlan.numCoords(); c++) {
+        outps << '\t' << sweepCoords[c];
+    }
+    outps << '\t' << ampl;
+
+    if(lockin->isPhaseAccessible()) {
+        outps << '\t' << phs;
+    }
+
+    if(config.averaging) {
+        outps << '\t' << stdDev;
+    }
+    
+    outps << '\n';
+}
+
+
+void SweepEngine::doAveraging(
+  double ampl0, double phs0, double *ampl, double *phs, double *stdDev
+)
+{
+  ComplexAverager avg;
+  avg.start(config.avgRejectOutliers);
+  int drawn = 0;
+  bool polled = !config.bufferedAveraging;
+  
+  if(config.bufferedAveraging) {
+    // A failed buffer transfer falls back to polling the lockin
+    drawn = acquireBuffer(avg);
+    polled = drawn == 0 && !isCanceled();
+  }
+  if(drawn == 0) {
+    // Use the existing measurement
+    avg.add(ampl0*cos(M_PI*phs0/180), ampl0*sin(M_PI*phs0/180));
+    drawn = 1;
+  }
+
+  // Take repeated measurements until there are enough
+  if(polled) {
+    double ampl_tmp, phs_tmp;
+    for(; drawn < config.numAvgPts && !averagingDone(avg); drawn++) {
+      lockin->get_AmplPhase(ampl_tmp, phs_tmp);
+      avg.add(
+        ampl_tmp * cos(M_PI * phs_tmp / 180),
+        ampl_tmp * sin(M_PI * phs_tmp / 180)
+      );
+    }
+  }
+  avgSamples += avg.count();
+  avgRejected += avg.numRejected();
+  
+  // Convert the average value back to (amplitude-phase) form
+  *stdDev = avg.stdDev();
+  *ampl = hypot(avg.re(), avg.im());
+  *phs  = 180 * atan2(avg.im(), avg.re()) / M_PI;
+}
+
+
+bool SweepEngine::averagingDone(const ComplexAverager& avg)
+{
+  return config.avgTargetError > 0 && avg.count() >= config.avgMinPts
+      && avg.stdError() <= config.avgTargetError / 100 * hypot(avg.re(), avg.im());
+}
+
+
+int SweepEngine::acquireBuffer(ComplexAverager& avg)
+{
+  int nPts = (config.numAvgPts < SR830_BUFFER_SIZE) ? config.numAvgPts : SR830_BUFFER_SIZE;
+  double rate = getSampleRateValue(config.avgSampleRate);
+  double re[AVG_BUFFER_CHUNK];
+  double im[AVG_BUFFER_CHUNK];
+  
+  // The first point is stored as soon as the buffer starts. Read the
+  // samples as they come when averaging may stop early, otherwise all at
+  // once at the end.
+  lockin->buffer_start(config.avgSampleRate);
+  lockin->sync();
+  int want = nPts;
+  if(config.avgTargetError > 0) {
+    want = (config.avgMinPts < 2) ? 2 : ((config.avgMinPts < nPts) ? config.avgMinPts : nPts);
+  }
+  int read = 0;
+  int stored = 1;
+  int stalls = 0;
+  while(read < nPts) {
+    long waitTime = (long) ceil(1000 * ((want > stored) ? want - stored : 1) / rate);
+    if(waitCanceled(waitTime)) {
+      lockin->buffer_pause();
+      return read;
+    }
+    int now = lockin->buffer_points();
+    stalls = (now > stored) ? 0 : stalls + 1;
+    stored = (now < nPts) ? now : nPts;
+    if(stored < want && stalls < 10) {
+      continue;
+    }
+    
+    // CH1 and CH2 display X and Y while a buffered sweep runs (see sweep())
+    while(read < stored) {
+      int count = (stored - read < AVG_BUFFER_CHUNK) ? stored - read : AVG_BUFFER_CHUNK;
+      if(
+        lockin->buffer_read(1, read, count, re) != count
+        || lockin->buffer_read(2, read, count, im) != count
+      ) {
+        lockin->buffer_pause();
+        settingsLog() << "Data buffer transfer failed" << std::endl;
+        avg.start(config.avgRejectOutliers);
+        return 0;
+      }
+      for(int k = 0; k < count; k++) {
+        avg.add(re[k], im[k]);
+      }
+      read += count;
+    }
+    if(averagingDone(avg) || stalls >= 10) {
+      break;
+    }
+    
+    // Ask for as many samples as the spread so far says are needed
+    double target = config.avgTargetError / 100 * hypot(avg.re(), avg.im());
+    double needed = avg.count() * pow(avg.stdError() / target, 2);
+    want = (needed < nPts) ? (int) ceil(needed) : nPts;
+    if(want <= read) {
+      want = read + 1;
+    }
+  }
+  lockin->buffer_pause();
+  if(read < nPts && !averagingDone(avg)) {
+    settingsLog() << "Data buffer holds only " << read
+        << " of " << nPts << " points" << std::endl;
+  }
+  return read;
+}
+
+
+
+
+int SweepEngine::run()
+{
+  // Unroll the sweep into its steps; a resumed sweep continues after the
+  // step of its last checkpoint
+  long firstStep = 0;
+  int resumePoints[NUM_AVAIL_PARAMS];
+  TimeConstOrder ordering;
+  const TimeConstOrder* order = timeConstOrder(config, ordering) ? &ordering : NULL;
+  int numCustom = (int) config.customX.size();
+  bool planned = sweepPlan.compile(
+    config.setup, config.customX.data(), config.customY.data(), numCustom,
+    config.rampType, order
+  );
+  if(planned && resumingSweep && resumePoint.numLevels > 0) {
+    firstStep = sweepPlan.findResume(resumePoint, resumePoints);
+  }
+  if(!planned || firstStep < 0) {
+    log << (planned ? "Checkpoint is not part of the sweep"
+        : "Sweep has too many steps") << std::endl;
+    resumingSweep = false;
+    return 0;
+  }
+  log << "Sweep plan: " << sweepPlan.size() << " steps, "
+      << sweepPlan.numMeasurements() << " points" << std::endl;
+  if(order != NULL) {
+    // Report what ordering by time constant saves against the plain order
+    SweepPlan plain;
+    if(
+      plain.compile(
+        config.setup, config.customX.data(), config.customY.data(), numCustom,
+        config.rampType
+      )
+    ) {
+      long ordered = planDuration(config, sweepPlan, NULL);
+      long unordered = planDuration(config, plain, NULL);
+      log << "Time constant ordering: estimated " << ordered / 1000.0
+          << " s instead of " << unordered / 1000.0 << " s (saves "
+          << (unordered - ordered) / 1000.0 << " s)" << std::endl;
+    }
+  }
+
+  // Initialize output
+  SweepTextWriter outps;
+  if(!initOutput(outps)) {
+    resumingSweep = false;
+    return 0;
+  }
+
+  // Store initial settings so they can be reset; a resumed sweep restores
+  // those from before it was first started, and a sweep that follows others
+  // with keepState those from before the first of them
+  if(!resumingSweep && !holdingState) {
+    sweepInitial.sensitivity = lockin->get_sensitivity();
+    sweepInitial.timeConstant = lockin->get_time_constant();
+    sweepInitial.coupling = lockin->settings.getInt(OPT_INPUT_COUPLING);
+    for(int p = 0; p < 2; p++) {
+      sweepInitial.display1[p] = lockin->settings.getInt(OPT_CH1_DISPLAY, p);
+      sweepInitial.display2[p] = lockin->settings.getInt(OPT_CH2_DISPLAY, p);
+    }
+  }
+  startJournal(outps);
+  bool useBuffer = config.averaging && config.bufferedAveraging;
+  lockin->settings.resetElidedWrites();
+
+  // Setup lockin
+  lockin->begin_batch();
+  lockin->set_harmonic(config.setup.detHarm);
+  if(useBuffer) {
+    // The data buffer stores the displays; have them show X and Y
+    lockin->settings.set(lockin->address, OPT_CH1_DISPLAY, 0, 0);
+    lockin->settings.set(lockin->address, OPT_CH2_DISPLAY, 0, 0);
+  }
+  if(config.setup.ac_couple) {
+    lockin->AC_couple();
+  }
+  else {
+    lockin->DC_couple();
+  }
+  if(resumingSweep && resumePoint.numLevels > 0) {
+    // Continue with the settings of the last completed point
+    lockin->set_sensitivity(resumePoint.sensitivity);
+    lockin->set_time_constant(resumePoint.timeConstant);
+  }
+  lockin->end_batch();
+
+  // Do the parametric sweep
+  int exitVal = runPlan(outps, firstStep, resumePoints);
+
+  // Record where the sweep stopped, so that a canceled sweep can be resumed
+  checkpoint(outps);
+  journal.finish(exitVal ? "completed" : "canceled");
+  resumingSweep = false;
+
+  // Cleanup
+  finalizeOutput(outps);
+  restoreSens |= (bool) config.setup.autoSens;
+  restoreTimeConst |= (bool) config.setup.autoTimeConst;
+  restoreDisplays |= useBuffer;
+  holdingState = true;
+  if(!keepState) {
+    restoreState();
+  }
+  settingsLog() << "Setting writes skipped (value already current): "
+      << lockin->settings.getElidedWrites() << std::endl;
+  return exitVal;
+}
+
+
+void SweepEngine::restoreState()
+{
+  if(!holdingState) {
+    return;
+  }
+  lockin->begin_batch();
+  if(sweepInitial.coupling == 0) {
+    lockin->AC_couple();
+  }
+  else {
+    lockin->DC_couple();
+  }
+  if(restoreSens)
+    lockin->set_sensitivity(sweepInitial.sensitivity);
+  if(restoreTimeConst)
+    lockin->set_time_constant(sweepInitial.timeConstant);
+  if(restoreDisplays) {
+    lockin->settings.set(lockin->address, OPT_CH1_DISPLAY,
+        sweepInitial.display1[0], sweepInitial.display1[1]);
+    lockin->settings.set(lockin->address, OPT_CH2_DISPLAY,
+        sweepInitial.display2[0], sweepInitial.display2[1]);
+  }
+  lockin->end_batch();
+  holdingState = false;
+  restoreSens = restoreTimeConst = restoreDisplays = false;
+}
+
+
+void SweepEngine::startJournal(SweepTextWriter& outps)
+{
+  if(resumingSweep) {
+    lastPoint = resumePoint;
+    if(!journal.resume(journalName.c_str())) {
+      settingsLog() << "Could not reopen journal "
+          << journalName << std::endl;
+    }
+    return;
+  }
+  std::string journalFileName = outputBase();
+  journalFileName.append(".journal");
+  if(!journal.create(journalFileName.c_str(), definition())) {
+    settingsLog() << "Could not create journal "
+        << journalFileName << std::endl;
+    return;
+  }
+  // Nothing measured yet: resuming from here starts after the file header
+  lastPoint.numLevels = 0;
+  checkpoint(outps);
+}
+
+
+void SweepEngine::checkpoint(SweepTextWriter& outps)
+{
+  if(!journal.isOpen()) {
+    return;
+  }
+  if(dataWriter.isOpen()) {
+    dataWriter.sync();
+    lastPoint.outputLength = dataWriter.rows();
+  } else {
+    outps.sync();
+    lastPoint.outputLength = outps.size();
+  }
+  journal.checkpoint(lastPoint);
+}
+
+
+std::map<std::string, std::string> SweepEngine::definition()
+{
+  std::map<std::string, std::string> def = configDefinition(config);
+  std::ostringstream oss;
+  oss << sweepInitial.sensitivity << ' ' << sweepInitial.timeConstant << ' '
+      << sweepInitial.coupling << ' ' << sweepInitial.display1[0] << ' '
+      << sweepInitial.display1[1] << ' ' << sweepInitial.display2[0] << ' '
+      << sweepInitial.display2[1];
+  def["initial"] = oss.str();
+  return def;
+}
+
+
+std::map<std::string, std::string> SweepEngine::configDefinition(
+  const SweepConfig& config
+)
+{
+  std::map<std::string, std::string> def;
+  std::ostringstream oss;
+  // Enough digits for every double to read back unchanged
+  oss.precision(17);
+
+  def["output"] = config.fileName;
+  def["binary"] = config.binaryOutput ? "1" : "0";
+  oss << config.setup.maxRecursionLevel;
+  for(int k = 0; k < NUM_AVAIL_PARAMS; k++) {
+    oss << ' ' << config.setup.parameters[k];
+  }
+  def["levels"] = oss.str();
+  for(int k = 0; k < NUM_AVAIL_PARAMS; k++) {
+    oss.str("");
+    oss << config.setup.starts[k] << ' ' << config.setup.ends[k] << ' '
+        << config.setup.steps[k] << ' ' << config.setup.repeats[k] << ' '
+        << config.setup.waits[k] << ' ' << config.setup.logSpacing[k] << ' '
+        << config.setup.bidirectional[k];
+    def["param" + std::to_string(k)] = oss.str();
+  }
+  oss.str("");
+  oss << config.setup.ac_couple << ' ' << config.setup.autoSens << ' '
+      << config.setup.autoTimeConst << ' ' << config.setup.detHarm << ' '
+      << config.setup.signalToDC;
+  def["options"] = oss.str();
+  oss.str("");
+  oss << config.averaging << ' ' << config.numAvgPts << ' '
+      << config.bufferedAveraging << ' ' << config.avgSampleRate;
+  def["averaging"] = oss.str();
+  oss.str("");
+  oss << config.avgTargetError << ' ' << config.avgMinPts << ' '
+      << config.avgRejectOutliers;
+  def["avgstop"] = oss.str();
+  def["ramp"] = std::to_string(config.rampType);
+  oss.str("");
+  for(int k = 0; k < NUM_AVAIL_PARAMS; k++) {
+    oss << config.setup.slewRates[k] << ' ';
+  }
+  def["slew"] = oss.str();
+  oss.str("");
+  oss << config.settleMode << ' ' << config.settleTolerance;
+  def["settle"] = oss.str();
+  oss.str("");
+  for(int k = 0; k < NUM_AVAIL_PARAMS; k++) {
+    oss << config.setup.adaptive[k] << ' ';
+  }
+  oss << config.refineTolerance << ' ' << config.refinePhaseStep << ' '
+      << config.refineMaxPoints;
+  def["refine"] = oss.str();
+  def["order"] = config.orderTimeConsts ? "1" : "0";
+  def["hold"] = config.holdOnCancel ? "1" : "0";
+  oss.str("");
+  oss << config.customX.size();
+  for(size_t k = 0; k < config.customX.size(); k++) {
+    oss << ' ' << config.customX[k] << ' ' << config.customY[k];
+  }
+  def["custom"] = oss.str();
+  return def;
+}
+
+
+std::string SweepEngine::loadJournal(const char* fileName)
+{
+  std::map<std::string, std::string> def;
+  SweepCheckpoint last;
+  std::string status;
+  if(!journal.load(fileName, def, last, status)) {
+    return "This file is not a sweep journal.";
+  }
+  if(status == "completed") {
+    return "This sweep has already completed.";
+  }
+  if(last.numLevels < 0) {
+    return "The journal has no checkpoint; start the sweep again.";
+  }
+
+  // A damaged journal leaves the current sweep definition alone
+  SweepConfig previous = config;
+  SweepInitialState initial;
+  std::istringstream in(def["initial"]);
+  in >> initial.sensitivity >> initial.timeConstant >> initial.coupling
+      >> initial.display1[0] >> initial.display1[1]
+      >> initial.display2[0] >> initial.display2[1];
+  if(
+    !loadDefinition(def).empty() || !in || def["output"].empty()
+    || (last.numLevels > 0 && last.numLevels != config.setup.maxRecursionLevel + 1)
+  ) {
+    config = previous;
+    return "The journal's sweep definition is incomplete.";
+  }
+
+  // Held state already is what was there before the sweeps it followed
+  if(!holdingState) {
+    sweepInitial = initial;
+  }
+  journalName = fileName;
+  resumePoint = last;
+  resumingSweep = true;
+  log << "Resuming sweep " << config.fileName << " from checkpoint "
+      << last.sequence << std::endl;
+  return "";
+}
+
+
+std::string SweepEngine::loadDefinition(std::map<std::string, std::string>& def)
+{
+  return parseDefinition(def, config);
+}
+
+
+std::string SweepEngine::parseDefinition(
+  std::map<std::string, std::string>& def, SweepConfig& config
+)
+{
+  // Read into copies, so that a damaged definition leaves the current one
+  // alone
+  SweepParameters setup = config.setup;
+  int avg, avgPts, buffered, avgRate, ramp, nCustom = 0;
+  int settle = SETTLE_FIXED;
+  double tolerance = config.settleTolerance;
+  double target = 0;
+  int minPts = config.avgMinPts, outliers = 0;
+  double refineTol = config.refineTolerance, refinePhase = config.refinePhaseStep;
+  int refinePoints = config.refineMaxPoints;
+  std::istringstream in(def["levels"]);
+  in >> setup.maxRecursionLevel;
+  for(int k = 0; k < NUM_AVAIL_PARAMS; k++) {
+    in >> setup.parameters[k];
+  }
+  if(
+    !in || setup.maxRecursionLevel < 0
+    || setup.maxRecursionLevel >= NUM_AVAIL_PARAMS
+  ) {
+    return "The sweep has no valid levels.";
+  }
+  // Only the swept parameters need their ranges
+  for(int level = 0; level <= setup.maxRecursionLevel; level++) {
+    int param = setup.parameters[level];
+    if(
+      param < 0 || param >= NUM_AVAIL_PARAMS
+      || !def.count("param" + std::to_string(param))
+    ) {
+      return "The sweep has no range for level " + std::to_string(level) + ".";
+    }
+  }
+  for(int k = 0; k < NUM_AVAIL_PARAMS && in; k++) {
+    if(!def.count("param" + std::to_string(k))) {
+      continue;
+    }
+    in.clear();
+    in.str(def["param" + std::to_string(k)]);
+    in >> setup.starts[k] >> setup.ends[k] >> setup.steps[k]
+        >> setup.repeats[k] >> setup.waits[k] >> setup.logSpacing[k]
+        >> setup.bidirectional[k];
+  }
+  if(in) {
+    in.clear();
+    in.str(def["options"]);
+    in >> setup.ac_couple >> setup.autoSens >> setup.autoTimeConst
+        >> setup.detHarm >> setup.signalToDC;
+  }
+  if(in) {
+    in.clear();
+    in.str(def["averaging"]);
+    in >> avg >> avgPts >> buffered >> avgRate;
+  }
+  if(in) {
+    in.clear();
+    in.str(def["ramp"]);
+    in >> ramp;
+  }
+  // Journals written before adaptive settling have no "settle" entry
+  if(in && def.count("settle")) {
+    in.clear();
+    in.str(def["settle"]);
+    in >> settle >> tolerance;
+  }
+  // ... or slew rates
+  if(in && def.count("slew")) {
+    in.clear();
+    in.str(def["slew"]);
+    for(int k = 0; k < NUM_AVAIL_PARAMS; k++) {
+      in >> setup.slewRates[k];
+    }
+  }
+  // ... or early stopping of averaging
+  if(in && def.count("avgstop")) {
+    in.clear();
+    in.str(def["avgstop"]);
+    in >> target >> minPts >> outliers;
+  }
+  // ... or adaptive refinement, which stays off for them
+  for(int k = 0; k < NUM_AVAIL_PARAMS; k++) {
+    setup.adaptive[k] = false;
+  }
+  if(in && def.count("refine")) {
+    in.clear();
+    in.str(def["refine"]);
+    for(int k = 0; k < NUM_AVAIL_PARAMS; k++) {
+      in >> setup.adaptive[k];
+    }
+    in >> refineTol >> refinePhase >> refinePoints;
+  }
+  std::vector<double> xy;
+  if(in && def.count("custom")) {
+    in.clear();
+    in.str(def["custom"]);
+    in >> nCustom;
+    xy.resize(2 * (nCustom > 0 ? nCustom : 0));
+    for(size_t k = 0; k < xy.size(); k++) {
+      in >> xy[k];
+    }
+  }
+  if(!in) {
+    return "The sweep definition is incomplete.";
+  }
+  SweepConfig parsed = config;
+  parsed.setup = setup;
+  parsed.averaging = avg;
+  parsed.numAvgPts = avgPts;
+  parsed.bufferedAveraging = buffered;
+  parsed.avgSampleRate = avgRate;
+  parsed.avgTargetError = target;
+  parsed.avgMinPts = minPts;
+  parsed.avgRejectOutliers = outliers;
+  parsed.rampType = ramp;
+  parsed.settleMode = settle;
+  parsed.settleTolerance = tolerance;
+  parsed.refineTolerance = refineTol;
+  parsed.refinePhaseStep = refinePhase;
+  parsed.refineMaxPoints = refinePoints;
+  parsed.customX.clear();
+  parsed.customY.clear();
+  for(int k = 0; k < nCustom; k++) {
+    parsed.customX.push_back(xy[2*k]);
+    parsed.customY.push_back(xy[2*k + 1]);
+  }
+  if(def.count("output")) {
+    parsed.fileName = def["output"];
+  }
+  parsed.binaryOutput = def["binary"] == "1";
+  parsed.orderTimeConsts = def["order"] == "1";
+  if(def.count("hold")) {
+    parsed.holdOnCancel = def["hold"] == "1";
+  }
+  std::string error = validateConfig(parsed);
+  if(error.empty()) {
+    config = parsed;
+  }
+  return error;
+}
+
+
+std::string SweepEngine::validateConfig(SweepConfig& config)
+{
+  SweepParameters& setup = config.setup;
+  for(int level = 0; level <= setup.maxRecursionLevel; level++) {
+    int param = setup.parameters[level];
+    std::string name = "Level " + std::to_string(level);
+    if(param < 0 || param >= NUM_AVAIL_PARAMS) {
+      return name + " sweeps no parameter.";
+    }
+    for(int other = 0; other < level; other++) {
+      if(setup.parameters[other] == param) {
+        return name + " sweeps the same parameter as level "
+            + std::to_string(other) + ".";
+      }
+    }
+    if(param == SWEEP_CUSTOM) {
+      if(
+        config.customX.empty()
+        || config.customX.size() != config.customY.size()
+      ) {
+        return name + " is a custom sweep without points.";
+      }
+    } else if(setup.steps[param] < 1) {
+      return name + " must have at least 1 step.";
+    }
+    if(setup.repeats[param] < 1) {
+      return name + " must be repeated at least once.";
+    }
+    // The wait of a frequency sweep follows the time constant instead
+    if(setup.waits[param] < 1 && !(param == SWEEP_F && setup.autoTimeConst)) {
+      return name + " must wait at least 1 ms.";
+    }
+    if(
+      param != SWEEP_CUSTOM && setup.logSpacing[param]
+      && (setup.starts[param] <= 0 || setup.ends[param] <= 0)
+    ) {
+      return name + " is log-spaced but does not stay above 0.";
+    }
+    // Voltages beyond the auxiliary outputs are clamped, as the sweep window
+    // does
+    if(param == SWEEP_X || param == SWEEP_Y) {
+      double* ends[2] = {&setup.starts[param], &setup.ends[param]};
+      for(double* v : ends) {
+        if(*v > VOLTAGE_MAX) {
+          *v = VOLTAGE_MAX;
+        } else if(*v < VOLTAGE_MIN) {
+          *v = VOLTAGE_MIN;
+        }
+      }
+    }
+    if(setup.slewRates[param] < 0) {
+      return name + " has a negative slew rate.";
+    }
+  }
+  if(config.rampType < RAMP_NONE || config.rampType > RAMP_SLEW) {
+    return "The sweep has an unknown ramp type.";
+  }
+  if(config.settleMode < SETTLE_FIXED || config.settleMode > SETTLE_CONVERGE) {
+    return "The sweep has an unknown settle mode.";
+  }
+  if(config.settleMode != SETTLE_FIXED && config.settleTolerance <= 0) {
+    return "The settle tolerance must be above 0.";
+  }
+  if(config.averaging) {
+    if(config.numAvgPts < 1 || config.avgMinPts < 1) {
+      return "Averaging must take at least 1 point.";
+    }
+    if(config.avgTargetError < 0) {
+      return "The averaging target error cannot be negative.";
+    }
+    if(
+      config.bufferedAveraging
+      && (config.avgSampleRate < 0 || config.avgSampleRate > 13)
+    ) {
+      return "The averaging sample rate is out of range.";
+    }
+  }
+  if(
+    config.refineTolerance <= 0 || config.refinePhaseStep < 0
+    || config.refineMaxPoints < 1
+  ) {
+    return "The refinement settings are out of range.";
+  }
+  return "";
+}
+
+
+/*
+ * Log that a sweep was canceled and the time of cancellation
+ */
+void SweepEngine::logCanceled()
+{
+  time_t now = time(0);
+  struct tm tmNow = localTime(now);
+  settingsLog() << std::endl << "=== SWEEP CANCELED at " 
+      << (1900 + tmNow.tm_year) << "-" << (1 + tmNow.tm_mon) << "-"
+      << tmNow.tm_mday << " " << tmNow.tm_hour << ":" << tmNow.tm_min
+      << ":" << tmNow.tm_sec << " ===" << std::endl;
+}
+
+
+void SweepEngine::setPlanPoint(int level, int point)
+{
+  const SweepPlanLevel& L = sweepPlan.level(level);
+  if(L.param == SWEEP_CUSTOM) {
+    lockin->begin_batch();
+    sendCommand(SWEEP_X, L.x[point]);
+    sendCommand(SWEEP_Y, L.y[point]);
+    lockin->end_batch();
+  } else {
+    sendCommand(L.param, L.x[point]);
+  }
+}
+
+
+void SweepEngine::sendCommand(int currParam, double currVal)
+{
+  switch(currParam) {
+    case SWEEP_F:
+      lockin->set_frequency(currVal);
+    break;
+    case SWEEP_X:
+      lockin->set_auxout1(currVal);
+    break;
+    case SWEEP_Y:
+      lockin->set_auxout2(currVal);
+    break;
+    case SWEEP_A:
+      lockin->set_reference_amplitude(currVal);
+    break;
+  }
+}
+
+int SweepEngine::requiredTimeConst(const SweepConfig& c, double freq)
+{
+  return getTimeConst(
+    getTauReq(freq, filterType, c.setup.ac_couple, c.setup.signalToDC)
+  );
+}
+
+
+long SweepEngine::timeConstSettle(int timeConst)
+{
+  return getWaitFactor(filterType)*getTimeConstValue(timeConst)*1000;
+}
+
+
+bool SweepEngine::timeConstOrder(const SweepConfig& c, TimeConstOrder& order)
+{
+  order.required = [this, &c](double freq) {
+    return requiredTimeConst(c, freq);
+  };
+  order.settle = [this](int timeConst) {
+    return timeConstSettle(timeConst);
+  };
+  order.switchWait = FIRST_STEP_WAIT;
+  return c.orderTimeConsts && c.setup.autoTimeConst;
+}
+
+
+long SweepEngine::duration(const SweepConfig& c, long* rampMillis)
+{
+  // Add up the estimated time of the sweep's steps; a separate plan, since a
+  // sweep may be running
+  TimeConstOrder order;
+  bool ordered = timeConstOrder(c, order);
+  if(
+    !estimatePlan.compile(
+      c.setup, c.customX.data(), c.customY.data(), (int) c.customX.size(),
+      c.rampType, ordered ? &order : NULL
+    )
+  ) {
+    return -1;
+  }
+  return planDuration(c, estimatePlan, rampMillis);
+}
+
+
+long SweepEngine::planDuration(const SweepConfig& c, SweepPlan& plan, long* rampMillis)
+{
+  SweepClock clock = {-1, 0};
+  double millis = 0;
+  double ramping = 0;
+  for(size_t k = 0; k < plan.size(); k++) {
+    const SweepStep& st = plan.step(k);
+    double t = stepTime(c, plan, st, clock);
+    millis += t;
+    if(st.type == STEP_RAMP) {
+      ramping += t;
+    }
+  }
+  
+  if(rampMillis != NULL) {
+    *rampMillis = (ramping > LONG_MAX) ? LONG_MAX : (long) ramping;
+  }
+  return (millis > LONG_MAX) ? LONG_MAX : (long) millis;
+}
+
+
+double SweepEngine::stepTime(
+  const SweepConfig& c, SweepPlan& plan, const SweepStep& st, SweepClock& clock
+)
+{
+  const SweepTiming& timing = estimator.timing;
+  const SweepPlanLevel& L = plan.level(st.level);
+  switch(st.type) {
+    case STEP_WAIT: {
+      // Same waits as runPlan: the settling time at the point, plus
+      // FIRST_STEP_WAIT at the start of a pass and after the time constant
+      // changes
+      long settle = L.wait;
+      long extra = (st.index == 0) ? FIRST_STEP_WAIT : 0;
+      if(L.param == SWEEP_F && c.setup.autoTimeConst) {
+        int timeConst = (st.timeConst >= 0) ? st.timeConst
+            : requiredTimeConst(c, L.x[st.point]);
+        if(clock.timeConst != -1 && timeConst != clock.timeConst) {
+          extra += FIRST_STEP_WAIT;
+        }
+        clock.timeConst = timeConst;
+        settle = timeConstSettle(timeConst);
+      }
+      clock.wait = settle;
+      return timing.waitScale * (settle + extra);
+    }
+    case STEP_MEASURE: {
+      double millis = timing.measureMs;
+      if(c.setup.autoSens) {
+        // Every range change found by trial waits again
+        millis += timing.huntsPerPoint * clock.wait;
+      }
+      if(c.averaging) {
+        double samples = c.numAvgPts;
+        if(c.avgTargetError > 0) {
+          samples = fmin(c.numAvgPts, fmax(c.avgMinPts, c.numAvgPts * timing.avgFraction));
+        }
+        if(c.bufferedAveraging) {
+          samples = fmin(samples, SR830_BUFFER_SIZE);
+          millis += 1000 * (samples - 1) / getSampleRateValue(c.avgSampleRate)
+              + timing.bufferMs;
+        } else {
+          millis += (samples - 1) * timing.sampleMs;
+        }
+      }
+      return millis;
+    }
+    case STEP_SET:
+      return timing.commandMs;
+    case STEP_RAMP:
+      // The time the step takes at the slew rate, if it has one
+      return st.duration + timing.commandMs;
+    default:
+      return 0;
+  }
+}
+
+
+void SweepEngine::recordDuration(size_t points, double estimatedMs, double actualMs)
+{
+  double error = (actualMs > 0) ? 100 * (estimatedMs - actualMs) / actualMs : 0;
+  log << "Sweep duration: estimated " << estimatedMs / 1000.0 << " s, took "
+      << actualMs / 1000.0 << " s (" << error << "% error)" << std::endl;
+  
+  std::ofstream history(historyFile.c_str(), std::ios::app);
+  time_t now = time(NULL);
+  char date[32];
+  struct tm tmNow = localTime(now);
+  strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tmNow);
+  history << date << '\t' << estimator.name() << '\t' << points << '\t'
+      << estimatedMs / 1000.0 << '\t' << actualMs / 1000.0 << '\t' << error
+      << '\n';
+}
+
@@ -0,0 +1,607 @@
+// SweepEngine.h
+// encoding: utf-8
+//
+// Parametric sweep of one lock-in amplifier, independent of the user interface.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 23:05:40
+// Modified: 2026-10-17 10:29:52
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#ifndef SWEEPENGINE_H
+#define SWEEPENGINE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AsyncLogger.h"
+#include "ComplexAverager.h"
+#include "SensPredictor.h"
+#include "SettleDetector.h"
+#include "SR830.h"
+#include "SweepDataFile.h"
+#include "SweepEstimator.h"
+#include "SweepJournal.h"
+#include "SweepPlan.h"
+#include "SweepRefiner.h"
+#include "SweepTextWriter.h"
+
+
+#define ATTEN_2F -80
+#define SIGNAL_TO_DC -40
+#define FIRST_STEP_WAIT 2000
+
+// Samples read from the data buffer per transfer while averaging
+#define AVG_BUFFER_CHUNK 256
+
+// Margin on a predicted amplitude when choosing the sensitivity ahead of it
+#define SENS_PREDICT_HEADROOM 1.5
+
+// Timing of each instrument, and the estimated and actual duration of every
+// finished sweep
+#define SWEEP_TIMING_FILE "sweep_timing.txt"
+#define SWEEP_TIMING_HISTORY "sweep_timing_history.txt"
+
+// Least time (ms) between updates of the progress of a running sweep
+#define PROGRESS_INTERVAL_MS 1000
+
+
+/*
+ * struct SweepConfig
+ *
+ * Everything that defines a sweep, besides the instrument it runs on. A
+ * running sweep reads only its engine's copy.
+ *
+ * Fields:
+ *   setup - levels of the sweep and their options (see SweepParameters)
+ *   customX, customY - points of a custom XY level
+ *   fileName - output file; the journal and settings file are named after it
+ *   binaryOutput - write the output as typed columns (see SweepDataFile.h)
+ *       instead of text
+ *   averaging - average several samples at each point: numAvgPts, or
+ *       fewer once the standard error of the mean is below avgTargetError
+ *       percent of its amplitude (0 to always take numAvgPts), after at
+ *       least avgMinPts; from the data buffer at avgSampleRate if
+ *       bufferedAveraging; outliers dropped if avgRejectOutliers
+ *   rampType - how the levels return to their start (RAMP_NONE, ...)
+ *   holdOnCancel - leave the parameters where they are when the sweep is
+ *       canceled, so that it can be resumed without ramping back up
+ *   orderTimeConsts - order frequency points by the time constant they need
+ *       (see TimeConstOrder)
+ *   refineTolerance, refinePhaseStep, refineMaxPoints - adaptive
+ *       refinement: tolerance in percent of the largest amplitude of a pass,
+ *       largest phase step in degrees, and most points in a refined pass
+ *   settleMode, settleTolerance - how to wait after setting a point (see
+ *       SettleMode), and the settling tolerance in percent
+ */
+struct SweepConfig {
+  SweepParameters setup;
+  std::vector<double> customX;
+  std::vector<double> customY;
+  std::string fileName;
+  bool binaryOutput;
+  bool averaging;
+  int numAvgPts;
+  bool bufferedAveraging;
+  int avgSampleRate;
+  double avgTargetError;
+  int avgMinPts;
+  bool avgRejectOutliers;
+  int rampType;
+  bool holdOnCancel;
+  bool orderTimeConsts;
+  double refineTolerance;
+  double refinePhaseStep;
+  int refineMaxPoints;
+  int settleMode;
+  double settleTolerance;
+
+  SweepConfig();
+};
+
+
+/*
+ * struct SweepInitialState
+ *
+ * Instrument settings from before a sweep, restored when it ends. Kept in the
+ * sweep journal, so that a resumed sweep restores the original settings.
+ */
+struct SweepInitialState {
+  int sensitivity;
+  int timeConstant;
+  int coupling;
+  int display1[2];
+  int display2[2];
+};
+
+
+/*
+ * class SweepEngine
+ *
+ * Runs the sweep described by `config` on one lockin: compiles it into a
+ * SweepPlan, steps through the plan, and writes the output, journal and
+ * settings files. All of its state is its own, so that several engines can
+ * run side by side, each on its own thread and lockin.
+ *
+ * Any thread may cancel() a running sweep; the waits of the sweep end as
+ * soon as it does. The main log goes to the logger given to the
+ * constructor, settings changes to the logger of the lockin's settings.
+ */
+class SweepEngine {
+  typedef std::chrono::steady_clock Clock;
+
+  SR830* lockin;
+  AsyncLogger& log;
+
+  std::atomic<bool> canceling;
+  std::mutex cancelMutex;
+  std::condition_variable cancelWake;
+
+  // Steps of the running sweep, and a plan to estimate durations in
+  SweepPlan sweepPlan;
+  SweepPlan estimatePlan;
+
+  // Coordinates of the current point, one per sweep level (two for custom
+  // X,Y), and position at each level
+  double sweepCoords[SWEEP_MAX_COORDS];
+  SweepPosition sweepPos[NUM_AVAIL_PARAMS];
+
+  SweepInitialState sweepInitial;
+  int filterType;
+
+  // True once a sweep with keepState has left the lockin as it ended, until
+  // restoreState(); the settings to put back when it is called
+  bool holdingState;
+  bool restoreSens;
+  bool restoreTimeConst;
+  bool restoreDisplays;
+
+  SweepJournal journal;
+  SweepDataWriter dataWriter;
+  std::string journalName;
+
+  // Last measured point of the running sweep, for the next journal
+  // checkpoint; while resumingSweep, the checkpoint it resumes from
+  SweepCheckpoint lastPoint;
+  SweepCheckpoint resumePoint;
+  bool resumingSweep;
+
+  // Amplitudes of the innermost level of the running sweep, to set the
+  // sensitivity ahead of each point
+  SensPredictor sensPredictor;
+
+  // Samples averaged, and rejected as outliers, and time spent ramping (ms)
+  // in the running sweep
+  long long avgSamples;
+  long long avgRejected;
+  long long rampTime;
+
+  AsyncLogger& settingsLog() {
+    return *lockin->settings.getLogger();
+  }
+
+  /*
+   * Initialize output file and logging at the beginning of a sweep. A
+   * resumed sweep continues its files after the last checkpoint. Returns
+   * false if the output file cannot be created or reopened.
+   */
+  bool initOutput(SweepTextWriter& outps);
+
+  /*
+   * Log the end time of the sweep and flush the output and settings files.
+   */
+  void finalizeOutput(SweepTextWriter& outps);
+
+  /*
+   * Create the journal of a new sweep, or continue that of a resumed one.
+   */
+  void startJournal(SweepTextWriter& outps);
+
+  /*
+   * Sync the output to disk and append lastPoint to the journal.
+   */
+  void checkpoint(SweepTextWriter& outps);
+
+  /*
+   * Run the steps of sweepPlan from `firstStep` on. When resuming (firstStep
+   * > 0), points[level] gives the point each level is back at, and
+   * resumePoint the checkpoint. Returns 0 if the sweep was canceled.
+   */
+  int runPlan(SweepTextWriter& outps, long firstStep, const int* points);
+
+  /*
+   * Add points to the pass of adaptive level `level` measured into
+   * `refiner`, round by round, then write the whole pass in the order it was
+   * swept and leave the parameter at its last point. Returns 0 if the sweep
+   * was canceled.
+   */
+  int refinePass(
+    SweepTextWriter& outps, SweepRefiner& refiner, int level, bool reversed,
+    int &initialSens
+  );
+
+  /*
+   * Write the measured `points` of one pass of level `level`, last to first
+   * if `backwards`, and leave sweepCoords at the last one written.
+   */
+  void writePass(
+    SweepTextWriter& outps, int level, const std::vector<RefinePoint>& points,
+    bool backwards
+  );
+
+  /*
+   * Record the coordinates of the current point and the measured value to
+   * file.
+   */
+  void writeMeasurement(
+    SweepTextWriter& outps, double ampl, double phs, double stdDev
+  );
+
+  /*
+   * Send the `count` ramp steps at `steps`, in as few messages as possible.
+   * The steps of each level are spaced by the times they take at its slew
+   * rate (see SweepStep); different levels ramp side by side, and steps due
+   * at the same time go out together. Each step is sent at its time from
+   * the start of the ramp, so that the time the lockin takes to accept the
+   * previous ones counts towards it. Adds the time taken to rampTime, and
+   * returns the part of it spent waiting on the slew rate. If `cancelable`
+   * and the sweep is canceled with holdOnCancel, stops at once and returns
+   * -1, leaving the levels where they are; a cancel would otherwise ramp
+   * them back down at their slew rates all the same, so the ramp goes on.
+   */
+  long long ramp(const SweepStep* steps, size_t count, bool cancelable);
+
+  /*
+   * Take a measurement with the lock-in amplifier and verify the
+   * sensitivity setting.
+   */
+  int doMeasurement(
+    double *ampl, double *phs, int waitTime, int r, int i, int &initialSens
+  );
+
+  /*
+   * Get the average value and standard deviation over multiple repeated
+   * measurements: from the lockin's data buffer with bufferedAveraging, or
+   * by polling when its transfer fails, and stopping early with
+   * avgTargetError (see SweepConfig).
+   */
+  void doAveraging(
+    double ampl0, double phs0, double *ampl, double *phs, double *stdDev
+  );
+
+  /*
+   * True if `avg` has reached the standard error asked for by
+   * avgTargetError.
+   */
+  bool averagingDone(const ComplexAverager& avg);
+
+  /*
+   * Add to `avg` up to numAvgPts (X, Y) samples taken by the lockin's data
+   * buffer at avgSampleRate, read back AVG_BUFFER_CHUNK at a time per
+   * channel. Returns the number of samples read, which stops short if the
+   * sweep is canceled. A failed transfer empties `avg` and returns 0.
+   */
+  int acquireBuffer(ComplexAverager& avg);
+
+  /*
+   * Set the sensitivity that sensPredictor expects at point `point` of the
+   * innermost level, if the current one would be out of range there.
+   */
+  void presetSens(int point);
+
+  /*
+   * Wait up to `maxWait` ms for the lockin outputs to settle, as chosen by
+   * settleMode. Returns the time waited (ms), or -1 if the sweep was
+   * canceled.
+   */
+  long settle(int maxWait);
+
+  /*
+   * Calculate and set the minimum time constant for the given frequency.
+   */
+  int setAutoTimeConst(double currFreq, int *waitTime);
+
+  /*
+   * Set time constant `newTimeConst`, waiting FIRST_STEP_WAIT if it changes,
+   * and set `waitTime` to the settling time at it. Returns 0 if the sweep
+   * was canceled.
+   */
+  int setTimeConst(int newTimeConst, int *waitTime);
+
+  /*
+   * Queue the setting(s) for point `point` of sweep level `level` of
+   * sweepPlan. The commands are sent asynchronously, the two voltages of a
+   * custom XY point in a single message; call lockin->sync() before relying
+   * on them.
+   */
+  void setPlanPoint(int level, int point);
+
+  void sendCommand(int currParam, double currVal);
+
+  void logCanceled();
+
+  /*
+   * Wait `millis` ms, or until the sweep is canceled; true if it was.
+   */
+  bool waitCanceled(long millis);
+
+  /*
+   * Wait until `deadline`, or until the sweep is canceled; true if it was.
+   */
+  bool waitCanceled(Clock::time_point deadline);
+
+  /*
+   * Estimated duration (ms) of the steps of compiled plan `plan` of sweep
+   * `c` (see stepTime); the ramping time alone goes to `rampMillis`, if
+   * given.
+   */
+  long planDuration(const SweepConfig& c, SweepPlan& plan, long* rampMillis);
+
+  /*
+   * Append the estimated and actual duration (ms) of a finished sweep of
+   * `points` points to historyFile, and log them.
+   */
+  void recordDuration(size_t points, double estimatedMs, double actualMs);
+
+public:
+  // Definition of the next sweep; loadJournal() replaces it
+  SweepConfig config;
+
+  // Sweep timing of the lockin, kept in timingFile; the estimated and
+  // actual duration of every finished sweep go to historyFile
+  SweepEstimator estimator;
+  std::string timingFile;
+  std::string historyFile;
+
+  // Called with the fraction done and the time left (ms) as a sweep runs,
+  // at most every PROGRESS_INTERVAL_MS
+  std::function<void(double, double)> onProgress;
+
+  // Leave the lockin as each sweep leaves it, for sweeps run back to back:
+  // the next sweep neither re-queries its settings nor stores them again,
+  // and restoreState() puts back those from before the first one
+  bool keepState;
+
+  SweepEngine(AsyncLogger& log);
+
+
+  /*
+   * Run sweeps on `lockin`, and select its timing in estimator.
+   */
+  void setLockin(SR830* lockin);
+
+
+  /*
+   * Run the sweep in config, or resume the one loaded by loadJournal().
+   * Returns 0 if it was canceled or could not start.
+   */
+  int run();
+
+
+  /*
+   * Cancel the running sweep, or the next one if none is running, until
+   * clearCancel() is called.
+   */
+  void cancel();
+
+  void clearCancel();
+
+  bool isCanceled() const {
+    return canceling;
+  }
+
+
+  /*
+   * Restore the coupling, sensitivity, time constant and displays the lockin
+   * had before the sweeps run with keepState, if any.
+   */
+  void restoreState();
+
+
+  /*
+   * Load the sweep definition and last checkpoint of the journal `fileName`
+   * into config, so that the next run() resumes it. Returns an error
+   * message, or an empty string on success.
+   */
+  std::string loadJournal(const char* fileName);
+
+
+  /*
+   * Read the sweep definition `def`, as written to a journal by
+   * definition(), into config, or with parseDefinition() into `config`. Keys
+   * missing from older journals keep their defaults. Returns an error
+   * message, or an empty string on success.
+   */
+  std::string loadDefinition(std::map<std::string, std::string>& def);
+
+  static std::string parseDefinition(
+    std::map<std::string, std::string>& def, SweepConfig& config
+  );
+
+  /*
+   * Check that sweep `config` can run: the checks the sweep window makes on
+   * its input, shared with the definitions read by parseDefinition(). X and
+   * Y voltages beyond VOLTAGE_MIN..VOLTAGE_MAX are clamped. Returns an error
+   * message, or an empty string if the sweep is valid.
+   */
+  static std::string validateConfig(SweepConfig& config);
+
+
+  /*
+   * Sweep definition, instrument state and output file of the current sweep,
+   * as stored in its journal.
+   */
+  std::map<std::string, std::string> definition();
+
+  /*
+   * Definition of sweep `config` alone, without the instrument state.
+   */
+  static std::map<std::string, std::string> configDefinition(
+    const SweepConfig& config
+  );
+
+
+  /*
+   * File name of the sweep output without its extension; the journal and the
+   * settings file are named after it.
+   */
+  std::string outputBase();
+
+  static std::string outputBase(const std::string& fileName);
+
+
+  /*
+   * Estimated duration (ms) of the sweep `c`, or -1 if it has too many
+   * steps to compile. The ramping time alone goes to `rampMillis`, if given.
+   */
+  long duration(const SweepConfig& c, long* rampMillis = NULL);
+
+
+  /*
+   * Estimated time (ms) of step `st` of `plan` of sweep `c`, from the waits
+   * it plans and the timing of the lockin in estimator. `clock` carries the
+   * state of the sweep from one step to the next; start it at {-1, 0}.
+   */
+  double stepTime(
+    const SweepConfig& c, SweepPlan& plan, const SweepStep& st, SweepClock& clock
+  );
+
+
+  /*
+   * Time constant required at frequency `freq` in sweep `c`, and settling
+   * time (ms) at time constant `timeConst`, with the current filter slope.
+   */
+  int requiredTimeConst(const SweepConfig& c, double freq);
+
+  long timeConstSettle(int timeConst);
+
+
+  /*
+   * How the frequency levels of sweep `c` pick their time constants. Returns
+   * false if they follow the frequency point by point (orderTimeConsts or
+   * autoTimeConst off).
+   */
+  bool timeConstOrder(const SweepConfig& c, TimeConstOrder& order);
+
+};
+
+
+/*
+ * Get the value (in volts) of the sensitivity given by the index i.
+ *
+ * See LockinSettings.cpp for valid indices and the values of the sensitivity to which
+ * they correspond.
+ */
+double getSensValue(int i);
+
+
+/*
+ * Get the most appropriate lockin sensitivity for the given voltage.
+ */
+int getBestSens(double ampl, int currSens);
+
+
+/*
+ * Get the minimum required time constant.
+ *
+ * The time constant is computed for the given frequency and filter slope,
+ * with the lockin input ac-coupled or not, and the signal `signalToDC` dB
+ * below its dc level.
+ */
+double getTauReq(double freq, int filtSlope, bool acCouple, double signalToDC);
+
+/*
+ * Get the smallest available time constant setting that is larger than reqTau.
+ */
+int getTimeConst(double reqTau);
+
+
+/*
+ * Returns the double-precision value representing the value of the time 
+ * constant given by the index i. See LockinSettings.cpp for valid indices and
+ * the values of the time constant to which they correspond. Returned value is
+ * in seconds.
+ */
+double getTimeConstValue(int i);
+
+
+/*
+ * Returns the data storage sample rate, in Hz, given by the index i (0 to 13).
+ */
+double getSampleRateValue(int i);
+
+
+/*
+ * Returns the index of the fastest data storage sample rate that does not
+ * exceed `rate` (Hz).
+ */
+int getSampleRate(double rate);
+
+
+/*
+ * Returns the double-precision value representing the slope of the low-pass
+ * filter given by the index i. See LockinSettings.cpp for valid indices and the
+ * values of the filter slope to which they correspond. Returned value is in
+ * dB/octet and is signed, i.e. a filter with roll-off of 18 dB/octet will be
+ * represented by -18.0.
+ */
+double getFiltSlopeValue(int i);
+
+
+/*
+ * Returns the multiplier which relates the wait time to the time constant
+ * that is appropriate for the indicated slope of the low-pass filter.
+ */
+double getWaitFactor(int filtSlope);
+
+
+/*
+ * Determines whether the given voltage `ampl` is out of range for the lockin
+ * sensitivity `sens`.
+ */
+bool outOfRange(double ampl, int sens);
+
+
+/*
+ * Time (ms) since `start`.
+ */
+double millisSince(std::chrono::steady_clock::time_point start);
+
+
+/*
+ * Local time of `when`. Unlike localtime(), safe to call from the threads of
+ * engines running at once.
+ */
+struct tm localTime(time_t when);
+
+#endif
@@ -0,0 +1,188 @@
+// SweepEstimator.cpp
+// encoding: utf-8
+//
+// Sweep duration model calibrated per instrument, and progress of a running sweep.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 22:31:12
+// Modified: 2026-10-17 05:31:08
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#include "SweepEstimator.h"
+
+#include <cmath>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+
+static const SweepTiming DEFAULT_TIMING = {1, 30, 20, 100, 1, 0, 10, 0};
+
+// Held while a timing file is rewritten, by the engines of all instruments
+static std::mutex timingFileMutex;
+
+
+/*
+ * Add the timing of each instrument in file `fileName` to `instruments`.
+ * Returns false if the file could not be read.
+ */
+static bool readTimings(
+  const char* fileName, std::map<std::string, SweepTiming>& instruments
+)
+{
+  std::ifstream in(fileName);
+  if(!in) {
+    return false;
+  }
+  // Each line: the timing fields, a tab, then the instrument name. Files
+  // written before commandMs was added end at sweeps.
+  std::string line;
+  while(std::getline(in, line)) {
+    size_t tab = line.find('\t');
+    if(line.empty() || line[0] == '#' || tab == std::string::npos) {
+      continue;
+    }
+    SweepTiming t;
+    std::istringstream fields(line.substr(0, tab));
+    fields >> t.waitScale >> t.measureMs >> t.sampleMs >> t.bufferMs
+        >> t.avgFraction >> t.huntsPerPoint >> t.sweeps;
+    if(!fields) {
+      continue;
+    }
+    if(!(fields >> t.commandMs)) {
+      t.commandMs = DEFAULT_TIMING.commandMs;
+    }
+    instruments[line.substr(tab + 1)] = t;
+  }
+  return true;
+}
+
+
+// ===== Method Implementation for class SweepEstimator ========================
+
+SweepEstimator::SweepEstimator(): total(0), done(0)
+{
+  timing = DEFAULT_TIMING;
+}
+
+
+bool SweepEstimator::load(const char* fileName)
+{
+  std::lock_guard<std::mutex> lock(timingFileMutex);
+  if(!readTimings(fileName, instruments)) {
+    return false;
+  }
+  select(instrument);
+  return true;
+}
+
+
+bool SweepEstimator::save(const char* fileName) const
+{
+  // Engines of other instruments may have saved theirs since this one loaded
+  std::lock_guard<std::mutex> lock(timingFileMutex);
+  std::map<std::string, SweepTiming> all = instruments;
+  readTimings(fileName, all);
+  std::map<std::string, SweepTiming>::const_iterator own =
+      instruments.find(instrument);
+  if(own != instruments.end()) {
+    all[instrument] = own->second;
+  }
+  std::ofstream out(fileName, std::ios::trunc);
+  out << "# waitScale measureMs sampleMs bufferMs avgFraction huntsPerPoint"
+      << " sweeps commandMs\tinstrument" << '\n';
+  std::map<std::string, SweepTiming>::const_iterator it;
+  for(it = all.begin(); it != all.end(); ++it) {
+    const SweepTiming& t = it->second;
+    out << t.waitScale << ' ' << t.measureMs << ' ' << t.sampleMs << ' '
+        << t.bufferMs << ' ' << t.avgFraction << ' ' << t.huntsPerPoint << ' '
+        << t.sweeps << ' ' << t.commandMs << '\t' << it->first << '\n';
+  }
+  out.flush();
+  return (bool) out;
+}
+
+
+void SweepEstimator::select(const std::string& name)
+{
+  instrument = name;
+  std::map<std::string, SweepTiming>::const_iterator it = instruments.find(name);
+  timing = (it != instruments.end()) ? it->second : DEFAULT_TIMING;
+}
+
+
+/*
+ * Move `value` towards `measured` by the learning rate, or to it for the
+ * first sweep; unmeasured (negative) values leave it alone.
+ */
+static void learnField(double& value, double measured, int sweeps)
+{
+  if(measured >= 0 && std::isfinite(measured)) {
+    value = (sweeps == 0) ? measured
+        : value + ESTIMATOR_LEARN_RATE * (measured - value);
+  }
+}
+
+
+void SweepEstimator::learn(const SweepTiming& measured)
+{
+  learnField(timing.waitScale, measured.waitScale, timing.sweeps);
+  learnField(timing.measureMs, measured.measureMs, timing.sweeps);
+  learnField(timing.sampleMs, measured.sampleMs, timing.sweeps);
+  learnField(timing.bufferMs, measured.bufferMs, timing.sweeps);
+  learnField(timing.avgFraction, measured.avgFraction, timing.sweeps);
+  learnField(timing.huntsPerPoint, measured.huntsPerPoint, timing.sweeps);
+  learnField(timing.commandMs, measured.commandMs, timing.sweeps);
+  timing.sweeps++;
+  instruments[instrument] = timing;
+}
+
+
+void SweepEstimator::start(double totalMs, double doneMs)
+{
+  total = totalMs;
+  done = doneMs;
+}
+
+
+double SweepEstimator::fraction() const
+{
+  return (total > 0) ? fmin(1, done / total) : 0;
+}
+
+
+double SweepEstimator::remaining(double elapsedMs, double startDoneMs) const
+{
+  double left = fmax(0, total - done);
+  double estimated = done - startDoneMs;
+  // Trust the pace of this sweep as it covers more of the estimate
+  if(estimated > 0 && elapsedMs > 0) {
+    double weight = fmin(1, estimated / (0.1 * total + 1));
+    double pace = elapsedMs / estimated;
+    left *= 1 + weight * (pace - 1);
+  }
+  return left;
+}
@@ -0,0 +1,179 @@
+// SweepEstimator.h
+// encoding: utf-8
+//
+// Sweep duration model calibrated per instrument, and progress of a running sweep.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 22:31:12
+// Modified: 2026-10-17 05:31:08
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#ifndef SWEEPESTIMATOR_H
+#define SWEEPESTIMATOR_H
+
+#include <map>
+#include <string>
+
+// Weight of the latest sweep when the timing of an instrument is updated
+#define ESTIMATOR_LEARN_RATE 0.3
+
+
+/*
+ * struct SweepTiming
+ *
+ * What a sweep costs on one instrument beyond its planned waits, as learned
+ * from the sweeps it has run.
+ *
+ * Fields:
+ *   waitScale - actual over planned time of setting points and waiting for
+ *       them (below 1 with adaptive settling)
+ *   measureMs - time per measured point for reading, writing and journaling
+ *   sampleMs - time per averaging sample queried from the lockin
+ *   bufferMs - time per buffered acquisition beyond its sampling time
+ *   avgFraction - fraction of numAvgPts taken when averaging stops early
+ *   huntsPerPoint - sensitivity changes found by trial per point, each
+ *       costing a wait
+ *   commandMs - time per set or ramp step for commanding the lockin to the
+ *       point, beyond the slew time of a ramp
+ *   sweeps - number of sweeps learned from
+ */
+struct SweepTiming {
+  double waitScale;
+  double measureMs;
+  double sampleMs;
+  double bufferMs;
+  double avgFraction;
+  double huntsPerPoint;
+  double commandMs;
+  int sweeps;
+};
+
+
+/*
+ * struct SweepClock
+ *
+ * Carried from step to step while adding up the time of a sweep plan: the
+ * time constant of the automatic frequency level (-1 before its first
+ * point), and the settle time of the last wait.
+ */
+struct SweepClock {
+  int timeConst;
+  long wait;
+};
+
+
+/*
+ * class SweepEstimator
+ *
+ * Keeps the SweepTiming of every instrument, in a text file with one line
+ * per instrument, and follows the progress of the running sweep against
+ * its estimate.
+ *
+ * While a sweep runs, the caller adds the estimated time of every step done
+ * with advance(). The time left is the estimate of the steps still to come,
+ * scaled by how the time actually taken compares with the estimate of the
+ * steps done, once enough of the sweep has passed for that to mean
+ * something.
+ */
+class SweepEstimator {
+  std::map<std::string, SweepTiming> instruments;
+  std::string instrument;
+  double total;
+  double done;
+
+public:
+  // Timing of the selected instrument
+  SweepTiming timing;
+
+  SweepEstimator();
+
+
+  /*
+   * Read the timing of all instruments from `fileName`. Returns false if it
+   * could not be read.
+   */
+  bool load(const char* fileName);
+
+
+  /*
+   * Write the timing of all instruments to `fileName`. The timing of other
+   * instruments already in the file is kept as it is there, so that engines
+   * running at once on several instruments can share the file.
+   */
+  bool save(const char* fileName) const;
+
+
+  /*
+   * Use the timing of instrument `name`, the defaults if it has none yet.
+   */
+  void select(const std::string& name);
+
+
+  /*
+   * Name of the selected instrument.
+   */
+  const std::string& name() const {
+    return instrument;
+  }
+
+
+  /*
+   * Fold the timing measured in a sweep into that of the selected
+   * instrument. Fields of `measured` below 0 were not measured.
+   */
+  void learn(const SweepTiming& measured);
+
+
+  /*
+   * Start following a sweep estimated at `totalMs`, of which `doneMs`
+   * (resuming) are already done.
+   */
+  void start(double totalMs, double doneMs);
+
+
+  /*
+   * Add the estimated time of a step just done.
+   */
+  void advance(double ms) {
+    done += ms;
+  }
+
+
+  /*
+   * Fraction of the estimated sweep done.
+   */
+  double fraction() const;
+
+
+  /*
+   * Time left (ms), `elapsedMs` after start() was called with `startDoneMs`
+   * already done.
+   */
+  double remaining(double elapsedMs, double startDoneMs) const;
+
+};
+
+#endif
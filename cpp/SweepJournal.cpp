@@ -0,0 +1,312 @@
+// SweepJournal.cpp
+// encoding: utf-8
+//
+// Write-ahead journal of sweep progress, for resuming interrupted sweeps.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 21:02:24
+// Modified: 2026-10-17 05:02:37
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#include "SweepJournal.h"
+
+#include <sstream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+
+bool fileSync(FILE* file)
+{
+  if(fflush(file) != 0) {
+    return false;
+  }
+#ifdef _WIN32
+  return _commit(_fileno(file)) == 0;
+#else
+  return fsync(fileno(file)) == 0;
+#endif
+}
+
+
+long long fileTell(FILE* file)
+{
+#ifdef _WIN32
+  return _ftelli64(file);
+#else
+  return ftello(file);
+#endif
+}
+
+
+bool fileSeek(FILE* file, long long offset)
+{
+#ifdef _WIN32
+  return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+  return fseeko(file, offset, SEEK_SET) == 0;
+#endif
+}
+
+
+bool fileTruncate(const char* fileName, long long length)
+{
+#ifdef _WIN32
+  int fd = _open(fileName, _O_RDWR | _O_BINARY);
+  if(fd < 0) {
+    return false;
+  }
+  bool ok = _chsize_s(fd, length) == 0;
+  _close(fd);
+  return ok;
+#else
+  return truncate(fileName, length) == 0;
+#endif
+}
+
+
+bool fileReplace(const char* from, const char* to)
+{
+#ifdef _WIN32
+  return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  return rename(from, to) == 0;
+#endif
+}
+
+
+/*
+ * FNV-1a hash of `len` characters of `s`, to detect damaged records.
+ */
+static unsigned long checksum(const char* s, size_t len)
+{
+  uint32_t h = 2166136261u;
+  for(size_t k = 0; k < len; k++) {
+    h = (h ^ (unsigned char) s[k]) * 16777619u;
+  }
+  return h;
+}
+
+
+/*
+ * Parse the checkpoint record `line`. Returns false if it is damaged.
+ */
+static bool parseCheckpoint(const std::string& line, SweepCheckpoint& cp)
+{
+  size_t mark = line.rfind(" #");
+  if(line.compare(0, 2, "P ") != 0 || mark == std::string::npos) {
+    return false;
+  }
+  char* end;
+  unsigned long sum = strtoul(line.c_str() + mark + 2, &end, 16);
+  if(*end != '\0' || sum != checksum(line.c_str(), mark)) {
+    return false;
+  }
+  std::istringstream in(line.substr(2, mark - 2));
+  in >> cp.sequence >> cp.outputLength >> cp.sensitivity >> cp.timeConstant
+      >> cp.numLevels;
+  if(!in || cp.numLevels < 0 || cp.numLevels > JOURNAL_MAX_LEVELS) {
+    return false;
+  }
+  for(int level = 0; level < cp.numLevels; level++) {
+    SweepPosition& p = cp.levels[level];
+    in >> p.repeat >> p.reversed >> p.index >> p.initialSens;
+  }
+  return !in.fail();
+}
+
+
+// ===== Method Implementation for class SweepJournal ==========================
+
+SweepJournal::SweepJournal(): file(NULL), sequence(0), validLength(0), pendingPoints(0)
+{
+}
+
+
+SweepJournal::~SweepJournal()
+{
+  // Without an END record, the sweep reads back as interrupted
+  if(file != NULL) {
+    fclose(file);
+  }
+}
+
+
+bool SweepJournal::create(
+  const char* fileName, const std::map<std::string, std::string>& definition
+)
+{
+  if(file != NULL) {
+    fclose(file);
+  }
+  // Binary mode, so that lengths read back by load() match
+  file = fopen(fileName, "wb");
+  if(file == NULL) {
+    return false;
+  }
+  fprintf(file, "%s\n", JOURNAL_MAGIC);
+  for(std::map<std::string, std::string>::const_iterator it = definition.begin();
+      it != definition.end(); ++it) {
+    fprintf(file, "%s %s\n", it->first.c_str(), it->second.c_str());
+  }
+  fprintf(file, "BEGIN\n");
+  sequence = 0;
+  pendingPoints = 0;
+  lastSync = Clock::now();
+  return fileSync(file);
+}
+
+
+bool SweepJournal::load(
+  const char* fileName, std::map<std::string, std::string>& definition,
+  SweepCheckpoint& last, std::string& status
+)
+{
+  FILE* in = fopen(fileName, "rb");
+  if(in == NULL) {
+    return false;
+  }
+  std::string text;
+  char buf[4096];
+  size_t n;
+  while((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    text.append(buf, n);
+  }
+  fclose(in);
+
+  definition.clear();
+  status.clear();
+  last.numLevels = -1;
+  sequence = 0;
+  validLength = 0;
+  bool inBody = false;
+  size_t pos = 0;
+  size_t end;
+  // A line without its newline was cut short, and is ignored
+  while((end = text.find('\n', pos)) != std::string::npos) {
+    std::string line = text.substr(pos, end - pos);
+    pos = end + 1;
+    if(validLength == 0 && !inBody) {
+      if(line != JOURNAL_MAGIC) {
+        return false;
+      }
+      validLength = pos;
+    } else if(!inBody) {
+      if(line == "BEGIN") {
+        inBody = true;
+        validLength = pos;
+      } else {
+        size_t space = line.find(' ');
+        definition[line.substr(0, space)] =
+            (space == std::string::npos) ? "" : line.substr(space + 1);
+      }
+    } else if(line.compare(0, 4, "END ") == 0) {
+      status = line.substr(4);
+      break;
+    } else {
+      SweepCheckpoint cp;
+      if(!parseCheckpoint(line, cp)) {
+        break;
+      }
+      last = cp;
+      sequence = cp.sequence;
+      validLength = pos;
+    }
+  }
+  return inBody;
+}
+
+
+bool SweepJournal::resume(const char* fileName)
+{
+  if(file != NULL) {
+    fclose(file);
+  }
+  // Drop the END record, or a damaged tail, before adding to the journal
+  if(!fileTruncate(fileName, validLength)) {
+    file = NULL;
+    return false;
+  }
+  file = fopen(fileName, "ab");
+  pendingPoints = 0;
+  lastSync = Clock::now();
+  return file != NULL;
+}
+
+
+bool SweepJournal::isOpen()
+{
+  return file != NULL;
+}
+
+
+bool SweepJournal::pointDone()
+{
+  pendingPoints++;
+  return pendingPoints >= JOURNAL_SYNC_POINTS
+      || Clock::now() - lastSync >= std::chrono::milliseconds(JOURNAL_SYNC_MS);
+}
+
+
+void SweepJournal::checkpoint(SweepCheckpoint& cp)
+{
+  if(file == NULL) {
+    return;
+  }
+  cp.sequence = ++sequence;
+  char record[64 + 48*JOURNAL_MAX_LEVELS];
+  int len = snprintf(record, sizeof(record), "P %lld %lld %d %d %d",
+      cp.sequence, cp.outputLength, cp.sensitivity, cp.timeConstant,
+      cp.numLevels);
+  for(int level = 0; level < cp.numLevels; level++) {
+    const SweepPosition& p = cp.levels[level];
+    len += snprintf(record + len, sizeof(record) - len, " %d %d %d %d",
+        p.repeat, p.reversed, p.index, p.initialSens);
+  }
+  fprintf(file, "%s #%08lx\n", record, checksum(record, len));
+  fileSync(file);
+  pendingPoints = 0;
+  lastSync = Clock::now();
+}
+
+
+void SweepJournal::finish(const char* status)
+{
+  if(file == NULL) {
+    return;
+  }
+  fprintf(file, "END %s\n", status);
+  fileSync(file);
+  fclose(file);
+  file = NULL;
+}
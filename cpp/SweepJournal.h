@@ -0,0 +1,205 @@
+// SweepJournal.h
+// encoding: utf-8
+//
+// Write-ahead journal of sweep progress, for resuming interrupted sweeps.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 21:02:24
+// Modified: 2026-10-17 05:02:37
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#ifndef SWEEPJOURNAL_H
+#define SWEEPJOURNAL_H
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+
+/*
+ * Journal layout (text, one record per line):
+ *
+ *   LCJOURNAL 1
+ *   <key> <value>          sweep definition, written by the application
+ *   ...
+ *   BEGIN
+ *   P <seq> <outputLength> <sens> <tc> <levels> {<repeat> <reversed> <index> <initialSens>} #<checksum>
+ *   ...
+ *   END <status>
+ *
+ * Each P record is a checkpoint: every point up to and including the one it
+ * describes is in the output file, whose first outputLength bytes (text) or
+ * rows (binary) are complete. The output is synced to disk before the record
+ * is written. A record whose checksum does not match, such as one cut short
+ * by a crash, ends the journal.
+ */
+
+#define JOURNAL_MAGIC "LCJOURNAL 1"
+#define JOURNAL_MAX_LEVELS 8
+
+// A checkpoint is synced to disk after JOURNAL_SYNC_POINTS measured points,
+// or after the first point once JOURNAL_SYNC_MS have passed
+#define JOURNAL_SYNC_POINTS 50
+#define JOURNAL_SYNC_MS 10000
+
+
+/*
+ * Flush `file` and have the operating system write it to disk. Returns false
+ * on failure.
+ */
+bool fileSync(FILE* file);
+
+/*
+ * 64-bit ftell() and absolute fseek().
+ */
+long long fileTell(FILE* file);
+bool fileSeek(FILE* file, long long offset);
+
+/*
+ * Cut the file `fileName` to its first `length` bytes.
+ */
+bool fileTruncate(const char* fileName, long long length);
+
+/*
+ * Rename the file `from` to `to`, replacing `to` in one step if it exists.
+ */
+bool fileReplace(const char* from, const char* to);
+
+
+/*
+ * struct SweepPosition
+ *
+ * Position of the loops at one level of a sweep.
+ *
+ * Fields:
+ *   repeat - repeat number r
+ *   reversed - 1 during the reverse pass of a bidirectional sweep
+ *   index - loop index i of the point
+ *   initialSens - sensitivity stored for the repeats of this level
+ */
+struct SweepPosition {
+  int repeat;
+  int reversed;
+  int index;
+  int initialSens;
+};
+
+
+/*
+ * struct SweepCheckpoint
+ *
+ * The last completed point of a sweep.
+ *
+ * Fields:
+ *   sequence - number of the checkpoint in the journal
+ *   outputLength - bytes of the text output file, or rows of the binary
+ *       output file, that hold every point up to this one
+ *   sensitivity, timeConstant - instrument settings at this point
+ *   numLevels - number of sweep levels; 0 if no point has been measured
+ *   levels - position at each level, outermost first
+ */
+struct SweepCheckpoint {
+  long long sequence;
+  long long outputLength;
+  int sensitivity;
+  int timeConstant;
+  int numLevels;
+  SweepPosition levels[JOURNAL_MAX_LEVELS];
+};
+
+
+/*
+ * class SweepJournal
+ *
+ * Appends checkpoints of a running sweep to its journal file, and reads the
+ * last valid checkpoint back when the sweep is resumed.
+ */
+class SweepJournal {
+  typedef std::chrono::steady_clock Clock;
+
+  FILE* file;
+  long long sequence;
+  long long validLength;  // bytes of the loaded journal up to its last checkpoint
+  int pendingPoints;
+  Clock::time_point lastSync;
+
+public:
+  SweepJournal();
+  ~SweepJournal();
+
+
+  /*
+   * Create the journal `fileName` for a sweep described by `definition`
+   * (keys without spaces, values on one line). The definition is on disk
+   * when this returns true.
+   */
+  bool create(
+    const char* fileName, const std::map<std::string, std::string>& definition
+  );
+
+
+  /*
+   * Read the journal `fileName`: its definition, its last valid checkpoint
+   * (numLevels = -1 if there is none) and how it ended ("completed",
+   * "canceled", or empty if the sweep was interrupted). Returns false if the
+   * file is not a journal.
+   */
+  bool load(
+    const char* fileName, std::map<std::string, std::string>& definition,
+    SweepCheckpoint& last, std::string& status
+  );
+
+
+  /*
+   * Continue the journal `fileName`, previously read with load(), after its
+   * last valid checkpoint.
+   */
+  bool resume(const char* fileName);
+
+
+  bool isOpen();
+
+
+  /*
+   * Count a measured point. Returns true when a checkpoint is due.
+   */
+  bool pointDone();
+
+
+  /*
+   * Append `cp` as the next checkpoint and sync it to disk. The output it
+   * refers to must already be on disk.
+   */
+  void checkpoint(SweepCheckpoint& cp);
+
+
+  /*
+   * Record how the sweep ended and close the journal.
+   */
+  void finish(const char* status);
+
+};
+
+#endif
@@ -0,0 +1,566 @@
+// SweepPlan.cpp
+// encoding: utf-8
+//
+// Compilation of a parametric sweep into a flat list of steps.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 21:08:00
+// Modified: 2026-10-17 09:12:48
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#include "SweepPlan.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+
+
+// What comes next at a level of the walk through the steps
+enum {
+  PHASE_REPEAT,
+  PHASE_SET,
+  PHASE_WAIT,
+  PHASE_MEASURE,
+  PHASE_NEXT,
+  PHASE_RAMP
+};
+
+
+// ===== Method Implementation for class SweepPlan =============================
+
+SweepPlan::SweepPlan(): rampType(1), total(0), coords(0), measurements(0),
+    depth(-1), walked(0)
+{
+}
+
+
+bool SweepPlan::compile(
+  const SweepParameters& setup, const double* customX,
+  const double* customY, int numCustom, int rampType,
+  const TimeConstOrder* order
+)
+{
+  this->rampType = rampType;
+  for(int k = 0; k < NUM_AVAIL_PARAMS; k++) {
+    slewRates[k] = setup.slewRates[k];
+  }
+  levels.clear();
+  passes.clear();
+  total = 0;
+  coords = 0;
+  measurements = 0;
+  this->order.required = nullptr;
+  if(order != NULL) {
+    this->order = *order;
+  }
+
+  for(int level = 0; level <= setup.maxRecursionLevel; level++) {
+    SweepPlanLevel L;
+    L.param = setup.parameters[level];
+    L.coord = coords;
+    L.wait = 0;
+    L.repeats = 0;
+    L.bidirectional = false;
+    L.adaptive = false;
+    L.logSpacing = false;
+    L.ordered = false;
+    if(L.param >= 0 && L.param < NUM_AVAIL_PARAMS) {
+      L.wait = setup.waits[L.param];
+      L.repeats = setup.repeats[L.param];
+      L.bidirectional = setup.bidirectional[L.param];
+      L.logSpacing = setup.logSpacing[L.param];
+      L.adaptive = setup.adaptive[L.param]
+          && (L.param == SWEEP_F || L.param == SWEEP_A)
+          && level == setup.maxRecursionLevel;
+    }
+    if(L.param == SWEEP_CUSTOM) {
+      if(numCustom > 0) {
+        L.x.assign(customX, customX + numCustom);
+        L.y.assign(customY, customY + numCustom);
+      }
+      coords += 2;
+    } else {
+      if(L.param >= 0 && L.param < NUM_AVAIL_PARAMS) {
+        // Evenly spaced points, or evenly spaced in log10 of the value
+        double start = setup.starts[L.param];
+        double end = setup.ends[L.param];
+        if(L.logSpacing) {
+          start = log10(start);
+          end = log10(end);
+        }
+        int n = setup.steps[L.param];
+        if(n >= SWEEP_PLAN_MAX_POINTS) {
+          levels.clear();
+          return false;
+        }
+        double stepSize = (end - start) / n;
+        for(int i = 0; i < n + 1; i++) {
+          double val = start + i * stepSize;
+          L.x.push_back(L.logSpacing ? pow(10, val) : val);
+        }
+      }
+      coords += 1;
+    }
+    L.ordered = order != NULL && L.param == SWEEP_F && !L.adaptive;
+    if(L.ordered) {
+      for(size_t p = 0; p < L.x.size(); p++) {
+        L.timeConsts.push_back(order->required(L.x[p]));
+      }
+    }
+    levels.push_back(L);
+  }
+  for(int level = 0; level < (int) levels.size(); level++) {
+    SweepPlanLevel& L = levels[level];
+    // An ordered innermost level continues from where it ended instead
+    bool continues = L.ordered && level + 1 == (int) levels.size();
+    if(!L.bidirectional && !L.x.empty() && !continues) {
+      appendRamp(L.ramp, level, L.x.size() - 1);
+    }
+  }
+
+  double count = countSteps(0);
+  if(count > SWEEP_PLAN_MAX_STEPS) {
+    levels.clear();
+    return false;
+  }
+  total = (size_t) count;
+  double points = 1;
+  for(size_t level = 0; level < levels.size(); level++) {
+    const SweepPlanLevel& L = levels[level];
+    points *= L.repeats * (L.bidirectional ? 2 : 1) * (double) L.x.size();
+  }
+  measurements = levels.empty() ? 0 : (size_t) points;
+  passes.assign(levels.size(), std::vector<SweepPass>());
+  cursors.assign(levels.size(), Cursor());
+  recent.assign(SWEEP_PLAN_HISTORY, SweepStep());
+  rewind();
+  return true;
+}
+
+
+/*
+ * Number of steps in a full sweep of level `level` and those inside it (as
+ * a double, which cannot overflow).
+ */
+double SweepPlan::countSteps(int level)
+{
+  if(level >= (int) levels.size()) {
+    return 1;  // the measurement
+  }
+  const SweepPlanLevel& L = levels[level];
+  double passes = L.bidirectional ? 2 : 1;
+  double perRepeat = 1 + passes * L.x.size() * (2 + countSteps(level + 1))
+      + L.ramp.size();
+  return L.repeats * perRepeat;
+}
+
+
+/*
+ * Time constant to set with point i of `pass`, `current` being set: the one
+ * it requires, unless the current one is longer and lowering it would not
+ * pay off over the points ahead that allow the lower one.
+ */
+int SweepPlan::pickTimeConst(
+  int level, const std::vector<int>& pass, size_t i, int current
+)
+{
+  const std::vector<int>& required = levels[level].timeConsts;
+  int need = required[pass[i]];
+  if(current < 0 || need >= current) {
+    return need;
+  }
+  long saved = 0;
+  long perPoint = order.settle(current) - order.settle(need);
+  for(size_t j = i; j < pass.size() && required[pass[j]] <= need; j++) {
+    saved += perPoint;
+    if(saved > order.switchWait) {
+      return need;
+    }
+  }
+  return current;
+}
+
+
+/*
+ * Index in passes[level] of the pass in direction `reversed` that follows
+ * one which left the level at `fromPoint` with `fromTimeConst`, worked out
+ * the first time it is asked for.
+ */
+int SweepPlan::findPass(int level, int reversed, int fromPoint, int fromTimeConst)
+{
+  const SweepPlanLevel& L = levels[level];
+  int n = L.x.size();
+  bool innermost = level + 1 == (int) levels.size();
+  // Only ordered levels depend on where the last pass left them, and only
+  // the innermost level, whose output is one pass, can be reordered
+  if(!L.ordered) {
+    fromTimeConst = -1;
+  }
+  if(!(L.ordered && innermost)) {
+    fromPoint = -1;
+  }
+  std::vector<SweepPass>& known = passes[level];
+  for(size_t k = 0; k < known.size(); k++) {
+    if(
+      known[k].reversed == reversed && known[k].fromPoint == fromPoint
+      && known[k].fromTimeConst == fromTimeConst
+    ) {
+      return k;
+    }
+  }
+
+  SweepPass p;
+  p.reversed = reversed;
+  p.fromPoint = fromPoint;
+  p.fromTimeConst = fromTimeConst;
+  p.points.resize(n);
+  for(int i = 0; i < n; i++) {
+    p.points[i] = reversed ? n - 1 - i : i;
+  }
+  // Go backwards if that starts the pass where the last one ended
+  if(n > 1 && fromPoint >= 0) {
+    int last = L.timeConsts[fromPoint];
+    if(L.timeConsts[p.points[0]] != last && L.timeConsts[p.points[n-1]] == last) {
+      std::reverse(p.points.begin(), p.points.end());
+    }
+  }
+  if(L.ordered) {
+    int current = fromTimeConst;
+    for(int i = 0; i < n; i++) {
+      current = pickTimeConst(level, p.points, i, current);
+      p.timeConsts.push_back(current);
+    }
+  }
+  known.push_back(p);
+  return known.size() - 1;
+}
+
+
+/*
+ * Index in passes[level] of pass `nth` of the level, counting every pass of
+ * every time the level is swept from the start of the sweep.
+ */
+int SweepPlan::nthPass(int level, unsigned long long nth)
+{
+  const SweepPlanLevel& L = levels[level];
+  int perRepeat = L.bidirectional ? 2 : 1;
+  if(!L.ordered) {
+    return findPass(level, nth % perRepeat, -1, -1);
+  }
+  // Each pass of an ordered level starts where the one before left it; the
+  // passes repeat once a starting state comes round again
+  std::map<std::tuple<int, int, int>, unsigned long long> seen;
+  bool cycled = false;
+  int lastPoint = -1;
+  int lastTimeConst = -1;
+  for(unsigned long long p = 0; ; p++) {
+    int reversed = p % perRepeat;
+    if(!cycled) {
+      std::tuple<int, int, int> state(reversed, lastPoint, lastTimeConst);
+      if(seen.count(state)) {
+        unsigned long long cycle = p - seen[state];
+        p += (nth - p) / cycle * cycle;
+        cycled = true;
+      } else {
+        seen[state] = p;
+      }
+    }
+    int k = findPass(level, reversed, lastPoint, lastTimeConst);
+    if(p == nth) {
+      return k;
+    }
+    const SweepPass& pass = passes[level][k];
+    lastPoint = pass.points.back();
+    lastTimeConst = pass.timeConsts.empty() ? -1 : pass.timeConsts.back();
+  }
+}
+
+
+/*
+ * Start the next pass of the level, in the direction of its cursor. Returns
+ * false if the level has no points.
+ */
+bool SweepPlan::startPass(int level)
+{
+  Cursor& c = cursors[level];
+  if(levels[level].x.empty()) {
+    return false;
+  }
+  c.index = 0;
+  c.pass = findPass(level, c.reversed, c.lastPoint, c.lastTimeConst);
+  const SweepPass& p = passes[level][c.pass];
+  c.lastPoint = p.points.back();
+  c.lastTimeConst = p.timeConsts.empty() ? -1 : p.timeConsts.back();
+  return true;
+}
+
+
+/*
+ * Step of type `type` at the current position of level `level`.
+ */
+SweepStep SweepPlan::makeStep(int type, int level)
+{
+  const SweepPlanLevel& L = levels[level];
+  const Cursor& c = cursors[level];
+  SweepStep s;
+  s.type = type;
+  s.level = level;
+  s.repeat = c.repeat;
+  s.reversed = 0;
+  s.index = 0;
+  s.point = 0;
+  s.duration = 0;
+  s.timeConst = -1;
+  if(type != STEP_REPEAT) {
+    const SweepPass& p = passes[level][c.pass];
+    s.reversed = c.reversed;
+    s.index = c.index;
+    s.point = p.points[c.index];
+    if(L.ordered) {
+      s.timeConst = p.timeConsts[c.index];
+    }
+  }
+  s.value = L.x.empty() ? 0 : L.x[s.point];
+  return s;
+}
+
+
+/*
+ * Go back to the first step.
+ */
+void SweepPlan::rewind()
+{
+  for(size_t level = 0; level < cursors.size(); level++) {
+    cursors[level].repeat = 0;
+    cursors[level].phase = PHASE_REPEAT;
+    cursors[level].lastPoint = -1;
+    cursors[level].lastTimeConst = -1;
+  }
+  depth = levels.empty() ? -1 : 0;
+  walked = 0;
+}
+
+
+/*
+ * Put the next step in `out`. Returns false after the last one.
+ */
+bool SweepPlan::next(SweepStep& out)
+{
+  while(depth >= 0) {
+    const SweepPlanLevel& L = levels[depth];
+    Cursor& c = cursors[depth];
+    switch(c.phase) {
+      case PHASE_REPEAT:
+        if(c.repeat >= L.repeats) {
+          // Done with the level; its parent moves on to its next point
+          depth--;
+          break;
+        }
+        c.reversed = 0;
+        c.phase = startPass(depth) ? PHASE_SET : PHASE_RAMP;
+        c.ramp = 0;
+        out = makeStep(STEP_REPEAT, depth);
+        return true;
+
+      case PHASE_SET:
+        c.phase = PHASE_WAIT;
+        out = makeStep(STEP_SET, depth);
+        return true;
+
+      case PHASE_WAIT:
+        out = makeStep(STEP_WAIT, depth);
+        if(depth + 1 == (int) levels.size()) {
+          c.phase = PHASE_MEASURE;
+        } else {
+          // A full sweep of the next level at each point
+          c.phase = PHASE_NEXT;
+          depth++;
+          cursors[depth].repeat = 0;
+          cursors[depth].phase = PHASE_REPEAT;
+        }
+        return true;
+
+      case PHASE_MEASURE:
+        c.phase = PHASE_NEXT;
+        out = makeStep(STEP_MEASURE, depth);
+        return true;
+
+      case PHASE_NEXT:
+        if(++c.index < (int) L.x.size()) {
+          c.phase = PHASE_SET;
+        } else if(L.bidirectional && c.reversed == 0) {
+          c.reversed = 1;
+          startPass(depth);
+          c.phase = PHASE_SET;
+        } else {
+          c.phase = PHASE_RAMP;
+        }
+        break;
+
+      case PHASE_RAMP:
+        if(c.ramp < L.ramp.size()) {
+          out = L.ramp[c.ramp++];
+          return true;
+        }
+        c.repeat++;
+        c.phase = PHASE_REPEAT;
+        break;
+    }
+  }
+  return false;
+}
+
+
+SweepStep SweepPlan::step(size_t k)
+{
+  if(k < walked && walked - k > SWEEP_PLAN_HISTORY) {
+    rewind();
+  }
+  SweepStep s;
+  while(walked <= k && next(s)) {
+    recent[walked % SWEEP_PLAN_HISTORY] = s;
+    walked++;
+  }
+  return recent[k % SWEEP_PLAN_HISTORY];
+}
+
+
+void SweepPlan::appendRamp(std::vector<SweepStep>& out, int level, int fromPoint)
+{
+  const SweepPlanLevel& L = levels[level];
+  SweepStep s = {STEP_RAMP, (uint8_t) level, 0, -1, 0, 0, 0, 0, 0};
+  if(L.x.empty() || fromPoint <= 0) {
+    return;
+  }
+  if(rampType == RAMP_SLEW) {
+    appendSlewRamp(out, level, fromPoint);
+  } else if(rampType == RAMP_NONE) {
+    s.value = L.x[0];
+    out.push_back(s);
+  } else if(rampType == RAMP_ALL || L.param == SWEEP_CUSTOM) {
+    for(int p = fromPoint - 1; p >= 0; p--) {
+      s.point = p;
+      s.value = L.x[p];
+      out.push_back(s);
+    }
+  } else {
+    double endDecade = log10(L.x[fromPoint]);
+    double startDecade = log10(L.x[0]);
+    double decades = fabs(endDecade - startDecade);
+    int rampSteps = (int) ceil(STEPS_PER_RAMP_DECADE * decades);
+    double rampStep = (endDecade - startDecade) / rampSteps;
+    s.point = -1;
+    for(int m = rampSteps - 1; m >= 0; m--) {
+      s.value = pow(10, startDecade + rampStep*m);
+      out.push_back(s);
+    }
+  }
+}
+
+
+/*
+ * Milliseconds to move a parameter by `distance` at `rate` (no time if the
+ * rate is not limited).
+ */
+static int32_t slewTime(double distance, double rate)
+{
+  return (rate > 0) ? (int32_t) ceil(1000 * fabs(distance) / rate) : 0;
+}
+
+
+void SweepPlan::appendSlewRamp(std::vector<SweepStep>& out, int level, int fromPoint)
+{
+  const SweepPlanLevel& L = levels[level];
+  SweepStep s = {STEP_RAMP, (uint8_t) level, 0, -1, 0, 0, 0, 0, 0};
+  if(L.param == SWEEP_CUSTOM) {
+    for(int p = fromPoint - 1; p >= 0; p--) {
+      s.point = p;
+      s.value = L.x[p];
+      s.duration = std::max(
+        slewTime(L.x[p+1] - L.x[p], slewRates[SWEEP_X]),
+        slewTime(L.y[p+1] - L.y[p], slewRates[SWEEP_Y])
+      );
+      out.push_back(s);
+    }
+    return;
+  }
+
+  // Evenly spaced steps, in decades for the frequency, each as large as
+  // the rate allows in one tick
+  bool decades = L.param == SWEEP_F;
+  double from = decades ? log10(L.x[fromPoint]) : L.x[fromPoint];
+  double to = decades ? log10(L.x[0]) : L.x[0];
+  double rate = slewRates[L.param];
+  int n = 1;
+  if(rate > 0) {
+    double perTick = rate * RAMP_SLEW_TICK_MS / 1000;
+    n = std::max(1, (int) ceil(fabs(to - from) / perTick - 1e-9));
+  }
+  s.point = -1;
+  s.duration = slewTime((to - from) / n, rate);
+  for(int m = 1; m <= n; m++) {
+    double u = from + (to - from) * m / n;
+    s.value = decades ? pow(10, u) : u;
+    if(m == n) {
+      s.point = 0;
+      s.value = L.x[0];
+    }
+    out.push_back(s);
+  }
+}
+
+
+long SweepPlan::findResume(const SweepCheckpoint& cp, int* points)
+{
+  if(cp.numLevels != (int) levels.size() || levels.empty()) {
+    return -1;
+  }
+  // The steps before the measurement: at each level, those of the repeats,
+  // passes and points before its position, then its repeat, set and wait
+  // steps. Each point of a level holds a full sweep of the next one.
+  double before = 0;
+  unsigned long long entered = 0;
+  for(int level = 0; level < cp.numLevels; level++) {
+    const SweepPlanLevel& L = levels[level];
+    const SweepPosition& pos = cp.levels[level];
+    int n = L.x.size();
+    int perRepeat = L.bidirectional ? 2 : 1;
+    if(
+      pos.repeat < 0 || pos.repeat >= L.repeats || pos.reversed < 0
+      || pos.reversed >= perRepeat || pos.index < 0 || pos.index >= n
+    ) {
+      return -1;
+    }
+    double perPoint = 2 + countSteps(level + 1);
+    before += pos.repeat * (countSteps(level) / L.repeats) + 1
+        + (pos.reversed * n + pos.index) * perPoint + 2;
+    unsigned long long pass = (entered * L.repeats + pos.repeat) * perRepeat
+        + pos.reversed;
+    points[level] = passes[level][nthPass(level, pass)].points[pos.index];
+    entered = pass * n + pos.index;
+  }
+  return (long) before + 1;
+}
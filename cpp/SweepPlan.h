@@ -0,0 +1,397 @@
+// SweepPlan.h
+// encoding: utf-8
+//
+// Compilation of a parametric sweep into the numbered list of its steps.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 21:08:00
+// Modified: 2026-10-17 09:12:48
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#ifndef SWEEPPLAN_H
+#define SWEEPPLAN_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+#include "resource.h"
+#include "SweepJournal.h"
+
+// Steps per decade of a logarithmic ramp down
+#define STEPS_PER_RAMP_DECADE 25
+
+// Ramp down types: straight to the first point, back through every point, in
+// logarithmic steps, or as fast as the slew rate of the parameter allows
+#define RAMP_NONE 0
+#define RAMP_ALL 1
+#define RAMP_LOG 2
+#define RAMP_SLEW 3
+
+// Interval between the steps of a slew-rate-limited ramp (ms)
+#define RAMP_SLEW_TICK_MS 100
+
+// Most points in one level of a plan, about 64 MB of values
+#define SWEEP_PLAN_MAX_POINTS (1 << 23)
+
+// Most steps in a plan, so that a resume position fits a long
+#define SWEEP_PLAN_MAX_STEPS LONG_MAX
+
+// Steps kept back by SweepPlan::step(), which can go back that far cheaply
+#define SWEEP_PLAN_HISTORY 64
+
+
+/*
+ * struct SweepParameters
+ *
+ * This data structure defines the data that is needed to perform a sweep
+ * across N variables. This structure describes the dimensionality, nesting
+ * order, repetition, wait times, and ranges for a multi-parameter sweep.
+ *
+ * Fields:
+ *   parameters - int array of size N. This parameter describes the nesting of
+ *       the sweeps. parameters[0] contains an identifier for the parameter to
+ *       be controlled in the top-level sweep. parameters[1] contains an
+ *       identifier for the parameter to be controlled in the second-level
+ *       sweep; that is, a full sweep of parameters[1] will be made for each
+ *       value of parameters[0] in the top level of the sweep
+ *   maxRecursionLevel - integer describing the size of parameters, identifying
+ *       the number of parameters to be swept, and therefore the number of
+ *       levels of recursion of the sweep
+ *   starts - array with size equal to size(parameters). starts[i] gives the
+ *       starting value for the i^th level of the sweep
+ *   ends - array with size equal to size(parameters). ends[i] gives the final
+ *       value for the i^th level of the sweep
+ *   steps - array with size equal to size(parameters). steps[i] gives the
+ *       number of steps between starts[i] and ends[i]. Note that a sweep with
+ *       N steps will include N+1 points, in order to include the endpoints
+ *   repeats - array with size equal to size(parameters). repeats[i] gives the
+ *       number of times to repeat the i^th level of the sweep
+ *   waits - array with size equal to size(parameters). waits[i] gives the
+ *       number of milliseconds to wait after setting the value for the i^th
+ *       parameter in the sweep. If i denotes the innermost level of the sweep,
+ *       the program will wait for a period of waits[i] before measuring the
+ *       response of the vibrometer. If i denotes a level which is not the
+ *       innermost level of the sweep, the program will wait for a period of
+ *       waits[i] before entering the (i+1)^th level of the sweep
+ *   autoTimeConst - if true, allow the program to automatically adjust the time
+ *       constant to be appropriate for the frequency being studied. This value
+ *       will have no effect unless parameters[i] = SWEEP_F for some i.
+ *   autoSens - allow the program to automatically adjust the lockin sensitivity
+ *       to adjust to signal magnitudes which have a functional dependence on
+ *       the sweep parameters.
+ *   detHarm - detection harmonic, for example, if detHarm=2, the lockin will
+ *       excite a frequency f and measure the signal component at 2f
+ *   logSpacing - true to specify logarithmicly-spaced sweep values, false to
+ *       specify linearly-spaced sweep values. ADDED IN V1.0.9. As of V1.0.9,
+ *       only amplitude and frequency can be log-spaced.
+ *   adaptive - true to add points where the response changes fastest (see
+ *       SweepRefiner) to each pass over the parameter. Only frequency and
+ *       amplitude can be refined, and only as the innermost level.
+ *   slewRates - fastest rate at which a RAMP_SLEW ramp moves each parameter:
+ *       V/s for the voltages and the amplitude, decades/s for the frequency;
+ *       0 for no limit. A custom XY level follows those of X and Y.
+ */
+struct SweepParameters {
+  bool ac_couple;
+  bool adaptive[NUM_AVAIL_PARAMS];
+  bool autoSens;
+  bool autoTimeConst;
+  bool bidirectional[NUM_AVAIL_PARAMS];
+  int detHarm;
+  double ends[NUM_AVAIL_PARAMS];
+  bool logSpacing[NUM_AVAIL_PARAMS];
+  int maxRecursionLevel;
+  int parameters[NUM_AVAIL_PARAMS];
+  int repeats[NUM_AVAIL_PARAMS];
+  double signalToDC;
+  double slewRates[NUM_AVAIL_PARAMS];
+  double starts[NUM_AVAIL_PARAMS];
+  int steps[NUM_AVAIL_PARAMS];
+  long waits[NUM_AVAIL_PARAMS];
+};
+
+
+/*
+ * struct TimeConstOrder
+ *
+ * How the time constant of a frequency level follows its frequency, for
+ * SweepPlan::compile to pick the time constant of every point and order its
+ * passes so that the filter is retuned as rarely as possible.
+ *
+ * Fields:
+ *   required - index of the shortest time constant allowed at a frequency
+ *   settle - settling time in ms after each point at a time constant
+ *   switchWait - extra time in ms to wait after the time constant changes
+ */
+struct TimeConstOrder {
+  std::function<int(double)> required;
+  std::function<long(int)> settle;
+  long switchWait;
+};
+
+
+/*
+ * Kinds of step in a SweepPlan.
+ *
+ *   STEP_REPEAT - start repeat `repeat` of a level
+ *   STEP_SET - set the parameter of a level to `point`
+ *   STEP_WAIT - let the signal settle after the preceding STEP_SET
+ *   STEP_MEASURE - measure and record the current point
+ *   STEP_RAMP - move the parameter of a level back towards its start: to
+ *       `point`, or to `value` if point is -1. Consecutive ramp steps are
+ *       sent together, without waiting.
+ */
+enum SweepStepType {
+  STEP_REPEAT,
+  STEP_SET,
+  STEP_WAIT,
+  STEP_MEASURE,
+  STEP_RAMP
+};
+
+
+/*
+ * struct SweepStep
+ *
+ * One step of a SweepPlan. `repeat`, `reversed` and `index` give the position
+ * of the level as recorded by the sweep journal: the repeat number, 1 in the
+ * reverse pass of a bidirectional sweep, and the loop index of the point
+ * (which counts down the points in the reverse pass). `timeConst` is the
+ * time constant to set with a frequency point of a plan compiled with a
+ * TimeConstOrder, and -1 otherwise.
+ *
+ * Ramp steps have no position. Their `duration` is the time in ms the step
+ * takes at the slew rate of the parameter, before the next step of the level
+ * may follow (0 for all other steps, and in ramps other than RAMP_SLEW).
+ */
+struct SweepStep {
+  uint8_t type;
+  uint8_t level;
+  uint8_t reversed;
+  int8_t timeConst;
+  int32_t repeat;
+  int32_t index;
+  int32_t point;
+  int32_t duration;
+  double value;
+};
+
+
+/*
+ * struct SweepPlanLevel
+ *
+ * One level of a compiled sweep, outermost first.
+ *
+ * Fields:
+ *   param - SWEEP_X, SWEEP_Y, SWEEP_F, SWEEP_A or SWEEP_CUSTOM
+ *   coord - index of its (first) coordinate in a row of output
+ *   wait - settling time in ms after each point
+ *   repeats - number of times the level is swept
+ *   bidirectional - true to sweep back from the last point after each pass
+ *   adaptive - true to refine each pass with extra points (innermost level
+ *       only); its output is written when the pass is complete
+ *   logSpacing - true if the points are evenly spaced in log10 of the value
+ *   ordered - true if the time constant of each point is chosen by the plan
+ *       (see TimeConstOrder). A pass of an ordered innermost level may then
+ *       visit its points backwards, to start at the time constant the
+ *       previous pass ended with.
+ *   x - value of every point; for SWEEP_CUSTOM, the X voltage
+ *   y - for SWEEP_CUSTOM, the Y voltage of every point
+ *   ramp - steps of the ramp down after a pass that ends at the last point
+ *   timeConsts - for an ordered level, the time constant required at each
+ *       point
+ */
+struct SweepPlanLevel {
+  int param;
+  int coord;
+  long wait;
+  int repeats;
+  bool bidirectional;
+  bool adaptive;
+  bool logSpacing;
+  bool ordered;
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<SweepStep> ramp;
+  std::vector<int> timeConsts;
+};
+
+
+/*
+ * struct SweepPass
+ *
+ * One pass over the points of a level, as visited from a given state: the
+ * direction of the pass, and the point and time constant the level was left
+ * at by its previous pass (-1 where they make no difference).
+ *
+ * Fields:
+ *   points - point visited at each loop index
+ *   timeConsts - for an ordered level, the time constant set with each
+ */
+struct SweepPass {
+  int reversed;
+  int fromPoint;
+  int fromTimeConst;
+  std::vector<int> points;
+  std::vector<int> timeConsts;
+};
+
+
+/*
+ * class SweepPlan
+ *
+ * A parametric sweep as the numbered list of steps it performs: every
+ * repeat, pass and point of every level, with the ramps down between them.
+ * The sweep is then run by going through the steps in order, and the same
+ * list gives the number of points and the settling time ahead.
+ *
+ * The steps are not stored: each pass of a level is worked out once, and
+ * step() walks the nest of levels with a cursor per level, so that a plan
+ * takes memory in proportion to the points of its levels rather than to
+ * the points of the sweep. Going forward is cheap, as is going back up to
+ * SWEEP_PLAN_HISTORY steps; going further back starts the walk over.
+ */
+class SweepPlan {
+  // Where the walk is at one level: the loop position of the point, what
+  // comes next there, and the point and time constant its last pass left
+  struct Cursor {
+    int repeat;
+    int reversed;
+    int index;
+    int phase;
+    size_t ramp;
+    int pass;
+    int lastPoint;
+    int lastTimeConst;
+  };
+
+  int rampType;
+  double slewRates[NUM_AVAIL_PARAMS];
+  std::vector<SweepPlanLevel> levels;
+  std::vector<std::vector<SweepPass> > passes;
+  size_t total;
+  int coords;
+  size_t measurements;
+  TimeConstOrder order;
+
+  std::vector<Cursor> cursors;
+  int depth;
+  size_t walked;
+  std::vector<SweepStep> recent;
+
+  double countSteps(int level);
+  int pickTimeConst(int level, const std::vector<int>& pass, size_t i, int current);
+  int findPass(int level, int reversed, int fromPoint, int fromTimeConst);
+  int nthPass(int level, unsigned long long nth);
+  bool startPass(int level);
+  SweepStep makeStep(int type, int level);
+  void rewind();
+  bool next(SweepStep& out);
+  void appendSlewRamp(std::vector<SweepStep>& out, int level, int fromPoint);
+
+public:
+  SweepPlan();
+
+
+  /*
+   * Compile the sweep described by `setup`. A SWEEP_CUSTOM level takes its
+   * numCustom points from customX and customY. rampType selects the ramp
+   * down after each pass that ends away from the start: RAMP_NONE straight
+   * to the first point, RAMP_ALL back through every point, RAMP_LOG in
+   * logarithmic steps, RAMP_SLEW in as few steps as setup.slewRates allow
+   * at one step per RAMP_SLEW_TICK_MS (a custom XY level goes back through
+   * every point, each taking as long as its slew rates ask).
+   * Returns false, leaving the plan empty, if a level has more than
+   * SWEEP_PLAN_MAX_POINTS points or the sweep more than SWEEP_PLAN_MAX_STEPS
+   * steps.
+   *
+   * With a TimeConstOrder `order`, every non-adaptive frequency level is
+   * ordered: the time constant is raised whenever a point requires it, but
+   * only lowered when the settling time this saves before the required
+   * time constant changes again outweighs order->switchWait. A pass of an
+   * ordered innermost level that would start away from the time constant
+   * it is at, and end there, is visited backwards instead; such a level is
+   * not ramped down between passes.
+   */
+  bool compile(
+    const SweepParameters& setup, const double* customX,
+    const double* customY, int numCustom, int rampType,
+    const TimeConstOrder* order = NULL
+  );
+
+
+  /*
+   * Append to `out` the ramp steps that take level `level` from point
+   * `fromPoint` back to its first point; none if it is already there.
+   */
+  void appendRamp(std::vector<SweepStep>& out, int level, int fromPoint);
+
+
+  /*
+   * True if step `st`, of level `st.level`, belongs to a pass visited
+   * backwards from the order of its points.
+   */
+  bool isFlipped(const SweepStep& st) {
+    int n = levels[st.level].x.size();
+    return st.point != (st.reversed ? n - 1 - st.index : st.index);
+  }
+
+
+  /*
+   * Find the measurement recorded by checkpoint `cp`. Returns the index of
+   * the step after it and sets points[level] to the point each level is at
+   * there, or returns -1 if the plan has no such measurement.
+   */
+  long findResume(const SweepCheckpoint& cp, int* points);
+
+
+  /*
+   * Step `k`, below size().
+   */
+  SweepStep step(size_t k);
+
+
+  size_t size() {
+    return total;
+  }
+  int numLevels() {
+    return levels.size();
+  }
+  const SweepPlanLevel& level(int level) {
+    return levels[level];
+  }
+  int numCoords() {
+    return coords;
+  }
+  size_t numMeasurements() {
+    return measurements;
+  }
+
+};
+
+#endif
@@ -0,0 +1,396 @@
+// SweepQueue.cpp
+// encoding: utf-8
+//
+// Persistent queue of sweeps run back to back.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-17 00:41:26
+// Modified: 2026-10-17 10:14:37
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#include "SweepQueue.h"
+
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+
+const char* const JOB_STATUS_NAMES[NUM_JOB_STATUS] = {
+  "queued", "running", "completed", "canceled", "failed"
+};
+
+
+// ===== Method Implementation for class SweepQueue ============================
+
+SweepQueue::SweepQueue()
+{
+  nextId = 1;
+  paused = false;
+  stopping = false;
+  log = NULL;
+}
+
+
+void SweepQueue::setLogger(AsyncLogger* log)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  this->log = log;
+}
+
+
+bool SweepQueue::load(const char* fileName)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  this->fileName = fileName;
+  std::ifstream in(fileName);
+  if(!in) {
+    return true;
+  }
+  std::string line;
+  if(!std::getline(in, line) || line != QUEUE_MAGIC) {
+    this->fileName.clear();
+    return false;
+  }
+  std::vector<SweepJob> loaded;
+  long next = 1;
+  SweepJob job;
+  std::map<std::string, std::string> def;
+  bool inJob = false;
+  while(std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string key;
+    fields >> key;
+    if(!inJob && key == "NEXT") {
+      fields >> next;
+    } else if(!inJob && key == "JOB") {
+      std::string status;
+      fields >> job.id >> job.priority >> status;
+      job.status = JOB_FAILED;
+      for(int k = 0; k < NUM_JOB_STATUS; k++) {
+        if(status == JOB_STATUS_NAMES[k]) {
+          job.status = (JobStatus) k;
+        }
+      }
+      def.clear();
+      inJob = (bool) fields;
+    } else if(inJob && key == "END") {
+      // Jobs whose sweep no longer reads are dropped
+      SweepConfig config;
+      if(SweepEngine::parseDefinition(def, config).empty()) {
+        job.resume = (job.status == JOB_RUNNING);
+        if(job.resume) {
+          job.status = JOB_QUEUED;
+        }
+        job.config = std::make_shared<const SweepConfig>(config);
+        loaded.push_back(job);
+        if(job.id >= next) {
+          next = job.id + 1;
+        }
+      }
+      inJob = false;
+    } else if(inJob) {
+      size_t space = line.find(' ');
+      def[key] = (space == std::string::npos) ? "" : line.substr(space + 1);
+    }
+  }
+  jobs = loaded;
+  nextId = next;
+  return true;
+}
+
+
+/*
+ * Write the queue to its file, replacing the previous version only once the
+ * new one is on disk. Failures are logged. Must be called with mutex held.
+ */
+bool SweepQueue::saveLocked() const
+{
+  if(fileName.empty()) {
+    return true;
+  }
+  std::ostringstream out;
+  out << QUEUE_MAGIC << '\n';
+  out << "NEXT " << nextId << '\n';
+  for(size_t k = 0; k < jobs.size(); k++) {
+    const SweepJob& job = jobs[k];
+    out << "JOB " << job.id << ' ' << job.priority << ' '
+        << JOB_STATUS_NAMES[job.status] << '\n';
+    std::map<std::string, std::string> def =
+        SweepEngine::configDefinition(*job.config);
+    for(auto it = def.begin(); it != def.end(); ++it) {
+      out << it->first << ' ' << it->second << '\n';
+    }
+    out << "END\n";
+  }
+
+  std::string text = out.str();
+  std::string tmpName = fileName + ".tmp";
+  FILE* file = fopen(tmpName.c_str(), "w");
+  bool ok = file != NULL;
+  if(ok) {
+    ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = fileSync(file) && ok;
+    ok = (fclose(file) == 0) && ok;
+  }
+  ok = ok && fileReplace(tmpName.c_str(), fileName.c_str());
+  if(!ok) {
+    std::ostream& err = (log != NULL) ? log->line() : std::cerr;
+    err << "Could not save the sweep queue to " << fileName << std::endl;
+  }
+  return ok;
+}
+
+
+size_t SweepQueue::positionFor(int priority) const
+{
+  // Behind the jobs that have run, the running one, and the queued ones of
+  // the same or higher priority
+  size_t pos = 0;
+  for(size_t k = 0; k < jobs.size(); k++) {
+    if(jobs[k].status != JOB_QUEUED || jobs[k].priority >= priority) {
+      pos = k + 1;
+    }
+  }
+  return pos;
+}
+
+
+long SweepQueue::insertLocked(const SweepConfig& config, int priority, size_t pos)
+{
+  SweepJob job;
+  job.id = nextId++;
+  job.priority = priority;
+  job.status = JOB_QUEUED;
+  job.resume = false;
+
+  // Name the output after the time it was queued and the job, so that no
+  // two jobs share it
+  time_t now = time(NULL);
+  char date[32];
+  struct tm local = localTime(now);
+  strftime(date, sizeof(date), "%Y%m%d_%H%M%S", &local);
+  std::ostringstream path;
+  if(!outputDir.empty()) {
+    path << outputDir;
+    char last = outputDir[outputDir.size() - 1];
+    if(last != '/' && last != '\\') {
+      path << '/';
+    }
+  }
+  path << "sweep_" << date << "_job" << job.id << ".txt";
+  SweepConfig snapshot = config;
+  snapshot.fileName = path.str();
+  job.config = std::make_shared<const SweepConfig>(snapshot);
+
+  jobs.insert(jobs.begin() + pos, job);
+  saveLocked();
+  return job.id;
+}
+
+
+long SweepQueue::add(const SweepConfig& config, int priority)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return insertLocked(config, priority, positionFor(priority));
+}
+
+
+long SweepQueue::insert(const SweepConfig& config, long beforeId)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for(size_t k = 0; k < jobs.size(); k++) {
+    if(jobs[k].id == beforeId && jobs[k].status == JOB_QUEUED) {
+      return insertLocked(config, jobs[k].priority, k);
+    }
+  }
+  return -1;
+}
+
+
+bool SweepQueue::remove(long id)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for(size_t k = 0; k < jobs.size(); k++) {
+    if(jobs[k].id == id && jobs[k].status == JOB_QUEUED) {
+      jobs.erase(jobs.begin() + k);
+      saveLocked();
+      return true;
+    }
+  }
+  return false;
+}
+
+
+bool SweepQueue::setPriority(long id, int priority)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for(size_t k = 0; k < jobs.size(); k++) {
+    if(jobs[k].id == id && jobs[k].status == JOB_QUEUED) {
+      SweepJob job = jobs[k];
+      job.priority = priority;
+      jobs.erase(jobs.begin() + k);
+      jobs.insert(jobs.begin() + positionFor(priority), job);
+      saveLocked();
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void SweepQueue::clearFinished()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<SweepJob> left;
+  for(size_t k = 0; k < jobs.size(); k++) {
+    if(jobs[k].status == JOB_QUEUED || jobs[k].status == JOB_RUNNING) {
+      left.push_back(jobs[k]);
+    }
+  }
+  jobs = left;
+  saveLocked();
+}
+
+
+void SweepQueue::pause()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  paused = true;
+}
+
+
+void SweepQueue::resume()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  paused = false;
+}
+
+
+bool SweepQueue::isPaused() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return paused;
+}
+
+
+void SweepQueue::stop()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  stopping = true;
+}
+
+
+std::vector<SweepJob> SweepQueue::list() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return jobs;
+}
+
+
+size_t SweepQueue::pending() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t count = 0;
+  for(size_t k = 0; k < jobs.size(); k++) {
+    count += (jobs[k].status == JOB_QUEUED);
+  }
+  return count;
+}
+
+
+int SweepQueue::run(SweepEngine& engine, AsyncLogger& log)
+{
+  int ran = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = false;
+  }
+  engine.keepState = true;
+  while(true) {
+    // Take the first queued job; the jobs are kept in the order they run
+    SweepJob job;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      size_t k = 0;
+      while(k < jobs.size() && jobs[k].status != JOB_QUEUED) {
+        k++;
+      }
+      if(paused || stopping || k == jobs.size()) {
+        break;
+      }
+      jobs[k].status = JOB_RUNNING;
+      saveLocked();
+      job = jobs[k];
+    }
+
+    engine.clearCancel();
+    engine.config = *job.config;
+    bool finished = false;
+    if(job.resume) {
+      // The sweep may have ended before the queue file was written
+      std::string journalName = SweepEngine::outputBase(job.config->fileName);
+      journalName.append(".journal");
+      std::map<std::string, std::string> def;
+      SweepCheckpoint last;
+      std::string status;
+      SweepJournal journal;
+      finished = journal.load(journalName.c_str(), def, last, status)
+          && status == "completed";
+      std::string error = finished ? "" : engine.loadJournal(journalName.c_str());
+      if(!error.empty()) {
+        log << "Job " << job.id << " starts over: " << error << std::endl;
+        engine.config = *job.config;
+      }
+    }
+    int ok = 1;
+    if(!finished) {
+      log << "Job " << job.id << ": " << job.config->fileName << std::endl;
+      ok = engine.run();
+      ran++;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for(size_t k = 0; k < jobs.size(); k++) {
+      if(jobs[k].id == job.id) {
+        jobs[k].status = ok ? JOB_COMPLETED
+            : (engine.isCanceled() ? JOB_CANCELED : JOB_FAILED);
+        jobs[k].resume = false;
+        log << "Job " << job.id << " " << JOB_STATUS_NAMES[jobs[k].status]
+            << std::endl;
+      }
+    }
+    saveLocked();
+  }
+  engine.keepState = false;
+
+  // A paused queue keeps the lockin as it is for the jobs still to come
+  if(!isPaused()) {
+    engine.restoreState();
+  }
+  return ran;
+}
@@ -0,0 +1,217 @@
+// SweepQueue.h
+// encoding: utf-8
+//
+// Persistent queue of sweeps run back to back.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-17 00:41:26
+// Modified: 2026-10-17 05:02:37
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#ifndef SWEEPQUEUE_H
+#define SWEEPQUEUE_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "SweepEngine.h"
+
+/*
+ * Queue file layout (text, one record per line):
+ *
+ *   LCQUEUE 1
+ *   NEXT <id>
+ *   JOB <id> <priority> <status>
+ *   <key> <value>          sweep definition (see SweepEngine::definition())
+ *   ...
+ *   END
+ *   ...
+ *
+ * The file is rewritten on every change, so that the queue survives a crash;
+ * a job found running when the file is loaded was interrupted, and is
+ * resumed from its journal. Each version is written to "<file>.tmp", synced
+ * to disk, then renamed over the file, so a crash while saving leaves the
+ * previous version whole.
+ */
+
+#define QUEUE_MAGIC "LCQUEUE 1"
+
+// Priority of jobs that should jump ahead of the others
+#define JOB_PRIORITY_NORMAL 0
+#define JOB_PRIORITY_URGENT 10
+
+
+enum JobStatus {
+  JOB_QUEUED,
+  JOB_RUNNING,
+  JOB_COMPLETED,
+  JOB_CANCELED,
+  JOB_FAILED,
+  NUM_JOB_STATUS
+};
+
+extern const char* const JOB_STATUS_NAMES[NUM_JOB_STATUS];
+
+
+/*
+ * struct SweepJob
+ *
+ * One sweep of the queue.
+ *
+ * Fields:
+ *   id - number of the job, unique within its queue
+ *   priority - jobs of higher priority run first; equal ones in the order
+ *       they were queued
+ *   status - where the job is (see JobStatus)
+ *   resume - the job was interrupted while running; continue it from its
+ *       journal
+ *   config - the sweep, as it was when queued, with its output path
+ */
+struct SweepJob {
+  long id;
+  int priority;
+  JobStatus status;
+  bool resume;
+  std::shared_ptr<const SweepConfig> config;
+};
+
+
+/*
+ * class SweepQueue
+ *
+ * Jobs waiting to run on one engine, in the order they will run, and the
+ * jobs already run. Jobs are queued with a copy of their sweep, which
+ * nothing changes afterwards, and an output path of their own under
+ * outputDir. run() runs them back to back, with the lockin left as each
+ * sweep leaves it (see SweepEngine::keepState), until none is left.
+ *
+ * All methods may be called from any thread, also while run() is running.
+ */
+class SweepQueue {
+  mutable std::mutex mutex;
+  std::vector<SweepJob> jobs;
+  long nextId;
+  bool paused;
+  bool stopping;
+  std::string fileName;
+  // Where failures to save the queue are reported; std::cerr unless set
+  AsyncLogger* log;
+
+  bool saveLocked() const;
+  long insertLocked(const SweepConfig& config, int priority, size_t pos);
+  size_t positionFor(int priority) const;
+
+public:
+  // Directory the outputs of new jobs go to; empty for the current one
+  std::string outputDir;
+
+  SweepQueue();
+
+  void setLogger(AsyncLogger* log);
+
+
+  /*
+   * Read the queue from `fileName`, and keep it there from now on. A missing
+   * file gives an empty queue. Returns false if the file is not a queue.
+   */
+  bool load(const char* fileName);
+
+
+  /*
+   * Queue a copy of sweep `config` behind the jobs of the same or higher
+   * priority, with a new output path. Returns the id of the job.
+   */
+  long add(const SweepConfig& config, int priority = JOB_PRIORITY_NORMAL);
+
+
+  /*
+   * Queue a copy of sweep `config` right ahead of queued job `beforeId`, at
+   * its priority. Returns the id of the new job, or -1 if `beforeId` is not
+   * queued.
+   */
+  long insert(const SweepConfig& config, long beforeId);
+
+
+  /*
+   * Take a queued job off the queue, or move it among the queued jobs as if
+   * it had been queued with `priority`. Return false if the job is not
+   * queued.
+   */
+  bool remove(long id);
+
+  bool setPriority(long id, int priority);
+
+
+  /*
+   * Forget the jobs that have run.
+   */
+  void clearFinished();
+
+
+  /*
+   * Stop starting jobs once the running one ends, and start again. The
+   * lockin is kept as the last sweep left it while paused.
+   */
+  void pause();
+
+  void resume();
+
+  bool isPaused() const;
+
+
+  /*
+   * Have run() return once the running job ends.
+   */
+  void stop();
+
+
+  /*
+   * All jobs: those that have run, the running one, then the queued ones in
+   * the order they will run.
+   */
+  std::vector<SweepJob> list() const;
+
+
+  /*
+   * Number of queued jobs.
+   */
+  size_t pending() const;
+
+
+  /*
+   * Run the queued jobs on `engine`, highest priority first, until none is
+   * left, or until paused or stopped. Jobs added meanwhile run too. A job
+   * canceled with engine.cancel() ends as canceled, and the next one starts.
+   * The lockin settings are restored once the queue has drained or was
+   * stopped. Returns the number of jobs run.
+   */
+  int run(SweepEngine& engine, AsyncLogger& log);
+
+};
+
+#endif
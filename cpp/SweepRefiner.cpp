@@ -0,0 +1,149 @@
+// SweepRefiner.cpp
+// encoding: utf-8
+//
+// Adaptive refinement of a frequency or amplitude sweep.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 21:20:16
+// Modified: 2026-10-16 21:20:16
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#include "SweepRefiner.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// ===== Method Implementation for class SweepRefiner ==========================
+
+SweepRefiner::SweepRefiner()
+{
+  start(false, 0.01, 10, 0);
+}
+
+
+void SweepRefiner::start(
+  bool logSpacing, double tolerance, double phaseStep, size_t maxPoints
+)
+{
+  this->logSpacing = logSpacing;
+  this->tolerance = tolerance;
+  this->phaseStep = phaseStep;
+  this->maxPoints = maxPoints;
+  minSpacing = -1;
+  points.clear();
+}
+
+
+double SweepRefiner::position(double value) const
+{
+  return logSpacing ? log10(value) : value;
+}
+
+
+void SweepRefiner::add(const RefinePoint& p)
+{
+  std::vector<RefinePoint>::iterator at = std::upper_bound(
+    points.begin(), points.end(), p,
+    [](const RefinePoint& a, const RefinePoint& b) { return a.value < b.value; }
+  );
+  points.insert(at, p);
+}
+
+
+const std::vector<double>& SweepRefiner::nextRound()
+{
+  pending.clear();
+  size_t n = points.size();
+  if(n < 2 || n >= maxPoints) {
+    return pending;
+  }
+  // The coarse grid sets the finest spacing
+  if(minSpacing < 0) {
+    minSpacing = fabs(position(points[n-1].value) - position(points[0].value))
+        / (n - 1) / (1 << REFINE_MAX_DEPTH);
+  }
+
+  double scale = 0;
+  for(size_t i = 0; i < n; i++) {
+    scale = fmax(scale, fabs(points[i].ampl));
+  }
+  if(scale <= 0) {
+    return pending;
+  }
+  double floor = tolerance * scale;
+
+  // score[i] rates interval i (points i and i+1); above 1 it needs a point
+  score.assign(n - 1, 0);
+  for(size_t i = 0; i + 1 < n; i++) {
+    const RefinePoint& a = points[i];
+    const RefinePoint& b = points[i+1];
+    if(fabs(a.ampl) > floor && fabs(b.ampl) > floor && phaseStep > 0) {
+      double turn = fmod(fabs(b.phs - a.phs), 360);
+      score[i] = fmin(turn, 360 - turn) / phaseStep;
+    }
+  }
+  for(size_t i = 1; i + 1 < n; i++) {
+    const RefinePoint& a = points[i-1];
+    const RefinePoint& m = points[i];
+    const RefinePoint& b = points[i+1];
+    double ua = position(a.value);
+    double um = position(m.value);
+    double ub = position(b.value);
+    double w = (um - ua) / (ub - ua);
+    double rad = M_PI / 180;
+    double ax = a.ampl * cos(a.phs * rad), ay = a.ampl * sin(a.phs * rad);
+    double mx = m.ampl * cos(m.phs * rad), my = m.ampl * sin(m.phs * rad);
+    double bx = b.ampl * cos(b.phs * rad), by = b.ampl * sin(b.phs * rad);
+    double dev = hypot(mx - (ax + w * (bx - ax)), my - (ay + w * (by - ay)));
+    double s = dev / floor;
+    score[i-1] = fmax(score[i-1], s);
+    score[i] = fmax(score[i], s);
+  }
+
+  // Worst intervals first, within the point budget
+  order.clear();
+  for(size_t i = 0; i + 1 < n; i++) {
+    double ua = position(points[i].value);
+    double ub = position(points[i+1].value);
+    if(score[i] > 1 && fabs(ub - ua) > 2 * minSpacing) {
+      order.push_back(i);
+    }
+  }
+  std::sort(order.begin(), order.end(), [this](size_t p, size_t q) {
+    return score[p] > score[q];
+  });
+  if(order.size() > maxPoints - n) {
+    order.resize(maxPoints - n);
+  }
+  std::sort(order.begin(), order.end());
+  for(size_t k = 0; k < order.size(); k++) {
+    double mid = 0.5 * (position(points[order[k]].value)
+        + position(points[order[k] + 1].value));
+    pending.push_back(logSpacing ? pow(10, mid) : mid);
+  }
+  return pending;
+}
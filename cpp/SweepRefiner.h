@@ -0,0 +1,128 @@
+// SweepRefiner.h
+// encoding: utf-8
+//
+// Adaptive refinement of a frequency or amplitude sweep.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 21:20:16
+// Modified: 2026-10-16 21:20:16
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#ifndef SWEEPREFINER_H
+#define SWEEPREFINER_H
+
+#include <stddef.h>
+#include <vector>
+
+// Intervals are halved at most this many times below the coarse spacing
+#define REFINE_MAX_DEPTH 10
+
+
+/*
+ * struct RefinePoint
+ *
+ * One measured point of a refined pass, kept until the pass is written out.
+ */
+struct RefinePoint {
+  double value;
+  double ampl;
+  double phs;
+  double stdDev;
+  int sensitivity;
+  int timeConstant;
+};
+
+
+/*
+ * class SweepRefiner
+ *
+ * Adds points to one pass of a frequency or amplitude sweep where the
+ * response changes fastest. The coarse points of the pass are added first;
+ * each call to nextRound() then proposes the midpoints of the intervals
+ * where the response is poorly resolved:
+ *   - the complex response ampl * exp(i phs) at a point is further than
+ *     `tolerance` (relative to the largest amplitude of the pass) from the
+ *     straight line through its neighbours, or
+ *   - the phase turns by more than `phaseStep` degrees across the interval,
+ *     where the signal is above the tolerance.
+ * Rounds stop when no interval needs refining, when the pass holds
+ * `maxPoints` points, or when intervals reach 2^-REFINE_MAX_DEPTH of the
+ * coarse spacing. With a point budget, the worst intervals are refined
+ * first.
+ *
+ * Intervals are measured in the spacing of the sweep: in log10 of the value
+ * for a log-spaced sweep.
+ */
+class SweepRefiner {
+  bool logSpacing;
+  double tolerance;
+  double phaseStep;
+  size_t maxPoints;
+  double minSpacing;
+
+  // Sorted by value
+  std::vector<RefinePoint> points;
+  std::vector<double> pending;
+
+  // Scratch space of nextRound()
+  std::vector<double> score;
+  std::vector<size_t> order;
+
+  double position(double value) const;
+
+public:
+  SweepRefiner();
+
+
+  /*
+   * Start a new pass.
+   */
+  void start(bool logSpacing, double tolerance, double phaseStep, size_t maxPoints);
+
+
+  /*
+   * Add a measured point.
+   */
+  void add(const RefinePoint& p);
+
+
+  /*
+   * Values to measure in the next round, in increasing order; empty when the
+   * pass is done.
+   */
+  const std::vector<double>& nextRound();
+
+
+  /*
+   * Points of the pass, in increasing order of value.
+   */
+  const std::vector<RefinePoint>& result() const {
+    return points;
+  }
+
+};
+
+#endif
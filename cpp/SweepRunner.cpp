@@ -0,0 +1,515 @@
+// SweepRunner.cpp
+// encoding: utf-8
+//
+// Command-line runner for sweeps defined in files.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 23:58:31
+// Modified: 2026-10-17 10:29:52
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+// Usage:
+//
+//   SweepRunner [-b board] [-a address] [--resume journal] [definition ...]
+//   SweepRunner [-b board] [-a address] --queue file [-p priority]
+//       [-o directory] [definition ...]
+//   SweepRunner -b board[,...] -a address[,...] [definition ...]
+//
+// Runs each definition file back to back on the SR830 at `address` (default
+// 8) of GPIB board `board` (default 0), after resuming `journal` if given.
+// The lockin settings are restored after the last one only.
+//
+// Given several boards or addresses, each definition runs on the lockins at
+// all those addresses of all those boards at once (see SweepScheduler.h),
+// with the output of each named after its address, e.g. "sweep_8.txt" and
+// "sweep_9.txt", or after its board and address, e.g. "sweep_0_8.txt" and
+// "sweep_1_8.txt".
+//
+// With --queue, the definitions are added to the queue kept in `file` (see
+// SweepQueue.h) at `priority`, with their outputs in `directory`, and the
+// queue runs until it is empty; jobs left in it by an earlier run, or cut
+// short, run too.
+// A definition file holds one "<key> <value>" line per entry, in the format
+// the application writes to the head of a sweep journal (see
+// SweepEngine::definition()), so the journal of a sweep run from the GUI can
+// be run again as it is. Lines starting with '#' are comments. Without an
+// "output" entry, the output is named after the definition file. Ctrl-C (or
+// SIGTERM) cancels the running sweep and skips the rest; a second one quits.
+//
+// Without NI-488.2, as on the Linux acquisition boxes, link against the
+// simulated backend (ni4882sim.cpp) instead:
+//
+//   g++ -std=c++17 -O2 -I. -o SweepRunner SweepRunner.cpp SweepEngine.cpp
+//       AsyncLogger.cpp ComplexAverager.cpp EmulatedSR830.cpp GPIB.cpp
+//       LockinSettings.cpp SensPredictor.cpp SettleDetector.cpp
+//       SweepDataFile.cpp SweepEstimator.cpp SweepJournal.cpp SweepLevel.cpp
+//       SweepPlan.cpp SweepQueue.cpp SweepRefiner.cpp SweepScheduler.cpp
+//       SweepTextWriter.cpp ni4882sim.cpp -lpthread
+
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+#include "AsyncLogger.h"
+#include "GPIB.h"
+#include "SR830.h"
+#include "SweepEngine.h"
+#include "SweepQueue.h"
+#include "SweepScheduler.h"
+
+
+// Engine or scheduler canceled, and queue stopped, by Ctrl-C, once they exist
+static std::atomic<SweepEngine*> activeEngine(NULL);
+static std::atomic<SweepScheduler*> activeScheduler(NULL);
+static std::atomic<SweepQueue*> activeQueue(NULL);
+
+
+#ifdef _WIN32
+static void onInterrupt(int)
+{
+  // Console control handlers run on a thread of their own
+  std::signal(SIGINT, SIG_DFL);
+  if(activeQueue != NULL) {
+    activeQueue.load()->stop();
+  }
+  if(activeEngine != NULL) {
+    activeEngine.load()->cancel();
+  }
+  if(activeScheduler != NULL) {
+    activeScheduler.load()->cancel();
+  }
+}
+#else
+// Written to by the signal handler, which can do little else safely
+static int interruptPipe[2];
+
+static void onInterrupt(int)
+{
+  char c = 0;
+  if(write(interruptPipe[1], &c, 1) < 0) {
+    _exit(130);
+  }
+}
+#endif
+
+
+/*
+ * Have Ctrl-C cancel activeEngine (or activeScheduler), or quit before there
+ * is one; a second one quits. On POSIX, SIGINT and SIGTERM are passed on to
+ * a thread of their own, where locking the engine is safe.
+ */
+static void catchInterrupt()
+{
+#ifdef _WIN32
+  std::signal(SIGINT, onInterrupt);
+#else
+  if(pipe(interruptPipe) != 0) {
+    return;
+  }
+  std::thread([] {
+    char c;
+    while(read(interruptPipe[0], &c, 1) < 0 && errno == EINTR);
+    if(activeEngine != NULL || activeScheduler != NULL) {
+      std::cerr << "Canceling the sweep; interrupt again to quit" << std::endl;
+      if(activeQueue != NULL) {
+        activeQueue.load()->stop();
+      }
+      if(activeEngine != NULL) {
+        activeEngine.load()->cancel();
+      }
+      if(activeScheduler != NULL) {
+        activeScheduler.load()->cancel();
+      }
+      while(read(interruptPipe[0], &c, 1) < 0 && errno == EINTR);
+    }
+    _exit(130);
+  }).detach();
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = onInterrupt;
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+#endif
+}
+
+
+/*
+ * Read the sweep definition in `fileName` into `def`: one "<key> <value>"
+ * line per entry, up to a journal's BEGIN line. Returns false if the file
+ * cannot be read.
+ */
+static bool readDefinition(
+  const std::string& fileName, std::map<std::string, std::string>& def
+)
+{
+  std::ifstream in(fileName.c_str());
+  if(!in) {
+    return false;
+  }
+  std::string line;
+  while(std::getline(in, line)) {
+    if(!line.empty() && line[line.size() - 1] == '\r') {
+      line.erase(line.size() - 1);
+    }
+    if(line == "BEGIN") {
+      break;
+    }
+    if(line.empty() || line[0] == '#' || line == JOURNAL_MAGIC) {
+      continue;
+    }
+    size_t space = line.find(' ');
+    if(space == std::string::npos) {
+      def[line] = "";
+    } else {
+      def[line.substr(0, space)] = line.substr(space + 1);
+    }
+  }
+  return true;
+}
+
+
+/*
+ * Read the sweep in definition file `fileName` into `config`. Without an
+ * output in the file, it is named after the file. Returns an error message,
+ * or an empty string on success.
+ */
+static std::string loadSweep(const std::string& fileName, SweepConfig& config)
+{
+  std::map<std::string, std::string> def;
+  if(!readDefinition(fileName, def)) {
+    return "cannot be read";
+  }
+  config = SweepConfig();
+  std::string error = SweepEngine::parseDefinition(def, config);
+  if(error.empty() && !def.count("output")) {
+    std::string base = fileName;
+    size_t dot = base.rfind('.');
+    if(dot != std::string::npos && base.find('/', dot) == std::string::npos) {
+      base.erase(dot);
+    }
+    config.fileName = base + ".txt";
+  }
+  return error;
+}
+
+
+static void showProgress(double fraction, double remainingMs)
+{
+  long left = (long) (remainingMs / 1000);
+  std::cout << "\r" << (int) (100 * fraction) << "% done, about "
+      << left / 3600 << "hr " << (left % 3600) / 60 << "min " << left % 60
+      << "s left   " << std::flush;
+}
+
+
+/*
+ * Parse a comma-separated list of numbers.
+ */
+static std::vector<int> parseList(const std::string& value)
+{
+  std::vector<int> list;
+  for(size_t start = 0; start < value.size(); ) {
+    size_t comma = value.find(',', start);
+    if(comma == std::string::npos) {
+      comma = value.size();
+    }
+    list.push_back(atoi(value.substr(start, comma - start).c_str()));
+    start = comma + 1;
+  }
+  return list;
+}
+
+
+/*
+ * Run each definition file on all the lockins at `addresses` of all GPIB
+ * boards `boards` at once, back to back. Returns the exit status.
+ */
+static int runTogether(
+  const std::vector<int>& boards, const std::vector<int>& addresses,
+  const std::vector<std::string>& definitions, AsyncLogger& logger
+)
+{
+  std::vector<GPIBInterface*> interfaces;
+  int failed = 0;
+  for(size_t b = 0; b < boards.size(); b++) {
+    try {
+      interfaces.push_back(new GPIBInterface(boards[b]));
+    } catch(std::exception& e) {
+      std::cerr << "Cannot reach GPIB board " << boards[b] << ": " << e.what()
+          << std::endl;
+      failed++;
+    }
+  }
+
+  bool canceled = false;
+  {
+    SweepScheduler scheduler(logger);
+    for(size_t b = 0; b < interfaces.size(); b++) {
+      for(size_t k = 0; k < addresses.size(); k++) {
+        if(scheduler.add(interfaces[b], addresses[k]) == NULL) {
+          std::cerr << "No lockin at " << interfaces[b]->getBoardId() << ":"
+              << addresses[k] << std::endl;
+          failed++;
+        }
+      }
+    }
+    scheduler.onProgress = showProgress;
+    for(size_t k = 0; k < scheduler.size(); k++) {
+      scheduler.engine(k).keepState = true;
+    }
+    activeScheduler = &scheduler;
+
+    for(size_t d = 0; d < definitions.size() && !canceled && scheduler.size() > 0; d++) {
+      SweepConfig config;
+      std::string error = loadSweep(definitions[d], config);
+      if(!error.empty()) {
+        std::cerr << definitions[d] << ": " << error << std::endl;
+        failed++;
+        continue;
+      }
+      std::string base = SweepEngine::outputBase(config.fileName);
+      long estimate = 0;
+      bool planned = true;
+      for(size_t k = 0; k < scheduler.size(); k++) {
+        SweepEngine& engine = scheduler.engine(k);
+        engine.config = config;
+        SR830* lockin = scheduler.lockin(k);
+        engine.config.fileName = base + "_";
+        if(boards.size() > 1) {
+          engine.config.fileName += std::to_string(lockin->gInterface->getBoardId()) + "_";
+        }
+        engine.config.fileName += std::to_string(GetPAD(lockin->address)) + ".txt";
+        long duration = engine.duration(engine.config);
+        planned = planned && duration >= 0;
+        estimate = std::max(estimate, duration);
+      }
+      if(!planned) {
+        std::cerr << definitions[d] << ": The sweep has too many points."
+            << std::endl;
+        failed++;
+        continue;
+      }
+      std::cout << definitions[d] << " on " << scheduler.size()
+          << " lockins (estimated " << estimate / 1000.0 << " s)" << std::endl;
+      failed += scheduler.size() - scheduler.run();
+      std::cout << std::endl;
+      for(size_t k = 0; k < scheduler.size(); k++) {
+        canceled = canceled || scheduler.engine(k).isCanceled();
+      }
+    }
+
+    activeScheduler = NULL;
+    for(size_t k = 0; k < scheduler.size(); k++) {
+      scheduler.engine(k).keepState = false;
+      scheduler.engine(k).restoreState();
+    }
+  }
+  for(size_t b = 0; b < interfaces.size(); b++) {
+    delete interfaces[b];
+  }
+  return (failed > 0 || canceled) ? 1 : 0;
+}
+
+
+static void usage()
+{
+  std::cerr << "Usage: SweepRunner [-b board] [-a address] [--resume journal]"
+      << " [definition ...]" << std::endl;
+  std::cerr << "       SweepRunner [-b board] [-a address] --queue file"
+      << " [-p priority] [-o directory] [definition ...]" << std::endl;
+  std::cerr << "       SweepRunner -b board[,...] -a address[,...]"
+      << " [definition ...]" << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+  std::vector<int> boards;
+  std::vector<int> addresses;
+  int priority = JOB_PRIORITY_NORMAL;
+  std::string resume;
+  std::string queueFile;
+  std::string outputDir;
+  std::vector<std::string> definitions;
+  for(int k = 1; k < argc; k++) {
+    std::string arg = argv[k];
+    bool valued = arg == "-b" || arg == "-a" || arg == "-p" || arg == "-o"
+        || arg == "--resume" || arg == "--queue";
+    if(valued && k + 1 < argc) {
+      std::string value = argv[++k];
+      if(arg == "-b") {
+        boards = parseList(value);
+      } else if(arg == "-a") {
+        addresses = parseList(value);
+      } else if(arg == "-p") {
+        priority = atoi(value.c_str());
+      } else if(arg == "-o") {
+        outputDir = value;
+      } else if(arg == "--resume") {
+        resume = value;
+      } else {
+        queueFile = value;
+      }
+    } else if(!arg.empty() && arg[0] == '-') {
+      usage();
+      return 2;
+    } else {
+      definitions.push_back(arg);
+    }
+  }
+  if(boards.empty()) {
+    boards.push_back(0);
+  }
+  if(addresses.empty()) {
+    addresses.push_back(8);
+  }
+  bool together = boards.size() > 1 || addresses.size() > 1;
+  if(
+    (definitions.empty() && resume.empty() && queueFile.empty())
+    || (!resume.empty() && !queueFile.empty())
+    || (together && (!resume.empty() || !queueFile.empty()))
+  ) {
+    usage();
+    return 2;
+  }
+
+  catchInterrupt();
+  AsyncLogger logger("sweep_runner_log.txt");
+  if(together) {
+    int status = runTogether(boards, addresses, definitions, logger);
+    logger.close();
+    return status;
+  }
+  int board = boards[0];
+  int address = addresses[0];
+  SweepEngine engine(logger);
+  engine.estimator.load(engine.timingFile.c_str());
+  engine.onProgress = showProgress;
+  activeEngine = &engine;
+
+  // Settings changes of this instrument, from the settings read when it is
+  // connected, go to a logger of its own, which each sweep points at its
+  // settings file
+  std::string settingsName = "settings_log_" + std::to_string(board) + "_"
+      + std::to_string(address) + ".txt";
+  AsyncLogger settingsLog(settingsName.c_str());
+  GPIBInterface* gpib;
+  SR830* lockin;
+  try {
+    gpib = new GPIBInterface(board);
+    lockin = new SR830(gpib, address, &settingsLog);
+  } catch(std::exception& e) {
+    std::cerr << "Cannot reach the lockin at " << board << ":" << address
+        << ": " << e.what() << std::endl;
+    return 1;
+  }
+  engine.setLockin(lockin);
+
+  int failed = 0;
+  if(!queueFile.empty()) {
+    SweepQueue queue;
+    queue.setLogger(&logger);
+    if(!queue.load(queueFile.c_str())) {
+      std::cerr << queueFile << " is not a sweep queue" << std::endl;
+      return 1;
+    }
+    queue.outputDir = outputDir;
+    for(size_t k = 0; k < definitions.size(); k++) {
+      SweepConfig config;
+      std::string error = loadSweep(definitions[k], config);
+      if(!error.empty()) {
+        std::cerr << definitions[k] << ": " << error << std::endl;
+        failed++;
+        continue;
+      }
+      long id = queue.add(config, priority);
+      std::cout << definitions[k] << " queued as job " << id << std::endl;
+    }
+    activeQueue = &queue;
+    queue.run(engine, logger);
+    activeQueue = NULL;
+    std::vector<SweepJob> jobs = queue.list();
+    for(size_t k = 0; k < jobs.size(); k++) {
+      std::cout << "Job " << jobs[k].id << " " << JOB_STATUS_NAMES[jobs[k].status]
+          << ": " << jobs[k].config->fileName << std::endl;
+      failed += (jobs[k].status == JOB_FAILED);
+    }
+  } else {
+    // Back to back: the settings are restored once, after the last sweep
+    engine.keepState = true;
+    if(!resume.empty()) {
+      std::string error = engine.loadJournal(resume.c_str());
+      if(!error.empty()) {
+        std::cerr << resume << ": " << error << std::endl;
+        failed++;
+      } else {
+        std::cout << "Resuming " << engine.config.fileName << std::endl;
+        failed += (engine.run() == 0);
+        std::cout << std::endl;
+      }
+    }
+    for(size_t k = 0; k < definitions.size() && !engine.isCanceled(); k++) {
+      std::string error = loadSweep(definitions[k], engine.config);
+      if(!error.empty()) {
+        std::cerr << definitions[k] << ": " << error << std::endl;
+        failed++;
+        continue;
+      }
+      long estimate = engine.duration(engine.config);
+      if(estimate < 0) {
+        std::cerr << definitions[k] << ": The sweep has too many points."
+            << std::endl;
+        failed++;
+        continue;
+      }
+      std::cout << definitions[k] << " -> " << engine.config.fileName
+          << " (estimated " << estimate / 1000.0 << " s)" << std::endl;
+      failed += (engine.run() == 0);
+      std::cout << std::endl;
+    }
+    engine.keepState = false;
+    engine.restoreState();
+  }
+
+  delete lockin;
+  delete gpib;
+  settingsLog.close();
+  logger.close();
+  return (failed > 0 || engine.isCanceled()) ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+// SweepScheduler.cpp
+// encoding: utf-8
+//
+// Sweeps run at once on several lockins, on one or more GPIB buses.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-17 02:05:19
+// Modified: 2026-10-17 09:48:03
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#include "SweepScheduler.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+
+
+// ===== Method Implementation for class SweepScheduler ========================
+
+SweepScheduler::SweepScheduler(AsyncLogger& log): log(log)
+{
+}
+
+
+SweepScheduler::~SweepScheduler()
+{
+}
+
+
+SweepEngine* SweepScheduler::add(GPIBInterface* gpib, int pad)
+{
+  for(size_t k = 0; k < stations.size(); k++) {
+    SR830* lockin = stations[k]->lockin.get();
+    if(lockin->gInterface == gpib && GetPAD(lockin->address) == pad) {
+      return stations[k]->engine.get();
+    }
+  }
+  bool present = false;
+  for(int k = 0; k < gpib->listenerCount(); k++) {
+    present = present || (GetPAD(gpib->listenerAddress(k)) == pad);
+  }
+  if(!present) {
+    return NULL;
+  }
+
+  std::unique_ptr<Station> station(new Station());
+  std::string settingsName = "settings_log_" + std::to_string(gpib->getBoardId())
+      + "_" + std::to_string(pad) + ".txt";
+  station->settingsLog.reset(new AsyncLogger(settingsName.c_str()));
+  // A lockin that fails to answer its first queries is left out, so that
+  // addAll() goes on with the others
+  try {
+    station->lockin.reset(new SR830(gpib, pad, station->settingsLog.get()));
+  } catch(std::exception& e) {
+    log << "Lockin " << gpib->getBoardId() << ":" << pad << ": " << e.what()
+        << std::endl;
+    return NULL;
+  }
+  station->engine.reset(new SweepEngine(log));
+  SweepEngine& engine = *station->engine;
+  engine.estimator.load(engine.timingFile.c_str());
+  engine.setLockin(station->lockin.get());
+  size_t k = stations.size();
+  engine.onProgress = [this, k](double fraction, double remainingMs) {
+    stationProgress(k, fraction, remainingMs);
+  };
+  station->fraction = 0;
+  station->remainingMs = 0;
+  stations.push_back(std::move(station));
+  return &engine;
+}
+
+
+int SweepScheduler::addAll(GPIBInterface* gpib, const char* model)
+{
+  int added = 0;
+  for(int k = 0; k < gpib->listenerCount(); k++) {
+    Addr4882_t address = gpib->listenerAddress(k);
+    char desc[BUF_SIZE];
+    gpib->getDeviceDesc(address, desc, BUF_SIZE);
+    if(strstr(desc, model) != NULL && add(gpib, GetPAD(address)) != NULL) {
+      added++;
+    }
+  }
+  return added;
+}
+
+
+void SweepScheduler::stationProgress(size_t k, double fraction, double remainingMs)
+{
+  double total = 0;
+  double longest = 0;
+  {
+    std::lock_guard<std::mutex> lock(progressMutex);
+    stations[k]->fraction = fraction;
+    stations[k]->remainingMs = remainingMs;
+    for(size_t j = 0; j < stations.size(); j++) {
+      total += stations[j]->fraction;
+      longest = std::max(longest, stations[j]->remainingMs);
+    }
+  }
+  if(onProgress) {
+    onProgress(total / stations.size(), longest);
+  }
+}
+
+
+int SweepScheduler::run()
+{
+  std::vector<int> results(stations.size(), 0);
+  std::vector<std::thread> threads;
+  for(size_t k = 0; k < stations.size(); k++) {
+    Station& station = *stations[k];
+    station.engine->clearCancel();
+    station.fraction = 0;
+    station.remainingMs = std::max(0L, station.engine->duration(station.engine->config));
+  }
+  for(size_t k = 0; k < stations.size(); k++) {
+    SR830* lockin = stations[k]->lockin.get();
+    log << "Lockin " << lockin->gInterface->getBoardId() << ":"
+        << GetPAD(lockin->address) << ": "
+        << stations[k]->engine->config.fileName << std::endl;
+    threads.emplace_back([this, k, &results] {
+      results[k] = stations[k]->engine->run();
+    });
+  }
+
+  int completed = 0;
+  for(size_t k = 0; k < threads.size(); k++) {
+    threads[k].join();
+    completed += (results[k] != 0);
+  }
+  return completed;
+}
+
+
+void SweepScheduler::cancel()
+{
+  for(size_t k = 0; k < stations.size(); k++) {
+    stations[k]->engine->cancel();
+  }
+}
@@ -0,0 +1,138 @@
+// SweepScheduler.h
+// encoding: utf-8
+//
+// Sweeps run at once on several lockins, on one or more GPIB buses.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-17 02:05:19
+// Modified: 2026-10-17 09:48:03
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+
+#ifndef SWEEPSCHEDULER_H
+#define SWEEPSCHEDULER_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "AsyncLogger.h"
+#include "GPIB.h"
+#include "SR830.h"
+#include "SweepEngine.h"
+
+
+/*
+ * class SweepScheduler
+ *
+ * Runs a sweep on each of several lockins at once, an engine and a thread
+ * per lockin. An engine spends most of a sweep waiting for its lockin to
+ * settle, without holding the bus; the arbiter of each interface hands its
+ * bus to one transaction at a time, in turn, so that meanwhile the other
+ * lockins on it are set and read. The sweeps on one bus therefore take about
+ * as long together as the longest alone, until the bus is busy all the time.
+ *
+ * Lockins may be on several interface boards. Each board has its own bus
+ * worker thread and arbiter, so sweeps on different boards never wait for
+ * each other.
+ *
+ * Each lockin has its own engine, sharing the scheduler's log, and its own
+ * settings log. Set up the sweep of each in engine(k).config, then run().
+ */
+class SweepScheduler {
+  // Destroyed bottom up: the engine before its lockin, and the lockin
+  // before the settings log it writes to
+  struct Station {
+    std::unique_ptr<AsyncLogger> settingsLog;
+    std::unique_ptr<SR830> lockin;
+    std::unique_ptr<SweepEngine> engine;
+    double fraction;
+    double remainingMs;
+  };
+
+  AsyncLogger& log;
+  std::vector<std::unique_ptr<Station>> stations;
+  std::mutex progressMutex;
+
+  void stationProgress(size_t k, double fraction, double remainingMs);
+
+public:
+  /*
+   * Called with the fraction of all sweeps done, and the time (ms) until the
+   * last of them ends. May be called from any of the sweep threads.
+   */
+  std::function<void(double, double)> onProgress;
+
+  SweepScheduler(AsyncLogger& log);
+
+  ~SweepScheduler();
+
+
+  /*
+   * Add the lockin at primary address `pad` of interface `gpib`. Returns its
+   * engine, or NULL if there is no device there or it cannot be set up.
+   */
+  SweepEngine* add(GPIBInterface* gpib, int pad);
+
+
+  /*
+   * Add every listener of interface `gpib` whose identification contains
+   * `model`. Returns the number added.
+   */
+  int addAll(GPIBInterface* gpib, const char* model = "SR8");
+
+
+  /*
+   * Number of lockins, and the lockin and engine of each.
+   */
+  size_t size() const {
+    return stations.size();
+  }
+
+  SR830* lockin(size_t k) {
+    return stations[k]->lockin.get();
+  }
+
+  SweepEngine& engine(size_t k) {
+    return *stations[k]->engine;
+  }
+
+
+  /*
+   * Run the sweep in the config of every engine at once, and wait for all of
+   * them to end. Returns the number that completed.
+   */
+  int run();
+
+
+  /*
+   * Cancel the running sweeps.
+   */
+  void cancel();
+
+};
+
+#endif
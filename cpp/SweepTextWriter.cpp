@@ -0,0 +1,215 @@
+// SweepTextWriter.cpp
+// encoding: utf-8
+//
+// Buffered writer for the tab-separated sweep output file.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 20:58:34
+// Modified: 2026-10-16 21:05:57
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#include "SweepTextWriter.h"
+#include "SweepJournal.h"
+
+#include <charconv>
+#include <string.h>
+
+
+int formatDouble(char* buf, double value)
+{
+  std::to_chars_result res = std::to_chars(buf, buf + DOUBLE_TEXT_LEN, value);
+  return res.ptr - buf;
+}
+
+
+// ===== Method Implementation for class SweepTextWriter =======================
+
+SweepTextWriter::SweepTextWriter(): file(NULL), used(0)
+{
+}
+
+
+SweepTextWriter::~SweepTextWriter()
+{
+  close();
+}
+
+
+bool SweepTextWriter::open(const char* fileName)
+{
+  close();
+  // Text mode, so that line endings stay as std::ofstream wrote them
+  file = fopen(fileName, "w");
+  if(file == NULL) {
+    return false;
+  }
+  // The buffer replaces the C library's
+  setvbuf(file, NULL, _IONBF, 0);
+  buffer.resize(TEXT_BUFFER_SIZE);
+  used = 0;
+  lastFlush = Clock::now();
+  return true;
+}
+
+
+bool SweepTextWriter::reopen(const char* fileName, long long length)
+{
+  close();
+  if(!fileTruncate(fileName, length)) {
+    return false;
+  }
+  // Not append mode, in which ftell() may not report the end until a write
+  file = fopen(fileName, "r+");
+  if(file == NULL) {
+    return false;
+  }
+  setvbuf(file, NULL, _IONBF, 0);
+  fileSeek(file, length);
+  buffer.resize(TEXT_BUFFER_SIZE);
+  used = 0;
+  lastFlush = Clock::now();
+  return true;
+}
+
+
+bool SweepTextWriter::isOpen()
+{
+  return file != NULL;
+}
+
+
+void SweepTextWriter::close()
+{
+  if(file != NULL) {
+    flush();
+    fclose(file);
+    file = NULL;
+  }
+}
+
+
+void SweepTextWriter::flush()
+{
+  if(file != NULL && used > 0) {
+    fwrite(buffer.data(), 1, used, file);
+  }
+  used = 0;
+  lastFlush = Clock::now();
+}
+
+
+void SweepTextWriter::sync()
+{
+  if(file != NULL) {
+    flush();
+    fileSync(file);
+  }
+}
+
+
+long long SweepTextWriter::size()
+{
+  return (file != NULL) ? fileTell(file) : 0;
+}
+
+
+/*
+ * Make room for `len` more characters.
+ */
+void SweepTextWriter::reserve(size_t len)
+{
+  if(used + len > buffer.size()) {
+    flush();
+    if(len > buffer.size()) {
+      buffer.resize(len);
+    }
+  }
+}
+
+
+void SweepTextWriter::endLine()
+{
+  if(
+    buffer.size() - used < TEXT_LINE_RESERVE
+    || Clock::now() - lastFlush >= std::chrono::milliseconds(TEXT_FLUSH_MS)
+  ) {
+    flush();
+  }
+}
+
+
+SweepTextWriter& SweepTextWriter::operator<<(double value)
+{
+  reserve(DOUBLE_TEXT_LEN);
+  used += formatDouble(buffer.data() + used, value);
+  return *this;
+}
+
+
+SweepTextWriter& SweepTextWriter::operator<<(int value)
+{
+  return *this << (long) value;
+}
+
+
+SweepTextWriter& SweepTextWriter::operator<<(long value)
+{
+  reserve(24);
+  std::to_chars_result res = std::to_chars(
+    buffer.data() + used, buffer.data() + buffer.size(), value
+  );
+  used = res.ptr - buffer.data();
+  return *this;
+}
+
+
+SweepTextWriter& SweepTextWriter::operator<<(char c)
+{
+  reserve(1);
+  buffer[used++] = c;
+  if(c == '\n') {
+    endLine();
+  }
+  return *this;
+}
+
+
+SweepTextWriter& SweepTextWriter::operator<<(const char* s)
+{
+  size_t len = strlen(s);
+  reserve(len);
+  memcpy(buffer.data() + used, s, len);
+  used += len;
+  if(len > 0 && s[len - 1] == '\n') {
+    endLine();
+  }
+  return *this;
+}
+
+
+SweepTextWriter& SweepTextWriter::operator<<(const std::string& s)
+{
+  return *this << s.c_str();
+}
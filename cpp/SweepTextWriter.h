@@ -0,0 +1,111 @@
+// SweepTextWriter.h
+// encoding: utf-8
+//
+// Buffered writer for the tab-separated sweep output file.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 20:58:34
+// Modified: 2026-10-16 21:05:57
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#ifndef SWEEPTEXTWRITER_H
+#define SWEEPTEXTWRITER_H
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Size of the output buffer. It is written out when less than
+// TEXT_LINE_RESERVE bytes are left, or at the end of a line once
+// TEXT_FLUSH_MS have passed since the last write.
+#define TEXT_BUFFER_SIZE (1 << 20)
+#define TEXT_LINE_RESERVE 4096
+#define TEXT_FLUSH_MS 1000
+
+// Longest text produced for one double
+#define DOUBLE_TEXT_LEN 32
+
+
+/*
+ * Format `value` into `buf` as the shortest text that reads back as the same
+ * double. Returns the number of characters written (no terminator).
+ */
+int formatDouble(char* buf, double value);
+
+
+/*
+ * class SweepTextWriter
+ *
+ * Writes the tab-separated sweep output file. Values are formatted straight
+ * into one large buffer (doubles with std::to_chars), which goes to the file
+ * in big writes: when it is nearly full, or at a newline once TEXT_FLUSH_MS
+ * have passed, so an interrupted sweep loses at most about a second of data.
+ */
+class SweepTextWriter {
+  typedef std::chrono::steady_clock Clock;
+
+  FILE* file;
+  std::vector<char> buffer;
+  size_t used;
+  Clock::time_point lastFlush;
+
+  void reserve(size_t len);
+  void endLine();
+
+public:
+  SweepTextWriter();
+  ~SweepTextWriter();
+
+  bool open(const char* fileName);
+
+  // Open `fileName` to continue after its first `length` bytes, dropping the
+  // rest (for a resumed sweep)
+  bool reopen(const char* fileName, long long length);
+
+  bool isOpen();
+
+  // Write out the buffer and close the file
+  void close();
+
+  // Write out the buffer
+  void flush();
+
+  // Write out the buffer and have it written to disk
+  void sync();
+
+  // Bytes written to the file so far, excluding the buffer
+  long long size();
+
+  SweepTextWriter& operator<<(double value);
+  SweepTextWriter& operator<<(int value);
+  SweepTextWriter& operator<<(long value);
+  SweepTextWriter& operator<<(char c);
+  SweepTextWriter& operator<<(const char* s);
+  SweepTextWriter& operator<<(const std::string& s);
+
+};
+
+#endif
@@ -0,0 +1,196 @@
+// TextWriterBenchmark.cpp
+// encoding: utf-8
+//
+// Speed of SweepTextWriter against the ofstream output it replaced.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-17 04:48:12
+// Modified: 2026-10-17 04:48:12
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+//
+// Usage:
+//
+//   TextWriterBenchmark [-n rows] [-d directory]
+//
+// Writes `rows` rows (default 10000000) of a two-level sweep, "x y F R theta
+// stdDev", to a file in `directory` (default the current one) twice: through
+// SweepTextWriter, and as the sweep wrote them before it, through an
+// std::ofstream with std::endl after each row. Prints the rows per second of
+// each, then removes the files. The values are random full-precision
+// doubles, the longest lines the writer sees.
+//
+//   g++ -std=c++17 -O2 -I. -o TextWriterBenchmark TextWriterBenchmark.cpp
+//       SweepTextWriter.cpp SweepJournal.cpp
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "SweepTextWriter.h"
+
+
+// Rows of random values, written over and over
+#define BENCH_TABLE_ROWS 4096
+
+// Rows per point of the outer level
+#define BENCH_INNER_POINTS 100
+
+
+struct BenchRow {
+  double f;
+  double r;
+  double theta;
+  double stdDev;
+};
+
+
+typedef std::chrono::steady_clock Clock;
+
+
+static double secondsSince(Clock::time_point start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+/*
+ * Write the rows through SweepTextWriter, as SweepEngine does. Returns the
+ * time taken in seconds, or -1 if the file could not be written.
+ */
+static double writeNew(
+  const std::string& fileName, long rows, const std::vector<BenchRow>& table,
+  const std::vector<double>& outer
+)
+{
+  Clock::time_point start = Clock::now();
+  SweepTextWriter out;
+  if(!out.open(fileName.c_str())) {
+    return -1;
+  }
+  out << "X\tY\tFrequency\tR\tTheta\tStdDev\t" << '\n';
+  for(long k = 0; k < rows; k++) {
+    const BenchRow& row = table[k % BENCH_TABLE_ROWS];
+    size_t p = (k / BENCH_INNER_POINTS) % outer.size();
+    out << outer[p] << '\t' << outer[outer.size() - 1 - p] << '\t';
+    out << row.f << '\t' << row.r << '\t' << row.theta << '\t' << row.stdDev << '\n';
+  }
+  out.close();
+  return secondsSince(start);
+}
+
+
+/*
+ * Write the rows as the sweep did before SweepTextWriter: the outer levels
+ * as a prefix built with an ostringstream, then each value through an
+ * std::ofstream, and std::endl after each row. Returns the time taken in
+ * seconds, or -1 if the file could not be written.
+ */
+static double writeOld(
+  const std::string& fileName, long rows, const std::vector<BenchRow>& table,
+  const std::vector<double>& outer
+)
+{
+  Clock::time_point start = Clock::now();
+  std::ofstream out(fileName.c_str());
+  if(!out) {
+    return -1;
+  }
+  out << "X\tY\tFrequency\tR\tTheta\tStdDev\t" << std::endl;
+  std::string prefix;
+  for(long k = 0; k < rows; k++) {
+    const BenchRow& row = table[k % BENCH_TABLE_ROWS];
+    if(k % BENCH_INNER_POINTS == 0) {
+      size_t p = (k / BENCH_INNER_POINTS) % outer.size();
+      std::ostringstream prefixTmp;
+      prefixTmp << outer[p] << "\t" << outer[outer.size() - 1 - p] << "\t";
+      prefix = prefixTmp.str();
+    }
+    out << prefix << row.f;
+    out << '\t' << row.r << '\t' << row.theta << '\t' << row.stdDev;
+    out << std::endl;
+  }
+  out.close();
+  return out ? secondsSince(start) : -1;
+}
+
+
+int main(int argc, char** argv)
+{
+  long rows = 10000000;
+  std::string dir = ".";
+  for(int k = 1; k + 1 < argc; k += 2) {
+    std::string arg = argv[k];
+    if(arg == "-n") {
+      rows = atol(argv[k + 1]);
+    } else if(arg == "-d") {
+      dir = argv[k + 1];
+    } else {
+      argc = 0;
+    }
+  }
+  if(argc % 2 == 0 || rows < 1) {
+    fprintf(stderr, "Usage: TextWriterBenchmark [-n rows] [-d directory]\n");
+    return 2;
+  }
+
+  std::mt19937_64 rng(12345);
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::vector<BenchRow> table(BENCH_TABLE_ROWS);
+  for(size_t k = 0; k < table.size(); k++) {
+    table[k].f = 100 + 99900 * unit(rng);
+    table[k].r = 1e-3 * unit(rng);
+    table[k].theta = 360 * unit(rng) - 180;
+    table[k].stdDev = 1e-6 * unit(rng);
+  }
+  std::vector<double> outer(64);
+  for(size_t k = 0; k < outer.size(); k++) {
+    outer[k] = 5 * unit(rng);
+  }
+
+  std::string newName = dir + "/textwriter_benchmark_new.txt";
+  std::string oldName = dir + "/textwriter_benchmark_old.txt";
+  double newSeconds = writeNew(newName, rows, table, outer);
+  double oldSeconds = writeOld(oldName, rows, table, outer);
+  remove(newName.c_str());
+  remove(oldName.c_str());
+  if(newSeconds < 0 || oldSeconds < 0) {
+    fprintf(stderr, "Could not write to %s\n", dir.c_str());
+    return 1;
+  }
+
+  printf("%ld rows\n", rows);
+  printf("  SweepTextWriter:      %6.2f M rows/s (%.2f s)\n",
+      rows / newSeconds / 1e6, newSeconds);
+  printf("  ofstream << endl:     %6.2f M rows/s (%.2f s)\n",
+      rows / oldSeconds / 1e6, oldSeconds);
+  printf("  speedup:              %6.1fx\n", oldSeconds / newSeconds);
+  return 0;
+}
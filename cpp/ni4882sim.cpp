@@ -0,0 +1,448 @@
+// ni4882sim.cpp
+// encoding: utf-8
+//
+// Simulated NI-488.2 backend built on EmulatedSR830.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 09:40:18
+// Modified: 2026-10-17 07:03:14
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cstdlib>
+
+#include <ni4882.h>
+
+#include "ni4882sim.h"
+
+
+/*
+ * One simulated GPIB board. The bus mutex is held for the duration of every
+ * transfer, so that concurrent callers see a serialized bus as on hardware.
+ */
+struct SimBoard {
+  bool online;
+  EmulatedTiming timing;
+  std::map<int, EmulatedSR830*> devices;
+  std::map<int, std::chrono::steady_clock::time_point> busyUntil;
+  std::mutex busMutex;
+  SimBusStats stats;
+
+  SimBoard() {
+    online = true;
+  }
+};
+
+
+// Process-wide status variables (see ni4882.h)
+unsigned int ibsta = 0;
+unsigned int iberr = 0;
+unsigned int ibcnt = 0;
+unsigned int ibcntl = 0;
+
+static thread_local unsigned int threadIbsta = 0;
+static thread_local unsigned int threadIberr = 0;
+static thread_local unsigned int threadIbcnt = 0;
+
+static std::mutex registryMutex;
+static std::map<int, SimBoard*> boards;
+static bool explicitConfig = false;
+static bool defaultsLoaded = false;
+
+
+static void setStatus(unsigned int sta, unsigned int err, unsigned int cnt)
+{
+  threadIbsta = sta;
+  threadIberr = err;
+  threadIbcnt = cnt;
+  ibsta = sta;
+  iberr = err;
+  ibcnt = cnt;
+  ibcntl = cnt;
+}
+
+
+static double envTimeScale()
+{
+  const char* scale = getenv("NI4882SIM_TIMESCALE");
+  return (scale != NULL) ? atof(scale) : 1.0;
+}
+
+
+// Must be called with registryMutex held
+static EmulatedSR830* attach(int boardID, int pad)
+{
+  static const double timeScale = envTimeScale();
+  SimBoard*& board = boards[boardID];
+  if(board == NULL) {
+    board = new SimBoard();
+    board->timing.timeScale = timeScale;
+  }
+  EmulatedSR830*& dev = board->devices[pad];
+  if(dev == NULL) {
+    dev = new EmulatedSR830(pad);
+    dev->timing.timeScale = timeScale;
+  }
+  return dev;
+}
+
+
+/*
+ * Read the instrument list from the environment the first time the bus is
+ * used, unless the instruments were configured with simAttachSR830().
+ */
+static void loadDefaults()
+{
+  if(explicitConfig || defaultsLoaded) {
+    return;
+  }
+  defaultsLoaded = true;
+
+  const char* env = getenv("NI4882SIM_SR830");
+  std::string spec = (env != NULL) ? env : "0:8";
+  size_t start = 0;
+  while(start < spec.size()) {
+    size_t stop = spec.find(',', start);
+    if(stop == std::string::npos) {
+      stop = spec.size();
+    }
+    std::string entry = spec.substr(start, stop - start);
+    size_t colon = entry.find(':');
+    if(colon == std::string::npos) {
+      attach(0, atoi(entry.c_str()));
+    } else {
+      attach(atoi(entry.substr(0, colon).c_str()), atoi(entry.substr(colon + 1).c_str()));
+    }
+    start = stop + 1;
+  }
+}
+
+
+static SimBoard* getBoard(int boardID)
+{
+  std::lock_guard<std::mutex> lock(registryMutex);
+  loadDefaults();
+  std::map<int, SimBoard*>::iterator it = boards.find(boardID);
+  return (it == boards.end()) ? NULL : it->second;
+}
+
+
+static EmulatedSR830* findDevice(SimBoard* board, Addr4882_t addr)
+{
+  std::map<int, EmulatedSR830*>::iterator it = board->devices.find(GetPAD(addr));
+  return (it == board->devices.end()) ? NULL : it->second;
+}
+
+
+/*
+ * Occupy the bus for the given number of (unscaled) microseconds. Must be
+ * called with the board's bus mutex held.
+ */
+static void busDelay(SimBoard* board, const EmulatedTiming& timing, double micros)
+{
+  double scaled = micros * timing.timeScale;
+  board->stats.busyMicros += scaled;
+  if(scaled > 0) {
+    std::this_thread::sleep_for(std::chrono::microseconds((long) scaled));
+  }
+}
+
+
+/*
+ * Wait until the instrument has finished executing the previous message; the
+ * SR830 does not accept or return data while it is parsing.
+ */
+static void waitUntilIdle(SimBoard* board, int pad)
+{
+  std::chrono::steady_clock::time_point until = board->busyUntil[pad];
+  if(until > std::chrono::steady_clock::now()) {
+    std::this_thread::sleep_until(until);
+  }
+}
+
+
+static void deliver(
+  SimBoard* board, EmulatedSR830* dev, const void* databuf, size_t datacnt
+)
+{
+  waitUntilIdle(board, dev->getAddress());
+  long micros = dev->write((const char*) databuf, datacnt);
+  board->busyUntil[dev->getAddress()] = std::chrono::steady_clock::now()
+      + std::chrono::microseconds((long) (micros * dev->timing.timeScale));
+}
+
+
+// ===== Configuration =========================================================
+
+EmulatedSR830* simAttachSR830(int boardID, int pad)
+{
+  std::lock_guard<std::mutex> lock(registryMutex);
+  explicitConfig = true;
+  return attach(boardID, pad);
+}
+
+
+EmulatedSR830* simGetSR830(int boardID, int pad)
+{
+  SimBoard* board = getBoard(boardID);
+  if(board == NULL) {
+    return NULL;
+  }
+  std::lock_guard<std::mutex> lock(board->busMutex);
+  return findDevice(board, pad);
+}
+
+
+SimBusStats simGetBusStats(int boardID)
+{
+  SimBoard* board = getBoard(boardID);
+  if(board == NULL) {
+    return SimBusStats();
+  }
+  std::lock_guard<std::mutex> lock(board->busMutex);
+  return board->stats;
+}
+
+
+void simResetBusStats(int boardID)
+{
+  SimBoard* board = getBoard(boardID);
+  if(board != NULL) {
+    std::lock_guard<std::mutex> lock(board->busMutex);
+    board->stats = SimBusStats();
+  }
+}
+
+
+// ===== NI-488 status functions ===============================================
+
+unsigned int NI488CC Ibsta(void) { return ibsta; }
+unsigned int NI488CC Iberr(void) { return iberr; }
+unsigned int NI488CC Ibcnt(void) { return ibcnt; }
+
+unsigned int NI488CC ThreadIbsta(void) { return threadIbsta; }
+unsigned int NI488CC ThreadIberr(void) { return threadIberr; }
+unsigned int NI488CC ThreadIbcnt(void) { return threadIbcnt; }
+
+
+unsigned int NI488CC ibonl(int ud, int v)
+{
+  SimBoard* board = getBoard(ud);
+  if(board == NULL) {
+    setStatus(ERR, ENEB, 0);
+    return ibsta;
+  }
+  std::lock_guard<std::mutex> lock(board->busMutex);
+  board->online = (v != 0);
+  setStatus(CMPL, 0, 0);
+  return ibsta;
+}
+
+
+// ===== NI-488.2 functions ====================================================
+
+void NI488CC SendIFC(int boardID)
+{
+  SimBoard* board = getBoard(boardID);
+  if(board == NULL) {
+    setStatus(ERR, ENEB, 0);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(board->busMutex);
+  board->online = true;
+  busDelay(board, board->timing, board->timing.messageOverhead);
+  setStatus(CMPL | CIC, 0, 0);
+}
+
+
+void NI488CC FindLstn(
+  int boardID, const Addr4882_t * addrlist, Addr4882_t * results, size_t limit
+)
+{
+  SimBoard* board = getBoard(boardID);
+  if(board == NULL || !board->online) {
+    setStatus(ERR, (board == NULL) ? ENEB : ECIC, 0);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(board->busMutex);
+  size_t found = 0;
+  for(int i = 0; addrlist[i] != NOADDR && found < limit; i++) {
+    busDelay(board, board->timing, board->timing.messageOverhead);
+    if(findDevice(board, addrlist[i]) != NULL) {
+      results[found++] = addrlist[i];
+    }
+  }
+  setStatus(CMPL | CIC, 0, found);
+}
+
+
+void NI488CC SendList(
+  int boardID, const Addr4882_t * addrlist, const void * databuf,
+  size_t datacnt, int /*eotMode*/
+)
+{
+  SimBoard* board = getBoard(boardID);
+  if(board == NULL || !board->online) {
+    setStatus(ERR, (board == NULL) ? ENEB : ECIC, 0);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(board->busMutex);
+  busDelay(
+    board, board->timing,
+    board->timing.messageOverhead + board->timing.perByte * datacnt
+  );
+  int listeners = 0;
+  for(int i = 0; addrlist[i] != NOADDR; i++) {
+    EmulatedSR830* dev = findDevice(board, addrlist[i]);
+    if(dev != NULL) {
+      deliver(board, dev, databuf, datacnt);
+      listeners++;
+    }
+  }
+  board->stats.sends++;
+  board->stats.bytesSent += datacnt;
+  if(listeners == 0) {
+    setStatus(ERR, ENOL, 0);
+  } else {
+    setStatus(CMPL | CIC, 0, datacnt);
+  }
+}
+
+
+void NI488CC Send(
+  int boardID, Addr4882_t addr, const void * databuf, size_t datacnt, int /*eotMode*/
+)
+{
+  SimBoard* board = getBoard(boardID);
+  if(board == NULL || !board->online) {
+    setStatus(ERR, (board == NULL) ? ENEB : ECIC, 0);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(board->busMutex);
+  EmulatedSR830* dev = findDevice(board, addr);
+  if(dev == NULL) {
+    busDelay(board, board->timing, board->timing.messageOverhead);
+    setStatus(ERR, ENOL, 0);
+    return;
+  }
+  waitUntilIdle(board, dev->getAddress());
+  busDelay(
+    board, dev->timing, dev->timing.messageOverhead + dev->timing.perByte * datacnt
+  );
+  deliver(board, dev, databuf, datacnt);
+  board->stats.sends++;
+  board->stats.bytesSent += datacnt;
+  setStatus(CMPL | CIC, 0, datacnt);
+}
+
+
+void NI488CC Receive(
+  int boardID, Addr4882_t addr, void * buffer, size_t cnt, int Termination
+)
+{
+  SimBoard* board = getBoard(boardID);
+  if(board == NULL || !board->online) {
+    setStatus(ERR, (board == NULL) ? ENEB : ECIC, 0);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(board->busMutex);
+  EmulatedSR830* dev = findDevice(board, addr);
+  if(dev == NULL) {
+    busDelay(board, board->timing, board->timing.messageOverhead);
+    setStatus(ERR, ENOL, 0);
+    return;
+  }
+  waitUntilIdle(board, dev->getAddress());
+  bool end = false;
+  if(dev->streaming()) {
+    // Fast mode: the instrument talks each sample as it is taken and never
+    // asserts EOI, so the read lasts until the count is reached
+    size_t n = 0;
+    while(n < cnt && dev->streaming()) {
+      if(dev->pending() == 0) {
+        std::this_thread::sleep_until(dev->nextSampleTime());
+      }
+      n += dev->read((char*) buffer + n, cnt - n, -1, end);
+    }
+    busDelay(board, dev->timing, dev->timing.messageOverhead + dev->timing.perByte * n);
+    board->stats.receives++;
+    board->stats.bytesReceived += n;
+    setStatus(CMPL | CIC, 0, n);
+    return;
+  }
+  if(dev->pending() == 0) {
+    // Nothing to talk: the real driver would wait for the I/O timeout
+    busDelay(board, dev->timing, dev->timing.messageOverhead);
+    setStatus(ERR | TIMO | CIC, EABO, 0);
+    return;
+  }
+  int stopChar = (Termination == STOPend) ? -1 : (Termination & 0xFF);
+  size_t n = dev->read((char*) buffer, cnt, stopChar, end);
+  busDelay(board, dev->timing, dev->timing.messageOverhead + dev->timing.perByte * n);
+  board->stats.receives++;
+  board->stats.bytesReceived += n;
+  setStatus(CMPL | CIC | (end ? END : 0), 0, n);
+}
+
+
+void NI488CC DevClear(int boardID, Addr4882_t addr)
+{
+  SimBoard* board = getBoard(boardID);
+  if(board == NULL || !board->online) {
+    setStatus(ERR, (board == NULL) ? ENEB : ECIC, 0);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(board->busMutex);
+  EmulatedSR830* dev = findDevice(board, addr);
+  busDelay(board, board->timing, board->timing.messageOverhead);
+  if(dev == NULL) {
+    setStatus(ERR, ENOL, 0);
+    return;
+  }
+  dev->clear();
+  setStatus(CMPL | CIC, 0, 0);
+}
+
+
+void NI488CC ReadStatusByte(int boardID, Addr4882_t addr, short * result)
+{
+  SimBoard* board = getBoard(boardID);
+  if(board == NULL || !board->online) {
+    setStatus(ERR, (board == NULL) ? ENEB : ECIC, 0);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(board->busMutex);
+  EmulatedSR830* dev = findDevice(board, addr);
+  busDelay(board, board->timing, 2 * board->timing.messageOverhead);
+  if(dev == NULL) {
+    setStatus(ERR, ENOL, 0);
+    return;
+  }
+  *result = (short) dev->statusByte();
+  setStatus(CMPL | CIC, 0, 0);
+}
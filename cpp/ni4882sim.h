@@ -0,0 +1,100 @@
+// ni4882sim.h
+// encoding: utf-8
+//
+// Configuration of the simulated NI-488.2 backend.
+//
+// Author:   Connor D. Pierce
+// Created:  2026-10-16 09:40:18
+// Modified: 2026-10-16 09:40:18
+//
+// Copyright (C) 2018-2026 Connor D. Pierce
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+// ni4882sim.cpp implements the NI-488.2 entry points used by GPIB.cpp
+// (SendIFC, FindLstn, SendList, Send, Receive, ibonl, ...) on top of one or
+// more EmulatedSR830 instruments. Link it in place of the NI-488.2 import
+// library to run GPIBInterface, SR830 and the sweep engine without hardware.
+//
+// Unless simAttachSR830() is called first, the instruments are taken from the
+// environment variable NI4882SIM_SR830, a comma-separated list of `pad` or
+// `board:pad` entries (default: "0:8", matching connectToAmp()).
+// NI4882SIM_TIMESCALE multiplies all simulated latencies (0 disables them).
+
+
+#ifndef NI4882SIM_H
+#define NI4882SIM_H
+
+#include "EmulatedSR830.h"
+
+
+/*
+ * struct SimBusStats
+ *
+ * Traffic counters for one simulated board.
+ *
+ * Fields:
+ *   sends - number of Send/SendList messages
+ *   receives - number of Receive calls
+ *   bytesSent - data bytes written to instruments
+ *   bytesReceived - data bytes read from instruments
+ *   busyMicros - total simulated bus time, in microseconds
+ */
+struct SimBusStats {
+  long sends;
+  long receives;
+  long bytesSent;
+  long bytesReceived;
+  double busyMicros;
+
+  SimBusStats() {
+    sends = receives = bytesSent = bytesReceived = 0;
+    busyMicros = 0;
+  }
+};
+
+
+/*
+ * Attach an emulated SR830 at primary address `pad` of board `boardID` and
+ * return it, so that its timing and sample model can be adjusted. Returns the
+ * existing instrument if one is already attached at that address.
+ */
+EmulatedSR830* simAttachSR830(int boardID, int pad);
+
+
+/*
+ * Returns the emulated instrument at the given address, or NULL.
+ */
+EmulatedSR830* simGetSR830(int boardID, int pad);
+
+
+/*
+ * Returns the traffic counters for the given board.
+ */
+SimBusStats simGetBusStats(int boardID);
+
+
+/*
+ * Reset the traffic counters for the given board.
+ */
+void simResetBusStats(int boardID);
+
+#endif
@@ -5,7 +5,7 @@
 //
 // Author:   Connor D. Pierce
 // Created:  2018-02-01
-// Modified: 2023-04-05 21:39:11
+// Modified: 2026-10-17 01:12:47
 //
 // Copyright (C) 2018-2023 Connor D. Pierce
 //
@@ -104,6 +104,25 @@
 
 #define MI_SIGNAL_DC 314
 
+#define MI_BINARY_OUTPUT 315
+
+#define MI_RESUME_SWEEP 316
+#define MI_HOLD_ON_CANCEL 317
+
+#define MI_ADAPTIVE_SETTLE 318
+
+#define MI_REFINEMENT 319
+
+#define MI_ORDER_TIME_CONST 320
+
+#define MI_RAMP_SLEW 321
+
+#define MI_QUEUE_ADD 322
+#define MI_QUEUE_URGENT 323
+#define MI_QUEUE_RUN 324
+#define MI_QUEUE_PAUSE 325
+#define MI_QUEUE_STOP 326
+
 const char PARAM_DESCRIPTIONS[][10] = {"X","Y","F","A","Custom XY"};
 
 /*
@@ -166,6 +185,9 @@ const char PARAM_DESCRIPTIONS[][10] = {"X","Y","F","A","Custom XY"};
 #define BTN_C_ADD 547
 #define BTN_C_DELETE 548
 
+#define LTEXT_F_ADAPT 550
+#define LTEXT_A_ADAPT 551
+
 #define TVIEW_SWEEP_ORDER 701
 #define LTEXT_SUMMARY 702
 
@@ -182,6 +204,24 @@ const char PARAM_DESCRIPTIONS[][10] = {"X","Y","F","A","Custom XY"};
 #define LTEXT_SIGNAL_DC 808
 #define BTN_DC_COUPLE 809
 #define BTN_AC_COUPLE 810
+#define CHK_AVG_BUFFER 811
+#define LTEXT_AVG_RATE 812
+#define SETTLE_DIALOG 813
+#define BTN_SETTLE_MODEL 814
+#define BTN_SETTLE_CONVERGE 815
+#define LTEXT_SETTLE_TOL 816
+#define REFINE_DIALOG 817
+#define LTEXT_REFINE_TOL 818
+#define LTEXT_REFINE_PHASE 819
+#define LTEXT_REFINE_POINTS 820
+#define LTEXT_AVG_TARGET 821
+#define LTEXT_AVG_MIN 822
+#define CHK_AVG_OUTLIERS 823
+#define SLEW_DIALOG 824
+#define LTEXT_SLEW_X 825
+#define LTEXT_SLEW_Y 826
+#define LTEXT_SLEW_F 827
+#define LTEXT_SLEW_A 828
 
 #endif /* RESOURCE_H_ */
 